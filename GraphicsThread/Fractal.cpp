@@ -0,0 +1,177 @@
+/**********************************************
+	Fractal.cpp
+
+	Mandelbrot set generation into an array of
+	pixels used as a texture, with movement and
+	zoom of the area of the set shown
+***********************************************/
+
+#include <math.h>
+#include <algorithm>
+using namespace std;
+
+#include "Fractal.h"
+
+
+/////////////////////////////
+// Fractal data
+
+// Areas to store fractal data
+unsigned int FractalDepths[FractalTexHeight * FractalTexWidth];
+unsigned int FractalPixels[FractalTexHeight * FractalTexWidth];
+
+// Dimensions of the fractal area being generated
+double FractalAreaLeft = -2.0;
+double FractalAreaTop = -1.1;
+double FractalAreaWidth = 2.5;
+double FractalAreaHeight = 2.2;
+
+// Flag if fractal needs to be recalculated
+bool FractalDirty = true;
+
+// For cycling colours
+float FractalCycle = 0.0f; 
+
+
+/////////////////////////////
+// Fractal Area Movement
+
+void FractalMoveX( double xOffset )
+{
+	FractalAreaLeft += xOffset * FractalAreaWidth;
+	FractalDirty = true;
+}
+
+void FractalMoveY( double yOffset )
+{
+	FractalAreaTop += yOffset * FractalAreaHeight;
+	FractalDirty = true;
+}
+
+void FractalZoomIn( double percent )
+{
+	double scale = 100.0 / percent;
+	double newWidth = FractalAreaWidth * scale;
+	double newHeight = FractalAreaHeight * scale;
+	FractalAreaLeft += (FractalAreaWidth - newWidth) / 2.0;
+	FractalAreaTop += (FractalAreaHeight - newHeight) / 2.0;
+	FractalAreaWidth = newWidth;
+	FractalAreaHeight = newHeight;
+	FractalDirty = true;
+}
+
+void FractalZoomOut( double percent )
+{
+	FractalZoomIn( 10000.0 / percent );
+	FractalDirty = true;
+}
+
+
+/////////////////////////////
+// Fractal generation
+
+// Draw Mandelbrot set. Formula using complex numbers:
+//     c = ai + b, z(0) = 0, z(n+1) = z(n)^2 + c
+// We plot a black colour for c if z(n) doesn't diverge, i.e. z(n) doesn't head off to infinity
+// If z(n) diverges, we plot a colour for c based on how many steps it took us to realise the divergence
+// Same formula using real numbers:
+//     given a & b,  x(0) = y(0) = 0, x(n+1) = x(n)^2 - y(n)^2 + a, y(n+1) = 2x(n)y(n) + b
+// We stop if n becomes too large or x(n)^2 + y(n)^2 >= 4 (for which we can guarantee divergence)
+void DrawMandelbrot()
+{
+	// Calculate fractal into data areas
+	unsigned int* pDepth;
+	unsigned int* pPixel;
+
+	// Step per-pixel
+	double stepX = FractalAreaWidth / FractalTexWidth;
+	double stepY = FractalAreaHeight / FractalTexHeight;
+
+	// Calculate how large we will allow n depending on zoom level
+	double stepMin = log( min( stepX, stepY ) ) / log( 2.0 );
+	unsigned int depth = static_cast<unsigned int>(max( 15.0, -12.0 * stepMin - 45 ));
+
+	// First calculate steps to diverge, only recalculate this (slow) stage if necessary
+	if (FractalDirty)
+	{
+		unsigned int d;
+		double p, q, r, s, t;
+
+		// Per-pixel calculations
+		pDepth = FractalDepths;
+		double y = FractalAreaTop;
+		for (unsigned int rows = FractalTexHeight; rows; --rows)
+		{
+			double x = FractalAreaLeft;
+			for (unsigned int cols = FractalTexWidth; cols; --cols)
+			{
+				p = x;
+				q = y;
+				d = depth;
+				do
+				{
+					// Pipeline optimised - split into tiny steps with minimal adjacent dependency
+					s = q;
+					r = p;
+					t = 4.0;
+					s *= q;
+					r *= p;
+					t -= s;
+					q += q;
+					if (t <= r)
+					{
+						break;
+					}
+					q *= p;
+					r -= s;
+					p = x;
+					q += y;
+					p += r;
+
+				} while (--d > 0);
+				*pDepth++ = d;
+
+				x += stepX;
+			}
+			y += stepY;
+		}
+		FractalDirty = false;
+	}
+	
+	// Convert steps to diverge into colours
+	pDepth = FractalDepths;
+	pPixel = FractalPixels;
+	for (unsigned int rows = FractalTexHeight; rows; --rows)
+	{
+		for (unsigned int cols = FractalTexWidth; cols; --cols)
+		{
+			unsigned int d = *pDepth++;
+			if (d == 0)
+			{
+				*pPixel = 0;
+			}
+			else
+			{
+				unsigned int level = static_cast<unsigned int>(FractalCycle + depth - d);
+				unsigned int R, G, B;
+				R = level & 0x1ff;
+				G = (level * 3) & 0x1ff;
+				B = (level * 7) & 0x1ff;
+				if (R & 0x100)
+				{
+					R = 0x1ff - R;
+				}
+				if (G & 0x100)
+				{
+					G = 0x1ff - G;
+				}
+				if (B & 0x100)
+				{
+					B = 0x1ff - B;
+				}
+				*pPixel = (R << 16) | (G << 8) | B;
+			}
+			++pPixel;
+		}
+	}
+}
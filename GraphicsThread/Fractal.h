@@ -0,0 +1,42 @@
+/**********************************************
+	Fractal.h
+
+	Mandelbrot set generation into an array of
+	pixels used as a texture, with movement and
+	zoom of the area of the set shown
+***********************************************/
+
+#pragma once // Prevent file being included more than once (would cause errors)
+
+/////////////////////////////
+// Fractal data
+
+// Size of fractal texture
+const int FractalTexWidth = 512;
+const int FractalTexHeight = 512;
+
+// Fractal colours, one 32-bit X8R8G8B8 pixel per texel, updated by DrawMandelbrot
+extern unsigned int FractalPixels[FractalTexHeight * FractalTexWidth];
+
+// For cycling colours - the colours move along by one step for each whole unit of this value
+extern float FractalCycle;
+
+
+/////////////////////////////
+// Fractal Area Movement
+
+// Move the area shown by the given fraction of its width / height
+void FractalMoveX( double xOffset );
+void FractalMoveY( double yOffset );
+
+// Zoom the area shown in or out by the given percentage
+void FractalZoomIn( double percent );
+void FractalZoomOut( double percent );
+
+
+/////////////////////////////
+// Fractal generation
+
+// Draw the Mandelbrot set into FractalPixels, only recalculating the set itself if the area shown
+// has changed since the last call
+void DrawMandelbrot();
@@ -5,6 +5,7 @@
 **********************************************/
 
 #include <string>
+#include <sstream>
 using namespace std;
 
 #define _WIN32_WINNT 0x0400 // Must define minimum Windows version to use TryEnterCriticalSection
@@ -15,10 +16,14 @@ using namespace std;
 #include "Defines.h"
 
 // Declarations for supporting source files
+#include "Mesh.h"     // Mesh class, geometry shared by models
 #include "Model.h"    // Model class
 #include "Camera.h"   // Camera class
 #include "Shader.h"   // Vertex / pixel shader support
 #include "Input.h"    // Input support
+#include "Fractal.h"  // Fractal generation for the cube texture
+
+#include "MeshData.h" // Render methods of mesh materials (from import code)
 
 #include "Resource.h" // Resource file (used to add icon for application)
 
@@ -33,12 +38,14 @@ using namespace std;
 LPDIRECT3D9             g_pD3D       = NULL; // Used to create the D3DDevice
 LPDIRECT3DDEVICE9       g_pd3dDevice = NULL; // Our rendering device
 
-// Camera
-CCamera* MainCamera;
+// Camera, and its combined view and projection matrices for the current frame
+CCamera*      MainCamera;
+D3DXMATRIXA16 ViewProjMatrix;
 
 // Models
 CModel* Cube  = NULL;
 CModel* Floor = NULL;
+CModel* Placeholder = NULL; // Rendered in place of models still loading in the background
 
 // Textures for models
 LPDIRECT3DTEXTURE9 CubeTexture;
@@ -46,6 +53,7 @@ LPDIRECT3DTEXTURE9 FloorTexture;
 
 // Lights
 const int   NumLights = 2;
+const int   LightModelLODs = 4;           // Lower levels of detail generated for light models
 CModel*     LightModels[NumLights];       // Each light has a model attached in this exercise
 D3DXCOLOR   AmbientColour;                // Background light level
 D3DXVECTOR3 LightPositions[NumLights];    // Point light positions
@@ -61,6 +69,10 @@ LPDIRECT3DVERTEXSHADER9 VS_XformOnly,       VS_LightingTex;
 LPD3DXCONSTANTTABLE     VS_XformOnlyConsts, VS_LightingTexConsts;
 LPDIRECT3DPIXELSHADER9  PS_PlainColour,       PS_LightingTex;
 LPD3DXCONSTANTTABLE     PS_PlainColourConsts, PS_LightingTexConsts;
+
+// Count of frames rendered, used to report the render queue statistics regularly
+const unsigned int RenderStatsFrames = 300;
+unsigned int       FrameCount = 0;
                                                    
 // Thread
 HANDLE hThread;
@@ -71,13 +83,14 @@ volatile bool ThreadShutDown;
 // Light functions
 //-----------------------------------------------------------------------------
 
-// Initialise a light model for each light in the scene
+// Initialise a light model for each light in the scene. The models share a single mesh, which is
+// loaded in the background
 bool InitialiseLightModels()
 {
 	for (int light = 0; light < NumLights; ++light)
 	{
 		LightModels[light] = new CModel();
-		if (!LightModels[light]->Load( "Sphere.x" ))
+		if (!LightModels[light]->LoadAsync( "Sphere.x", LightModelLODs, true ))
 		{
 			return false;
 		}
@@ -196,175 +209,76 @@ void SetTexture( int texNum, LPDIRECT3DTEXTURE9 texture )
 }
 
 
-//*****************************************************************************
-// Fractal Generation
-//*****************************************************************************
-
-// Size of fractal texture
-const int FractalTexWidth = 512;
-const int FractalTexHeight = 512;
-
-// Areas to store fractal data
-unsigned int FractalDepths[FractalTexHeight * FractalTexWidth];
-unsigned int FractalPixels[FractalTexHeight * FractalTexWidth];
-
-// Dimensions of the fractal area being generated
-double FractalAreaLeft = -2.0;
-double FractalAreaTop = -1.1;
-double FractalAreaWidth = 2.5;
-double FractalAreaHeight = 2.2;
-
-// Flag if fractal needs to be recalculated
-bool FractalDirty = true;
-
-// For cycling colours
-float FractalCycle = 0.0f; 
-
-
-/////////////////////////////
-// Fractal Area Movement
-
-void FractalMoveX( double xOffset )
-{
-	FractalAreaLeft += xOffset * FractalAreaWidth;
-	FractalDirty = true;
-}
-
-void FractalMoveY( double yOffset )
-{
-	FractalAreaTop += yOffset * FractalAreaHeight;
-	FractalDirty = true;
-}
+//-----------------------------------------------------------------------------
+// Render method functions
+//-----------------------------------------------------------------------------
 
-void FractalZoomIn( double percent )
+// Set the constants shared by all models rendered with the lighting shaders - the view-projection
+// matrix for the vertex shader and the lighting information for the *pixel* shader
+void SetLightingShaderConstants()
 {
-	double scale = 100.0 / percent;
-	double newWidth = FractalAreaWidth * scale;
-	double newHeight = FractalAreaHeight * scale;
-	FractalAreaLeft += (FractalAreaWidth - newWidth) / 2.0;
-	FractalAreaTop += (FractalAreaHeight - newHeight) / 2.0;
-	FractalAreaWidth = newWidth;
-	FractalAreaHeight = newHeight;
-	FractalDirty = true;
+	VS_LightingTexConsts->SetMatrix( g_pd3dDevice, "ViewProjMatrix", &ViewProjMatrix );
+	PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "AmbientLight", (float*)&AmbientColour, 3 );
+	PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "Light1Position", (float*)&LightPositions[0], 3 );
+	PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "Light1Colour", (float*)&LightColours[0], 3 );
+	PS_LightingTexConsts->SetFloat( g_pd3dDevice, "Light1Brightness", LightAttenuations[0] );
+	PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "Light2Position", (float*)&LightPositions[1], 3 );
+	PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "Light2Colour", (float*)&LightColours[1], 3 );
+	PS_LightingTexConsts->SetFloat( g_pd3dDevice, "Light2Brightness", LightAttenuations[1] );
+	PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "CameraPosition", (float*)&MainCamera->GetPosition(), 3 );
+	PS_LightingTexConsts->SetFloat( g_pd3dDevice, "SpecularPower", SpecularPower );
 }
 
-void FractalZoomOut( double percent )
+// Set the constants for a model rendered with the lighting shaders - pass its world matrix to the
+// vertex shader
+void SetLightingModelConstants( CModel* model, const CMesh::SSubMeshRange& )
 {
-	FractalZoomIn( 10000.0 / percent );
-	FractalDirty = true;
+	D3DXMATRIXA16 worldMatrix = model->GetWorldMatrix();
+	VS_LightingTexConsts->SetMatrix( g_pd3dDevice, "WorldMatrix", &worldMatrix );
 }
 
-
-/////////////////////////////
-// Fractal generation
-
-// Draw Mandelbrot set. Formula using complex numbers:
-//     c = ai + b, z(0) = 0, z(n+1) = z(n)^2 + c
-// We plot a black colour for c if z(n) doesn't diverge, i.e. z(n) doesn't head off to infinity
-// If z(n) diverges, we plot a colour for c based on how many steps it took us to realise the divergence
-// Same formula using real numbers:
-//     given a & b,  x(0) = y(0) = 0, x(n+1) = x(n)^2 - y(n)^2 + a, y(n+1) = 2x(n)y(n) + b
-// We stop if n becomes too large or x(n)^2 + y(n)^2 >= 4 (for which we can guarantee divergence)
-void DrawMandelbrot()
+// Set the constants for a model rendered in plain colour. The vertex shader requires a single
+// combined world/view/projection matrix. The colour is set in the pixel shader - light models use
+// their light's colour, other models the colour of their material
+void SetPlainColourModelConstants( CModel* model, const CMesh::SSubMeshRange& subMesh )
 {
-	// Calculate fractal into data areas
-	unsigned int* pDepth;
-	unsigned int* pPixel;
-
-	// Step per-pixel
-	double stepX = FractalAreaWidth / FractalTexWidth;
-	double stepY = FractalAreaHeight / FractalTexHeight;
+	D3DXMATRIXA16 worldViewProjMatrix = model->GetWorldMatrix() * ViewProjMatrix;
+	VS_XformOnlyConsts->SetMatrix( g_pd3dDevice, "WorldViewProjMatrix", &worldViewProjMatrix );
 
-	// Calculate how large we will allow n depending on zoom level
-	double stepMin = log( min( stepX, stepY ) ) / log( 2.0 );
-	unsigned int depth = static_cast<unsigned int>(max( 15.0, -12.0 * stepMin - 45 ));
-
-	// First calculate steps to diverge, only recalculate this (slow) stage if necessary
-	if (FractalDirty)
+	const D3DXCOLOR* colour = &subMesh.material->diffuseColour;
+	for (int light = 0; light < NumLights; ++light)
 	{
-		unsigned int d;
-		double p, q, r, s, t;
-
-		// Per-pixel calculations
-		pDepth = FractalDepths;
-		double y = FractalAreaTop;
-		for (unsigned int rows = FractalTexHeight; rows; --rows)
+		if (model == LightModels[light])
 		{
-			double x = FractalAreaLeft;
-			for (unsigned int cols = FractalTexWidth; cols; --cols)
-			{
-				p = x;
-				q = y;
-				d = depth;
-				do
-				{
-					// Pipeline optimised - split into tiny steps with minimal adjacent dependency
-					s = q;
-					r = p;
-					t = 4.0;
-					s *= q;
-					r *= p;
-					t -= s;
-					q += q;
-					if (t <= r)
-					{
-						break;
-					}
-					q *= p;
-					r -= s;
-					p = x;
-					q += y;
-					p += r;
-
-				} while (--d > 0);
-				*pDepth++ = d;
-
-				x += stepX;
-			}
-			y += stepY;
-		}
-		FractalDirty = false;
-	}
-	
-	// Convert steps to diverge into colours
-	pDepth = FractalDepths;
-	pPixel = FractalPixels;
-	for (unsigned int rows = FractalTexHeight; rows; --rows)
-	{
-		for (unsigned int cols = FractalTexWidth; cols; --cols)
-		{
-			unsigned int d = *pDepth++;
-			if (d == 0)
-			{
-				*pPixel = 0;
-			}
-			else
-			{
-				unsigned int level = static_cast<unsigned int>(FractalCycle + depth - d);
-				unsigned int R, G, B;
-				R = level & 0x1ff;
-				G = (level * 3) & 0x1ff;
-				B = (level * 7) & 0x1ff;
-				if (R & 0x100)
-				{
-					R = 0x1ff - R;
-				}
-				if (G & 0x100)
-				{
-					G = 0x1ff - G;
-				}
-				if (B & 0x100)
-				{
-					B = 0x1ff - B;
-				}
-				*pPixel = (R << 16) | (G << 8) | B;
-			}
-			++pPixel;
+			colour = &LightColours[light];
 		}
 	}
+	PS_PlainColourConsts->SetFloatArray( g_pd3dDevice, "MaterialColour", (float*)colour, 3 );
+}
+
+// Select the shaders used to render each render method of mesh materials. There are two shader
+// pairs here - the lighting shaders need a texture, so untextured methods use plain colour
+void SetRenderMethodShaders()
+{
+	CModel::SetRenderMethodShaders( gen::PlainColour, VS_XformOnly, PS_PlainColour, NULL,
+	                                SetPlainColourModelConstants );
+	CModel::SetRenderMethodShaders( gen::VertexLit, VS_XformOnly, PS_PlainColour, NULL,
+	                                SetPlainColourModelConstants );
+	CModel::SetRenderMethodShaders( gen::PixelLit, VS_XformOnly, PS_PlainColour, NULL,
+	                                SetPlainColourModelConstants );
+	CModel::SetRenderMethodShaders( gen::PlainTexture, VS_LightingTex, PS_LightingTex,
+	                                SetLightingShaderConstants, SetLightingModelConstants );
+	CModel::SetRenderMethodShaders( gen::VertexLitTex, VS_LightingTex, PS_LightingTex,
+	                                SetLightingShaderConstants, SetLightingModelConstants );
+	CModel::SetRenderMethodShaders( gen::PixelLitTex, VS_LightingTex, PS_LightingTex,
+	                                SetLightingShaderConstants, SetLightingModelConstants );
 }
 
 
+//*****************************************************************************
+// Fractal Generation
+//*****************************************************************************
+
 /////////////////////////////
 // Fractal texture update
 
@@ -413,15 +327,34 @@ bool SceneSetup()
 	{
 		return false;  // Return on failure
 	}
+
+	// Start loading models in the background, a cube is rendered in their place until loaded
+	Placeholder = new CModel;
+	if (!CMesh::StartLoader() || !Placeholder->Load( "Cube.x" ))
+	{
+		return false;
+	}
+
+	// Reload models when their files are changed, so edits can be seen without restarting
+	if (!CMesh::StartHotReload())
+	{
+		return false;
+	}
+	CModel::SetPlaceholder( Placeholder );
 	Cube->SetPosition( 0.0f, 15.0f, 0.0f );
 
-	// Load textures to apply to models
+	// Load textures to apply to models, which are lit and use these textures whatever their
+	// materials
 	CubeTexture = CreateDynamicTexture( FractalTexWidth, FractalTexHeight );
 	FloorTexture = LoadTexture( "wood.jpg" );
 	if (!CubeTexture || !FloorTexture)
 	{
 		return false;
 	}
+	Cube->SetRenderMethod( gen::PixelLitTex );
+	Cube->SetTexture( CubeTexture );
+	Floor->SetRenderMethod( gen::PixelLitTex );
+	Floor->SetTexture( FloorTexture );
 
     // Create lights - the pixel shader in this example will handle two point lights
 	// Will also load and display models for the lights in this exercise
@@ -432,6 +365,10 @@ bool SceneSetup()
 	SetAmbientColour( 0.5f, 0.5f, 0.5f );
 	SetPointLight( 0,  LightOrbit, 15.0f, 0.0f,  1.0f, 1.0f, 1.0f,  10.0f );
 	SetPointLight( 1,  -60.0f, 30.0f, 60.0f,     1.0f, 0.9f, 0.2f,  100.0f );
+	for (int light = 0; light < NumLights; ++light)
+	{
+		LightModels[light]->SetRenderMethod( gen::PlainColour );
+	}
 
 	// Load and compile shaders. Two shader pairs here, a pixel lighting effect for the main 
 	// models and a simple plain colour effect for the light models
@@ -442,6 +379,7 @@ bool SceneSetup()
 	{
 		return false;
 	}
+	SetRenderMethodShaders();
 
 	ThreadShutDown = false;
 	// create handle
@@ -480,11 +418,15 @@ void SceneShutdown()
 	SAFE_RELEASE( VS_XformOnly );
 	SAFE_RELEASE( FloorTexture );
 	SAFE_RELEASE( CubeTexture );
+	CModel::ReleaseTextures();
 
-	// Release light models
+	// Stop hot reload and background loading then release light models
+	CMesh::StopHotReload();
+	CMesh::StopLoader();
 	UninitialiseLightModels();
 
 	// Delete dynamically allocated objects. Our own types - no need to use DirectX release code
+	delete Placeholder;
 	delete Floor;
 	delete Cube;
 	delete MainCamera; 
@@ -498,6 +440,11 @@ void SceneShutdown()
 // Draw one frame of the scene
 void RenderScene()
 {
+	// Start reloading meshes whose files have changed, then copy a limited amount of geometry from
+	// meshes loaded in the background to the GPU
+	CMesh::ReloadChangedMeshes();
+	CMesh::UploadLoadedMeshes();
+
     // Clear the back-buffer and the z-buffer
     g_pd3dDevice->Clear( 0, NULL, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER,
                          D3DCOLOR_XRGB(128,128,128), 1.0f, 0 );
@@ -508,43 +455,18 @@ void RenderScene()
 		//////////////////////////
 		// Common model settings
 
-		// Select shaders
-		SetVertexShader( VS_LightingTex );
-		SetPixelShader( PS_LightingTex );
-
-		// Calculate the view and projection matrices for the camera, then pass combined
-		// view-projection matrix to the vertex shader
+		// Calculate the view and projection matrices for the camera. The combined view-projection
+		// matrix is passed to the shaders as each model is rendered
 		MainCamera->CalculateMatrices();
-		D3DXMATRIXA16 viewProjMatrix = MainCamera->GetViewProjectionMatrix();
-		VS_LightingTexConsts->SetMatrix( g_pd3dDevice, "ViewProjMatrix", &viewProjMatrix );
-		
-		// Pass lighting information to *pixel* shader
-		PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "AmbientLight", (float*)&AmbientColour, 3 );
-		PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "Light1Position", (float*)&LightPositions[0], 3 );
-		PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "Light1Colour", (float*)&LightColours[0], 3 );
-		PS_LightingTexConsts->SetFloat( g_pd3dDevice, "Light1Brightness", LightAttenuations[0] );
-		PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "Light2Position", (float*)&LightPositions[1], 3 );
-		PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "Light2Colour", (float*)&LightColours[1], 3 );
-		PS_LightingTexConsts->SetFloat( g_pd3dDevice, "Light2Brightness", LightAttenuations[1] );
-		PS_LightingTexConsts->SetFloatArray( g_pd3dDevice, "CameraPosition", (float*)&MainCamera->GetPosition(), 3 );
-		PS_LightingTexConsts->SetFloat( g_pd3dDevice, "SpecularPower", SpecularPower );
-
-
-		////////////////////
-		// Floor rendering
-
-		// Calculate world matrix for floor and pass it to the vertex shader
-		Floor->CalculateMatrix();
-		D3DXMATRIXA16 worldMatrix = Floor->GetWorldMatrix();
-		VS_LightingTexConsts->SetMatrix( g_pd3dDevice, "WorldMatrix", &worldMatrix );
+		ViewProjMatrix = MainCamera->GetViewProjectionMatrix();
 
-		// Select a texture for the floor and render it
-		SetTexture( 0, FloorTexture );
-		Floor->Render();
 
+		//////////////////////////
+		// Model queuing
 
-		////////////////////
-		// Cube rendering
+		// Calculate world matrices for the floor and cube and queue them for rendering
+		Floor->CalculateMatrix();
+		Floor->Queue();
 
 		// Copy the fractal pixels to the cube texture
 		CopyToDynamicTexture( (char*)FractalPixels, CubeTexture );
@@ -552,38 +474,50 @@ void RenderScene()
 		// threads
 		RedrawFractal = true;
 
-		// Calculate world matrix for cube and pass it to the vertex shader
 		Cube->CalculateMatrix();
-		worldMatrix = Cube->GetWorldMatrix();
-		VS_LightingTexConsts->SetMatrix( g_pd3dDevice, "WorldMatrix", &worldMatrix );
-
-		// Select a texture and render cube
-		SetTexture( 0, CubeTexture );
-		Cube->Render();
+		Cube->Queue();
 
-
-		//////////////////////////
-		// Light model rendering
-
-		// Select different shaders - light models are rendering in plain colour
-		SetVertexShader( VS_XformOnly );
-		SetPixelShader( PS_PlainColour );
-		
-		// Render each light in turn
+		// Queue each light model
 		for (int light = 0; light < NumLights; ++light)
 		{
-			// The light's vertex shader requires a single combined world/view/projection
-			// matrix. The view/projection matrix has already been calculated from the camera.
-			// Calculate world matrix for current light and combine into a single matrix before
-			// passing to the light's vertex shader
+			// Light models are small, so select a lower level of detail when distant
 			LightModels[light]->CalculateMatrix();
-			D3DXMATRIXA16 worldViewProjMatrix = LightModels[light]->GetWorldMatrix() * viewProjMatrix;
-			VS_XformOnlyConsts->SetMatrix( g_pd3dDevice, "WorldViewProjMatrix", &worldViewProjMatrix );
+			LightModels[light]->SelectLOD( MainCamera->GetPosition(), MainCamera->GetProjectionMatrix() );
+			LightModels[light]->CullMeshlets( MainCamera->GetPosition(), ViewProjMatrix );
+			LightModels[light]->Queue();
+		}
 
-			// Use light colour for model plain colour - set in pixel shader
-			PS_PlainColourConsts->SetFloatArray( g_pd3dDevice, "MaterialColour", (float*)&LightColours[light], 3 );
 
-			LightModels[light]->Render();
+		//////////////////////////
+		// Model rendering
+
+		// Render the queued models, sorted by render method, shaders and texture so each is only
+		// selected once. The shader constants are set by the render method functions above
+		CModel::RenderQueue();
+
+		// Regularly report the draw calls and state changes of the last frame to the debugger
+		if (++FrameCount % RenderStatsFrames == 0)
+		{
+			CModel::SRenderStats stats;
+			CModel::GetRenderStats( &stats );
+			ostringstream report;
+			report << "Render queue: " << stats.numDrawCalls << " draw calls, "
+			       << stats.numStateChanges << " state changes (" << stats.numShaderChanges
+			       << " shader, " << stats.numTextureChanges << " texture, "
+			       << stats.numBufferChanges << " buffer), " << stats.numUnsortedStateChanges
+			       << " if unsorted\n";
+			OutputDebugStringA( report.str().c_str() );
+
+			// Also the time spent uploading meshes loaded in the background since the last report
+			CMesh::SUploadStats uploadStats;
+			CMesh::GetUploadStats( &uploadStats );
+			ostringstream uploadReport;
+			uploadReport << "Mesh upload: " << uploadStats.numCalls << " calls, "
+			             << uploadStats.totalMilliseconds << " ms total, "
+			             << uploadStats.maxMilliseconds << " ms max, " << uploadStats.numSlowCalls
+			             << " over 1 ms, " << uploadStats.bytesCopied << " bytes copied, "
+			             << uploadStats.numBuffersCreated << " buffers created\n";
+			OutputDebugStringA( uploadReport.str().c_str() );
 		}
 
 
@@ -0,0 +1,508 @@
+/**************************************************************************************************
+	Module:       CImportOBJFile.cpp
+	Date created: 18/10/26
+
+	Class encapsulating the import of a Wavefront OBJ file and its MTL material libraries
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+using namespace std;
+
+#include "Defines.h"
+#include "Utility.h"
+#include "CImportOBJFile.h"
+
+namespace gen
+{
+
+/*-----------------------------------------------------------------------------------------
+	CImportOBJFile public member functions
+-----------------------------------------------------------------------------------------*/
+
+// Tests if supplied filename is a Wavefront OBJ file - OBJ files have no header so only the
+// extension (.obj) is checked
+bool CImportOBJFile::IsOBJFile
+(
+	const string& sFileName
+)
+{
+	GEN_GUARD;
+
+	if (sFileName.length() < 4)
+	{
+		return false;
+	}
+
+	// Compare extension ignoring case
+	const char* szExtension = sFileName.c_str() + sFileName.length() - 4;
+	return szExtension[0] == '.' && tolower( szExtension[1] ) == 'o' &&
+	       tolower( szExtension[2] ) == 'b' && tolower( szExtension[3] ) == 'j';
+
+	GEN_ENDGUARD;
+}
+
+
+// Return the triangle after the last one in the given run of an OBJ file
+static TUInt32 OBJRunEnd
+(
+	const SOBJData& objData,
+	const TUInt32   iRun
+)
+{
+	return (iRun + 1 < objData.runs.size()) ? objData.runs[iRun + 1].iFirstTriangle :
+	                                          static_cast<TUInt32>(objData.corners.size() / 3);
+}
+
+
+// Parse an OBJ file and the MTL material libraries it uses. Creates a single root frame with
+// a child frame for each object, and a mesh for each group in an object. Missing material
+// libraries or materials are not errors, default materials are used instead
+// Possible return values:
+//		kFileError:			Missing file
+//		kInvalidData:		The file could not be parsed correctly, or contains invalid data
+EImportError CImportOBJFile::ParseFile
+(
+	const string& sFileName
+)
+{
+	GEN_GUARD;
+
+	// Unclutter code with references to the importer's report and frames
+	SImportReport& report = m_ImportFile.m_Report;
+	TXFileFrames& frames = m_ImportFile.m_Frames;
+
+	// Read and parse the whole file
+	SOBJData objData;
+	{
+		CStageTimer stage( &report.aStages[kStageReadMesh], &m_ImportFile.m_pCurrentStage );
+
+		vector<char> text;
+		if (!ReadTextFile( sFileName, &text ))
+		{
+			return kFileError;
+		}
+		stage.AddBytes( text.size() );
+		if (!ParseOBJ( &text[0], static_cast<TUInt32>(text.size()), &objData ))
+		{
+			return kInvalidData;
+		}
+	}
+
+	// Read the materials from each material library, found relative to the folder of the OBJ
+	// file. Libraries that are missing or invalid are skipped - the geometry is still usable
+	vector<SOBJMaterial> objMaterials;
+	{
+		CStageTimer stage( &report.aStages[kStageReadOtherData], &m_ImportFile.m_pCurrentStage );
+
+		string sFolder = sFileName.substr( 0, sFileName.find_last_of( "\\/" ) + 1 );
+		vector<char> text;
+		for (TUInt32 iLibrary = 0; iLibrary < objData.materialLibraries.size(); ++iLibrary)
+		{
+			string sLibrary = objData.names.GetString( objData.materialLibraries[iLibrary] );
+			if (ReadTextFile( sFolder + sLibrary, &text ))
+			{
+				stage.AddBytes( text.size() );
+				TUInt32 iOldNumMaterials = static_cast<TUInt32>(objMaterials.size());
+				if (!ParseMTL( &text[0], static_cast<TUInt32>(text.size()), &objData.names,
+				               &objMaterials ))
+				{
+					objMaterials.resize( iOldNumMaterials );
+				}
+			}
+		}
+	}
+
+	// Index the materials by name ID, the first definition of a name is used
+	TXFileInts materialIndex( objData.names.GetNumStrings(), kiOBJNoIndex );
+	for (TUInt32 iMaterial = 0; iMaterial < objMaterials.size(); ++iMaterial)
+	{
+		TUInt32& iIndex = materialIndex[objMaterials[iMaterial].iName];
+		if (iIndex == kiOBJNoIndex)
+		{
+			iIndex = iMaterial;
+		}
+	}
+
+	// Create new root frame
+	frames.push_back( SXFileFrame() );
+
+	// Set root frame values
+	frames[0].iName = m_ImportFile.m_Names.Intern( "Root" );
+	frames[0].iDepth = 0;
+	frames[0].iParentIndex = 0;
+	frames[0].iNumChildren = 0;
+	frames[0].defaultMatrix = CMatrix4x4::kIdentity;
+	frames[0].offsetMatrix = CMatrix4x4::kIdentity;
+
+	// Frame created for each object (by name ID), 0 if none yet - the root is never an object's
+	TXFileInts objectFrames( objData.names.GetNumStrings(), 0 );
+
+	// Each sequence of runs in the same object and group becomes a mesh. Empty runs never start a
+	// mesh or split one, they only record name changes with no triangles between them
+	TUInt32 iNumRuns = static_cast<TUInt32>(objData.runs.size());
+	TUInt32 iFirstRun = 0;
+	while (iFirstRun < iNumRuns)
+	{
+		const SOBJRun& firstRun = objData.runs[iFirstRun];
+		if (OBJRunEnd( objData, iFirstRun ) == firstRun.iFirstTriangle)
+		{
+			++iFirstRun;
+			continue;
+		}
+		TUInt32 iEndRun = iFirstRun + 1;
+		while (iEndRun < iNumRuns)
+		{
+			const SOBJRun& run = objData.runs[iEndRun];
+			if (OBJRunEnd( objData, iEndRun ) != run.iFirstTriangle &&
+			    (run.iObject != firstRun.iObject || run.iGroup != firstRun.iGroup))
+			{
+				break;
+			}
+			++iEndRun;
+		}
+
+		// Meshes in an object are held by a child frame of the root, created the first time the
+		// object is used. Meshes outside any object are held by the root
+		TUInt32 iFrame = 0;
+		if (firstRun.iObject != kiEmptyString)
+		{
+			iFrame = objectFrames[firstRun.iObject];
+			if (iFrame == 0)
+			{
+				iFrame = static_cast<TUInt32>(frames.size());
+				objectFrames[firstRun.iObject] = iFrame;
+				frames.push_back( SXFileFrame() );
+				const char* szObject = objData.names.GetString( firstRun.iObject );
+				frames[iFrame].iName = m_ImportFile.m_Names.Intern( szObject );
+				frames[iFrame].iDepth = 1;
+				frames[iFrame].iParentIndex = 0;
+				frames[iFrame].iNumChildren = 0;
+				frames[iFrame].defaultMatrix = CMatrix4x4::kIdentity;
+				frames[iFrame].offsetMatrix = CMatrix4x4::kIdentity;
+				++frames[0].iNumChildren;
+			}
+		}
+
+		// Create the mesh, nothing more to do with it if only hashing
+		ReadMesh( objData, objMaterials, materialIndex, iFirstRun, iEndRun, iFrame );
+		if (!m_ImportFile.m_Options.bHashOnly)
+		{
+			TUInt32 iMesh = static_cast<TUInt32>(m_ImportFile.m_Meshes.size()) - 1;
+			EImportError eError = m_ImportFile.CompleteMesh( iMesh );
+			if (eError != kSuccess)
+			{
+				return eError;
+			}
+		}
+
+		iFirstRun = iEndRun;
+	}
+
+	// Meshes have not been processed if only hashing, and have already been passed on if streaming
+	if (m_ImportFile.m_Options.bHashOnly || m_ImportFile.m_Options.pfnSubMeshCallback)
+	{
+		return kSuccess;
+	}
+
+	// Make a single global material list for all meshes. There are no bones in an OBJ file
+	m_ImportFile.MakeGlobalMaterialList();
+
+	return kSuccess;
+
+	GEN_ENDGUARD;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	CImportOBJFile private member functions
+-----------------------------------------------------------------------------------------*/
+
+// Create a mesh from a range of runs of triangles in the OBJ file, held by the given frame.
+// Each distinct combination of position, texture coordinate and normal in the faces becomes a
+// vertex. OBJ materials are indexed by name ID (kiOBJNoIndex for none). If only hashing, the
+// mesh is left with just its hash and frame
+void CImportOBJFile::ReadMesh
+(
+	const SOBJData&             objData,
+	const vector<SOBJMaterial>& objMaterials,
+	const TXFileInts&           materialIndex,
+	const TUInt32               iFirstRun,
+	const TUInt32               iEndRun,
+	const TUInt32               iFrame
+)
+{
+	GEN_GUARD;
+
+	// Unclutter code with a reference to the importer's names
+	CStringTable& names = m_ImportFile.m_Names;
+
+	CStageTimer stage( &m_ImportFile.m_Report.aStages[kStageReadMesh],
+	                   &m_ImportFile.m_pCurrentStage );
+
+	// Create new mesh
+	TUInt32 iMesh = static_cast<TUInt32>(m_ImportFile.m_Meshes.size());
+	m_ImportFile.m_Meshes.push_back( SXFileMesh() );
+
+	// Unclutter code with a reference to the mesh 
+	SXFileMesh& mesh = m_ImportFile.m_Meshes[iMesh];
+
+	// Set owner frame and index in the file
+	mesh.iParentFrame = iFrame;
+	mesh.iSourceMesh = m_ImportFile.m_iNumSourceMeshes++;
+	mesh.iNumUniqueVertices = 0;
+	mesh.iMaxBonesPerVertex = 0;
+	mesh.iMaxBonesPerFace = 0;
+
+	// Range of face corners in the mesh
+	TUInt32 iFirstCorner = objData.runs[iFirstRun].iFirstTriangle * 3;
+	TUInt32 iNumCorners = OBJRunEnd( objData, iEndRun - 1 ) * 3 - iFirstCorner;
+	const SOBJCorner* pCorners = &objData.corners[iFirstCorner];
+	stage.AddBytes( iNumCorners * sizeof(SOBJCorner) );
+
+	// The mesh has texture coordinates or normals if any of its corners do, corners without them
+	// will get zeros
+	bool bTextureCoords = false;
+	bool bNormals = false;
+	for (TUInt32 iCorner = 0; iCorner < iNumCorners; ++iCorner)
+	{
+		bTextureCoords |= (pCorners[iCorner].iTextureCoord != kiOBJNoIndex);
+		bNormals |= (pCorners[iCorner].iNormal != kiOBJNoIndex);
+	}
+
+	// Each distinct corner becomes a vertex. Corners are matched using an open addressing hash
+	// table of vertex indices, at most half full, comparing against the first corner of each
+	// vertex. The faces index the vertices directly, so there are no separate normal faces
+	TUInt32 iNumSlots = 16;
+	while (iNumSlots < iNumCorners * 2)
+	{
+		iNumSlots *= 2;
+	}
+	TUInt32 iSlotMask = iNumSlots - 1;
+	TXFileTempInts slots( iNumSlots, kiOBJNoIndex, m_ImportFile.m_Arena );
+	TXFileTempInts vertexCorners( iNumCorners, 0, m_ImportFile.m_Arena );
+	TUInt32 iNumVertices = 0;
+	mesh.faces.resize( iNumCorners / 3 );
+	for (TUInt32 iCorner = 0; iCorner < iNumCorners; ++iCorner)
+	{
+		const SOBJCorner& corner = pCorners[iCorner];
+		TUInt32 iSlot = HashData( &corner, sizeof(SOBJCorner) ) & iSlotMask;
+		while (slots[iSlot] != kiOBJNoIndex &&
+		       memcmp( &pCorners[vertexCorners[slots[iSlot]]], &corner, sizeof(SOBJCorner) ) != 0)
+		{
+			iSlot = (iSlot + 1) & iSlotMask;
+		}
+		if (slots[iSlot] == kiOBJNoIndex)
+		{
+			slots[iSlot] = iNumVertices;
+			vertexCorners[iNumVertices] = iCorner;
+			++iNumVertices;
+		}
+		mesh.faces[iCorner / 3].aiVertex[iCorner % 3] = slots[iSlot];
+	}
+
+	// Copy the vertex data, flipping texture coordinates from the OBJ convention (V upwards)
+	mesh.vertices.resize( iNumVertices );
+	if (bTextureCoords)
+	{
+		mesh.textureCoords.resize( iNumVertices );
+	}
+	if (bNormals)
+	{
+		mesh.normals.resize( iNumVertices );
+	}
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		const SOBJCorner& corner = pCorners[vertexCorners[iVertex]];
+		mesh.vertices[iVertex] = objData.positions[corner.iPosition];
+		if (bTextureCoords)
+		{
+			SXFileUV uv = { 0.0f, 0.0f };
+			if (corner.iTextureCoord != kiOBJNoIndex)
+			{
+				uv.fU = objData.textureCoords[corner.iTextureCoord].fU;
+				uv.fV = 1.0f - objData.textureCoords[corner.iTextureCoord].fV;
+			}
+			mesh.textureCoords[iVertex] = uv;
+		}
+		if (bNormals)
+		{
+			mesh.normals[iVertex] = (corner.iNormal != kiOBJNoIndex) ?
+			                        objData.normals[corner.iNormal] : CVector3::kZero;
+		}
+	}
+
+	// Create a local material for each distinct OBJ material used by the runs, with a default
+	// material for triangles with no material or an unknown one
+	TXFileInts localMaterials; // OBJ material index of each local material
+	mesh.faceMaterials.resize( iNumCorners / 3 );
+	for (TUInt32 iRun = iFirstRun; iRun < iEndRun; ++iRun)
+	{
+		TUInt32 iRunFirst = objData.runs[iRun].iFirstTriangle;
+		TUInt32 iRunEnd = OBJRunEnd( objData, iRun );
+		if (iRunEnd == iRunFirst)
+		{
+			continue;
+		}
+
+		TUInt32 iOBJMaterial = materialIndex[objData.runs[iRun].iMaterial];
+		TUInt32 iMaterial = static_cast<TUInt32>(find( localMaterials.begin(), localMaterials.end(),
+		                                               iOBJMaterial ) - localMaterials.begin());
+		if (iMaterial == localMaterials.size())
+		{
+			const SOBJMaterial* pOBJMaterial =
+				(iOBJMaterial != kiOBJNoIndex) ? &objMaterials[iOBJMaterial] : 0;
+			localMaterials.push_back( iOBJMaterial );
+			mesh.materials.push_back( MakeMaterial( pOBJMaterial, objData.names ) );
+		}
+		fill( mesh.faceMaterials.begin() + (iRunFirst - iFirstCorner / 3),
+		      mesh.faceMaterials.begin() + (iRunEnd - iFirstCorner / 3), iMaterial );
+	}
+
+	// Hash the mesh data so unchanged meshes can be identified when the file is re-imported. The
+	// OBJ data for the mesh is not contiguous in the file, so the mesh created from it is hashed
+	TUInt32 iHash = HashData( &mesh.vertices[0], iNumVertices * sizeof(CVector3) );
+	if (bTextureCoords)
+	{
+		iHash = HashData( &mesh.textureCoords[0], iNumVertices * sizeof(SXFileUV), iHash );
+	}
+	if (bNormals)
+	{
+		iHash = HashData( &mesh.normals[0], iNumVertices * sizeof(CVector3), iHash );
+	}
+	iHash = HashData( &mesh.faces[0], iNumCorners / 3 * sizeof(SXFileFace), iHash );
+	iHash = HashData( &mesh.faceMaterials[0], iNumCorners / 3 * sizeof(TUInt32), iHash );
+	for (TUInt32 iMaterial = 0; iMaterial < mesh.materials.size(); ++iMaterial)
+	{
+		const SXFileMaterial& material = mesh.materials[iMaterial];
+		iHash = HashData( &material.faceColour, 11 * sizeof(TFloat32), iHash );
+		iHash = HashData( names.GetString( material.iName ), names.GetLength( material.iName ),
+		                  iHash );
+		iHash = HashData( names.GetString( material.iTextureName ),
+		                  names.GetLength( material.iTextureName ), iHash );
+	}
+	mesh.iSourceHash = iHash;
+
+	// Discard the data if only hashing
+	if (m_ImportFile.m_Options.bHashOnly)
+	{
+		SXFileMesh hashedMesh;
+		hashedMesh.iParentFrame = iFrame;
+		hashedMesh.iSourceMesh = mesh.iSourceMesh;
+		hashedMesh.iSourceHash = iHash;
+		hashedMesh.iNumUniqueVertices = 0;
+		hashedMesh.iMaxBonesPerVertex = 0;
+		hashedMesh.iMaxBonesPerFace = 0;
+		m_ImportFile.m_Meshes[iMesh] = move( hashedMesh );
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+// Convert an OBJ material to an X-file material, or return a default material if none given
+CImportOBJFile::SXFileMaterial CImportOBJFile::MakeMaterial
+(
+	const SOBJMaterial* pMaterial,
+	const CStringTable& objNames
+)
+{
+	GEN_GUARD;
+
+	// Unclutter code with a reference to the importer's names
+	CStringTable& names = m_ImportFile.m_Names;
+
+	// Default material is white with no texture, as for X-file material lists
+	SXFileMaterial material = 
+	{
+		kiEmptyString,
+		{ 1.0f, 1.0f, 1.0f, 1.0f },
+		20.0f, { 0.0f, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, 0.0f },
+		kiEmptyString,
+		false
+	};
+	if (!pMaterial)
+	{
+		return material;
+	}
+
+	// Names are moved from the OBJ data's name table to the import's
+	material.iName = names.Intern( objNames.GetString( pMaterial->iName ),
+	                               objNames.GetLength( pMaterial->iName ) );
+	material.bPlain = (strstr( names.GetString( material.iName ), "Plain" ) != 0);
+	material.iTextureName = names.Intern( objNames.GetString( pMaterial->iDiffuseMap ),
+	                                      objNames.GetLength( pMaterial->iDiffuseMap ) );
+
+	material.faceColour.fRed   = pMaterial->afDiffuse[0];
+	material.faceColour.fGreen = pMaterial->afDiffuse[1];
+	material.faceColour.fBlue  = pMaterial->afDiffuse[2];
+	material.faceColour.fAlpha = pMaterial->fAlpha;
+	material.fSpecularPower = pMaterial->fSpecularPower;
+	material.specularColour.fRed   = pMaterial->afSpecular[0];
+	material.specularColour.fGreen = pMaterial->afSpecular[1];
+	material.specularColour.fBlue  = pMaterial->afSpecular[2];
+	material.emmisiveColour.fRed   = pMaterial->afEmissive[0];
+	material.emmisiveColour.fGreen = pMaterial->afEmissive[1];
+	material.emmisiveColour.fBlue  = pMaterial->afEmissive[2];
+
+	return material;
+
+	GEN_ENDGUARD;
+}
+
+
+// Read the whole of a text file, adding a newline at the end if the file does not end with one.
+// Returns false if the file cannot be read
+bool CImportOBJFile::ReadTextFile
+(
+	const string& sFileName,
+	vector<char>* pText
+)
+{
+	GEN_GUARD;
+
+	FILE* pFile = fopen( sFileName.c_str(), "rb" );
+	if (!pFile)
+	{
+		return false;
+	}
+
+	// Get the file size and read it in one go
+	fseek( pFile, 0, SEEK_END );
+	long iSize = ftell( pFile );
+	fseek( pFile, 0, SEEK_SET );
+	bool bRead = (iSize >= 0);
+	if (iSize > 0)
+	{
+		pText->resize( iSize );
+		bRead = (fread( &(*pText)[0], 1, iSize, pFile ) == static_cast<TUInt32>(iSize));
+	}
+	else
+	{
+		pText->clear();
+	}
+	fclose( pFile );
+	if (!bRead)
+	{
+		return false;
+	}
+
+	// The OBJ and MTL parsers require the text to end with a newline
+	if (pText->empty() || pText->back() != '\n')
+	{
+		pText->push_back( '\n' );
+	}
+
+	return true;
+
+	GEN_ENDGUARD;
+}
+
+
+} // namespace gen
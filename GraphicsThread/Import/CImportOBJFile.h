@@ -0,0 +1,126 @@
+/**************************************************************************************************
+	Module:       CImportOBJFile.h
+	Date created: 18/10/26
+
+	Class encapsulating the import of a Wavefront OBJ file and its MTL material libraries
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_C_IMPORT_OBJFILE_H_INCLUDED
+#define GEN_C_IMPORT_OBJFILE_H_INCLUDED
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CImportXFile.h"
+#include "OBJFile.h"
+
+namespace gen
+{
+
+// Reads a Wavefront OBJ file into the frames, meshes and materials of a CImportXFile, in the same
+// form as an X-file is read, so the meshes are then processed and accessed in the same way. Used
+// by CImportXFile::ImportFile for files with an .obj extension - construct one to read a single
+// file
+class CImportOBJFile
+{
+	GEN_CLASS( CImportOBJFile )
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+public:
+	// Constructor, reading into the given importer, which must have been cleared for a new import
+	CImportOBJFile( CImportXFile& importFile ) : m_ImportFile( importFile ) {}
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CImportOBJFile( const CImportOBJFile& );
+	CImportOBJFile& operator=( const CImportOBJFile& );
+
+
+/*-----------------------------------------------------------------------------------------
+	Public interface
+-----------------------------------------------------------------------------------------*/
+public:
+
+	// Tests if supplied filename is a Wavefront OBJ file - OBJ files have no header so only the
+	// extension (.obj) is checked
+	static bool IsOBJFile
+	(
+		const string& sFileName
+	);
+
+	// Parse an OBJ file and the MTL material libraries it uses. Creates a single root frame with
+	// a child frame for each object, and a mesh for each group in an object. Missing material
+	// libraries or materials are not errors, default materials are used instead
+	// Possible return values:
+	//		kFileError:			Missing file
+	//		kInvalidData:		The file could not be parsed correctly, or contains invalid data
+	EImportError ParseFile
+	(
+		const string& sFileName
+	);
+
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Types of the importer read into
+	typedef CImportXFile::TXFileInts     TXFileInts;
+	typedef CImportXFile::TXFileTempInts TXFileTempInts;
+	typedef CImportXFile::SXFileFrame    SXFileFrame;
+	typedef CImportXFile::TXFileFrames   TXFileFrames;
+	typedef CImportXFile::SXFileMesh     SXFileMesh;
+	typedef CImportXFile::SXFileFace     SXFileFace;
+	typedef CImportXFile::SXFileUV       SXFileUV;
+	typedef CImportXFile::SXFileMaterial SXFileMaterial;
+
+	// Create a mesh from a range of runs of triangles in the OBJ file, held by the given frame.
+	// Each distinct combination of position, texture coordinate and normal in the faces becomes a
+	// vertex. OBJ materials are indexed by name ID (kiOBJNoIndex for none). If only hashing, the
+	// mesh is left with just its hash and frame
+	void ReadMesh
+	(
+		const SOBJData&             objData,
+		const vector<SOBJMaterial>& objMaterials,
+		const TXFileInts&           materialIndex,
+		const TUInt32               iFirstRun,
+		const TUInt32               iEndRun,
+		const TUInt32               iFrame
+	);
+
+	// Convert an OBJ material to an X-file material, or return a default material if none given
+	SXFileMaterial MakeMaterial
+	(
+		const SOBJMaterial* pMaterial,
+		const CStringTable& objNames
+	);
+
+	// Read the whole of a text file, adding a newline at the end if the file does not end with
+	// one. Returns false if the file cannot be read
+	static bool ReadTextFile
+	(
+		const string& sFileName,
+		vector<char>* pText
+	);
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	// Importer whose frames, meshes and materials the file is read into
+	CImportXFile& m_ImportFile;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_IMPORT_OBJFILE_H_INCLUDED
@@ -11,22 +11,75 @@
 		V1.0    Created 12/06/06 - LN
 **************************************************************************************************/
 
+#include <cstring>
+#include <cctype>
 #include <algorithm>
 #include <numeric>
+#include <unordered_map>
+#include <sstream>
+#include <iomanip>
 using namespace std;
 
-#define INITGUID
-#include <windows.h>
-#include <dxfile.h>
-#include <rmxfguid.h>
-#include <rmxftmpl.h>
+#include "Defines.h"
+
+// X-files are read with the D3DX X-file API, only available with DirectX
+#if defined(GEN_DIRECTX)
+	#define INITGUID
+	#include <windows.h>
+	#include <dxfile.h>
+	#include <rmxfguid.h>
+	#include <rmxftmpl.h>
+#endif
+
+// Tangents are orthogonalised four at a time with SSE on processors that have it
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define GEN_SSE_TANGENTS
+	#include <xmmintrin.h>
+#endif
 
 //#include "Error.h"
+#include "Utility.h"
+#include "Parallel.h"
 #include "CImportXFile.h"
+#include "CImportOBJFile.h"
 
 namespace gen
 {
 
+/*-----------------------------------------------------------------------------------------
+	Import stages
+-----------------------------------------------------------------------------------------*/
+
+// Get the name of an import stage, e.g. for logging
+const char* GetImportStageName
+(
+	const EImportStage eStage
+)
+{
+	static const char* asStageNames[kiNumImportStages] =
+	{
+		"ParseFile",
+		"ReadMesh",
+		"ReadNormals",
+		"ReadOtherData",
+		"MatchFaceLists",
+		"WeldVertices",
+		"MaterialList",
+		"ProcessBones",
+		"SplitMeshes",
+		"SplitLargeMeshes",
+		"PartitionBones",
+		"GenerateLODs",
+		"ClusterMeshes",
+		"OptimiseMeshes",
+		"BuildBVHs",
+		"CalculateBounds",
+		"GetSubMesh",
+	};
+	return asStageNames[eStage];
+}
+
+
 /*-----------------------------------------------------------------------------------------
 	CImportXFile public member functions
 -----------------------------------------------------------------------------------------*/
@@ -65,75 +118,179 @@ bool CImportXFile::IsXFile
 }
 
 	
-// Import a Microsoft X-File into a list of meshes and a frame hierarchy
+// Import a Microsoft X-File, or a Wavefront OBJ file (see CImportOBJFile), into a list of meshes
+// and a frame hierarchy
 // Possible return values:
 //		kSuccess:			...
-//		kFileError:			Missing file or not an X-file
+//		kFileError:			Missing file or not an X-file or OBJ file
 //		kInvalidData:		The file could not be parsed correctly, or contains invalid data
 //		kOutOfSystemMemory:	...
-//		kSystemFailure:		X-file API failure
+//		kSystemFailure:		X-file API failure, or an X-file on a platform without the API
 EImportError CImportXFile::ImportFile
 (
-	const string& sFileName
+	const string&         sFileName,
+	const SImportOptions& options /*= SImportOptions()*/
 )
 {
 	GEN_GUARD;
 
+	m_Options = options;
+	m_Report = SImportReport();
+	m_pCurrentStage = 0;
+
 	// Wipe any existing data
 	m_Frames.clear();
+	m_FrameBounds.clear();
 	m_Meshes.clear();
+	m_HeldMeshes.clear();
+	m_Materials.clear();
+	m_Names.Clear();
+	m_iNumStreamedSubMeshes = 0;
+	m_iNumSourceMeshes = 0;
 	m_bImported = false;
 
-	// Ensure the file is an X-file
-	if (!IsXFile( sFileName ))
+	// Release the working memory of the last import, keeping a block to reuse. The arena's
+	// statistics are accumulated over its life, so note them to report this import's usage
+	m_Arena.Reset();
+	TUInt32 iStartArenaAllocations = m_Arena.GetNumAllocations();
+	TUInt64 iStartArenaBytes = m_Arena.GetBytesAllocated();
+	TUInt32 iStartArenaBlocks = m_Arena.GetNumBlocks();
+
+	// Ensure the file is an X-file or an OBJ file
+	bool bOBJFile = CImportOBJFile::IsOBJFile( sFileName );
+	if (!bOBJFile && !IsXFile( sFileName ))
 	{
 		return kFileError;
 	}
 
-	// Create X-File object
-	ID3DXFile* pXFile;
-	EImportError eError = PrepareXFileObject( &pXFile );
-	if (eError != kSuccess)
+	// Open and parse the file, measured as a stage (excluding the reading stages within it)
+	EImportError eError;
 	{
-		return eError;
-	}
+		CStageTimer stage( &m_Report.aStages[kStageParseFile], &m_pCurrentStage );
 
-	// Get X-File enumerator
-	ID3DXFileEnumObject* pXFileEnumer;
-	eError = GetXFileEnumerator( sFileName, pXFile, &pXFileEnumer );
-	if (eError != kSuccess)
-	{
-		pXFile->Release();
-		return eError;
-	}
+		// OBJ files are text, parsed without the X-file API
+		if (bOBJFile)
+		{
+			CImportOBJFile objFile( *this );
+			eError = objFile.ParseFile( sFileName );
+		}
+		else
+		{
+#if defined(GEN_DIRECTX)
+			// Create X-File object
+			ID3DXFile* pXFile;
+			eError = PrepareXFileObject( &pXFile );
+			if (eError != kSuccess)
+			{
+				return eError;
+			}
+
+			// Get X-File enumerator
+			ID3DXFileEnumObject* pXFileEnumer;
+			eError = GetXFileEnumerator( sFileName, pXFile, &pXFileEnumer );
+			if (eError != kSuccess)
+			{
+				pXFile->Release();
+				return eError;
+			}
 
-	// Parse X file to create frame hierachy and meshes
-	eError = ParseXFile( pXFileEnumer );
+			// Parse X file to create frame hierachy and meshes
+			eError = ParseXFile( pXFileEnumer );
 
-	// Release X-File interfaces
-	pXFileEnumer->Release();
-	pXFile->Release();
+			// Release X-File interfaces
+			pXFileEnumer->Release();
+			pXFile->Release();
+#else
+			// No X-file API on this platform
+			return kSystemFailure;
+#endif
+		}
+	}
 
 	// Check for errors
 	if (eError != kSuccess)
 	{
 		m_Frames.clear();
+		m_FrameBounds.clear();
 		m_Meshes.clear();
+		m_HeldMeshes.clear();
+		m_Materials.clear();
 		return eError;
 	}
 
-	// Split into meshes containing only one material each
-	SplitMeshes();
+	// Meshes are left unprocessed if only hashing, and have already been processed if streaming.
+	// Frame bounds can only be completed once all meshes are processed
+	if (!m_Options.bHashOnly)
+	{
+		if (!m_Options.pfnSubMeshCallback)
+		{
+			ProcessMeshes();
+		}
+		CalculateFrameBounds();
+	}
+	m_Report.iArenaAllocations = m_Arena.GetNumAllocations() - iStartArenaAllocations;
+	m_Report.iArenaBytes = m_Arena.GetBytesAllocated() - iStartArenaBytes;
+	m_Report.iArenaBlocks = m_Arena.GetNumBlocks() - iStartArenaBlocks;
 
 	// Mark file as loaded
 	m_bImported = true;
 
+	if (m_Options.bLogReport)
+	{
+		LogImportReport();
+	}
+
 	return kSuccess;
 
 	GEN_ENDGUARD;
 }
 
 
+// Write the report of the last import to the debugger output - the time, bytes processed and
+// allocations for each stage
+void CImportXFile::LogImportReport() const
+{
+	GEN_GUARD;
+
+	ostringstream report;
+	report << "Import report" << endl;
+	report << left << setw(18) << "Stage" << right << setw(8) << "Calls" << setw(12) << "Time (ms)"
+	       << setw(14) << "Bytes" << setw(13) << "Allocations" << endl;
+	report << fixed << setprecision( 3 );
+	SStageStats total;
+	for (TUInt32 iStage = 0; iStage < kiNumImportStages; ++iStage)
+	{
+		const SStageStats& stats = m_Report.aStages[iStage];
+		if (stats.iCalls == 0)
+		{
+			continue;
+		}
+		report << left << setw(18) << GetImportStageName( static_cast<EImportStage>(iStage) )
+		       << right << setw(8) << stats.iCalls << setw(12) << stats.fSeconds * 1000.0
+		       << setw(14) << stats.iBytes << setw(13) << stats.iAllocations << endl;
+		total.fSeconds += stats.fSeconds;
+		total.iAllocations += stats.iAllocations;
+	}
+	report << left << setw(26) << "Total" << right << setw(12) << total.fSeconds * 1000.0
+	       << setw(27) << total.iAllocations << endl;
+	if (m_Report.iBonePartitions > 0)
+	{
+		report << "Bone partitions: " << m_Report.iBonePartitions << ", vertices "
+		       << m_Report.iVerticesBeforePartition << " -> "
+		       << m_Report.iVerticesAfterPartition << endl;
+	}
+	report << "Arena: " << m_Report.iArenaAllocations << " allocations, " << m_Report.iArenaBytes
+	       << " bytes, " << m_Report.iArenaBlocks << " blocks" << endl;
+#if defined(_MSC_VER)
+	OutputDebugStringA( report.str().c_str() );
+#else
+	fputs( report.str().c_str(), stderr );
+#endif
+
+	GEN_ENDGUARD;
+}
+
+
 /////////////////////////////////////
 // Data access
 
@@ -146,12 +303,20 @@ void CImportXFile::GetNode
 {
 	GEN_GUARD;
 
-	pOutNode->name = m_Frames[iNode].sName;
+	pOutNode->name = m_Frames[iNode].iName;
 	pOutNode->depth = m_Frames[iNode].iDepth;
 	pOutNode->parent = m_Frames[iNode].iParentIndex;
 	pOutNode->numChildren = m_Frames[iNode].iNumChildren;
 	pOutNode->positionMatrix = m_Frames[iNode].defaultMatrix;
 	pOutNode->invMeshOffset = m_Frames[iNode].offsetMatrix;
+	if (iNode < m_FrameBounds.size())
+	{
+		pOutNode->bounds = m_FrameBounds[iNode];
+	}
+	else
+	{
+		ClearBounds( &pOutNode->bounds );
+	}
 
 	GEN_ENDGUARD;
 }
@@ -165,7 +330,8 @@ ERenderMethod CImportXFile::GetSubMeshRenderMethod( const TUInt32 iSubMesh ) con
 
 
 // Get the specification and data for given sub-mesh, returned through a pointer. May request
-// tangents to be calculated
+// tangents to be calculated. The vertex and face data are allocated with new[], the caller
+// must delete[] them. Prefer GetSubMeshSpec / GetSubMeshData to write directly to buffers
 // Possible return values:
 //		kSuccess:			...
 //		kOutOfSystemMemory:	...
@@ -174,26 +340,63 @@ EImportError CImportXFile::GetSubMesh
 	const TUInt32 iSubMesh,
 	SSubMesh*     pOutSubMesh,
 	bool          bTangents /*= false*/
-) const
+)
 {
 	GEN_GUARD;
 
-	// Set sub-mesh owner node
-	pOutSubMesh->node = m_Meshes[iSubMesh].iParentFrame;
+	GetSubMeshSpec( iSubMesh, pOutSubMesh, bTangents );
 
-	// Calculate tangents if required
-	TXFileVectors tangents;
-	pOutSubMesh->hasTangents = bTangents;
-	if (pOutSubMesh->hasTangents)
+	// Reserve space for vertex and face data
+	TUInt8* pVertices = new TUInt8[pOutSubMesh->numVertices * pOutSubMesh->vertexSize];
+	TUInt8* pFaces = new TUInt8[pOutSubMesh->numFaces * 3 * pOutSubMesh->indexSize];
+	if (!pVertices || !pFaces)
 	{
-		CalculateTangents( iSubMesh, &tangents );
+		delete[] pVertices;
+		delete[] pFaces;
+		return kOutOfSystemMemory;
+	}
+
+	EImportError eError = GetSubMeshData( iSubMesh, pOutSubMesh, pVertices, pFaces );
+	if (eError != kSuccess)
+	{
+		delete[] pVertices;
+		delete[] pFaces;
+		pOutSubMesh->vertices = 0;
+		pOutSubMesh->faces = 0;
 	}
+	return eError;
+
+	GEN_ENDGUARD;
+}
+
+
+// Get the specification of given sub-mesh without its data - all fields except the vertex and
+// face pointers, which are set to 0. Used to size the memory passed to GetSubMeshData. May
+// request tangents (only provided if the mesh has normals and texture coordinates) and choose
+// the vertex layout
+void CImportXFile::GetSubMeshSpec
+(
+	const TUInt32       iSubMesh,
+	SSubMesh*           pOutSubMesh,
+	bool                bTangents /*= false*/,
+	const EVertexLayout vertexLayout /*= InterleavedVertices*/
+) const
+{
+	GEN_GUARD;
+
+	// Unclutter code with a reference to the mesh 
+	const SXFileMesh& mesh = m_Meshes[iSubMesh];
+
+	// Set sub-mesh owner node and material (all faces in sub-mesh have the same material)
+	pOutSubMesh->node = mesh.iParentFrame;
+	pOutSubMesh->material = mesh.materialMap.front();
 
 	// Find what vertex data there is and calculate total vertex size
-	pOutSubMesh->hasSkinningData = (m_Meshes[iSubMesh].bones.size() > 0);
-	pOutSubMesh->hasNormals = (m_Meshes[iSubMesh].normals.size() > 0);
-	pOutSubMesh->hasTextureCoords = (m_Meshes[iSubMesh].textureCoords.size() > 0);
-	pOutSubMesh->hasVertexColours = (m_Meshes[iSubMesh].vertexColours.size() > 0);
+	pOutSubMesh->hasSkinningData = (mesh.bones.size() > 0);
+	pOutSubMesh->hasNormals = (mesh.normals.size() > 0);
+	pOutSubMesh->hasTangents = bTangents && pOutSubMesh->hasNormals && (mesh.textureCoords.size() > 0);
+	pOutSubMesh->hasTextureCoords = (mesh.textureCoords.size() > 0);
+	pOutSubMesh->hasVertexColours = (mesh.vertexColours.size() > 0);
 	pOutSubMesh->vertexSize = sizeof(CVector3) + 
 							  (pOutSubMesh->hasSkinningData ? 4 * sizeof(TFloat32) + sizeof(TUInt32) : 0) +
 	                          (pOutSubMesh->hasNormals ? sizeof(CVector3) : 0) +
@@ -201,138 +404,132 @@ EImportError CImportXFile::GetSubMesh
 	                          (pOutSubMesh->hasTextureCoords ? sizeof(SXFileUV) : 0) +
 	                          (pOutSubMesh->hasVertexColours ? sizeof(SXFileRGBAColour) : 0);
 	                          // Skinning data: assuming 4 float weights / 4 byte indices in TUInt32
-
-	// Set number of vertices and reserve space for vertex data
-	pOutSubMesh->numVertices = static_cast<TUInt32>(m_Meshes[iSubMesh].vertices.size());
-	pOutSubMesh->vertices = new TUInt8[pOutSubMesh->numVertices * pOutSubMesh->vertexSize];
-	if (!pOutSubMesh->vertices)
+	pOutSubMesh->vertexLayout = vertexLayout;
+
+	// Set number of vertices and faces, but no data. Use 16-bit indices where possible to save
+	// memory and bandwidth
+	pOutSubMesh->numVertices = static_cast<TUInt32>(mesh.vertices.size());
+	pOutSubMesh->vertices = 0;
+	pOutSubMesh->numFaces = static_cast<TUInt32>(mesh.faces.size());
+	pOutSubMesh->indexSize = (pOutSubMesh->numVertices <= kiMax16BitVertices) ? 
+	                         sizeof(TUInt16) : sizeof(TUInt32);
+	pOutSubMesh->faces = 0;
+
+	// Copy levels of detail, or a single level of all faces
+	if (mesh.lods.empty())
 	{
-		return kOutOfSystemMemory;
+		pOutSubMesh->numLODs = 1;
+		pOutSubMesh->lods[0].firstFace = 0;
+		pOutSubMesh->lods[0].numFaces = pOutSubMesh->numFaces;
+		pOutSubMesh->lods[0].numVertices = pOutSubMesh->numVertices;
+		pOutSubMesh->lods[0].error = 0.0f;
 	}
-
-	// Prefetch relevant vertex list info
-	TXFileVectors::const_iterator itVertex = m_Meshes[iSubMesh].vertices.begin();
-	TXFileVectors::const_iterator itVertexEnd = m_Meshes[iSubMesh].vertices.end();
-	TXFileVectors::const_iterator itNormal = m_Meshes[iSubMesh].normals.begin();
-	TXFileVectors::const_iterator itTangent = tangents.begin();
-	TXFileUVs::const_iterator itTextureCooord = m_Meshes[iSubMesh].textureCoords.begin();
-	TXFileRGBAColours::const_iterator itVertexColour = m_Meshes[iSubMesh].vertexColours.begin();
-
-	// Loop through vertices, add each component present to the raw output stream
-	TUInt8* pVertexData = pOutSubMesh->vertices;
-	while (itVertex != itVertexEnd)
+	else
 	{
-		*reinterpret_cast<CVector3*>(pVertexData) = *itVertex++;
-		pVertexData += sizeof(CVector3);
-		if (pOutSubMesh->hasSkinningData)
-		{
-			// Initialise vertex with no influencing bones
-			*reinterpret_cast<TFloat32*>(pVertexData) = 0.0f;
-			pVertexData += sizeof(TFloat32);
-			*reinterpret_cast<TFloat32*>(pVertexData) = 0.0f;
-			pVertexData += sizeof(TFloat32);
-			*reinterpret_cast<TFloat32*>(pVertexData) = 0.0f;
-			pVertexData += sizeof(TFloat32);
-			*reinterpret_cast<TFloat32*>(pVertexData) = 0.0f;
-			pVertexData += sizeof(TFloat32);
-			*reinterpret_cast<TUInt32*>(pVertexData) = 0;
-			pVertexData += sizeof(TUInt32);
-		}
-		if (pOutSubMesh->hasNormals)
-		{
-			*reinterpret_cast<CVector3*>(pVertexData) = *itNormal++;
-			pVertexData += sizeof(CVector3);
-		}
-		if (pOutSubMesh->hasTangents)
+		pOutSubMesh->numLODs = static_cast<TUInt32>(mesh.lods.size());
+		for (TUInt32 iLOD = 0; iLOD < pOutSubMesh->numLODs; ++iLOD)
 		{
-			*reinterpret_cast<CVector3*>(pVertexData) = *itTangent++;
-			pVertexData += sizeof(CVector3);
-		}
-		if (pOutSubMesh->hasTextureCoords)
-		{
-			*reinterpret_cast<SXFileUV*>(pVertexData) = *itTextureCooord++;
-			pVertexData += sizeof(SXFileUV);
-		}
-		if (pOutSubMesh->hasVertexColours)
-		{
-			*reinterpret_cast<SXFileRGBAColour*>(pVertexData) = *itVertexColour++;
-			pVertexData += sizeof(SXFileRGBAColour);
+			pOutSubMesh->lods[iLOD].firstFace = mesh.lods[iLOD].iFirstFace;
+			pOutSubMesh->lods[iLOD].numFaces = mesh.lods[iLOD].iNumFaces;
+			pOutSubMesh->lods[iLOD].numVertices = mesh.lods[iLOD].iNumVertices;
+			pOutSubMesh->lods[iLOD].error = mesh.lods[iLOD].fError;
 		}
 	}
+	pOutSubMesh->numMeshlets = static_cast<TUInt32>(mesh.meshlets.size());
+	pOutSubMesh->numPaletteBones = static_cast<TUInt32>(mesh.palette.size());
+	pOutSubMesh->bounds = mesh.bounds;
 
-	// Calculate bone influences if necessary
-	if (pOutSubMesh->hasSkinningData)
-	{
-		// Offsets to bone data in a vertex (data is immediately after vertex coord)
-		TUInt32 boneWeightsOffset = sizeof(CVector3);
-		int boneIndicesOffset = boneWeightsOffset + 4 * sizeof(TFloat32);
+	GEN_ENDGUARD;
+}
 
-		// For each bone...
-		TXFileBones::const_iterator itBone = m_Meshes[iSubMesh].bones.begin();
-		TXFileBones::const_iterator itBoneEnd = m_Meshes[iSubMesh].bones.end();
-		while (itBone != itBoneEnd)
-		{
-			// For each bone weight (influence)...
-			TXFileBoneWeights::const_iterator itBoneWeight = itBone->weights.begin();
-			TXFileBoneWeights::const_iterator itBoneWeightEnd = itBone->weights.end();
-			while (itBoneWeight != itBoneWeightEnd)
-			{
-				// Find affected vertex data - weights and bone indexes
-				TUInt8* pVert = pOutSubMesh->vertices + 
-					itBoneWeight->iVertexIndex * pOutSubMesh->vertexSize;
-				TFloat32* pVertBoneWeights = reinterpret_cast<TFloat32*>(pVert + boneWeightsOffset);
-				TUInt8* pVertBoneIndices = reinterpret_cast<TUInt8*>(pVert + boneIndicesOffset);
-
-				// Add influence of this bone to the vertex data
-				AddBoneInfluence( itBone->iFrame, itBoneWeight->fWeight,
-				                  pVertBoneWeights, pVertBoneIndices );
-				++itBoneWeight;
-			}
-			++itBone;
-		}
 
-		// Normalise vertex bone weights (ensure they add up to 1)
-		TUInt8* pVert = pOutSubMesh->vertices;
-		for (TUInt32 vert = 0; vert < pOutSubMesh->vertexSize; ++vert)
-		{
-			TFloat32* pVertBoneWeights = reinterpret_cast<TFloat32*>(pVert + boneWeightsOffset);
-			TUInt8* pVertBoneIndices = reinterpret_cast<TUInt8*>(pVert + boneIndicesOffset);
+// Write the vertex and face data for given sub-mesh into caller-provided memory, e.g. locked
+// vertex and index buffers, with no intermediate copy. The sub-mesh must have been prepared by
+// GetSubMeshSpec. The vertex memory must hold numVertices * vertexSize bytes and the face
+// memory numFaces * 3 * indexSize bytes. The sub-mesh's data pointers are set to the memory
+// Possible return values:
+//		kSuccess:			...
+//		kOutOfSystemMemory:	...
+EImportError CImportXFile::GetSubMeshData
+(
+	const TUInt32 iSubMesh,
+	SSubMesh*     pSubMesh,
+	TUInt8*       pVertices,
+	TUInt8*       pFaces
+)
+{
+	GEN_GUARD;
 
-			TFloat32 sum = pVertBoneWeights[0] + pVertBoneWeights[1] +
-			               pVertBoneWeights[2] + pVertBoneWeights[3];
-			if (sum == 0.0f)
-			{
-				// Vertex with no weights - reference root bone only (model is probably not skinned)
-				pVertBoneWeights[0] = 1.0f;
-				pVertBoneIndices[0] = pOutSubMesh->node;
-			}
-			else
-			{
-				pVertBoneWeights[0] /= sum;
-				pVertBoneWeights[1] /= sum;
-				pVertBoneWeights[2] /= sum;
-				pVertBoneWeights[3] /= sum;
-			}
-			pVert += pOutSubMesh->vertexSize;
-		}
+	CStageTimer stage( &m_Report.aStages[kStageGetSubMesh], &m_pCurrentStage );
+
+	// Unclutter code with a reference to the mesh 
+	const SXFileMesh& mesh = m_Meshes[iSubMesh];
+	GEN_ASSERT( pSubMesh->numVertices == mesh.vertices.size() &&
+	            pSubMesh->numFaces == mesh.faces.size(), "Sub-mesh specification mismatch" );
+	stage.AddBytes( static_cast<TUInt64>(pSubMesh->numVertices) * pSubMesh->vertexSize +
+	                static_cast<TUInt64>(pSubMesh->numFaces) * 3 * pSubMesh->indexSize );
+
+	pSubMesh->vertices = pVertices;
+	pSubMesh->faces = pFaces;
+
+	// Calculate tangents if required
+	TXFileVectors tangents;
+	if (pSubMesh->hasTangents)
+	{
+		CalculateTangents( iSubMesh, &tangents );
 	}
 
-	// Pre-size face array
-	pOutSubMesh->numFaces = static_cast<TUInt32>(m_Meshes[iSubMesh].faces.size());
-	pOutSubMesh->faces = new SMeshFace[pOutSubMesh->numFaces];
+	// Write vertex data
+	if (pSubMesh->vertexLayout == InterleavedVertices)
+	{
+		// Table of vertex writers, one instantiation for each set of vertex components
+		#define GEN_VERTEX_WRITERS_4( iFirst ) \
+			&WriteInterleavedVertices<iFirst>,     &WriteInterleavedVertices<iFirst + 1>, \
+			&WriteInterleavedVertices<iFirst + 2>, &WriteInterleavedVertices<iFirst + 3>
+		typedef void (*TVertexWriter)( const SXFileMesh&, const TXFileVectors&, TUInt8* );
+		static const TVertexWriter kaVertexWriters[kNumComponentSets] =
+		{
+			GEN_VERTEX_WRITERS_4( 0 ),  GEN_VERTEX_WRITERS_4( 4 ),
+			GEN_VERTEX_WRITERS_4( 8 ),  GEN_VERTEX_WRITERS_4( 12 ),
+			GEN_VERTEX_WRITERS_4( 16 ), GEN_VERTEX_WRITERS_4( 20 ),
+			GEN_VERTEX_WRITERS_4( 24 ), GEN_VERTEX_WRITERS_4( 28 ),
+		};
+		#undef GEN_VERTEX_WRITERS_4
+
+		TUInt32 iComponents = (pSubMesh->hasSkinningData ? kSkinningComponent : 0) |
+		                      (pSubMesh->hasNormals ? kNormalComponent : 0) |
+		                      (pSubMesh->hasTangents ? kTangentComponent : 0) |
+		                      (pSubMesh->hasTextureCoords ? kTextureCoordComponent : 0) |
+		                      (pSubMesh->hasVertexColours ? kVertexColourComponent : 0);
+		kaVertexWriters[iComponents]( mesh, tangents, pVertices );
+	}
+	else
+	{
+		WriteVertexStreams( mesh, tangents, *pSubMesh, pVertices );
+	}
 
-	// Get material from material map (all faces in sub-mesh have the same material at this point)
-	pOutSubMesh->material = m_Meshes[iSubMesh].materialMap.front();
+	// Write bone influences if necessary
+	if (pSubMesh->hasSkinningData)
+	{
+		WriteBoneInfluences( mesh, *pSubMesh, pVertices );
+	}
 
-	// Loop through faces outputing to given sub-mesh
-	TXFileFaces::const_iterator itFace = m_Meshes[iSubMesh].faces.begin();
-	TXFileFaces::const_iterator itFaceEnd = m_Meshes[iSubMesh].faces.end();
-	for (TUInt32 iFace = 0; iFace < pOutSubMesh->numFaces; ++iFace)
+	// Loop through faces outputing to given sub-mesh, narrowing to 16-bit indices if possible
+	if (pSubMesh->indexSize == sizeof(TUInt16))
+	{
+		SMeshFace* pFace = reinterpret_cast<SMeshFace*>(pFaces);
+		TXFileFaces::const_iterator itFace = mesh.faces.begin();
+		for (TUInt32 iFace = 0; iFace < pSubMesh->numFaces; ++iFace)
+		{
+			pFace[iFace].aiVertex[0] = static_cast<TUInt16>(itFace->aiVertex[0]);
+			pFace[iFace].aiVertex[1] = static_cast<TUInt16>(itFace->aiVertex[1]);
+			pFace[iFace].aiVertex[2] = static_cast<TUInt16>(itFace->aiVertex[2]);
+			++itFace;
+		}
+	}
+	else if (pSubMesh->numFaces > 0)
 	{
-		pOutSubMesh->faces[iFace].aiVertex[0] = itFace->aiVertex[0];
-		pOutSubMesh->faces[iFace].aiVertex[1] = itFace->aiVertex[1];
-		pOutSubMesh->faces[iFace].aiVertex[2] = itFace->aiVertex[2];
-		++itFace;
+		memcpy( pFaces, &mesh.faces[0], pSubMesh->numFaces * sizeof(SMeshFace32) );
 	}
 
 	return kSuccess;
@@ -341,6 +538,41 @@ EImportError CImportXFile::GetSubMesh
 }
 
 
+// Copy the meshlets for given sub-mesh into caller-provided memory, which must hold the number
+// of meshlets given by GetSubMeshSpec
+void CImportXFile::GetSubMeshMeshlets
+(
+	const TUInt32 iSubMesh,
+	SMeshlet*     pMeshlets
+) const
+{
+	GEN_GUARD;
+
+	const vector<SMeshlet>& meshlets = m_Meshes[iSubMesh].meshlets;
+	copy( meshlets.begin(), meshlets.end(), pMeshlets );
+
+	GEN_ENDGUARD;
+}
+
+
+// Copy the bone palette for given sub-mesh into caller-provided memory, which must hold the
+// number of palette bones given by GetSubMeshSpec. Each entry is the node driving the bone with
+// that index in the vertex data
+void CImportXFile::GetSubMeshPalette
+(
+	const TUInt32 iSubMesh,
+	TUInt32*      pNodes
+) const
+{
+	GEN_GUARD;
+
+	const TXFileInts& palette = m_Meshes[iSubMesh].palette;
+	copy( palette.begin(), palette.end(), pNodes );
+
+	GEN_ENDGUARD;
+}
+
+
 // Get the render method used for the given material, optionaly return the number of textures
 // used by the method. The render method of a material specifies how to draw geometry with this
 // material. Can use the X-file material or texture names to select the appropriate method,
@@ -351,11 +583,12 @@ ERenderMethod CImportXFile::GetMaterialRenderMethod
 	TUInt32*      pNumTextures /*= 0*/
 ) const
 {
-	// Set up default rendering method - taking note of whether a texture is present
-	if (m_Materials[iMaterial].sTextureName == "")
+	// Set up default rendering method - taking note of whether a texture is present. Whether the
+	// name contains "Plain" was noted when the material was read
+	if (m_Materials[iMaterial].iTextureName == kiEmptyString)
 	{
 		if (pNumTextures) *pNumTextures = 0;
-		if (m_Materials[iMaterial].sName.find( "Plain" ) != string::npos )
+		if (m_Materials[iMaterial].bPlain)
 		{
 			return PlainColour;
 		}
@@ -367,7 +600,7 @@ ERenderMethod CImportXFile::GetMaterialRenderMethod
 	else
 	{
 		if (pNumTextures) *pNumTextures = 1;
-		if (m_Materials[iMaterial].sName.find( "Plain" ) != string::npos )
+		if (m_Materials[iMaterial].bPlain)
 		{
 			return PlainTexture;
 		}
@@ -406,31 +639,19 @@ void CImportXFile::GetMaterial
 	pOutMaterial->specularColour.a = 1.0f;
 	pOutMaterial->specularPower = xFileMaterial.fSpecularPower;
 
-	// Set one texture if texture name is present
-	if (xFileMaterial.sTextureName == "")
-	{
-		pOutMaterial->numTextures = 0;
-	}
-	else
-	{
-		pOutMaterial->numTextures = 1;
-		pOutMaterial->textureFileNames[0] = xFileMaterial.sTextureName;
-	}
+	// Textures used by the render method, named when the global material list was made
 	pOutMaterial->renderMethod = GetMaterialRenderMethod( iMaterial, &pOutMaterial->numTextures );
-	if (pOutMaterial->numTextures > 0)
+	for (TUInt32 iTexture = 0; iTexture < pOutMaterial->numTextures; ++iTexture)
 	{
-		pOutMaterial->textureFileNames[0] = xFileMaterial.sTextureName;
-		for (TUInt32 iExtraTex = 1; iExtraTex < pOutMaterial->numTextures; ++iExtraTex)
-		{
-			pOutMaterial->textureFileNames[iExtraTex] = 
-				char('0' + iExtraTex) + xFileMaterial.sTextureName;
-		}
+		pOutMaterial->textureFileNames[iTexture] = xFileMaterial.aiTextureNames[iTexture];
 	}
 
 	GEN_ENDGUARD;
 }
 
 
+#if defined(GEN_DIRECTX)
+
 /*-----------------------------------------------------------------------------------------
 	X-File API support
 -----------------------------------------------------------------------------------------*/
@@ -572,7 +793,7 @@ EImportError CImportXFile::ParseXFile
 	m_Frames.push_back( SXFileFrame() );
 
 	// Set root frame values
-	m_Frames[0].sName = "Root";
+	m_Frames[0].iName = m_Names.Intern( "Root" );
 	m_Frames[0].iDepth = 0;
 	m_Frames[0].iParentIndex = 0;
 	m_Frames[0].iNumChildren = 0;
@@ -631,6 +852,20 @@ EImportError CImportXFile::ParseXFile
 		}
 	}		
 
+	// Meshes have not been read if only hashing
+	if (m_Options.bHashOnly)
+	{
+		return kSuccess;
+	}
+
+	// If streaming, the other meshes have already been passed on, so just process those held back
+	// for their bone frames, which are now all read
+	if (m_Options.pfnSubMeshCallback)
+	{
+		m_Meshes.swap( m_HeldMeshes );
+		return StreamMeshes( true );
+	}
+
 	// Make a single global material list for all meshes
 	MakeGlobalMaterialList();
 	
@@ -665,7 +900,7 @@ EImportError CImportXFile::ParseXFileFrame
 	m_Frames.push_back( SXFileFrame() );
 
 	// Get name for frame
-	EImportError eError = GetXFileDataName( pXFileData, m_Frames[iCurrFrame].sName );
+	EImportError eError = GetXFileDataName( pXFileData, &m_Frames[iCurrFrame].iName );
 	if (eError != kSuccess)
 	{
 		return eError;
@@ -749,14 +984,24 @@ EImportError CImportXFile::ParseXFileMesh
 	TUInt32 iCurrMesh = static_cast<TUInt32>(m_Meshes.size());
 	m_Meshes.push_back( SXFileMesh() );
 
-	// Set owner frame
+	// Set owner frame and index in the file
 	m_Meshes[iCurrMesh].iParentFrame = iCurrFrame;
+	m_Meshes[iCurrMesh].iSourceMesh = m_iNumSourceMeshes++;
 	m_Meshes[iCurrMesh].iNumUniqueVertices = 0;
 	m_Meshes[iCurrMesh].iMaxBonesPerVertex = 0;
 	m_Meshes[iCurrMesh].iMaxBonesPerFace = 0;
 
+	// Hash the mesh data and its child objects so unchanged meshes can be identified when the file
+	// is re-imported. Nothing more to do if only hashing
+	m_Meshes[iCurrMesh].iSourceHash = kiHashSeed;
+	EImportError eError = HashXFileData( pXFileData, &m_Meshes[iCurrMesh].iSourceHash );
+	if (eError != kSuccess || m_Options.bHashOnly)
+	{
+		return eError;
+	}
+
 	// Read vertices and faces for the mesh
-	EImportError eError = ReadMeshData( pXFileData, iCurrMesh );
+	eError = ReadMeshData( pXFileData, iCurrMesh );
 	if (eError != kSuccess)
 	{
 		return eError;
@@ -858,12 +1103,46 @@ EImportError CImportXFile::ParseXFileMesh
 	// Match the face lists of vertices and normals, so there is exactly one normal per vertex
 	MatchFaceLists( iCurrMesh );
 
+	return CompleteMesh( iCurrMesh );
+
+	GEN_ENDGUARD;
+}
+
+#endif // GEN_DIRECTX
+
+
+// Weld the vertices of the mesh just read if required, and pass it on if streaming
+// Possible return values:
+//		kInvalidData:		Could not find a frame matching one of the bones (when streaming)
+EImportError CImportXFile::CompleteMesh
+(
+	const TUInt32 iMesh
+)
+{
+	GEN_GUARD;
+
+	// Optionally weld the vertices that are left identical by reading
+	if (m_Options.bWeldVertices)
+	{
+		m_Report.iVerticesBeforeWeld += static_cast<TUInt32>(m_Meshes[iMesh].vertices.size());
+		WeldVertices( iMesh, m_Options.fWeldEpsilon );
+		m_Report.iVerticesAfterWeld += static_cast<TUInt32>(m_Meshes[iMesh].vertices.size());
+	}
+
+	// If streaming, process the mesh and pass it on now. It is the only mesh in the list
+	if (m_Options.pfnSubMeshCallback)
+	{
+		return StreamMeshes( false );
+	}
+
 	return kSuccess;
 
 	GEN_ENDGUARD;
 }
 
 
+#if defined(GEN_DIRECTX)
+
 /*-----------------------------------------------------------------------------------------
 	X-File template parsing
 -----------------------------------------------------------------------------------------*/
@@ -877,6 +1156,8 @@ EImportError CImportXFile::ReadMeshData
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageReadMesh], &m_pCurrentStage );
+
 	// Lock mesh data pointer
 	TUInt32 iMeshDataSize = 0;
 	const TUInt8* pMeshDataStart;
@@ -946,6 +1227,8 @@ EImportError CImportXFile::ReadNormalData
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageReadNormals], &m_pCurrentStage );
+
 	// Only allow one vertex normal list in a mesh
 	if (m_Meshes[iMesh].normals.size() > 0)
 	{
@@ -1023,6 +1306,8 @@ EImportError CImportXFile::ReadTextureUVData
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageReadOtherData], &m_pCurrentStage );
+
 	// Only allow one texture coordinate list in a mesh
 	if (m_Meshes[iMesh].textureCoords.size() > 0)
 	{
@@ -1069,6 +1354,8 @@ EImportError CImportXFile::ReadVertexColourData
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageReadOtherData], &m_pCurrentStage );
+
 	// Only allow one vertex colour list in a mesh
 	if (m_Meshes[iMesh].vertexColours.size() > 0)
 	{
@@ -1116,6 +1403,8 @@ EImportError CImportXFile::ReadMaterialData
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageReadOtherData], &m_pCurrentStage );
+
 	// Only allow one material list in a mesh
 	if (m_Meshes[iMesh].materials.size() > 0)
 	{
@@ -1137,11 +1426,12 @@ EImportError CImportXFile::ReadMaterialData
 	{
 		SXFileMaterial material = 
 		{
-			"",
+			kiEmptyString,
 			{ 1.0f, 1.0f, 1.0f, 1.0f },
 			20.0f, { 0.0f, 0.0f, 0.0f },
 			{ 0.0f, 0.0f, 0.0f },
-			""
+			kiEmptyString,
+			false
 		};
 		m_Meshes[iMesh].materials.push_back( material );
 	}
@@ -1221,14 +1511,17 @@ EImportError CImportXFile::ReadMaterialData
 				return kInvalidData;
 			}
 
-			// Read material name
-			EImportError eError =
-				GetXFileDataName( pMatListChildData, m_Meshes[iMesh].materials[iMaterialsRead].sName );
+			// Read material name, noting if it selects a plain render method so the name need not
+			// be searched again (see GetMaterialRenderMethod)
+			SXFileMaterial& material = m_Meshes[iMesh].materials[iMaterialsRead];
+			EImportError eError = GetXFileDataName( pMatListChildData, &material.iName );
 			if (eError != kSuccess)
 			{
 				pMatListChildData->Release();
 				return kInvalidData;
 			}
+			material.bPlain = (strstr( m_Names.GetString( material.iName ), "Plain" ) != 0);
+			material.iTextureName = kiEmptyString;
 
 			// Get material data (11 floats in material template up to optional data)
 			// Fills in all of SXFileMaterial between name & texture name TODO a bit dodgy
@@ -1272,8 +1565,8 @@ EImportError CImportXFile::ReadMaterialData
 						pMatListChildData->Release();
 						return kInvalidData;
 					}
-					m_Meshes[iMesh].materials[iMaterialsRead].sTextureName = 
-						reinterpret_cast<const char*>(pFileNameData);
+					m_Meshes[iMesh].materials[iMaterialsRead].iTextureName = 
+						m_Names.Intern( reinterpret_cast<const char*>(pFileNameData) );
 					pMatChildData->Unlock();
 				}
 
@@ -1321,6 +1614,8 @@ EImportError CImportXFile::ReadDuplicationData
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageReadOtherData], &m_pCurrentStage );
+
 	// Only allow one vertex duplication list in a mesh
 	if (m_Meshes[iMesh].duplicateIndices.size() > 0)
 	{
@@ -1368,6 +1663,8 @@ EImportError CImportXFile::ReadAdjacencyData
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageReadOtherData], &m_pCurrentStage );
+
 	// Only allow one face adjacency list in a mesh
 	if (m_Meshes[iMesh].adjacencyIndices.size() > 0)
 	{
@@ -1408,6 +1705,8 @@ EImportError CImportXFile::ReadSkinDefnData
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageReadOtherData], &m_pCurrentStage );
+
 	// Only allow one skining definition in a mesh
 	if (m_Meshes[iMesh].bones.size() > 0)
 	{
@@ -1455,6 +1754,8 @@ EImportError CImportXFile::ReadSkinWeightsData
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageReadOtherData], &m_pCurrentStage );
+
 	// Check if no skinning definition or too many bones
 	if (m_Meshes[iMesh].bones.size() == 0 || iBone >= m_Meshes[iMesh].bones.size())
 	{
@@ -1470,8 +1771,9 @@ EImportError CImportXFile::ReadSkinWeightsData
 	}
 
 	// Read name of bone
-	m_Meshes[iMesh].bones[iBone].sFrameName = reinterpret_cast<const char*>(pSkinWeightData);
-	pSkinWeightData += m_Meshes[iMesh].bones[iBone].sFrameName.length() + 1;
+	TUInt32 iFrameName = m_Names.Intern( reinterpret_cast<const char*>(pSkinWeightData) );
+	m_Meshes[iMesh].bones[iBone].iFrameName = iFrameName;
+	pSkinWeightData += m_Names.GetLength( iFrameName ) + 1;
 
 	// Read number of weights
 	TUInt32 iNumWeights;
@@ -1601,7 +1903,7 @@ EImportError CImportXFile::GetXFileChild
 EImportError CImportXFile::GetXFileDataName
 (
 	ID3DXFileData* pXFileData,
-	string&        sName
+	TUInt32*       piName
 )
 {
 	GEN_GUARD;
@@ -1610,7 +1912,7 @@ EImportError CImportXFile::GetXFileDataName
 	HRESULT xFileError = pXFileData->GetName( NULL, &iDataSize );
 	if (!iDataSize)
 	{
-		sName = "";
+		*piName = kiEmptyString;
 	}
 	else
 	{
@@ -1621,7 +1923,7 @@ EImportError CImportXFile::GetXFileDataName
 		}
 		xFileError = pXFileData->GetName( szName, &iDataSize );
 		GEN_ASSERT( xFileError == S_OK, "Failure getting X-File name" );
-		sName = szName;
+		*piName = m_Names.Intern( szName );
 		delete[] szName;
 	}
 
@@ -1631,6 +1933,58 @@ EImportError CImportXFile::GetXFileDataName
 }
 
 
+// Hash the data of an X-file object and all of its child objects, chaining from the given hash
+EImportError CImportXFile::HashXFileData
+(
+	ID3DXFileData* pXFileData,
+	TUInt32*       piHash
+)
+{
+	GEN_GUARD;
+
+	// Hash the object's own data, including its size so data cannot shift between objects unseen
+	const TUInt8* pData;
+	TUInt32 iSize = 0;
+	EImportError eError = LockXFileData( pXFileData, &pData, &iSize );
+	if (eError != kSuccess)
+	{
+		return eError;
+	}
+	*piHash = HashData( &iSize, sizeof(iSize), *piHash );
+	*piHash = HashData( pData, iSize, *piHash );
+	UnlockXFileData( pXFileData );
+
+	// Hash the type and data of each child object
+	TUInt32 iNumChildren;
+	eError = GetXFileNumChildren( pXFileData, &iNumChildren );
+	if (eError != kSuccess)
+	{
+		return eError;
+	}
+	for (TUInt32 iChild = 0; iChild < iNumChildren; ++iChild)
+	{
+		ID3DXFileData* pChildData;
+		GUID childGUID;
+		eError = GetXFileChild( pXFileData, iChild, &pChildData, &childGUID );
+		if (eError != kSuccess)
+		{
+			return eError;
+		}
+		*piHash = HashData( &childGUID, sizeof(childGUID), *piHash );
+		eError = HashXFileData( pChildData, piHash );
+		pChildData->Release();
+		if (eError != kSuccess)
+		{
+			return eError;
+		}
+	}
+
+	return kSuccess;
+
+	GEN_ENDGUARD;
+}
+
+
 EImportError CImportXFile::LockXFileData
 (
 	ID3DXFileData* pXFileData,
@@ -1644,6 +1998,10 @@ EImportError CImportXFile::LockXFileData
 	HRESULT xFileError = 
 		pXFileData->Lock( &iActualSize, reinterpret_cast<const void**>(ppLockData) );
 	GEN_ASSERT( xFileError == S_OK, "Unexpected failure in Lock" );
+	if (m_pCurrentStage)
+	{
+		m_pCurrentStage->AddBytes( iActualSize );
+	}
 	if (pSize)
 	{
 		if (*pSize != 0 && *pSize != iActualSize)
@@ -1739,6 +2097,9 @@ void CImportXFile::ReadXFileLockedUInt16
 }
 
 
+#endif // GEN_DIRECTX
+
+
 /*-----------------------------------------------------------------------------------------
 	X-file type support
 -----------------------------------------------------------------------------------------*/
@@ -1761,10 +2122,41 @@ bool operator==
 	       cmp1.emmisiveColour.fRed == cmp2.emmisiveColour.fRed &&
 	       cmp1.emmisiveColour.fGreen == cmp2.emmisiveColour.fGreen &&
 	       cmp1.emmisiveColour.fBlue == cmp2.emmisiveColour.fBlue &&
-		   cmp1.sTextureName == cmp2.sTextureName;
+		   cmp1.iTextureName == cmp2.iTextureName;
 }
 
-
+// Hash of the contents of a material - materials that compare equal have equal hashes. Used to
+// index material lists without comparing every pair of materials
+TUInt32 CImportXFile::HashMaterial
+(
+	const SXFileMaterial& material
+)
+{
+	// Hash the same values that are compared by the equality operator above (not the name)
+	TFloat32 afValues[11] = 
+	{
+		material.faceColour.fRed, material.faceColour.fGreen,
+		material.faceColour.fBlue, material.faceColour.fAlpha,
+		material.fSpecularPower,
+		material.specularColour.fRed, material.specularColour.fGreen, material.specularColour.fBlue,
+		material.emmisiveColour.fRed, material.emmisiveColour.fGreen, material.emmisiveColour.fBlue
+	};
+
+	// -0 and +0 compare equal so must hash equally
+	for (TUInt32 iValue = 0; iValue < 11; ++iValue)
+	{
+		if (afValues[iValue] == 0.0f)
+		{
+			afValues[iValue] = 0.0f;
+		}
+	}
+
+	// The texture name is an ID, equal names have equal IDs
+	TUInt32 iHash = HashData( afValues, sizeof(afValues) );
+	return HashData( &material.iTextureName, sizeof(material.iTextureName), iHash );
+}
+
+
 /*-----------------------------------------------------------------------------------------
 	Geometry processing
 -----------------------------------------------------------------------------------------*/
@@ -1778,6 +2170,9 @@ void CImportXFile::MatchFaceLists
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageMatchFaceLists], &m_pCurrentStage );
+	stage.AddBytes( m_Meshes[iMesh].faces.size() * sizeof(SXFileFace) );
+
 	// Unclutter code with a reference to the mesh 
 	SXFileMesh& mesh = m_Meshes[iMesh];
 
@@ -1789,11 +2184,11 @@ void CImportXFile::MatchFaceLists
 		                                   mesh.origFaceEdges.end(), 0 );
 
 		// Create empty vertex and normal maps - use max vertex value as unused marker
-		TXFileInts vertexMap( iMaxVertices, iMaxVertices );
-		TXFileInts normalMap( iMaxVertices, iMaxVertices );
+		TXFileTempInts vertexMap( iMaxVertices, iMaxVertices, m_Arena );
+		TXFileTempInts normalMap( iMaxVertices, iMaxVertices, m_Arena );
 
 		// Table of vertex duplicates created by this process, each entry is next copy of vertex
-		TXFileInts vertexDup( iMaxVertices, iMaxVertices );
+		TXFileTempInts vertexDup( iMaxVertices, iMaxVertices, m_Arena );
 
 		// May need to duplicate vertices, count from original number of vertices
 		TUInt32 iNewNumVertices = static_cast<TUInt32>(mesh.vertices.size()); 
@@ -1872,6 +2267,26 @@ void CImportXFile::MatchFaceLists
 			}
 		}
 
+		// Copy the bone weights of each original vertex to all its duplicates
+		if (iNewNumVertices > iOldNumVertices)
+		{
+			for (TUInt32 iBone = 0; iBone < mesh.bones.size(); ++iBone)
+			{
+				TXFileBoneWeights& weights = mesh.bones[iBone].weights;
+				TUInt32 iNumWeights = static_cast<TUInt32>(weights.size());
+				for (TUInt32 iWeight = 0; iWeight < iNumWeights; ++iWeight)
+				{
+					TUInt32 iVert = vertexDup[weights[iWeight].iVertexIndex];
+					while (iVert != iMaxVertices)
+					{
+						SXFileBoneWeight dupWeight = { iVert, weights[iWeight].fWeight };
+						weights.push_back( dupWeight );
+						iVert = vertexDup[iVert];
+					}
+				}
+			}
+		}
+
 		// Build full updated normal list and replace original normals
 		TXFileVectors newNormals( iNewNumVertices );
 		for (TUInt32 iNormal = 0; iNormal < iNewNumVertices; ++iNormal)
@@ -1888,12 +2303,240 @@ void CImportXFile::MatchFaceLists
 }
 
 
+// Weld vertices with identical attributes (including bone weights), or attributes in the same
+// cell of a grid with the given epsilon spacing, into a single vertex and update the face list to
+// match. Uses a hash table over the vertex attributes so it is linear in the number of vertices.
+// Neighbouring cells are not searched, so the weld does not guarantee that vertices within
+// epsilon of each other are joined
+void CImportXFile::WeldVertices
+(
+	const TUInt32  iMesh,
+	const TFloat32 fEpsilon
+)
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStageWeldVertices], &m_pCurrentStage );
+	stage.AddBytes( m_Meshes[iMesh].faces.size() * sizeof(SXFileFace) );
+
+	// Unclutter code with a reference to the mesh 
+	SXFileMesh& mesh = m_Meshes[iMesh];
+	TUInt32 iNumVertices = static_cast<TUInt32>(mesh.vertices.size());
+	if (iNumVertices < 2)
+	{
+		return;
+	}
+
+	// Build a packed key for each vertex from the attributes present (colours are only present
+	// if there is one per vertex). Each attribute value takes one or two words (see WeldValue)
+	bool bNormals = (mesh.normals.size() == iNumVertices);
+	bool bUVs = (mesh.textureCoords.size() == iNumVertices);
+	bool bColours = (mesh.vertexColours.size() == iNumVertices);
+	TFloat32 fInvEpsilon = (fEpsilon > 0.0f) ? 1.0f / fEpsilon : 0.0f;
+	TUInt32 iValueWords = (fInvEpsilon > 0.0f) ? 2 : 1;
+	TUInt32 iKeySize =
+		(3 + (bNormals ? 3 : 0) + (bUVs ? 2 : 0) + (bColours ? 4 : 0)) * iValueWords;
+	TXFileTempInts keys( iNumVertices * iKeySize, 0, m_Arena );
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		TUInt32* piKey = &keys[iVertex * iKeySize];
+		piKey = WeldValue( mesh.vertices[iVertex].x, fInvEpsilon, piKey );
+		piKey = WeldValue( mesh.vertices[iVertex].y, fInvEpsilon, piKey );
+		piKey = WeldValue( mesh.vertices[iVertex].z, fInvEpsilon, piKey );
+		if (bNormals)
+		{
+			piKey = WeldValue( mesh.normals[iVertex].x, fInvEpsilon, piKey );
+			piKey = WeldValue( mesh.normals[iVertex].y, fInvEpsilon, piKey );
+			piKey = WeldValue( mesh.normals[iVertex].z, fInvEpsilon, piKey );
+		}
+		if (bUVs)
+		{
+			piKey = WeldValue( mesh.textureCoords[iVertex].fU, fInvEpsilon, piKey );
+			piKey = WeldValue( mesh.textureCoords[iVertex].fV, fInvEpsilon, piKey );
+		}
+		if (bColours)
+		{
+			piKey = WeldValue( mesh.vertexColours[iVertex].fRed, fInvEpsilon, piKey );
+			piKey = WeldValue( mesh.vertexColours[iVertex].fGreen, fInvEpsilon, piKey );
+			piKey = WeldValue( mesh.vertexColours[iVertex].fBlue, fInvEpsilon, piKey );
+			piKey = WeldValue( mesh.vertexColours[iVertex].fAlpha, fInvEpsilon, piKey );
+		}
+	}
+
+	// Gather the bone influences of each vertex into a contiguous list of (bone, weight) pairs
+	// for each vertex, ordered by bone. These are compared in the same way as the other attributes
+	const TUInt32 iInfluenceWords = 1 + iValueWords;
+	TXFileTempInts influenceStart( iNumVertices + 1, 0, m_Arena );
+	for (TUInt32 iBone = 0; iBone < mesh.bones.size(); ++iBone)
+	{
+		const TXFileBoneWeights& weights = mesh.bones[iBone].weights;
+		for (TUInt32 iWeight = 0; iWeight < weights.size(); ++iWeight)
+		{
+			influenceStart[weights[iWeight].iVertexIndex + 1] += iInfluenceWords;
+		}
+	}
+	partial_sum( influenceStart.begin(), influenceStart.end(), influenceStart.begin() );
+	TXFileTempInts influences( influenceStart[iNumVertices], 0, m_Arena );
+	TXFileTempInts influencePos( influenceStart.begin(), influenceStart.end() - 1, m_Arena );
+	for (TUInt32 iBone = 0; iBone < mesh.bones.size(); ++iBone)
+	{
+		const TXFileBoneWeights& weights = mesh.bones[iBone].weights;
+		for (TUInt32 iWeight = 0; iWeight < weights.size(); ++iWeight)
+		{
+			TUInt32& iPos = influencePos[weights[iWeight].iVertexIndex];
+			influences[iPos] = iBone;
+			WeldValue( weights[iWeight].fWeight, fInvEpsilon, &influences[iPos + 1] );
+			iPos += iInfluenceWords;
+		}
+	}
+
+	// Hash each vertex's key and influences
+	TXFileTempInts hashes( iNumVertices, 0, m_Arena );
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		TUInt32 iHash = HashData( &keys[iVertex * iKeySize], iKeySize * sizeof(TUInt32) );
+		TUInt32 iNumInfluences = influenceStart[iVertex + 1] - influenceStart[iVertex];
+		if (iNumInfluences > 0)
+		{
+			iHash = HashData( &influences[influenceStart[iVertex]],
+			                  iNumInfluences * sizeof(TUInt32), iHash );
+		}
+		hashes[iVertex] = iHash;
+	}
+
+	// Find the first vertex with the same attributes as each vertex using an open addressing
+	// hash table of vertex indices (linear probing), at most half full
+	TUInt32 iTableSize = 1;
+	while (iTableSize < iNumVertices * 2)
+	{
+		iTableSize <<= 1;
+	}
+	const TUInt32 iEmpty = iNumVertices;
+	TXFileTempInts table( iTableSize, iEmpty, m_Arena );
+	TXFileTempInts weldedVertex( iNumVertices, 0, m_Arena );
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		TUInt32 iInfluences = influenceStart[iVertex];
+		TUInt32 iNumInfluences = influenceStart[iVertex + 1] - iInfluences;
+		TUInt32 iSlot = hashes[iVertex] & (iTableSize - 1);
+		while (true)
+		{
+			TUInt32 iOther = table[iSlot];
+			if (iOther == iEmpty)
+			{
+				table[iSlot] = iVertex;
+				weldedVertex[iVertex] = iVertex;
+				break;
+			}
+
+			TUInt32 iOtherInfluences = influenceStart[iOther];
+			if (hashes[iOther] == hashes[iVertex] &&
+			    influenceStart[iOther + 1] - iOtherInfluences == iNumInfluences &&
+			    equal( &keys[iVertex * iKeySize], &keys[iVertex * iKeySize] + iKeySize,
+			           &keys[iOther * iKeySize] ) &&
+			    equal( influences.begin() + iInfluences,
+			           influences.begin() + iInfluences + iNumInfluences,
+			           influences.begin() + iOtherInfluences ))
+			{
+				weldedVertex[iVertex] = iOther;
+				break;
+			}
+			iSlot = (iSlot + 1) & (iTableSize - 1);
+		}
+	}
+
+	// Number the remaining vertices in their original order. Welded vertices are mapped beyond
+	// the new vertex count so their data is discarded
+	TXFileTempInts vertexRemap( iNumVertices, 0, m_Arena );
+	TUInt32 iNumNewVertices = 0;
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		vertexRemap[iVertex] = (weldedVertex[iVertex] == iVertex) ? iNumNewVertices++ : iEmpty;
+	}
+	if (iNumNewVertices == iNumVertices)
+	{
+		return;
+	}
+
+	// Point faces and duplication indices at the vertices that remain
+	for (TUInt32 iFace = 0; iFace < mesh.faces.size(); ++iFace)
+	{
+		for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
+		{
+			TUInt32& iVertex = mesh.faces[iFace].aiVertex[iIndex];
+			iVertex = vertexRemap[weldedVertex[iVertex]];
+		}
+	}
+	for (TUInt32 iVertex = 0; iVertex < mesh.duplicateIndices.size(); ++iVertex)
+	{
+		mesh.duplicateIndices[iVertex] = weldedVertex[mesh.duplicateIndices[iVertex]];
+	}
+	RemapMeshVertices( &vertexRemap[0], iNumNewVertices, &mesh );
+
+	GEN_ENDGUARD;
+}
+
+// Write the key words representing a vertex attribute for comparison during welding, returning
+// a pointer to the word after them. Without an inverse epsilon this is one word, the float bits
+// (with -0 as +0). With one it is two words, the 64-bit index of the nearest point on a grid of
+// epsilon spacing. This is the grid cell centred on that point, and values compare equal if they
+// fall in the same cell, not if they are within epsilon of each other. The index is 64-bit so
+// large values or small epsilons do not overflow it. Indices are clamped to +/-2^62 (only
+// reached by extreme values, or NaN, which is placed in the lowest cell)
+TUInt32* CImportXFile::WeldValue
+(
+	TFloat32       fValue,
+	const TFloat32 fInvEpsilon,
+	TUInt32*       piKey
+)
+{
+	if (fInvEpsilon > 0.0f)
+	{
+		const TFloat64 kfMaxCell = 4611686018427387904.0; // 2^62
+		TFloat64 fCell = floor( static_cast<TFloat64>(fValue) * fInvEpsilon + 0.5 );
+		if (!(fCell > -kfMaxCell))
+		{
+			fCell = -kfMaxCell;
+		}
+		else if (fCell > kfMaxCell)
+		{
+			fCell = kfMaxCell;
+		}
+		TUInt64 iCell = static_cast<TUInt64>(static_cast<TInt64>(fCell));
+		*piKey++ = static_cast<TUInt32>(iCell);
+		*piKey++ = static_cast<TUInt32>(iCell >> 32);
+		return piKey;
+	}
+
+	// -0 and +0 compare equal so must weld
+	if (fValue == 0.0f)
+	{
+		fValue = 0.0f;
+	}
+	memcpy( piKey, &fValue, sizeof(TUInt32) );
+	return piKey + 1;
+}
+
+
 // Create a global list of materials used by all the meshes - removing any duplicates. Also 
 // create a list for each mesh mapping local material indices to global ones
 void CImportXFile::MakeGlobalMaterialList()
 {
 	GEN_GUARD;
 
+	CStageTimer stage( &m_Report.aStages[kStageMaterialList], &m_pCurrentStage );
+
+	// Index the global list by material hash, so each material is only compared against the
+	// global materials with the same hash rather than the entire list
+	typedef unordered_multimap<TUInt32, TUInt32, hash<TUInt32>, equal_to<TUInt32>,
+	                           CArenaAllocator< pair<const TUInt32, TUInt32> > > TMaterialIndex;
+	TMaterialIndex materialIndex( m_Materials.size() + 1, hash<TUInt32>(), equal_to<TUInt32>(),
+	                              m_Arena );
+	for (TUInt32 iGlobal = 0; iGlobal < m_Materials.size(); ++iGlobal)
+	{
+		materialIndex.insert( make_pair( HashMaterial( m_Materials[iGlobal] ), iGlobal ) );
+	}
+
 	// Process each mesh
 	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
 	{
@@ -1904,22 +2547,35 @@ void CImportXFile::MakeGlobalMaterialList()
 		mesh.materialMap.resize( mesh.materials.size() );
 		for (TUInt32 iMaterial = 0; iMaterial < mesh.materials.size(); ++iMaterial)
 		{
-			// See if this material is already in the global list
-			TXFileMaterials::iterator duplicate = find( m_Materials.begin(), m_Materials.end(), 
-														mesh.materials[iMaterial] );
+			// See if this material is already in the global list - only need to check materials
+			// with the same hash (global materials are unique, so there is at most one match)
+			TUInt32 iHash = HashMaterial( mesh.materials[iMaterial] );
+			pair<TMaterialIndex::iterator, TMaterialIndex::iterator> candidates =
+				materialIndex.equal_range( iHash );
+			TUInt32 iDuplicate = static_cast<TUInt32>(m_Materials.size());
+			for (TMaterialIndex::iterator itCandidate = candidates.first; 
+			     itCandidate != candidates.second; ++itCandidate)
+			{
+				if (m_Materials[itCandidate->second] == mesh.materials[iMaterial])
+				{
+					iDuplicate = itCandidate->second;
+					break;
+				}
+			}
 			
 			// If not found...
-			if (duplicate == m_Materials.end())
+			if (iDuplicate == m_Materials.size())
 			{
 				// ...add new global material...
 				mesh.materialMap[iMaterial] = static_cast<TUInt32>(m_Materials.size());
+				materialIndex.insert( make_pair( iHash, mesh.materialMap[iMaterial] ) );
 				m_Materials.push_back( mesh.materials[iMaterial] );
+				NameMaterialTextures( mesh.materialMap[iMaterial] );
 			}
 			else
 			{
 				// ...otherwise refer to existing material
-				mesh.materialMap[iMaterial] =
-					static_cast<TUInt32>(duplicate - m_Materials.begin());
+				mesh.materialMap[iMaterial] = iDuplicate;
 			}
 		}
 	}
@@ -1927,53 +2583,63 @@ void CImportXFile::MakeGlobalMaterialList()
 	GEN_ENDGUARD;
 }
 
+// Add the names of the textures used by the render method of the given global material to the
+// name table, so GetMaterial can return them without changing the table
+void CImportXFile::NameMaterialTextures
+(
+	const TUInt32 iMaterial
+)
+{
+	SXFileMaterial& material = m_Materials[iMaterial];
+	TUInt32 iNumTextures;
+	GetMaterialRenderMethod( iMaterial, &iNumTextures );
+	for (TUInt32 iTexture = 0; iTexture < kiMaxTextures; ++iTexture)
+	{
+		material.aiTextureNames[iTexture] = kiEmptyString;
+	}
+	if (iNumTextures > 0)
+	{
+		// Extra textures are named by prefixing the texture name with the texture number
+		material.aiTextureNames[0] = material.iTextureName;
+		for (TUInt32 iExtraTex = 1; iExtraTex < iNumTextures; ++iExtraTex)
+		{
+			string sExtraTexture =
+				char('0' + iExtraTex) + string(m_Names.GetString( material.iTextureName ));
+			material.aiTextureNames[iExtraTex] = m_Names.Intern( sExtraTexture );
+		}
+	}
+}
+
 
 /*-----------------------------------------------------------------------------------------
 	Bone support functions
 -----------------------------------------------------------------------------------------*/
 
-// Add new bone weight/index to a vertex - maximum of 4, removes least signficant if necessary
-void CImportXFile::AddBoneInfluence( TUInt32 bone, TFloat32 weight,
-                                     TFloat32* vertWeights, TUInt8* vertBones )
+// Add new bone weight/index to a vertex - maximum of 4, removes least signficant if necessary.
+// The influences are held as a structure of arrays, one array of weights and one of bones for
+// each of the 4 slots. Instantiated for the type of bone index held. Called for every bone weight
+// so not guarded
+template <typename TBoneIndex>
+void CImportXFile::AddBoneInfluence( TUInt32 bone, TFloat32 weight, TUInt32 vertex,
+                                     TFloat32* const weights[4], TBoneIndex* const bones[4] )
 {
-	GEN_GUARD;
-
-	// Store weights (& indices) in decreasing order - find position for new weight
-	if (weight > vertWeights[0])
-	{
-		vertWeights[3] = vertWeights[2];
-		vertWeights[2] = vertWeights[1];
-		vertWeights[1] = vertWeights[0];
-		vertWeights[0] = weight;
-		vertBones[3] = vertBones[2];
-		vertBones[2] = vertBones[1];
-		vertBones[1] = vertBones[0];
-		vertBones[0] = bone;
-	}
-	else if (weight > vertWeights[1])
-	{
-		vertWeights[3]	= vertWeights[2];
-		vertWeights[2]	= vertWeights[1];
-		vertWeights[1] = weight;
-		vertBones[3] = vertBones[2];
-		vertBones[2] = vertBones[1];
-		vertBones[1] = bone;
-	}
-	else if (weight > vertWeights[2])
+	// Most weights are smaller than all 4 already held once a vertex has its main influences
+	if (!(weight > weights[3][vertex]))
 	{
-		vertWeights[3]	= vertWeights[2];
-		vertWeights[2] = weight;
-		vertBones[3] = vertBones[2];
-		vertBones[2] = bone;
+		return;
 	}
-	else if (weight > vertWeights[3])
+
+	// Store weights (& indices) in decreasing order - move smaller weights down to find the
+	// position for the new weight
+	TUInt32 slot = 3;
+	while (slot > 0 && weight > weights[slot - 1][vertex])
 	{
-		vertWeights[3] = weight;
-		vertBones[3] = bone;
+		weights[slot][vertex] = weights[slot - 1][vertex];
+		bones[slot][vertex] = bones[slot - 1][vertex];
+		--slot;
 	}
-	// else weight ignored
-
-	GEN_ENDGUARD;
+	weights[slot][vertex] = weight;
+	bones[slot][vertex] = static_cast<TBoneIndex>(bone);
 }
 
 
@@ -1984,24 +2650,38 @@ EImportError CImportXFile::ProcessBones()
 {
 	GEN_GUARD;
 
-	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	CStageTimer stage( &m_Report.aStages[kStageProcessBones], &m_pCurrentStage );
+
+	// Nothing to do (and no index to build) if no mesh has bones
+	TUInt32 iMesh = 0;
+	while (iMesh < m_Meshes.size() && m_Meshes[iMesh].bones.empty())
+	{
+		++iMesh;
+	}
+	if (iMesh == m_Meshes.size())
+	{
+		return kSuccess;
+	}
+
+	// Index frames by name, built once for all meshes. Names are IDs so the index is a table
+	// from name ID to frame. Where several frames share a name the first one is used
+	TUInt32 iNumFrames = static_cast<TUInt32>(m_Frames.size());
+	TXFileTempInts frameIndex( m_Names.GetNumStrings(), iNumFrames, m_Arena );
+	for (TUInt32 iFrame = iNumFrames; iFrame-- > 0;)
+	{
+		frameIndex[m_Frames[iFrame].iName] = iFrame;
+	}
+
+	for (; iMesh < m_Meshes.size(); ++iMesh)
 	{
 		for (TUInt32 iBone = 0; iBone < m_Meshes[iMesh].bones.size(); ++iBone)
 		{
-			bool bFoundFrame = false;
-			for (TUInt32 iFrame = 0; iFrame < m_Frames.size(); ++iFrame)
-			{
-				if (m_Meshes[iMesh].bones[iBone].sFrameName == m_Frames[iFrame].sName)
-				{
-					m_Meshes[iMesh].bones[iBone].iFrame = iFrame;
-					bFoundFrame = true;
-					break;
-				}
-			}
-			if (!bFoundFrame)
+			TUInt32 iFrame = frameIndex[m_Meshes[iMesh].bones[iBone].iFrameName];
+			if (iFrame == iNumFrames)
 			{
 				return kInvalidData;
 			}
+			m_Meshes[iMesh].bones[iBone].iFrame = iFrame;
 		}
 	}
 
@@ -2012,128 +2692,1618 @@ EImportError CImportXFile::ProcessBones()
 
 
 /*-----------------------------------------------------------------------------------------
-	Mesh processing
+	Sub-mesh output
 -----------------------------------------------------------------------------------------*/
 
-// Split each mesh into a set of meshes - each of which contains only a single material
-void CImportXFile::SplitMeshes()
+// Write interleaved vertex data for a mesh. Instantiated for each set of vertex components so
+// that the vertex layout is fixed at compile time, with no per-vertex branching. Space is left for
+// skinning data, which is written by WriteBoneInfluences
+template <TUInt32 iComponents>
+void CImportXFile::WriteInterleavedVertices
+(
+	const SXFileMesh&    mesh,
+	const TXFileVectors& tangents,
+	TUInt8*              pVertices
+)
 {
-	GEN_GUARD;
-
-	TUInt32 iNumOrigMeshes = static_cast<TUInt32>(m_Meshes.size());
-	for (TUInt32 iMesh = 0; iMesh < iNumOrigMeshes; ++iMesh)
+	const bool bSkinning      = (iComponents & kSkinningComponent) != 0;
+	const bool bNormals       = (iComponents & kNormalComponent) != 0;
+	const bool bTangents      = (iComponents & kTangentComponent) != 0;
+	const bool bTextureCoords = (iComponents & kTextureCoordComponent) != 0;
+	const bool bVertexColours = (iComponents & kVertexColourComponent) != 0;
+
+	// Component offsets and vertex size, all compile-time constants
+	const TUInt32 kiSkinningSize = 4 * sizeof(TFloat32) + sizeof(TUInt32);
+	const TUInt32 kiSkinningOffset = sizeof(CVector3);
+	const TUInt32 kiNormalOffset = kiSkinningOffset + (bSkinning ? kiSkinningSize : 0);
+	const TUInt32 kiTangentOffset = kiNormalOffset + (bNormals ? sizeof(CVector3) : 0);
+	const TUInt32 kiTextureCoordOffset = kiTangentOffset + (bTangents ? sizeof(CVector3) : 0);
+	const TUInt32 kiVertexColourOffset =
+		kiTextureCoordOffset + (bTextureCoords ? sizeof(SXFileUV) : 0);
+	const TUInt32 kiVertexSize =
+		kiVertexColourOffset + (bVertexColours ? sizeof(SXFileRGBAColour) : 0);
+
+	TUInt32 iNumVertices = static_cast<TUInt32>(mesh.vertices.size());
+	if (iNumVertices == 0)
 	{
-		TUInt32 iMaxVertices = static_cast<TUInt32>(m_Meshes[iMesh].vertices.size());
+		return;
+	}
 
-		for (TUInt32 iMaterial = 0; iMaterial < m_Meshes[iMesh].materials.size(); ++iMaterial)
+	// Source data pointers - only used if component present
+	const CVector3* pPosition = &mesh.vertices[0];
+	const CVector3* pNormal = bNormals ? &mesh.normals[0] : 0;
+	const CVector3* pTangent = bTangents ? &tangents[0] : 0;
+	const SXFileUV* pTextureCoord = bTextureCoords ? &mesh.textureCoords[0] : 0;
+	const SXFileRGBAColour* pVertexColour = bVertexColours ? &mesh.vertexColours[0] : 0;
+
+	// Loop through vertices, copy each component present to the raw output stream - constant
+	// sized copies compile to simple moves
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		memcpy( pVertices, pPosition + iVertex, sizeof(CVector3) );
+		if (bNormals)
+		{
+			memcpy( pVertices + kiNormalOffset, pNormal + iVertex, sizeof(CVector3) );
+		}
+		if (bTangents)
+		{
+			memcpy( pVertices + kiTangentOffset, pTangent + iVertex, sizeof(CVector3) );
+		}
+		if (bTextureCoords)
+		{
+			memcpy( pVertices + kiTextureCoordOffset, pTextureCoord + iVertex, sizeof(SXFileUV) );
+		}
+		if (bVertexColours)
 		{
-			SXFileMesh newMesh;
-			newMesh.iParentFrame = m_Meshes[iMesh].iParentFrame;
-			newMesh.materials.push_back( m_Meshes[iMesh].materials[iMaterial] );
-			newMesh.materialMap.push_back( m_Meshes[iMesh].materialMap[iMaterial] );
+			memcpy( pVertices + kiVertexColourOffset, pVertexColour + iVertex,
+			        sizeof(SXFileRGBAColour) );
+		}
+		pVertices += kiVertexSize;
+	}
+}
 
-			TXFileInts vertexMap( iMaxVertices, iMaxVertices );
 
-			for (TUInt32 iFace = 0; iFace < m_Meshes[iMesh].faceMaterials.size(); ++iFace)
-			{
-				if (m_Meshes[iMesh].faceMaterials[iFace] == iMaterial)
-				{
-					newMesh.faceMaterials.push_back( 0 );
-					SXFileFace newFace;
-					for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
-					{
-						TUInt32 iVert = m_Meshes[iMesh].faces[iFace].aiVertex[iIndex];
-						if (vertexMap[iVert] == iMaxVertices)
-						{
-							vertexMap[iVert] = static_cast<TUInt32>(newMesh.vertices.size());
-							newMesh.vertices.push_back( m_Meshes[iMesh].vertices[iVert] );
-							if (m_Meshes[iMesh].normals.size() > 0)
-							{
-								newMesh.normals.push_back( m_Meshes[iMesh].normals[iVert] );
-							}
-							if (m_Meshes[iMesh].textureCoords.size() > 0)
-							{
-								newMesh.textureCoords.push_back( m_Meshes[iMesh].textureCoords[iVert] );
-							}
-							if (m_Meshes[iMesh].vertexColours.size() > 0)
-							{
-								newMesh.vertexColours.push_back( m_Meshes[iMesh].vertexColours[iVert] );
-							}
-						}
-						newFace.aiVertex[iIndex] = vertexMap[iVert];
-					}
-					newMesh.faces.push_back( newFace );
-				}
-			}
-			if (newMesh.vertices.size() > 0)
-			{
-				m_Meshes.push_back( newMesh );
-			}
-		}
+// Write vertex data for a mesh as separate streams, one per component, as described for
+// SSubMesh. Space is left for skinning data, which is written by WriteBoneInfluences
+void CImportXFile::WriteVertexStreams
+(
+	const SXFileMesh&    mesh,
+	const TXFileVectors& tangents,
+	const SSubMesh&      subMesh,
+	TUInt8*              pVertices
+)
+{
+	GEN_GUARD;
+
+	TUInt32 iNumVertices = subMesh.numVertices;
+	if (iNumVertices == 0)
+	{
+		return;
+	}
+
+	// Each stream is a straight copy of the source list
+	memcpy( pVertices, &mesh.vertices[0], iNumVertices * sizeof(CVector3) );
+	pVertices += iNumVertices * sizeof(CVector3);
+	if (subMesh.hasSkinningData)
+	{
+		pVertices += iNumVertices * (4 * sizeof(TFloat32) + sizeof(TUInt32));
+	}
+	if (subMesh.hasNormals)
+	{
+		memcpy( pVertices, &mesh.normals[0], iNumVertices * sizeof(CVector3) );
+		pVertices += iNumVertices * sizeof(CVector3);
+	}
+	if (subMesh.hasTangents)
+	{
+		memcpy( pVertices, &tangents[0], iNumVertices * sizeof(CVector3) );
+		pVertices += iNumVertices * sizeof(CVector3);
+	}
+	if (subMesh.hasTextureCoords)
+	{
+		memcpy( pVertices, &mesh.textureCoords[0], iNumVertices * sizeof(SXFileUV) );
+		pVertices += iNumVertices * sizeof(SXFileUV);
+	}
+	if (subMesh.hasVertexColours)
+	{
+		memcpy( pVertices, &mesh.vertexColours[0], iNumVertices * sizeof(SXFileRGBAColour) );
 	}
-	m_Meshes.erase( m_Meshes.begin(), m_Meshes.begin() + iNumOrigMeshes );
 
 	GEN_ENDGUARD;
 }
 
-
-// Create a list of tangent vectors for the given mesh. The tangent vector is the direction of
-// a vertex's texture U axis in model-space. Returns true on success
-bool CImportXFile::CalculateTangents
+// Write the skinning data for a mesh into vertex data written by one of the functions above -
+// the 4 most significant bone influences of each vertex, with weights normalised to add up to 1.
+// Influences are gathered into arrays for each of the 4 slots (structure of arrays), normalised
+// in one pass over the arrays, then written to the vertices in a single sweep
+void CImportXFile::WriteBoneInfluences
 (
-	TUInt32 iMesh,
-	TXFileVectors* pTangents
-) const
+	const SXFileMesh& mesh,
+	const SSubMesh&   subMesh,
+	TUInt8*           pVertices
+)
 {
-	// Normals and UVs are required for tangent calculation
-	if (!m_Meshes[iMesh].normals.size() || !m_Meshes[iMesh].textureCoords.size())
+	GEN_GUARD;
+
+	TUInt32 iNumVertices = subMesh.numVertices;
+	if (iNumVertices == 0)
 	{
-		return false;
+		return;
 	}
 
-	pTangents->clear();
-	pTangents->resize( m_Meshes[iMesh].vertices.size(), CVector3::kOrigin );
+	// Bone indices are palette entries if the mesh has a bone palette, otherwise frames. The
+	// palette holds the frame of each bone in order, and the node if any vertex needs it
+	TUInt32 iNodeBone = subMesh.node;
+	if (!mesh.palette.empty())
+	{
+		iNodeBone = static_cast<TUInt32>(find( mesh.palette.begin(), mesh.palette.end(),
+		                                       subMesh.node ) - mesh.palette.begin());
+	}
 
-	// Step through faces
-	for (TUInt32 iFace = 0; iFace < m_Meshes[iMesh].faces.size(); ++iFace)
+	// Weight and bone arrays for each slot. Vertices with no influences reference the sub-mesh's
+	// node only (the model is probably not skinned) - new weights are always larger than 0, so
+	// the node is replaced by the first influence on a vertex
+	vector<TFloat32> weightArrays( 4 * iNumVertices, 0.0f );
+	vector<TUInt8> boneArrays( 4 * iNumVertices, 0 );
+	TFloat32* const apWeights[4] = { &weightArrays[0], &weightArrays[iNumVertices],
+	                                 &weightArrays[2 * iNumVertices],
+	                                 &weightArrays[3 * iNumVertices] };
+	TUInt8* const apBones[4] = { &boneArrays[0], &boneArrays[iNumVertices],
+	                             &boneArrays[2 * iNumVertices], &boneArrays[3 * iNumVertices] };
+	fill( apBones[0], apBones[0] + iNumVertices, static_cast<TUInt8>(iNodeBone) );
+
+	// Gather the influences of each bone
+	for (TXFileBones::const_iterator itBone = mesh.bones.begin(); itBone != mesh.bones.end();
+	     ++itBone)
 	{
-		int i1 = m_Meshes[iMesh].faces[iFace].aiVertex[0];
-		int i2 = m_Meshes[iMesh].faces[iFace].aiVertex[1];
-		int i3 = m_Meshes[iMesh].faces[iFace].aiVertex[2];
+		TUInt32 iBone = mesh.palette.empty() ? itBone->iFrame :
+		                static_cast<TUInt32>(itBone - mesh.bones.begin());
+		TUInt32 iNumWeights = static_cast<TUInt32>(itBone->weights.size());
+		for (TUInt32 iWeight = 0; iWeight < iNumWeights; ++iWeight)
+		{
+			const SXFileBoneWeight& boneWeight = itBone->weights[iWeight];
+			AddBoneInfluence( iBone, boneWeight.fWeight, boneWeight.iVertexIndex,
+			                  apWeights, apBones );
+		}
+	}
 
-		CVector3 v1 = m_Meshes[iMesh].vertices[i1];
-		CVector3 v2 = m_Meshes[iMesh].vertices[i2];
-		CVector3 v3 = m_Meshes[iMesh].vertices[i3];
+	// Normalise vertex bone weights (ensure they add up to 1). A vertex with no weights gets a
+	// weight of 1 in the first slot. No branches or dependencies between vertices, so the loop
+	// can be vectorised by the compiler
+	TFloat32* pWeights0 = apWeights[0];
+	TFloat32* pWeights1 = apWeights[1];
+	TFloat32* pWeights2 = apWeights[2];
+	TFloat32* pWeights3 = apWeights[3];
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		TFloat32 fSum = pWeights0[iVertex] + pWeights1[iVertex] +
+		                pWeights2[iVertex] + pWeights3[iVertex];
+		TFloat32 fScale = (fSum > 0.0f) ? 1.0f / fSum : 0.0f;
+		pWeights0[iVertex] = (fSum > 0.0f) ? pWeights0[iVertex] * fScale : 1.0f;
+		pWeights1[iVertex] *= fScale;
+		pWeights2[iVertex] *= fScale;
+		pWeights3[iVertex] *= fScale;
+	}
 
-		SXFileUV uv1 = m_Meshes[iMesh].textureCoords[i1];
-		SXFileUV uv2 = m_Meshes[iMesh].textureCoords[i2];
-		SXFileUV uv3 = m_Meshes[iMesh].textureCoords[i3];
+	// Location of bone data for first vertex and step between vertices. Interleaved bone data is
+	// immediately after the vertex coord, separate streams are as described for SSubMesh
+	TUInt8* pBoneWeights;
+	TUInt8* pBoneIndices;
+	TUInt32 iWeightsStride, iIndicesStride;
+	if (subMesh.vertexLayout == InterleavedVertices)
+	{
+		pBoneWeights = pVertices + sizeof(CVector3);
+		pBoneIndices = pBoneWeights + 4 * sizeof(TFloat32);
+		iWeightsStride = iIndicesStride = subMesh.vertexSize;
+	}
+	else
+	{
+		pBoneWeights = pVertices + iNumVertices * sizeof(CVector3);
+		pBoneIndices = pBoneWeights + iNumVertices * 4 * sizeof(TFloat32);
+		iWeightsStride = 4 * sizeof(TFloat32);
+		iIndicesStride = sizeof(TUInt32);
+	}
 
-		CVector3 edge1 = v2 - v1;
-		CVector3 edge2 = v3 - v1;
+	// Write all vertices in order
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		TFloat32 afWeights[4] = { pWeights0[iVertex], pWeights1[iVertex],
+		                          pWeights2[iVertex], pWeights3[iVertex] };
+		TUInt8 aiBones[4] = { apBones[0][iVertex], apBones[1][iVertex],
+		                      apBones[2][iVertex], apBones[3][iVertex] };
+		memcpy( pBoneWeights, afWeights, sizeof(afWeights) );
+		memcpy( pBoneIndices, aiBones, sizeof(aiBones) );
+		pBoneWeights += iWeightsStride;
+		pBoneIndices += iIndicesStride;
+	}
 
-		float s1 = uv2.fU - uv1.fU;
-		float s2 = uv3.fU - uv1.fU;
-		float t1 = uv2.fV - uv1.fV;
-		float t2 = uv3.fV - uv1.fV;
+	GEN_ENDGUARD;
+}
 
-		CVector3 tangent = (t2 * edge1 - t1 * edge2) / (s1 * t2 - s2 * t1);
 
-		(*pTangents)[i1] += tangent;
-		(*pTangents)[i2] += tangent;
-		(*pTangents)[i3] += tangent;
+/*-----------------------------------------------------------------------------------------
+	Mesh processing
+-----------------------------------------------------------------------------------------*/
+
+// Apply the processing selected by the import options to all meshes - splitting, levels of
+// detail, meshlets, optimisation and ray query hierarchies
+void CImportXFile::ProcessMeshes()
+{
+	GEN_GUARD;
+
+	// Split into meshes containing only one material each
+	SplitMeshes();
+
+	// Optionally split meshes too large for 16-bit indices
+	if (m_Options.bSplitLargeMeshes)
+	{
+		SplitLargeMeshes( kiMax16BitVertices );
 	}
 
-	// Orthogonalise normals and tangents
-	for (TUInt32 iVert = 0; iVert < m_Meshes[iMesh].vertices.size(); ++iVert)
+	// Optionally split skinned meshes into bone palettes of bounded size
+	if (m_Options.iMaxPaletteBones > 0)
 	{
-		// Gram-Schmidt orthogonalize
-		TFloat32 dot = Dot( m_Meshes[iMesh].normals[iVert], (*pTangents)[iVert] );
-		(*pTangents)[iVert] -= dot * m_Meshes[iMesh].normals[iVert];
-		(*pTangents)[iVert].Normalise();
+		PartitionBones( min( max( m_Options.iMaxPaletteBones, kiMinPaletteBones ),
+		                     kiMaxPaletteBones ) );
 	}
 
-	return true;
+	// Optionally generate levels of detail
+	if (m_Options.iNumLODs > 0)
+	{
+		GenerateLODs();
+	}
+
+	// Optionally build meshlets, before optimisation which preserves them
+	if (m_Options.bBuildMeshlets)
+	{
+		ClusterMeshes();
+	}
+
+	// Optionally reorder faces and vertices for rendering
+	if (m_Options.bOptimiseVertexCache)
+	{
+		OptimiseMeshes();
+	}
+
+	// Optionally build hierarchies for ray queries, once faces are in their final order
+	if (m_Options.bBuildBVH)
+	{
+		BuildMeshBVHs();
+	}
+
+	// Calculate bounds of the final meshes
+	CalculateMeshBounds();
+
+	GEN_ENDGUARD;
+}
+
+
+// Streaming import: match bones, process the meshes read so far and pass their sub-meshes to the
+// callback, then free them. Before the end of the file, a mesh whose bones are driven by frames
+// not yet read is held back instead
+// Possible return values:
+//		kInvalidData:		Could not find a frame matching one of the bones (at end of file)
+EImportError CImportXFile::StreamMeshes
+(
+	const bool bEndOfFile
+)
+{
+	GEN_GUARD;
+
+	// Bone frames may follow the mesh in the file, in which case the mesh must wait for them. Only
+	// the mesh just read is in the list before the end of the file
+	EImportError eError = ProcessBones();
+	if (eError != kSuccess)
+	{
+		if (bEndOfFile)
+		{
+			return eError;
+		}
+		m_HeldMeshes.push_back( move( m_Meshes.back() ) );
+		m_Meshes.clear();
+		return kSuccess;
+	}
+
+	// Add the materials to the global list, which is kept for the whole import, then process
+	MakeGlobalMaterialList();
+	ProcessMeshes();
+
+	// Pass on each sub-mesh, then free all the mesh data (clear does not release the memory)
+	for (TUInt32 iSubMesh = 0; iSubMesh < m_Meshes.size(); ++iSubMesh)
+	{
+		m_Options.pfnSubMeshCallback( *this, iSubMesh, m_iNumStreamedSubMeshes,
+		                              m_Options.pSubMeshCallbackData );
+		++m_iNumStreamedSubMeshes;
+	}
+	TXFileMeshes().swap( m_Meshes );
+
+	// Working memory is only used within each processing stage, so can be reused for the next mesh
+	m_Arena.Reset();
+
+	return kSuccess;
+
+	GEN_ENDGUARD;
+}
+
+
+// Split each mesh into a set of meshes - each of which contains only a single material. The faces
+// of each mesh are bucketed by material in a single pass (a counting sort), then each bucket is
+// copied to a new mesh using a vertex map that is reused for every material
+void CImportXFile::SplitMeshes()
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStageSplitMeshes], &m_pCurrentStage );
+	stage.AddBytes( FaceDataBytes() );
+
+	// Size the new mesh list up front - at most one new mesh per material in each mesh
+	TUInt32 iMaxNewMeshes = 0;
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		iMaxNewMeshes += static_cast<TUInt32>(m_Meshes[iMesh].materials.size());
+	}
+	TXFileMeshes newMeshes;
+	newMeshes.reserve( iMaxNewMeshes );
+
+	// Working space reused for each mesh
+	TXFileTempInts materialStart( m_Arena ); // Start of each material's faces in the sorted list
+	TXFileTempInts materialPos( m_Arena );   // Current insertion point for each material in sort
+	TXFileTempInts sortedFaces( m_Arena );   // Face indices sorted by material
+	TXFileTempInts vertexMap( m_Arena );     // Map from original to new vertex indices
+	TXFileTempInts usedVertices( m_Arena );  // Original vertices used by a new mesh
+
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		// Unclutter code with a reference to the mesh 
+		const SXFileMesh& mesh = m_Meshes[iMesh];
+		TUInt32 iNumMaterials = static_cast<TUInt32>(mesh.materials.size());
+		TUInt32 iNumVertices = static_cast<TUInt32>(mesh.vertices.size());
+		TUInt32 iNumFaces = static_cast<TUInt32>(mesh.faceMaterials.size());
+
+		// Count the faces using each material (ignoring any faces with an invalid material), then
+		// convert the counts into the start position of each material in the sorted face list
+		materialStart.assign( iNumMaterials + 1, 0 );
+		for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+		{
+			if (mesh.faceMaterials[iFace] < iNumMaterials)
+			{
+				++materialStart[mesh.faceMaterials[iFace] + 1];
+			}
+		}
+		partial_sum( materialStart.begin(), materialStart.end(), materialStart.begin() );
+
+		// Place each face in its material's bucket, faces keep their original order in a bucket
+		sortedFaces.resize( materialStart[iNumMaterials] );
+		materialPos.assign( materialStart.begin(), materialStart.end() - 1 );
+		for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+		{
+			if (mesh.faceMaterials[iFace] < iNumMaterials)
+			{
+				sortedFaces[materialPos[mesh.faceMaterials[iFace]]++] = iFace;
+			}
+		}
+
+		// Create a new mesh for each material that is used by any faces
+		vertexMap.assign( iNumVertices, iNumVertices );
+		for (TUInt32 iMaterial = 0; iMaterial < iNumMaterials; ++iMaterial)
+		{
+			TUInt32 iNumMaterialFaces = materialStart[iMaterial + 1] - materialStart[iMaterial];
+			if (iNumMaterialFaces == 0)
+			{
+				continue;
+			}
+
+			// Construct new mesh in place in the new mesh list to avoid copying it
+			newMeshes.push_back( SXFileMesh() );
+			SXFileMesh& newMesh = newMeshes.back();
+			newMesh.iParentFrame = mesh.iParentFrame;
+			newMesh.iSourceMesh = mesh.iSourceMesh;
+			newMesh.iSourceHash = mesh.iSourceHash;
+			newMesh.iNumUniqueVertices = 0;
+			newMesh.iMaxBonesPerVertex = 0;
+			newMesh.iMaxBonesPerFace = 0;
+			newMesh.materials.push_back( mesh.materials[iMaterial] );
+			newMesh.materialMap.push_back( mesh.materialMap[iMaterial] );
+			newMesh.faceMaterials.resize( iNumMaterialFaces, 0 );
+
+			CopyMeshFaces( mesh, &sortedFaces[materialStart[iMaterial]], iNumMaterialFaces,
+			               vertexMap, usedVertices, &newMesh );
+		}
+	}
+
+	// Replace original meshes with the new ones
+	m_Meshes.swap( newMeshes );
+
+	GEN_ENDGUARD;
+}
+
+
+// Split any mesh with more than the given number of vertices into several meshes that each
+// have at most that many. Faces are kept in their original order, so each new mesh is a run
+// of consecutive faces, preserving their locality
+void CImportXFile::SplitLargeMeshes
+(
+	const TUInt32 iMaxVertices
+)
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStageSplitLargeMeshes], &m_pCurrentStage );
+	stage.AddBytes( FaceDataBytes() );
+
+	// Nothing to do if all meshes are small enough
+	TUInt32 iMesh = 0;
+	while (iMesh < m_Meshes.size() && m_Meshes[iMesh].vertices.size() <= iMaxVertices)
+	{
+		++iMesh;
+	}
+	if (iMesh == m_Meshes.size())
+	{
+		return;
+	}
+
+	// Working space reused for each mesh
+	TXFileTempInts faceList( m_Arena );     // Identity list of face indices - chunks are runs of it
+	TXFileTempInts vertexChunk( m_Arena );  // Last chunk to use each vertex
+	TXFileTempInts vertexMap( m_Arena );    // Map from original to new vertex indices
+	TXFileTempInts usedVertices( m_Arena ); // Original vertices used by a new mesh
+
+	TXFileMeshes newMeshes;
+	for (iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		// Move small meshes across unchanged
+		SXFileMesh& mesh = m_Meshes[iMesh];
+		TUInt32 iNumVertices = static_cast<TUInt32>(mesh.vertices.size());
+		if (iNumVertices <= iMaxVertices)
+		{
+			newMeshes.push_back( move( mesh ) );
+			continue;
+		}
+
+		TUInt32 iNumFaces = static_cast<TUInt32>(mesh.faces.size());
+		faceList.resize( iNumFaces );
+		iota( faceList.begin(), faceList.end(), 0 );
+		vertexChunk.assign( iNumVertices, iNumVertices );
+		vertexMap.assign( iNumVertices, iNumVertices );
+
+		// Step through the faces, closing the current chunk when the next face would take it
+		// over the vertex limit
+		TUInt32 iChunk = 0;
+		TUInt32 iChunkStart = 0;
+		TUInt32 iChunkVertices = 0;
+		for (TUInt32 iFace = 0; iFace <= iNumFaces; ++iFace)
+		{
+			// Count the vertices this face would add to the chunk (none past the last face)
+			TUInt32 iNewVertices = 0;
+			if (iFace < iNumFaces)
+			{
+				const SXFileFace& face = mesh.faces[iFace];
+				for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
+				{
+					if (vertexChunk[face.aiVertex[iIndex]] != iChunk &&
+					    (iIndex < 1 || face.aiVertex[iIndex] != face.aiVertex[0]) &&
+					    (iIndex < 2 || face.aiVertex[iIndex] != face.aiVertex[1]))
+					{
+						++iNewVertices;
+					}
+				}
+			}
+
+			// Output chunk if complete
+			if (iFace == iNumFaces || iChunkVertices + iNewVertices > iMaxVertices)
+			{
+				newMeshes.push_back( SXFileMesh() );
+				SXFileMesh& newMesh = newMeshes.back();
+				newMesh.iParentFrame = mesh.iParentFrame;
+				newMesh.iSourceMesh = mesh.iSourceMesh;
+				newMesh.iSourceHash = mesh.iSourceHash;
+				newMesh.iNumUniqueVertices = 0;
+				newMesh.iMaxBonesPerVertex = 0;
+				newMesh.iMaxBonesPerFace = 0;
+				newMesh.materials = mesh.materials;
+				newMesh.materialMap = mesh.materialMap;
+				newMesh.faceMaterials.resize( iFace - iChunkStart, 0 );
+				CopyMeshFaces( mesh, &faceList[iChunkStart], iFace - iChunkStart,
+				               vertexMap, usedVertices, &newMesh );
+
+				// Start a new chunk, the current face's vertices are all new to it
+				++iChunk;
+				iChunkStart = iFace;
+				iChunkVertices = 0;
+				if (iFace < iNumFaces)
+				{
+					const SXFileFace& face = mesh.faces[iFace];
+					iNewVertices = 1 + (face.aiVertex[1] != face.aiVertex[0]) +
+					               (face.aiVertex[2] != face.aiVertex[0] &&
+					                face.aiVertex[2] != face.aiVertex[1]);
+				}
+			}
+
+			// Add face to current chunk
+			if (iFace < iNumFaces)
+			{
+				const SXFileFace& face = mesh.faces[iFace];
+				vertexChunk[face.aiVertex[0]] = iChunk;
+				vertexChunk[face.aiVertex[1]] = iChunk;
+				vertexChunk[face.aiVertex[2]] = iChunk;
+				iChunkVertices += iNewVertices;
+			}
+		}
+	}
+
+	// Replace original meshes with the new ones
+	m_Meshes.swap( newMeshes );
+
+	GEN_ENDGUARD;
+}
+
+
+// Split each skinned mesh into partitions that each use at most the given number of bones, and
+// give each a bone palette. Each face needs the bones of its vertices, or the parent frame for a
+// vertex with no bones. Faces are taken in order of their main bone - the frame with the most
+// weight over the face. Frames are in depth-first order, so bones near each other in the skeleton
+// (e.g. along a limb) are near each other in this order, and faces sharing vertices tend to share
+// a partition, which reduces the vertices duplicated across partitions. Each face is added to the
+// current partition if its bones fit, the faces that do not fit are passed on to the next
+// partition. Faces keep their original order within a partition
+void CImportXFile::PartitionBones
+(
+	const TUInt32 iMaxBones
+)
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStagePartitionBones], &m_pCurrentStage );
+	stage.AddBytes( FaceDataBytes() );
+
+	// Working space reused for each mesh
+	TXFileTempInts   vertexStart( m_Arena );    // Start of each vertex's bones in the list below
+	TXFileTempInts   vertexPos( m_Arena );      // Insertion point for each vertex / partition
+	TXFileTempInts   vertexBones( m_Arena );    // Bones of each vertex, bone count for the node
+	TXFileTempFloats vertexWeights( m_Arena );  // Weight of each of the bones above
+	TXFileTempInts   faceStart( m_Arena );      // Start of each face's bones in the list below
+	TXFileTempInts   faceBones( m_Arena );      // Bones used by each face
+	TXFileTempInts   faceMainFrame( m_Arena );  // Main bone (as a frame) of each face
+	TXFileTempInts   frameStart( m_Arena );     // Start of each main frame's faces in the sort
+	TXFileTempInts   sortedFaces( m_Arena );    // Faces in order of main frame / of partition
+	TXFileTempInts   bonePartition( m_Arena );  // Last partition to use each bone
+	TXFileTempInts   facePartition( m_Arena );  // Partition holding each face
+	TXFileTempInts   partitionStart( m_Arena ); // Start of each partition's faces in the sort
+	TXFileTempInts   vertexMap( m_Arena );      // Map from original to new vertex indices
+	TXFileTempInts   usedVertices( m_Arena );   // Original vertices used by a new mesh
+
+	TUInt32 iNumFrames = static_cast<TUInt32>(m_Frames.size());
+	TXFileMeshes newMeshes;
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		// Move unskinned meshes across unchanged
+		SXFileMesh& mesh = m_Meshes[iMesh];
+		if (mesh.bones.empty())
+		{
+			newMeshes.push_back( move( mesh ) );
+			continue;
+		}
+
+		// Only the bones that will be written to the vertex data need to be in a palette
+		ReduceBoneInfluences( &mesh );
+		TUInt32 iNumBones = static_cast<TUInt32>(mesh.bones.size());
+		TUInt32 iNumVertices = static_cast<TUInt32>(mesh.vertices.size());
+		TUInt32 iNumFaces = static_cast<TUInt32>(mesh.faces.size());
+		m_Report.iVerticesBeforePartition += iNumVertices;
+
+		// Gather the bones and weights of each vertex into a contiguous list (a counting sort of
+		// the bone weights by vertex). A vertex with no bones is given the node, with no weight
+		vertexStart.assign( iNumVertices + 1, 0 );
+		for (TUInt32 iBone = 0; iBone < iNumBones; ++iBone)
+		{
+			const TXFileBoneWeights& weights = mesh.bones[iBone].weights;
+			for (TUInt32 iWeight = 0; iWeight < weights.size(); ++iWeight)
+			{
+				++vertexStart[weights[iWeight].iVertexIndex + 1];
+			}
+		}
+		for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+		{
+			vertexStart[iVertex + 1] = max( vertexStart[iVertex + 1], 1u );
+		}
+		partial_sum( vertexStart.begin(), vertexStart.end(), vertexStart.begin() );
+		vertexBones.assign( vertexStart[iNumVertices], iNumBones );
+		vertexWeights.assign( vertexStart[iNumVertices], 0.0f );
+		vertexPos.assign( vertexStart.begin(), vertexStart.end() - 1 );
+		for (TUInt32 iBone = 0; iBone < iNumBones; ++iBone)
+		{
+			const TXFileBoneWeights& weights = mesh.bones[iBone].weights;
+			for (TUInt32 iWeight = 0; iWeight < weights.size(); ++iWeight)
+			{
+				TUInt32 iPos = vertexPos[weights[iWeight].iVertexIndex]++;
+				vertexBones[iPos] = iBone;
+				vertexWeights[iPos] = weights[iWeight].fWeight;
+			}
+		}
+
+		// Find the bones used by each face, sorted and without duplicates, and its main frame.
+		// Count the faces with each main frame
+		faceStart.resize( iNumFaces + 1 );
+		faceStart[0] = 0;
+		faceBones.clear();
+		faceMainFrame.resize( iNumFaces );
+		frameStart.assign( iNumFrames + 1, 0 );
+		for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+		{
+			// At most 4 bones or the node for each vertex
+			TUInt32 aiBones[12];
+			TFloat32 afWeights[12];
+			TUInt32 iNumFaceBones = 0;
+			for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
+			{
+				TUInt32 iVertex = mesh.faces[iFace].aiVertex[iIndex];
+				for (TUInt32 iPos = vertexStart[iVertex]; iPos < vertexStart[iVertex + 1]; ++iPos)
+				{
+					TUInt32 iFaceBone = 0;
+					while (iFaceBone < iNumFaceBones && aiBones[iFaceBone] != vertexBones[iPos])
+					{
+						++iFaceBone;
+					}
+					if (iFaceBone == iNumFaceBones)
+					{
+						aiBones[iNumFaceBones] = vertexBones[iPos];
+						afWeights[iNumFaceBones++] = 0.0f;
+					}
+					afWeights[iFaceBone] += vertexWeights[iPos];
+				}
+			}
+
+			TUInt32 iMainBone = aiBones[0];
+			TFloat32 fMainWeight = afWeights[0];
+			for (TUInt32 iFaceBone = 1; iFaceBone < iNumFaceBones; ++iFaceBone)
+			{
+				if (afWeights[iFaceBone] > fMainWeight)
+				{
+					iMainBone = aiBones[iFaceBone];
+					fMainWeight = afWeights[iFaceBone];
+				}
+			}
+			TUInt32 iMainFrame = (iMainBone < iNumBones) ? mesh.bones[iMainBone].iFrame :
+			                                               mesh.iParentFrame;
+			faceMainFrame[iFace] = iMainFrame;
+			++frameStart[iMainFrame + 1];
+
+			sort( aiBones, aiBones + iNumFaceBones );
+			faceBones.insert( faceBones.end(), aiBones, aiBones + iNumFaceBones );
+			faceStart[iFace + 1] = static_cast<TUInt32>(faceBones.size());
+		}
+
+		// Sort the faces by main frame, faces keep their original order for each frame
+		partial_sum( frameStart.begin(), frameStart.end(), frameStart.begin() );
+		sortedFaces.resize( iNumFaces );
+		vertexPos.assign( frameStart.begin(), frameStart.end() - 1 );
+		for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+		{
+			sortedFaces[vertexPos[faceMainFrame[iFace]]++] = iFace;
+		}
+
+		// Fill partitions in turn from the faces not yet placed, which are compacted to the start
+		// of the sorted list. The first face always fits, as a face uses at most 12 bones
+		bonePartition.assign( iNumBones + 1, iNumFaces );
+		facePartition.resize( iNumFaces );
+		TUInt32 iNumPartitions = 0;
+		TUInt32 iNumRemaining = iNumFaces;
+		while (iNumRemaining > 0)
+		{
+			TUInt32 iNumPaletteBones = 0;
+			TUInt32 iNumNotPlaced = 0;
+			for (TUInt32 iSorted = 0; iSorted < iNumRemaining; ++iSorted)
+			{
+				TUInt32 iFace = sortedFaces[iSorted];
+				TUInt32 iNewBones = 0;
+				for (TUInt32 iPos = faceStart[iFace]; iPos < faceStart[iFace + 1]; ++iPos)
+				{
+					iNewBones += (bonePartition[faceBones[iPos]] != iNumPartitions);
+				}
+				if (iNumPaletteBones + iNewBones <= iMaxBones)
+				{
+					for (TUInt32 iPos = faceStart[iFace]; iPos < faceStart[iFace + 1]; ++iPos)
+					{
+						bonePartition[faceBones[iPos]] = iNumPartitions;
+					}
+					iNumPaletteBones += iNewBones;
+					facePartition[iFace] = iNumPartitions;
+				}
+				else
+				{
+					sortedFaces[iNumNotPlaced++] = iFace;
+				}
+			}
+			iNumRemaining = iNumNotPlaced;
+			++iNumPartitions;
+		}
+		m_Report.iBonePartitions += iNumPartitions;
+
+		// Keep a mesh within the limit whole
+		if (iNumPartitions == 1)
+		{
+			MakeBonePalette( &mesh );
+			m_Report.iVerticesAfterPartition += iNumVertices;
+			newMeshes.push_back( move( mesh ) );
+			continue;
+		}
+
+		// Bucket the faces by partition in their original order, then copy each partition to a
+		// new mesh
+		partitionStart.assign( iNumPartitions + 1, 0 );
+		for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+		{
+			++partitionStart[facePartition[iFace] + 1];
+		}
+		partial_sum( partitionStart.begin(), partitionStart.end(), partitionStart.begin() );
+		sortedFaces.resize( iNumFaces );
+		vertexPos.assign( partitionStart.begin(), partitionStart.end() - 1 );
+		for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+		{
+			sortedFaces[vertexPos[facePartition[iFace]]++] = iFace;
+		}
+
+		vertexMap.assign( iNumVertices, iNumVertices );
+		for (TUInt32 iPartition = 0; iPartition < iNumPartitions; ++iPartition)
+		{
+			TUInt32 iNumPartitionFaces = partitionStart[iPartition + 1] -
+			                             partitionStart[iPartition];
+			newMeshes.push_back( SXFileMesh() );
+			SXFileMesh& newMesh = newMeshes.back();
+			newMesh.iParentFrame = mesh.iParentFrame;
+			newMesh.iSourceMesh = mesh.iSourceMesh;
+			newMesh.iSourceHash = mesh.iSourceHash;
+			newMesh.iNumUniqueVertices = 0;
+			newMesh.iMaxBonesPerVertex = 0;
+			newMesh.iMaxBonesPerFace = 0;
+			newMesh.materials = mesh.materials;
+			newMesh.materialMap = mesh.materialMap;
+			newMesh.faceMaterials.resize( iNumPartitionFaces, 0 );
+			CopyMeshFaces( mesh, &sortedFaces[partitionStart[iPartition]], iNumPartitionFaces,
+			               vertexMap, usedVertices, &newMesh );
+			MakeBonePalette( &newMesh );
+			m_Report.iVerticesAfterPartition += static_cast<TUInt32>(newMesh.vertices.size());
+		}
+	}
+
+	// Replace original meshes with the new ones
+	m_Meshes.swap( newMeshes );
+
+	GEN_ENDGUARD;
+}
+
+
+// Keep only the 4 most significant bone influences of each vertex of a mesh (those written by
+// WriteBoneInfluences), and remove bones that no longer influence any vertex
+void CImportXFile::ReduceBoneInfluences
+(
+	SXFileMesh* pMesh
+)
+{
+	GEN_GUARD;
+
+	TUInt32 iNumBones = static_cast<TUInt32>(pMesh->bones.size());
+	TUInt32 iNumVertices = static_cast<TUInt32>(pMesh->vertices.size());
+	if (iNumVertices == 0)
+	{
+		pMesh->bones.clear();
+		return;
+	}
+
+	// Gather the influences into arrays for each slot as WriteBoneInfluences does, but holding
+	// bone indices in the mesh rather than frames. Empty slots hold the bone count
+	TXFileTempFloats weightArrays( 4 * iNumVertices, 0.0f, m_Arena );
+	TXFileTempInts boneArrays( 4 * iNumVertices, iNumBones, m_Arena );
+	TFloat32* const apWeights[4] = { &weightArrays[0], &weightArrays[iNumVertices],
+	                                 &weightArrays[2 * iNumVertices],
+	                                 &weightArrays[3 * iNumVertices] };
+	TUInt32* const apBones[4] = { &boneArrays[0], &boneArrays[iNumVertices],
+	                              &boneArrays[2 * iNumVertices], &boneArrays[3 * iNumVertices] };
+	for (TUInt32 iBone = 0; iBone < iNumBones; ++iBone)
+	{
+		const TXFileBoneWeights& weights = pMesh->bones[iBone].weights;
+		for (TUInt32 iWeight = 0; iWeight < weights.size(); ++iWeight)
+		{
+			AddBoneInfluence( iBone, weights[iWeight].fWeight, weights[iWeight].iVertexIndex,
+			                  apWeights, apBones );
+		}
+	}
+
+	// Rebuild the weights of each bone from the slots
+	for (TUInt32 iBone = 0; iBone < iNumBones; ++iBone)
+	{
+		pMesh->bones[iBone].weights.clear();
+	}
+	for (TUInt32 iSlot = 0; iSlot < 4; ++iSlot)
+	{
+		for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+		{
+			if (apBones[iSlot][iVertex] < iNumBones)
+			{
+				SXFileBoneWeight weight;
+				weight.iVertexIndex = iVertex;
+				weight.fWeight = apWeights[iSlot][iVertex];
+				pMesh->bones[apBones[iSlot][iVertex]].weights.push_back( weight );
+			}
+		}
+	}
+
+	// Remove unused bones, keeping the others in order
+	TUInt32 iNumUsedBones = 0;
+	for (TUInt32 iBone = 0; iBone < iNumBones; ++iBone)
+	{
+		if (!pMesh->bones[iBone].weights.empty())
+		{
+			if (iNumUsedBones != iBone)
+			{
+				pMesh->bones[iNumUsedBones] = move( pMesh->bones[iBone] );
+			}
+			++iNumUsedBones;
+		}
+	}
+	pMesh->bones.resize( iNumUsedBones );
+
+	GEN_ENDGUARD;
+}
+
+
+// Set the bone palette of a mesh from its bones, adding its parent frame if any vertex has no
+// bone influences
+void CImportXFile::MakeBonePalette
+(
+	SXFileMesh* pMesh
+)
+{
+	GEN_GUARD;
+
+	TUInt32 iNumBones = static_cast<TUInt32>(pMesh->bones.size());
+	pMesh->palette.resize( iNumBones );
+	for (TUInt32 iBone = 0; iBone < iNumBones; ++iBone)
+	{
+		pMesh->palette[iBone] = pMesh->bones[iBone].iFrame;
+	}
+
+	// Count the vertices with bone influences
+	vector<bool> influenced( pMesh->vertices.size(), false );
+	TUInt32 iNumInfluenced = 0;
+	for (TUInt32 iBone = 0; iBone < iNumBones; ++iBone)
+	{
+		const TXFileBoneWeights& weights = pMesh->bones[iBone].weights;
+		for (TUInt32 iWeight = 0; iWeight < weights.size(); ++iWeight)
+		{
+			if (!influenced[weights[iWeight].iVertexIndex])
+			{
+				influenced[weights[iWeight].iVertexIndex] = true;
+				++iNumInfluenced;
+			}
+		}
+	}
+	if (iNumInfluenced < pMesh->vertices.size() &&
+	    find( pMesh->palette.begin(), pMesh->palette.end(), pMesh->iParentFrame ) ==
+	    pMesh->palette.end())
+	{
+		pMesh->palette.push_back( pMesh->iParentFrame );
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+// Generate a chain of levels of detail for each mesh according to the import options. Each level
+// is simplified from the previous one and its faces added to the end of the face list. Vertices
+// are then reordered so each level uses a prefix of the vertex list
+void CImportXFile::GenerateLODs()
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStageGenerateLODs], &m_pCurrentStage );
+	stage.AddBytes( FaceDataBytes() );
+
+	TUInt32 iNumLODs = min( m_Options.iNumLODs, kiMaxLODs - 1 );
+	TXFileTempFaces lodFaces( m_Arena );
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		SXFileMesh& mesh = m_Meshes[iMesh];
+		TUInt32 iNumFaces = static_cast<TUInt32>(mesh.faces.size());
+		if (iNumFaces == 0)
+		{
+			continue;
+		}
+
+		// First level is the full detail mesh
+		TUInt32 iNumVertices = static_cast<TUInt32>(mesh.vertices.size());
+		SXFileLOD lod = { 0, iNumFaces, iNumVertices, 0.0f };
+		mesh.lods.push_back( lod );
+		for (TUInt32 iLOD = 1; iLOD <= iNumLODs; ++iLOD)
+		{
+			// Simplify from the previous level. Errors accumulate, so add them to give an upper
+			// bound on the error of this level
+			const SXFileLOD& prevLOD = mesh.lods.back();
+			TFloat32 fTargetFaces = prevLOD.iNumFaces * m_Options.fLODReduction;
+			TUInt32 iTargetFaces = static_cast<TUInt32>(fTargetFaces);
+			TFloat32 fMaxError = m_Options.fLODMaxError - prevLOD.fError;
+			lodFaces.resize( prevLOD.iNumFaces );
+			TFloat32 fError;
+			TUInt32 iNumLODFaces = SimplifyMesh( &mesh.faces[prevLOD.iFirstFace].aiVertex[0],
+			                                     prevLOD.iNumFaces, &mesh.vertices[0], iNumVertices,
+			                                     iTargetFaces, fMaxError, &lodFaces[0].aiVertex[0],
+			                                     &fError );
+			if (iNumLODFaces == 0 || iNumLODFaces == prevLOD.iNumFaces)
+			{
+				break;
+			}
+
+			lod.iFirstFace = static_cast<TUInt32>(mesh.faces.size());
+			lod.iNumFaces = iNumLODFaces;
+			lod.fError = prevLOD.fError + fError;
+			mesh.faces.insert( mesh.faces.end(), lodFaces.begin(),
+			                   lodFaces.begin() + iNumLODFaces );
+			mesh.lods.push_back( lod );
+		}
+
+		// Meshes have a single material at this point, extend the face material list to match
+		mesh.faceMaterials.resize( mesh.faces.size(), 0 );
+		if (mesh.lods.size() == 1)
+		{
+			mesh.lods.clear();
+		}
+		SortLODVertices( &mesh );
+	}
+
+	GEN_ENDGUARD;
+}
+
+// Get the range of faces in the full detail level of a mesh
+TUInt32 CImportXFile::NumFullDetailFaces
+(
+	const SXFileMesh& mesh
+)
+{
+	return mesh.lods.empty() ? static_cast<TUInt32>(mesh.faces.size()) : mesh.lods[0].iNumFaces;
+}
+
+// Reorder the vertices of a mesh with levels of detail so those used by coarser levels come first,
+// otherwise keeping their order. Each level then uses a prefix of the vertex list, whose length is
+// stored in the level. A renderer drawing a coarse level only needs to process that prefix
+void CImportXFile::SortLODVertices
+(
+	SXFileMesh* pMesh
+)
+{
+	GEN_GUARD;
+
+	if (pMesh->lods.empty())
+	{
+		return;
+	}
+
+	// Find the coarsest level using each vertex. Levels are in order of decreasing detail
+	TUInt32 iNumVertices = static_cast<TUInt32>(pMesh->vertices.size());
+	TUInt32 iNumLODs = static_cast<TUInt32>(pMesh->lods.size());
+	TXFileTempInts vertexLOD( iNumVertices, 0, m_Arena );
+	for (TUInt32 iLOD = 1; iLOD < iNumLODs; ++iLOD)
+	{
+		const SXFileLOD& lod = pMesh->lods[iLOD];
+		for (TUInt32 iFace = lod.iFirstFace; iFace < lod.iFirstFace + lod.iNumFaces; ++iFace)
+		{
+			for (TUInt32 iCorner = 0; iCorner < 3; ++iCorner)
+			{
+				vertexLOD[pMesh->faces[iFace].aiVertex[iCorner]] = iLOD;
+			}
+		}
+	}
+
+	// Count the vertices used by each level, then place the vertices of coarser levels first with
+	// a stable counting sort
+	TUInt32 aiLODStart[kiMaxLODs + 1] = { 0 };
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		++aiLODStart[iNumLODs - vertexLOD[iVertex]];
+	}
+	for (TUInt32 iLOD = 0; iLOD < iNumLODs; ++iLOD)
+	{
+		aiLODStart[iLOD + 1] += aiLODStart[iLOD];
+		pMesh->lods[iNumLODs - 1 - iLOD].iNumVertices = aiLODStart[iLOD + 1];
+	}
+	TXFileTempInts vertexRemap( iNumVertices, 0, m_Arena );
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		vertexRemap[iVertex] = aiLODStart[iNumLODs - 1 - vertexLOD[iVertex]]++;
+	}
+
+	RemapMeshVertices( &vertexRemap[0], iNumVertices, pMesh );
+	for (TUInt32 iFace = 0; iFace < pMesh->faces.size(); ++iFace)
+	{
+		for (TUInt32 iCorner = 0; iCorner < 3; ++iCorner)
+		{
+			pMesh->faces[iFace].aiVertex[iCorner] =
+				vertexRemap[pMesh->faces[iFace].aiVertex[iCorner]];
+		}
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+// Partition the full detail level of each mesh into meshlets according to the import options
+void CImportXFile::ClusterMeshes()
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStageClusterMeshes], &m_pCurrentStage );
+	stage.AddBytes( FaceDataBytes() );
+
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		SXFileMesh& mesh = m_Meshes[iMesh];
+		if (mesh.faces.empty())
+		{
+			continue;
+		}
+
+		// Faces are three contiguous indices, so the face list can be used as an index list. Meshes
+		// have a single material at this point, so the face material list is not reordered
+		BuildMeshlets( &mesh.faces[0].aiVertex[0], NumFullDetailFaces( mesh ), &mesh.vertices[0],
+		               static_cast<TUInt32>(mesh.vertices.size()), m_Options.iMaxMeshletVertices,
+		               m_Options.iMaxMeshletFaces, &mesh.meshlets );
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+// Reorder the faces and vertices of each mesh for efficient rendering, according to the import
+// options. Each level of detail is reordered separately, as is each meshlet. Records vertex cache
+// statistics (of the full detail level) before and after in the import report
+void CImportXFile::OptimiseMeshes()
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStageOptimiseMeshes], &m_pCurrentStage );
+	stage.AddBytes( FaceDataBytes() );
+
+	TXFileTempInts vertexRemap( m_Arena );
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		SXFileMesh& mesh = m_Meshes[iMesh];
+		TUInt32 iNumFaces = static_cast<TUInt32>(mesh.faces.size());
+		TUInt32 iNumVertices = static_cast<TUInt32>(mesh.vertices.size());
+		if (iNumFaces == 0)
+		{
+			continue;
+		}
+
+		// Faces are three contiguous indices, so the face list can be used as an index list
+		TUInt32* piIndices = &mesh.faces[0].aiVertex[0];
+		TUInt32 iNumFullFaces = NumFullDetailFaces( mesh );
+
+		SVertexCacheStats stats;
+		AnalyseVertexCache( piIndices, iNumFullFaces, iNumVertices, &stats );
+		m_Report.vertexCacheBefore += stats;
+
+		// Reorder faces in each level of detail. Meshes have a single material at this point, so
+		// the face material list does not need reordering to match
+		TUInt32 iNumLODs = mesh.lods.empty() ? 1 : static_cast<TUInt32>(mesh.lods.size());
+		for (TUInt32 iLOD = 0; iLOD < iNumLODs; ++iLOD)
+		{
+			TUInt32 iFirstFace = mesh.lods.empty() ? 0 : mesh.lods[iLOD].iFirstFace;
+			TUInt32 iLODFaces = mesh.lods.empty() ? iNumFaces : mesh.lods[iLOD].iNumFaces;
+			TUInt32* piLODIndices = piIndices + iFirstFace * 3;
+
+			// Meshlets in the full detail level must stay contiguous, so reorder each separately.
+			// They are not reordered for overdraw, which would mix them
+			if (iLOD == 0 && !mesh.meshlets.empty())
+			{
+				for (TUInt32 iMeshlet = 0; iMeshlet < mesh.meshlets.size(); ++iMeshlet)
+				{
+					const SMeshlet& meshlet = mesh.meshlets[iMeshlet];
+					OptimiseVertexCache( piIndices + meshlet.firstFace * 3, meshlet.numFaces,
+					                     iNumVertices );
+				}
+				continue;
+			}
+
+			OptimiseVertexCache( piLODIndices, iLODFaces, iNumVertices );
+			if (m_Options.bOptimiseOverdraw)
+			{
+				OptimiseOverdraw( piLODIndices, iLODFaces, &mesh.vertices[0], iNumVertices,
+				                  m_Options.fOverdrawThreshold );
+			}
+		}
+
+		// Reorder vertices to match and discard any unused. The full detail level comes first so
+		// its vertices are in the best order
+		vertexRemap.resize( iNumVertices );
+		TUInt32 iNumUsed = OptimiseVertexFetch( piIndices, iNumFaces, iNumVertices,
+		                                        &vertexRemap[0] );
+		RemapMeshVertices( &vertexRemap[0], iNumUsed, &mesh );
+
+		// Fetch order mixes the vertices of the levels of detail, so restore the order that lets
+		// each level use a prefix of the vertices. Fetch order is kept within each level
+		if (!mesh.lods.empty())
+		{
+			SortLODVertices( &mesh );
+		}
+
+		AnalyseVertexCache( piIndices, iNumFullFaces, iNumUsed, &stats );
+		m_Report.vertexCacheAfter += stats;
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+// Build a bounding volume hierarchy over the full detail level of each mesh
+void CImportXFile::BuildMeshBVHs()
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStageBuildBVHs], &m_pCurrentStage );
+	stage.AddBytes( FaceDataBytes() );
+
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		SXFileMesh& mesh = m_Meshes[iMesh];
+		if (mesh.faces.empty())
+		{
+			continue;
+		}
+		mesh.bvh.Build( &mesh.faces[0].aiVertex[0], NumFullDetailFaces( mesh ), &mesh.vertices[0],
+		                m_Options.iMaxBVHLeafFaces );
+	}
+
+	GEN_ENDGUARD;
+}
+
+// Calculate the bounds of each mesh and add them to the bounds of the frame holding it
+void CImportXFile::CalculateMeshBounds()
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStageCalculateBounds], &m_pCurrentStage );
+
+	// Frames may have been added since the last call if streaming
+	SMeshBounds emptyBounds;
+	ClearBounds( &emptyBounds );
+	m_FrameBounds.resize( m_Frames.size(), emptyBounds );
+
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		SXFileMesh& mesh = m_Meshes[iMesh];
+		stage.AddBytes( mesh.vertices.size() * sizeof(CVector3) );
+		TUInt32 iNumVertices = static_cast<TUInt32>(mesh.vertices.size());
+		CalculateBounds( (iNumVertices > 0) ? &mesh.vertices[0] : 0, iNumVertices, sizeof(CVector3),
+		                 &mesh.bounds );
+		MergeBounds( &m_FrameBounds[mesh.iParentFrame], mesh.bounds );
+	}
+
+	GEN_ENDGUARD;
+}
+
+// Add the bounds of each frame to those of its parent, in the parent's space, so each frame's
+// bounds contain all the meshes below it. Called once all the meshes have been processed
+void CImportXFile::CalculateFrameBounds()
+{
+	GEN_GUARD;
+
+	CStageTimer stage( &m_Report.aStages[kStageCalculateBounds], &m_pCurrentStage );
+
+	SMeshBounds emptyBounds;
+	ClearBounds( &emptyBounds );
+	m_FrameBounds.resize( m_Frames.size(), emptyBounds );
+
+	// Parents come before their children in the depth-first list, so working backwards each
+	// frame's bounds are complete before they are added to its parent's. The root has no parent
+	TUInt32 iFrame = static_cast<TUInt32>(m_Frames.size());
+	while (iFrame > 1)
+	{
+		--iFrame;
+		SMeshBounds parentBounds;
+		TransformBounds( m_FrameBounds[iFrame], m_Frames[iFrame].defaultMatrix, &parentBounds );
+		MergeBounds( &m_FrameBounds[m_Frames[iFrame].iParentIndex], parentBounds );
+	}
+
+	GEN_ENDGUARD;
+}
+
+// Return the total bytes of face data in all meshes, for the import report
+TUInt64 CImportXFile::FaceDataBytes() const
+{
+	TUInt64 iBytes = 0;
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		iBytes += m_Meshes[iMesh].faces.size() * sizeof(SXFileFace);
+	}
+	return iBytes;
+}
+
+// Reorder the vertex data of a mesh given a map from old to new vertex indices, discarding
+// vertices mapped beyond the new vertex count. Does not alter the face list
+void CImportXFile::RemapMeshVertices
+(
+	const TUInt32* piRemap,
+	const TUInt32  iNumNewVertices,
+	SXFileMesh*    pMesh
+)
+{
+	GEN_GUARD;
+
+	TUInt32 iNumVertices = static_cast<TUInt32>(pMesh->vertices.size());
+
+	// Duplication indices refer to vertices so are remapped as well as reordered
+	if (!pMesh->duplicateIndices.empty())
+	{
+		for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+		{
+			pMesh->duplicateIndices[iVertex] = piRemap[pMesh->duplicateIndices[iVertex]];
+		}
+	}
+
+	RemapVertexData( pMesh->vertices, piRemap, iNumNewVertices );
+	RemapVertexData( pMesh->normals, piRemap, iNumNewVertices );
+	RemapVertexData( pMesh->textureCoords, piRemap, iNumNewVertices );
+	RemapVertexData( pMesh->vertexColours, piRemap, iNumNewVertices );
+	RemapVertexData( pMesh->duplicateIndices, piRemap, iNumNewVertices );
+
+	// Remap bone weights, dropping those for discarded vertices
+	for (TUInt32 iBone = 0; iBone < pMesh->bones.size(); ++iBone)
+	{
+		TXFileBoneWeights& weights = pMesh->bones[iBone].weights;
+		TUInt32 iNumWeights = 0;
+		for (TUInt32 iWeight = 0; iWeight < weights.size(); ++iWeight)
+		{
+			TUInt32 iVertex = piRemap[weights[iWeight].iVertexIndex];
+			if (iVertex < iNumNewVertices)
+			{
+				weights[iNumWeights].iVertexIndex = iVertex;
+				weights[iNumWeights].fWeight = weights[iWeight].fWeight;
+				++iNumWeights;
+			}
+		}
+		weights.resize( iNumWeights );
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+// Copy a subset of the faces of a mesh into another (empty) mesh, along with the vertex data
+// and bone weights that those faces use. The vertex map must be the size of the source vertex
+// list and filled with the source vertex count (as an unused marker), it is returned in the same
+// state. The used vertex list is working space, passed in so it can be reused over many calls
+void CImportXFile::CopyMeshFaces
+(
+	const SXFileMesh& srcMesh,
+	const TUInt32*    piFaces,
+	const TUInt32     iNumFaces,
+	TXFileTempInts&   vertexMap,
+	TXFileTempInts&   usedVertices,
+	SXFileMesh*       pDestMesh
+)
+{
+	GEN_GUARD;
+
+	TUInt32 iUnused = static_cast<TUInt32>(srcMesh.vertices.size());
+
+	// Copy faces, giving each source vertex a new index on first use
+	usedVertices.clear();
+	pDestMesh->faces.resize( iNumFaces );
+	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+	{
+		const SXFileFace& srcFace = srcMesh.faces[piFaces[iFace]];
+		SXFileFace& destFace = pDestMesh->faces[iFace];
+		for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
+		{
+			TUInt32 iVert = srcFace.aiVertex[iIndex];
+			if (vertexMap[iVert] == iUnused)
+			{
+				vertexMap[iVert] = static_cast<TUInt32>(usedVertices.size());
+				usedVertices.push_back( iVert );
+			}
+			destFace.aiVertex[iIndex] = vertexMap[iVert];
+		}
+	}
+
+	// Gather the vertex data for the used vertices
+	TUInt32 iNumVertices = static_cast<TUInt32>(usedVertices.size());
+	pDestMesh->vertices.resize( iNumVertices );
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		pDestMesh->vertices[iVertex] = srcMesh.vertices[usedVertices[iVertex]];
+	}
+	if (!srcMesh.normals.empty())
+	{
+		pDestMesh->normals.resize( iNumVertices );
+		for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+		{
+			pDestMesh->normals[iVertex] = srcMesh.normals[usedVertices[iVertex]];
+		}
+	}
+	if (!srcMesh.textureCoords.empty())
+	{
+		pDestMesh->textureCoords.resize( iNumVertices );
+		for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+		{
+			pDestMesh->textureCoords[iVertex] = srcMesh.textureCoords[usedVertices[iVertex]];
+		}
+	}
+	if (!srcMesh.vertexColours.empty())
+	{
+		pDestMesh->vertexColours.resize( iNumVertices );
+		for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+		{
+			pDestMesh->vertexColours[iVertex] = srcMesh.vertexColours[usedVertices[iVertex]];
+		}
+	}
+
+	// Copy the weights each bone gives to the used vertices, leaving out bones that affect none
+	for (TUInt32 iBone = 0; iBone < srcMesh.bones.size(); ++iBone)
+	{
+		const SXFileBone& srcBone = srcMesh.bones[iBone];
+		SXFileBone* pDestBone = 0;
+		for (TUInt32 iWeight = 0; iWeight < srcBone.weights.size(); ++iWeight)
+		{
+			TUInt32 iVertex = vertexMap[srcBone.weights[iWeight].iVertexIndex];
+			if (iVertex == iUnused)
+			{
+				continue;
+			}
+			if (!pDestBone)
+			{
+				pDestMesh->bones.push_back( SXFileBone() );
+				pDestBone = &pDestMesh->bones.back();
+				pDestBone->iFrameName = srcBone.iFrameName;
+				pDestBone->iFrame = srcBone.iFrame;
+				pDestBone->offsetMatrix = srcBone.offsetMatrix;
+			}
+			SXFileBoneWeight weight;
+			weight.iVertexIndex = iVertex;
+			weight.fWeight = srcBone.weights[iWeight].fWeight;
+			pDestBone->weights.push_back( weight );
+		}
+	}
+
+	// Reset the entries used in the vertex map, ready for the next call
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		vertexMap[usedVertices[iVertex]] = iUnused;
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+// Create a list of tangent vectors for the given mesh. The tangent vector is the direction of
+// a vertex's texture U axis in model-space. Returns true on success
+bool CImportXFile::CalculateTangents
+(
+	TUInt32 iMesh,
+	TXFileVectors* pTangents
+) const
+{
+	// Normals and UVs are required for tangent calculation
+	const SXFileMesh& mesh = m_Meshes[iMesh];
+	if (!mesh.normals.size() || !mesh.textureCoords.size())
+	{
+		return false;
+	}
+
+	if (m_Options.bSerialTangents)
+	{
+		CalculateTangentsSerial( iMesh, pTangents );
+		return true;
+	}
+
+	// Use the faces of the full detail level (lower levels use the same vertices)
+	TUInt32 iNumFaces = NumFullDetailFaces( mesh );
+	TUInt32 iNumVertices = static_cast<TUInt32>(mesh.vertices.size());
+	pTangents->clear();
+	pTangents->resize( iNumVertices, CVector3::kOrigin );
+	if (iNumVertices == 0)
+	{
+		return true;
+	}
+
+	// Split the faces into ranges processed in parallel. Each range sums face tangents into its
+	// own per-vertex list so there are no shared writes - the first range uses the output list,
+	// further ranges need temporary lists. Limit the ranges to bound the temporary memory
+	const TUInt32 kiMaxPartialBytes = 64 * 1024 * 1024;
+	TUInt32 iNumRanges = ParallelRanges( iNumFaces );
+	TUInt32 iMaxPartials = kiMaxPartialBytes / (iNumVertices * sizeof(CVector3));
+	if (iNumRanges > iMaxPartials + 1)
+	{
+		iNumRanges = iMaxPartials + 1;
+	}
+	TXFileVectors partialTangents( (iNumRanges - 1) * iNumVertices ); // Cleared by each range
+
+	SXFileTangentTask task;
+	task.pMesh = &mesh;
+	task.iNumVertices = iNumVertices;
+	task.pTangents = &(*pTangents)[0];
+	task.pPartialTangents = partialTangents.empty() ? 0 : &partialTangents[0];
+	task.iNumPartials = iNumRanges - 1;
+	ParallelFor( iNumFaces, iNumRanges, SumFaceTangents, &task );
+
+	// Combine the sums and orthogonalise, vertices are independent so process them in parallel
+	ParallelFor( iNumVertices, ParallelRanges( iNumVertices ), OrthogonaliseTangents, &task );
+
+	return true;
+}
+
+// Reference version of CalculateTangents on a single thread, used with the serial tangents
+// option. The mesh must have normals and texture coordinates
+void CImportXFile::CalculateTangentsSerial
+(
+	TUInt32        iMesh,
+	TXFileVectors* pTangents
+) const
+{
+	const SXFileMesh& mesh = m_Meshes[iMesh];
+	pTangents->clear();
+	pTangents->resize( mesh.vertices.size(), CVector3::kOrigin );
+
+	// Sum the tangents of the full detail faces at each of their vertices
+	TUInt32 iNumFaces = NumFullDetailFaces( mesh );
+	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+	{
+		TUInt32 i1 = mesh.faces[iFace].aiVertex[0];
+		TUInt32 i2 = mesh.faces[iFace].aiVertex[1];
+		TUInt32 i3 = mesh.faces[iFace].aiVertex[2];
+
+		CVector3 edge1 = mesh.vertices[i2] - mesh.vertices[i1];
+		CVector3 edge2 = mesh.vertices[i3] - mesh.vertices[i1];
+
+		float s1 = mesh.textureCoords[i2].fU - mesh.textureCoords[i1].fU;
+		float s2 = mesh.textureCoords[i3].fU - mesh.textureCoords[i1].fU;
+		float t1 = mesh.textureCoords[i2].fV - mesh.textureCoords[i1].fV;
+		float t2 = mesh.textureCoords[i3].fV - mesh.textureCoords[i1].fV;
+
+		CVector3 tangent = (t2 * edge1 - t1 * edge2) / (s1 * t2 - s2 * t1);
+
+		(*pTangents)[i1] += tangent;
+		(*pTangents)[i2] += tangent;
+		(*pTangents)[i3] += tangent;
+	}
+
+	// Gram-Schmidt orthogonalize
+	for (TUInt32 iVert = 0; iVert < mesh.vertices.size(); ++iVert)
+	{
+		CVector3& tangent = (*pTangents)[iVert];
+		tangent -= Dot( mesh.normals[iVert], tangent ) * mesh.normals[iVert];
+		tangent.Normalise();
+	}
+}
+
+// Sum the tangents of a range of faces into per-vertex sums for that range, called by ParallelFor
+void CImportXFile::SumFaceTangents
+(
+	TUInt32 iBegin,
+	TUInt32 iEnd,
+	TUInt32 iRange,
+	void*   pTask
+)
+{
+	const SXFileTangentTask& task = *static_cast<SXFileTangentTask*>(pTask);
+
+	// First range sums into the output list, which is already cleared
+	CVector3* pSums = task.pTangents;
+	if (iRange > 0)
+	{
+		pSums = task.pPartialTangents + (iRange - 1) * task.iNumVertices;
+		fill( pSums, pSums + task.iNumVertices, CVector3::kOrigin );
+	}
+
+	const CVector3* pVertices = &task.pMesh->vertices[0];
+	const SXFileUV* pUVs = &task.pMesh->textureCoords[0];
+	const SXFileFace* pFace = &task.pMesh->faces[0] + iBegin;
+	for (TUInt32 iFace = iBegin; iFace < iEnd; ++iFace, ++pFace)
+	{
+		TUInt32 i1 = pFace->aiVertex[0];
+		TUInt32 i2 = pFace->aiVertex[1];
+		TUInt32 i3 = pFace->aiVertex[2];
+
+		const CVector3& v1 = pVertices[i1];
+		const CVector3& v2 = pVertices[i2];
+		const CVector3& v3 = pVertices[i3];
+
+		const SXFileUV& uv1 = pUVs[i1];
+		const SXFileUV& uv2 = pUVs[i2];
+		const SXFileUV& uv3 = pUVs[i3];
+
+		CVector3 edge1 = v2 - v1;
+		CVector3 edge2 = v3 - v1;
+
+		float s1 = uv2.fU - uv1.fU;
+		float s2 = uv3.fU - uv1.fU;
+		float t1 = uv2.fV - uv1.fV;
+		float t2 = uv3.fV - uv1.fV;
+
+		CVector3 tangent = (t2 * edge1 - t1 * edge2) / (s1 * t2 - s2 * t1);
+
+		pSums[i1] += tangent;
+		pSums[i2] += tangent;
+		pSums[i3] += tangent;
+	}
+}
+
+// Combine the tangent sums for a range of vertices and orthogonalise them against the vertex
+// normals, four vertices at a time with SSE where available, called by ParallelFor
+void CImportXFile::OrthogonaliseTangents
+(
+	TUInt32 iBegin,
+	TUInt32 iEnd,
+	TUInt32 /*iRange*/,
+	void*   pTask
+)
+{
+	const SXFileTangentTask& task = *static_cast<SXFileTangentTask*>(pTask);
+
+	// Add the sums from further ranges of faces, in range order. Each list of sums is added as one
+	// run of floats, reading it in sequence rather than visiting every list for each vertex
+	TFloat32* pSums = reinterpret_cast<TFloat32*>(task.pTangents + iBegin);
+	const TUInt32 iNumFloats = (iEnd - iBegin) * 3;
+	for (TUInt32 iPartial = 0; iPartial < task.iNumPartials; ++iPartial)
+	{
+		const TFloat32* pPartial = reinterpret_cast<const TFloat32*>(
+			task.pPartialTangents + iPartial * task.iNumVertices + iBegin);
+		for (TUInt32 iFloat = 0; iFloat < iNumFloats; ++iFloat)
+		{
+			pSums[iFloat] += pPartial[iFloat];
+		}
+	}
+
+	// Gram-Schmidt orthogonalize
+	const CVector3* pNormals = &task.pMesh->normals[0];
+	TUInt32 iVert = iBegin;
+#if defined(GEN_SSE_TANGENTS)
+	// Four vertices at a time - load each as four floats (the last is the next vertex's x) and
+	// transpose them into x, y and z for the four vertices. The same operations are used as for
+	// a single vertex below, so the results are identical. Stops before the last vertex in the
+	// range, as the fourth float of each vertex is also stored
+	const __m128 kOne = _mm_set1_ps( 1.0f );
+	const __m128 kEpsilon = _mm_set1_ps( kfEpsilon );
+	for (; iVert + 4 < iEnd; iVert += 4)
+	{
+		TFloat32* pTangent = reinterpret_cast<TFloat32*>(task.pTangents + iVert);
+		const TFloat32* pNormal = reinterpret_cast<const TFloat32*>(pNormals + iVert);
+		__m128 x = _mm_loadu_ps( pTangent );
+		__m128 y = _mm_loadu_ps( pTangent + 3 );
+		__m128 z = _mm_loadu_ps( pTangent + 6 );
+		__m128 next = _mm_loadu_ps( pTangent + 9 );
+		_MM_TRANSPOSE4_PS( x, y, z, next );
+		__m128 nx = _mm_loadu_ps( pNormal );
+		__m128 ny = _mm_loadu_ps( pNormal + 3 );
+		__m128 nz = _mm_loadu_ps( pNormal + 6 );
+		__m128 nNext = _mm_loadu_ps( pNormal + 9 );
+		_MM_TRANSPOSE4_PS( nx, ny, nz, nNext );
+
+		__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, x ), _mm_mul_ps( ny, y ) ),
+		                         _mm_mul_ps( nz, z ) );
+		x = _mm_sub_ps( x, _mm_mul_ps( dot, nx ) );
+		y = _mm_sub_ps( y, _mm_mul_ps( dot, ny ) );
+		z = _mm_sub_ps( z, _mm_mul_ps( dot, nz ) );
+
+		// Normalise, setting near zero length tangents to zero
+		__m128 lengthSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ),
+		                              _mm_mul_ps( z, z ) );
+		__m128 nonZero = _mm_cmpnlt_ps( lengthSq, kEpsilon );
+		__m128 invLength = _mm_div_ps( kOne, _mm_sqrt_ps( lengthSq ) );
+		x = _mm_and_ps( nonZero, _mm_mul_ps( x, invLength ) );
+		y = _mm_and_ps( nonZero, _mm_mul_ps( y, invLength ) );
+		z = _mm_and_ps( nonZero, _mm_mul_ps( z, invLength ) );
+
+		_MM_TRANSPOSE4_PS( x, y, z, next );
+		_mm_storeu_ps( pTangent, x );
+		_mm_storeu_ps( pTangent + 3, y );
+		_mm_storeu_ps( pTangent + 6, z );
+		_mm_storeu_ps( pTangent + 9, next );
+	}
+#endif
+	for (; iVert < iEnd; ++iVert)
+	{
+		CVector3& tangent = task.pTangents[iVert];
+		tangent -= Dot( pNormals[iVert], tangent ) * pNormals[iVert];
+		tangent.Normalise();
+	}
 }
 
 
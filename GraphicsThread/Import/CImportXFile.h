@@ -16,12 +16,33 @@
 
 #include <vector>
 using namespace std;
-#include <d3d9.h>
-#include <d3dx9.h>
+
+#include "Defines.h"
+
+// X-files are read with the D3DX X-file API, only available with DirectX. Elsewhere only OBJ
+// files can be imported, the X-file API types are declared so the class is the same
+#if defined(GEN_DIRECTX)
+	#include <d3d9.h>
+	#include <d3dx9.h>
+#else
+	struct ID3DXFile;
+	struct ID3DXFileEnumObject;
+	struct ID3DXFileData;
+	struct _GUID;
+	typedef _GUID GUID;
+#endif
 
 #include "CVector3.h"
 #include "CMatrix4x4.h"
 #include "MeshData.h"
+#include "MeshOptimise.h"
+#include "MeshSimplify.h"
+#include "MeshCluster.h"
+#include "MeshBVH.h"
+#include "MeshBounds.h"
+#include "Profile.h"
+#include "Arena.h"
+#include "StringTable.h"
 
 namespace gen
 {
@@ -37,10 +58,205 @@ enum EImportError
 };
 
 
+// Stages of an import measured in the import report. Bytes processed are X-file data bytes read
+// for parsing and reading stages, face data bytes for mesh processing stages (as each stage
+// starts), position bytes for bounds and vertex and face data bytes written for GetSubMesh
+enum EImportStage
+{
+	kStageParseFile,        // Opening and enumerating the file, excluding the reading stages
+	kStageReadMesh,         // Reading vertices and faces
+	kStageReadNormals,      // Reading normals and normal faces
+	kStageReadOtherData,    // Reading UVs, colours, materials, duplication, adjacency and skins
+	kStageMatchFaceLists,   // Matching the vertex and normal face lists
+	kStageWeldVertices,     // Welding identical vertices
+	kStageMaterialList,     // Making the global material list
+	kStageProcessBones,     // Validating bones and matching them to frames
+	kStageSplitMeshes,      // Splitting meshes by material
+	kStageSplitLargeMeshes, // Splitting meshes too large for 16-bit indices
+	kStagePartitionBones,   // Splitting skinned meshes into bone palettes
+	kStageGenerateLODs,     // Generating levels of detail
+	kStageClusterMeshes,    // Building meshlets
+	kStageOptimiseMeshes,   // Reordering for the vertex cache and overdraw
+	kStageBuildBVHs,        // Building hierarchies for ray queries
+	kStageCalculateBounds,  // Calculating bounding boxes and spheres of meshes and frames
+	kStageGetSubMesh,       // Writing sub-mesh data (GetSubMesh / GetSubMeshData after import)
+	kiNumImportStages
+};
+
+// Get the name of an import stage, e.g. for logging
+const char* GetImportStageName
+(
+	const EImportStage eStage
+);
+
+
+class CImportXFile;
+class CImportOBJFile;
+
+// Function called by a streaming import (see SImportOptions) for each sub-mesh as soon as it is
+// ready. The sub-mesh index can be passed to the importer's sub-mesh access functions
+// (GetSubMeshSpec, GetSubMeshData etc.) during the call only, the sub-mesh is freed afterwards.
+// iStreamIndex counts the sub-meshes passed so far during the import. pData is passed through from
+// the import options
+typedef void (*TSubMeshCallback)
+(
+	CImportXFile& importFile,
+	TUInt32       iSubMesh,
+	TUInt32       iStreamIndex,
+	void*         pData
+);
+
+// Options controlling the processing applied to meshes during import
+struct SImportOptions
+{
+	// Split meshes with too many vertices for 16-bit indices into several sub-meshes that can
+	// each use 16-bit indices. Otherwise such meshes become sub-meshes with 32-bit indices
+	bool bSplitLargeMeshes;
+
+	// Split skinned meshes into partitions that each use at most the given number of bones
+	// (clamped to kiMinPaletteBones - kiMaxPaletteBones), so each can be drawn with a bone palette
+	// of bounded size. Bone indices in the vertex data then index the sub-mesh's palette (see
+	// CImportXFile::GetSubMeshPalette) rather than the nodes. Vertices keep their 4 most
+	// significant bones. Vertices used by faces in several partitions are duplicated, the report
+	// gives the overhead. 0 to leave bone indices as node indices
+	TUInt32  iMaxPaletteBones;
+
+	// Reorder faces for the post-transform vertex cache, then vertices in the order the faces use
+	// them. Optionally also reorder clusters of faces to reduce overdraw, allowing the vertex
+	// cache miss ratio (ACMR) of each cluster to rise by the given factor to create more clusters
+	bool     bOptimiseVertexCache;
+	bool     bOptimiseOverdraw;
+	TFloat32 fOverdrawThreshold;
+
+	// Weld vertices that have identical attributes (position, normal, UVs, colour and bone
+	// weights), or where all attributes are within the given epsilon. A zero epsilon only welds
+	// exactly equal vertices, so does not alter the mesh. A non-zero epsilon snaps attributes to
+	// a grid of that spacing to compare them - it welds by grid cell, not by distance. Values in
+	// the same cell are welded (they may be up to epsilon apart), but close values on either side
+	// of a cell boundary will not be
+	bool     bWeldVertices;
+	TFloat32 fWeldEpsilon;
+
+	// Number of levels of detail to generate for each mesh, in addition to the full detail mesh
+	// (up to kiMaxLODs - 1). Each level is simplified from the previous one, aiming for the given
+	// fraction of its faces, but stops early if that would exceed the maximum error (a distance in
+	// model units). No further levels are generated if a level cannot be simplified
+	TUInt32  iNumLODs;
+	TFloat32 fLODReduction;
+	TFloat32 fLODMaxError;
+
+	// Partition the full detail level of each mesh into meshlets - clusters of neighbouring faces
+	// with at most the given number of vertices and faces, with bounds for culling. The faces are
+	// reordered so each meshlet is a contiguous range
+	bool     bBuildMeshlets;
+	TUInt32  iMaxMeshletVertices;
+	TUInt32  iMaxMeshletFaces;
+
+	// Build a bounding volume hierarchy over the full detail level of each mesh for fast ray
+	// queries, with at most the given number of faces in each leaf. Built after any other
+	// processing, so face indices in query results match the final face list
+	bool     bBuildBVH;
+	TUInt32  iMaxBVHLeafFaces;
+
+	// Write the import report to the debugger output when the import completes
+	bool     bLogReport;
+
+	// Calculate tangents with the serial reference code rather than in parallel, for debugging
+	// and to check and benchmark the parallel code
+	bool     bSerialTangents;
+
+	// Only hash the data of each mesh in the file, without reading or processing it, to find
+	// which meshes have changed since a previous import (see CImportXFile::GetSubMeshSourceHash).
+	// Sub-meshes are then the meshes in the file in order, with no data
+	bool     bHashOnly;
+
+	// Stream sub-meshes to the given callback. Each mesh is processed as soon as it has been read
+	// and its sub-meshes passed to the callback, then its data is freed, so peak memory is bounded
+	// by the largest mesh rather than the whole file. Skinned meshes whose bones are driven by
+	// frames later in the file are held until the end of the file. No sub-meshes remain once the
+	// import completes. Null for no streaming
+	TSubMeshCallback pfnSubMeshCallback;
+	void*            pSubMeshCallbackData;
+
+	// Constructor sets default options
+	SImportOptions()
+	{
+		bSplitLargeMeshes = false;
+		iMaxPaletteBones = 0;
+		bWeldVertices = true;
+		fWeldEpsilon = 0.0f;
+		iNumLODs = 0;
+		fLODReduction = 0.5f;
+		fLODMaxError = 1.0e30f;
+		bBuildMeshlets = false;
+		iMaxMeshletVertices = kiDefaultMaxMeshletVertices;
+		iMaxMeshletFaces = kiDefaultMaxMeshletFaces;
+		bBuildBVH = false;
+		iMaxBVHLeafFaces = kiDefaultMaxBVHLeafFaces;
+		bLogReport = false;
+		bSerialTangents = false;
+		bHashOnly = false;
+		pfnSubMeshCallback = 0;
+		pSubMeshCallbackData = 0;
+		bOptimiseVertexCache = false;
+		bOptimiseOverdraw = false;
+		fOverdrawThreshold = 1.05f;
+	}
+};
+
+
+// Report of the processing performed during an import
+struct SImportReport
+{
+	// Total vertices in all meshes before and after welding (only gathered when the welding
+	// option is used)
+	TUInt32 iVerticesBeforeWeld;
+	TUInt32 iVerticesAfterWeld;
+
+	// Vertex cache statistics for all sub-meshes before and after optimisation (only gathered
+	// when the vertex cache optimisation option is used)
+	SVertexCacheStats vertexCacheBefore;
+	SVertexCacheStats vertexCacheAfter;
+
+	// Partitions created from skinned meshes, and the total vertices in those meshes before and
+	// after partitioning - the difference is vertices duplicated across partitions (only gathered
+	// when the bone palette option is used)
+	TUInt32 iBonePartitions;
+	TUInt32 iVerticesBeforePartition;
+	TUInt32 iVerticesAfterPartition;
+
+	// Time, bytes processed and allocations for each stage of the import. Stages do not overlap,
+	// so the times can be summed. The GetSubMesh stage accumulates over calls made after import
+	SStageStats aStages[kiNumImportStages];
+
+	// Working memory allocated from the import's arena - the number of allocations and bytes
+	// served, and the heap blocks the arena allocated for them (also counted in the stages above)
+	TUInt32 iArenaAllocations;
+	TUInt64 iArenaBytes;
+	TUInt32 iArenaBlocks;
+
+	// Constructor sets an empty report
+	SImportReport()
+	{
+		iVerticesBeforeWeld = 0;
+		iVerticesAfterWeld = 0;
+		iBonePartitions = 0;
+		iVerticesBeforePartition = 0;
+		iVerticesAfterPartition = 0;
+		iArenaAllocations = 0;
+		iArenaBytes = 0;
+		iArenaBlocks = 0;
+	}
+};
+
+
 class CImportXFile
 {
 	GEN_CLASS( CImportXFile )
 
+	// OBJ files are read into the importer's frames, meshes and materials by CImportOBJFile
+	friend class CImportOBJFile;
+
 /*-----------------------------------------------------------------------------------------
 	Constructors/Destructors
 -----------------------------------------------------------------------------------------*/
@@ -49,6 +265,9 @@ public:
 	CImportXFile()
 	{
 		m_bImported = false;
+		m_pCurrentStage = 0;
+		m_iNumStreamedSubMeshes = 0;
+		m_iNumSourceMeshes = 0;
 	}
 
 private:
@@ -71,18 +290,30 @@ public:
 		return m_bImported;
 	}
 
-	// Import a Microsoft X-File into a list of meshes and a frame hierarchy
+	// Import a Microsoft X-File, or a Wavefront OBJ file (see CImportOBJFile), into a list of
+	// meshes and a frame hierarchy
 	// Possible return values:
 	//		kSuccess:			...
-	//		kFileError:			Missing file or not an X-file
+	//		kFileError:			Missing file or not an X-file or OBJ file
 	//		kInvalidData:		The file could not be parsed correctly, or contains invalid data
 	//		kOutOfSystemMemory:	...
-	//		kSystemFailure:		X-file API failure
+	//		kSystemFailure:		X-file API failure, or an X-file on a platform without the API
 	EImportError ImportFile
 	(
-		const string& sXName
+		const string&         sXName,
+		const SImportOptions& options = SImportOptions()
 	);
 
+	// Get report of the processing performed by the last import
+	const SImportReport& GetImportReport() const
+	{
+		return m_Report;
+	}
+
+	// Write the report of the last import to the debugger output - the time, bytes processed and
+	// allocations for each stage
+	void LogImportReport() const;
+
 
 	/////////////////////////////////////
 	// Data access
@@ -100,28 +331,119 @@ public:
 		SMeshNode* const pNode
 	) const;
 
+	// Get the characters of a name from the last import. Node names and texture file names in
+	// SMeshNode and SMeshMaterial are IDs of names, which are only valid until the next import -
+	// copy the characters to keep a name. IDs beyond the names of the last import are rejected,
+	// but other IDs kept from an earlier import silently give the wrong name
+	const char* GetName
+	(
+		const TUInt32 iName
+	) const
+	{
+		GEN_ASSERT_OPT( iName < m_Names.GetNumStrings(), "Name ID is not from the last import" );
+		return m_Names.GetString( iName );
+	}
+
 
-	// Get number of sub-meshes in the mesh hierarchy (meshes in an X-File)
+	// Get number of sub-meshes in the mesh hierarchy (meshes in an X-File). Always 0 after a
+	// streaming import, use GetNumStreamedSubMeshes
 	TUInt32 GetNumSubMeshes() const
 	{
 		return static_cast<TUInt32>(m_Meshes.size());
 	}
 
+	// Get number of sub-meshes passed to the callback by the last streaming import
+	TUInt32 GetNumStreamedSubMeshes() const
+	{
+		return m_iNumStreamedSubMeshes;
+	}
+
 	// Get the render method used for the given sub-mesh
 	ERenderMethod GetSubMeshRenderMethod( const TUInt32 iSubMesh ) const;
 		
 	// Get the specification and data for given submesh, returned through a pointer. May request
-	// tangents to be calculated
+	// tangents to be calculated. The vertex and face data are allocated with new[], the caller
+	// must delete[] them. Prefer GetSubMeshSpec / GetSubMeshData to write directly to buffers.
+	// Adds its time to the import report, so calls must not be made from several threads at once
 	// Possible return values:
 	//		kSuccess:			...
 	//		kOutOfSystemMemory:	...
-	EImportError CImportXFile::GetSubMesh
+	EImportError GetSubMesh
 	(
 		const TUInt32 iSubMesh,
 		SSubMesh*     pSubMesh,
 		bool          bTangents = false
+	);
+
+	// Get the specification of given submesh without its data - all fields except the vertex and
+	// face pointers, which are set to 0. Used to size the memory passed to GetSubMeshData. May
+	// request tangents (only provided if the mesh has normals and texture coordinates) and choose
+	// the vertex layout
+	void GetSubMeshSpec
+	(
+		const TUInt32       iSubMesh,
+		SSubMesh*           pSubMesh,
+		bool                bTangents = false,
+		const EVertexLayout vertexLayout = InterleavedVertices
+	) const;
+
+	// Write the vertex and face data for given submesh into caller-provided memory, e.g. locked
+	// vertex and index buffers, with no intermediate copy. The submesh must have been prepared by
+	// GetSubMeshSpec. The vertex memory must hold numVertices * vertexSize bytes and the face
+	// memory numFaces * 3 * indexSize bytes. The submesh's data pointers are set to the memory.
+	// Adds its time to the import report, so calls must not be made from several threads at once
+	// Possible return values:
+	//		kSuccess:			...
+	//		kOutOfSystemMemory:	...
+	EImportError GetSubMeshData
+	(
+		const TUInt32 iSubMesh,
+		SSubMesh*     pSubMesh,
+		TUInt8*       pVertices,
+		TUInt8*       pFaces
+	);
+
+	// Copy the meshlets for given submesh into caller-provided memory, which must hold the number
+	// of meshlets given by GetSubMeshSpec
+	void GetSubMeshMeshlets
+	(
+		const TUInt32 iSubMesh,
+		SMeshlet*     pMeshlets
 	) const;
 
+	// Get the index of the mesh in the file that given submesh was read from, counting the meshes
+	// in file order from 0. Submeshes split from one mesh share the index. After a hash-only import
+	// the submeshes are the meshes in the file, so this is the submesh index. Meshes with equal
+	// data have equal hashes, so the index tells them apart when a file is re-imported
+	TUInt32 GetSubMeshSourceMesh
+	(
+		const TUInt32 iSubMesh
+	) const
+	{
+		return m_Meshes[iSubMesh].iSourceMesh;
+	}
+
+	// Get a hash of the X-file data that given submesh was read from - its mesh and the mesh's
+	// child objects (normals, materials etc.). Submeshes split from one mesh share the hash. Used
+	// to identify meshes that are unchanged when a file is re-imported
+	TUInt32 GetSubMeshSourceHash
+	(
+		const TUInt32 iSubMesh
+	) const
+	{
+		return m_Meshes[iSubMesh].iSourceHash;
+	}
+
+	// Get the bounding volume hierarchy for given submesh, empty if none was built. Valid until
+	// the next import - copy it to keep it longer
+	const CMeshBVH& GetSubMeshBVH
+	(
+		const TUInt32 iSubMesh
+	) const
+	{
+		return m_Meshes[iSubMesh].bvh;
+	}
+
 
 	// Get the number of materials used in the mesh (across all submeshes - i.e. in all meshes
 	// in an X-File)
@@ -150,7 +472,14 @@ public:
 	) const;
 
 
-	// TODO: bones
+	// Copy the bone palette for given submesh into caller-provided memory, which must hold the
+	// number of palette bones given by GetSubMeshSpec. Each entry is the node driving the bone
+	// with that index in the vertex data
+	void GetSubMeshPalette
+	(
+		const TUInt32 iSubMesh,
+		TUInt32*      pNodes
+	) const;
 
 
 /*-----------------------------------------------------------------------------------------
@@ -187,6 +516,12 @@ private:
 	};
 	typedef vector<SXFileFace> TXFileFaces;
 
+	// Working space containers allocated from the import arena (see m_Arena), for temporary data
+	// used within a single processing function
+	typedef vector<TUInt32, CArenaAllocator<TUInt32> >       TXFileTempInts;
+	typedef vector<SXFileFace, CArenaAllocator<SXFileFace> > TXFileTempFaces;
+	typedef vector<TFloat32, CArenaAllocator<TFloat32> >     TXFileTempFloats;
+
 
 	// 2D texture coordinate in an X-file
 	struct SXFileUV
@@ -217,15 +552,21 @@ private:
 
 
 	// Material used in an X-file, material name, diffuse, specular and emmisive colours and a
-	// single (diffuse) texture
+	// single (diffuse) texture. Names are IDs in the import's name table (see m_Names)
 	struct SXFileMaterial
 	{
-		string           sName;
+		TUInt32          iName;
 		SXFileRGBAColour faceColour;
 		TFloat32         fSpecularPower;
 		SXFileRGBColour  specularColour;
 		SXFileRGBColour  emmisiveColour;
-		string           sTextureName;
+		TUInt32          iTextureName;
+		bool             bPlain; // Name contains "Plain" (see GetMaterialRenderMethod)
+
+		// Names of the textures used by the material's render method - the texture name, then
+		// the name prefixed with the texture number for extra textures. Only set for materials in
+		// the global list (see NameMaterialTextures)
+		TUInt32          aiTextureNames[kiMaxTextures];
 	};
 	typedef vector<SXFileMaterial> TXFileMaterials;
 
@@ -236,6 +577,13 @@ private:
 		const SXFileMaterial& cmp2
 	);
 
+	// Hash of the contents of a material - materials that compare equal have equal hashes. Used to
+	// index material lists without comparing every pair of materials
+	static TUInt32 HashMaterial
+	(
+		const SXFileMaterial& material
+	);
+
 
 	// Single bone weight as used in the bone structure below, contains the index of the affected
 	// vertex and the weight that the bone applies to that vertex
@@ -251,7 +599,7 @@ private:
 	{
 		// Container types used
 
-		string            sFrameName;   // Name of the frame that drives this bone
+		TUInt32           iFrameName;   // Name (ID) of the frame that drives this bone
 		TUInt32           iFrame;       // Index of the frame that drives this bone
 		TXFileBoneWeights weights;
 		CMatrix4x4        offsetMatrix; // TODO: Would like aligned matrices - but vector can't do it
@@ -263,7 +611,7 @@ private:
 	// Frame in an X-file hierarchy
 	struct SXFileFrame
 	{
-		string     sName;
+		TUInt32    iName; // ID in the import's name table (see m_Names)
 		TUInt32    iDepth;
 		TUInt32    iParentIndex;
 		TUInt32    iNumChildren;
@@ -273,12 +621,29 @@ private:
 	typedef vector<SXFileFrame> TXFileFrames;
 
 
+	// A level of detail of a mesh - a range of faces, the number of vertices used (the first ones
+	// in the vertex list) and the estimated error of the level
+	struct SXFileLOD
+	{
+		TUInt32  iFirstFace;
+		TUInt32  iNumFaces;
+		TUInt32  iNumVertices;
+		TFloat32 fError;
+	};
+	typedef vector<SXFileLOD> TXFileLODs;
+
+
 	// A single mesh in an X-File
 	struct SXFileMesh
 	{
 		// Index of frame that holds this mesh
 		TUInt32           iParentFrame;
 
+		// Index in the file of the mesh this mesh was read from, and a hash of the X-file data it
+		// was read from, see GetSubMeshSourceMesh and GetSubMeshSourceHash
+		TUInt32           iSourceMesh;
+		TUInt32           iSourceHash;
+
 		// Vertex data - lists of vertices, normals, texture coords (UVs) and colours. Vertex list
 		// is always present. The normal list may initially be a different length than the vertex
 		// list (see below), but the importer will adjust the data duplication to match them. 
@@ -334,6 +699,24 @@ private:
 		TUInt16           iMaxBonesPerVertex;
 		TUInt16           iMaxBonesPerFace;
 		TXFileBones       bones;
+
+		// Bone palette - the frame driving each bone index in the vertex data, being the frames of
+		// the bones above followed by the parent frame if any vertex has no bone influences.
+		// Empty if bone indices are frame indices (see SImportOptions::iMaxPaletteBones)
+		TXFileInts        palette;
+
+		// Levels of detail - ranges in the face list above, the first being the full detail mesh.
+		// Further levels are added to the end of the face list. Empty if there is just one level
+		TXFileLODs        lods;
+
+		// Meshlets covering the full detail level, empty if none were built
+		vector<SMeshlet>  meshlets;
+
+		// Bounding volume hierarchy over the full detail level, empty if none was built
+		CMeshBVH          bvh;
+
+		// Bounds of the vertices, calculated once the mesh is processed
+		SMeshBounds       bounds;
 	};
 	typedef vector<SXFileMesh> TXFileMeshes;
 
@@ -396,6 +779,14 @@ private:
 		const TUInt32  iCurrFrame
 	);
 
+	// Weld the vertices of the mesh just read if required, and pass it on if streaming
+	// Possible return values:
+	//		kInvalidData:		Could not find a frame matching one of the bones (when streaming)
+	EImportError CompleteMesh
+	(
+		const TUInt32 iMesh
+	);
+
 
 	/////////////////////////////////////
 	// X-File template parsing
@@ -498,13 +889,21 @@ private:
 	);
 
 
+	// Get the name of an X-file object as an ID in the name table (kiEmptyString if unnamed)
 	EImportError GetXFileDataName
 	(
 		ID3DXFileData* pXFileData,
-		string&        sName
+		TUInt32*       piName
 	);
 
 
+	// Hash the data of an X-file object and all of its child objects, chaining from the given hash
+	EImportError HashXFileData
+	(
+		ID3DXFileData* pXFileData,
+		TUInt32*       piHash
+	);
+
 	EImportError LockXFileData
 	(
 		ID3DXFileData* pXFileData,
@@ -554,28 +953,212 @@ private:
 		const TUInt32  iMesh
 	);
 
+	// Weld vertices with identical attributes (including bone weights), or attributes in the
+	// same cell of a grid with the given epsilon spacing, into a single vertex and update the
+	// face list to match. Uses a hash table over the vertex attributes so it is linear in the
+	// number of vertices. Neighbouring cells are not searched
+	void WeldVertices
+	(
+		const TUInt32  iMesh,
+		const TFloat32 fEpsilon
+	);
+
+	// Write the key words representing a vertex attribute for comparison during welding,
+	// returning a pointer to the word after them. Either the float bits (with -0 as +0) in one
+	// word or, if an inverse epsilon is given, the 64-bit index of the nearest grid point in two
+	static TUInt32* WeldValue
+	(
+		TFloat32       fValue,
+		const TFloat32 fInvEpsilon,
+		TUInt32*       piKey
+	);
+
 	// Create a global list of materials used by all the meshes - removing any duplicates. Also 
 	// create a list for each mesh mapping local material indices to global ones
 	void MakeGlobalMaterialList();
 
+	// Add the names of the textures used by the render method of the given global material to the
+	// name table, so GetMaterial can return them without changing the table
+	void NameMaterialTextures
+	(
+		const TUInt32 iMaterial
+	);
+
 
 	/////////////////////////////////////
 	// Bone support functions
 
-	// Add new bone weight/index to a vertex - maximum of 4, removes least signficant if necessary
-	static void AddBoneInfluence( TUInt32 bone, TFloat32 weight,
-	                              TFloat32* vertWeights, TUInt8* vertBones );
+	// Add new bone weight/index to a vertex - maximum of 4, removes least signficant if necessary.
+	// The influences are held as a structure of arrays, one array of weights and one of bones for
+	// each of the 4 slots. Instantiated for the type of bone index held
+	template <typename TBoneIndex>
+	static void AddBoneInfluence( TUInt32 bone, TFloat32 weight, TUInt32 vertex,
+	                              TFloat32* const weights[4], TBoneIndex* const bones[4] );
 
 	// Match the bones in each mesh to their frames
 	EImportError ProcessBones();
 
 
+	/////////////////////////////////////
+	// Sub-mesh output
+
+	// Flags for the components present in a vertex (vertex position always present)
+	enum EVertexComponents
+	{
+		kSkinningComponent     = 1,
+		kNormalComponent       = 2,
+		kTangentComponent      = 4,
+		kTextureCoordComponent = 8,
+		kVertexColourComponent = 16,
+		kNumComponentSets      = 32,
+	};
+
+	// Write interleaved vertex data for a mesh. Instantiated for each set of vertex components so
+	// that the vertex layout is fixed at compile time, with no per-vertex branching. Space is left
+	// for skinning data, which is written by WriteBoneInfluences
+	template <TUInt32 iComponents>
+	static void WriteInterleavedVertices
+	(
+		const SXFileMesh&    mesh,
+		const TXFileVectors& tangents,
+		TUInt8*              pVertices
+	);
+
+	// Write vertex data for a mesh as separate streams, one per component, as described for
+	// SSubMesh. Space is left for skinning data, which is written by WriteBoneInfluences
+	static void WriteVertexStreams
+	(
+		const SXFileMesh&    mesh,
+		const TXFileVectors& tangents,
+		const SSubMesh&      subMesh,
+		TUInt8*              pVertices
+	);
+
+	// Write the skinning data for a mesh into vertex data written by one of the functions above -
+	// the 4 most significant bone influences of each vertex, with weights normalised to add up to
+	// 1. Influences are gathered into arrays for each slot, normalised in one pass over the arrays,
+	// then written to the vertices in a single sweep
+	static void WriteBoneInfluences
+	(
+		const SXFileMesh& mesh,
+		const SSubMesh&   subMesh,
+		TUInt8*           pVertices
+	);
+
+
 	/////////////////////////////////////
 	// Mesh processing
 
+	// Apply the processing selected by the import options to all meshes - splitting, levels of
+	// detail, meshlets, optimisation and ray query hierarchies
+	void ProcessMeshes();
+
+	// Streaming import: match bones, process the meshes read so far and pass their sub-meshes to
+	// the callback, then free them. Before the end of the file, a mesh whose bones are driven by
+	// frames not yet read is held back instead
+	// Possible return values:
+	//		kInvalidData:		Could not find a frame matching one of the bones (at end of file)
+	EImportError StreamMeshes
+	(
+		const bool bEndOfFile
+	);
+
 	// Split each mesh into a set of meshes - each of which contains only a single material
 	void SplitMeshes();
 
+	// Split any mesh with more than the given number of vertices into several meshes that each
+	// have at most that many. Faces are kept in their original order, so each new mesh is a run
+	// of consecutive faces, preserving their locality
+	void SplitLargeMeshes
+	(
+		const TUInt32 iMaxVertices
+	);
+
+	// Split each skinned mesh into partitions that each use at most the given number of bones,
+	// and give each a bone palette. Faces are taken in order of their main bone, each added to the
+	// current partition if its bones fit
+	void PartitionBones
+	(
+		const TUInt32 iMaxBones
+	);
+
+	// Keep only the 4 most significant bone influences of each vertex of a mesh (those written
+	// by WriteBoneInfluences), and remove bones that no longer influence any vertex
+	void ReduceBoneInfluences
+	(
+		SXFileMesh* pMesh
+	);
+
+	// Set the bone palette of a mesh from its bones, adding its parent frame if any vertex has no
+	// bone influences
+	static void MakeBonePalette
+	(
+		SXFileMesh* pMesh
+	);
+
+	// Generate a chain of levels of detail for each mesh according to the import options. Each
+	// level is simplified from the previous one and its faces added to the end of the face list
+	void GenerateLODs();
+
+	// Get the range of faces in the full detail level of a mesh
+	static TUInt32 NumFullDetailFaces
+	(
+		const SXFileMesh& mesh
+	);
+
+	// Reorder the vertices of a mesh with levels of detail so those used by coarser levels come
+	// first, otherwise keeping their order. Each level then uses a prefix of the vertex list, whose
+	// length is stored in the level
+	void SortLODVertices
+	(
+		SXFileMesh* pMesh
+	);
+
+	// Partition the full detail level of each mesh into meshlets according to the import options
+	void ClusterMeshes();
+
+	// Reorder the faces and vertices of each mesh for efficient rendering, according to the
+	// import options. Each level of detail is reordered separately, as is each meshlet. Records
+	// vertex cache statistics (of the full detail level) before and after in the import report
+	void OptimiseMeshes();
+
+	// Build a bounding volume hierarchy over the full detail level of each mesh
+	void BuildMeshBVHs();
+
+	// Calculate the bounds of each mesh and add them to the bounds of the frame holding it
+	void CalculateMeshBounds();
+
+	// Add the bounds of each frame to those of its parent, in the parent's space, so each frame's
+	// bounds contain all the meshes below it. Called once all the meshes have been processed
+	void CalculateFrameBounds();
+
+	// Return the total bytes of face data in all meshes, for the import report
+	TUInt64 FaceDataBytes() const;
+
+	// Reorder the vertex data of a mesh given a map from old to new vertex indices, discarding
+	// vertices mapped beyond the new vertex count. Does not alter the face list
+	static void RemapMeshVertices
+	(
+		const TUInt32* piRemap,
+		const TUInt32  iNumNewVertices,
+		SXFileMesh*    pMesh
+	);
+
+	// Copy a subset of the faces of a mesh into another (empty) mesh, along with the vertex data
+	// and bone weights that those faces use. The vertex map must be the size of the source
+	// vertex list and filled with the source vertex count (as an unused marker), it is returned in
+	// the same state. The used vertex list is working space, passed in so it can be reused over
+	// many calls
+	static void CopyMeshFaces
+	(
+		const SXFileMesh& srcMesh,
+		const TUInt32*    piFaces,
+		const TUInt32     iNumFaces,
+		TXFileTempInts&   vertexMap,
+		TXFileTempInts&   usedVertices,
+		SXFileMesh*       pDestMesh
+	);
+
 	// Create a list of tangent vectors for the given mesh. The tangent vector is the direction of
 	// a vertex's texture U axis in model-space. Returns true on success
 	bool CalculateTangents
@@ -584,22 +1167,88 @@ private:
 		TXFileVectors* pTangents
 	) const;
 
+	// Reference version of CalculateTangents on a single thread, used with the serial tangents
+	// option. The mesh must have normals and texture coordinates
+	void CalculateTangentsSerial
+	(
+		TUInt32        iMesh,
+		TXFileVectors* pTangents
+	) const;
+
+	// Data shared by the threads calculating tangents for a mesh
+	struct SXFileTangentTask
+	{
+		const SXFileMesh* pMesh;
+		TUInt32           iNumVertices;
+		CVector3*         pTangents;        // Tangent sums for the first range of faces, then
+		                                    // the final tangents
+		CVector3*         pPartialTangents; // Tangent sums for each further range of faces
+		TUInt32           iNumPartials;     // Number of further ranges
+	};
+
+	// Sum the tangents of a range of faces into per-vertex sums for that range, called by
+	// ParallelFor
+	static void SumFaceTangents
+	(
+		TUInt32 iBegin,
+		TUInt32 iEnd,
+		TUInt32 iRange,
+		void*   pTask
+	);
+
+	// Combine the tangent sums for a range of vertices and orthogonalise them against the vertex
+	// normals, four vertices at a time with SSE where available, called by ParallelFor
+	static void OrthogonaliseTangents
+	(
+		TUInt32 iBegin,
+		TUInt32 iEnd,
+		TUInt32 iRange,
+		void*   pTask
+	);
+
 
 	/*---------------------------------------------------------------------------------------------
 		Data
 	---------------------------------------------------------------------------------------------*/
 
 	// Has any data been loaded into the lists below
-	bool            m_bImported;
+	bool                  m_bImported;
+
+	// Options used for the current import and report of the processing performed, and the
+	// innermost stage being measured. The report is also updated by GetSubMesh / GetSubMeshData
+	SImportOptions        m_Options;
+	SImportReport         m_Report;
+	CStageTimer*          m_pCurrentStage;
 
 	// The list of frames forms a flattened depth-first hierarchy
-	TXFileFrames    m_Frames;
+	TXFileFrames          m_Frames;
+
+	// Bounds of the meshes held by each frame, then of all the meshes below each frame once the
+	// import is complete (see CalculateFrameBounds). Kept separately from the frames as meshes
+	// may be streamed before all the frames have been read
+	vector<SMeshBounds>   m_FrameBounds;
 
 	// Each mesh is held by a frame in the hierarchy above
-	TXFileMeshes    m_Meshes;
+	TXFileMeshes          m_Meshes;
+
+	// Number of meshes read from the file so far, giving each its index in the file
+	TUInt32               m_iNumSourceMeshes;
+
+	// Streaming import only - meshes held until the end of the file for their bone frames, and
+	// the number of sub-meshes passed to the callback
+	TXFileMeshes          m_HeldMeshes;
+	TUInt32               m_iNumStreamedSubMeshes;
+
+	// Arena for the working memory of mesh processing, reset for each file (and each mesh when
+	// streaming). Mesh data is not allocated here as it is freed mesh by mesh when streaming
+	CArena                m_Arena;
 
 	// Global list of materials used by all the meshes
-	TXFileMaterials m_Materials;
+	TXFileMaterials       m_Materials;
+
+	// Names of frames, bones, materials and textures, so names are compared by comparing IDs.
+	// Cleared for each file
+	CStringTable          m_Names;
 };
 
 
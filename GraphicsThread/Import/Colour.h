@@ -8,10 +8,12 @@
 #ifndef GEN_COLOUR_H_INCLUDED
 #define GEN_COLOUR_H_INCLUDED
 
-#include <d3dx9.h>
-
 #include "Defines.h"
 
+#if defined(GEN_DIRECTX)
+	#include <d3dx9.h>
+#endif
+
 namespace gen
 {
 
@@ -32,6 +34,8 @@ struct SColourRGBA
 };
 
 
+#if defined(GEN_DIRECTX)
+
 // Reinterpret a SColourRGBA as a D3DXCOLOR - in various forms (const & ptr)
 inline D3DXCOLOR& ToD3DXCOLOR( SColourRGBA& colour )
 {
@@ -43,6 +47,8 @@ inline const D3DXCOLOR& ToD3DXCOLOR( const SColourRGBA& colour )
 	return *reinterpret_cast<const D3DXCOLOR*>(&colour);
 }
 
+#endif // GEN_DIRECTX
+
 
 } // namespace gen
 
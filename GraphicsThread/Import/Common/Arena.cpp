@@ -0,0 +1,131 @@
+/**************************************************************************************************
+	Module:       Arena.cpp
+	Date created: 18/10/26
+
+	Monotonic memory arena for short-lived working memory, and an allocator to use it with standard
+	library containers
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include "Arena.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Constructors/Destructors
+ ------------------------------------------------------------------------------------------------*/
+
+// Constructor, no memory is allocated until needed
+CArena::CArena
+(
+	const TUInt32 iFirstBlockSize /*= kiDefaultArenaBlockSize*/
+)
+{
+	m_pBlocks = 0;
+	m_pFree = 0;
+	m_pEnd = 0;
+	m_iNextBlockSize = iFirstBlockSize;
+	m_iNumAllocations = 0;
+	m_iNumBlocks = 0;
+	m_iBytesAllocated = 0;
+}
+
+// Destructor releases all blocks
+CArena::~CArena()
+{
+	while (m_pBlocks)
+	{
+		SBlock* pNext = m_pBlocks->pNext;
+		::operator delete( m_pBlocks );
+		m_pBlocks = pNext;
+	}
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Public interface
+ ------------------------------------------------------------------------------------------------*/
+
+// Allocate memory from the arena, aligned to kiArenaAlignment. A new block is allocated from the
+// heap if the current one is full. Throws std::bad_alloc on failure
+void* CArena::Allocate
+(
+	const size_t iSize
+)
+{
+	// Round the size up to keep the next allocation aligned, zero sized allocations must still
+	// return distinct memory
+	const size_t iAlignMask = kiArenaAlignment - 1;
+	size_t iAlignedSize = (iSize + iAlignMask) & ~iAlignMask;
+	if (iAlignedSize == 0)
+	{
+		iAlignedSize = kiArenaAlignment;
+	}
+	if (static_cast<size_t>(m_pEnd - m_pFree) < iAlignedSize)
+	{
+		NewBlock( iAlignedSize );
+	}
+
+	void* pMemory = m_pFree;
+	m_pFree += iAlignedSize;
+	++m_iNumAllocations;
+	m_iBytesAllocated += iSize;
+	return pMemory;
+}
+
+// Release all memory allocated from the arena. Only the largest block is kept, so an arena reused
+// for similar work settles on a single block. All memory from the arena must be unused
+void CArena::Reset()
+{
+	if (!m_pBlocks)
+	{
+		return;
+	}
+
+	// Blocks grow in size, so the current block (first in the list) is the largest
+	SBlock* pBlock = m_pBlocks->pNext;
+	while (pBlock)
+	{
+		SBlock* pNext = pBlock->pNext;
+		::operator delete( pBlock );
+		pBlock = pNext;
+	}
+	m_pBlocks->pNext = 0;
+	m_pFree = reinterpret_cast<TUInt8*>(m_pBlocks) + kiHeaderSize;
+	m_pEnd = reinterpret_cast<TUInt8*>(m_pBlocks) + m_pBlocks->iSize;
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Private interface
+ ------------------------------------------------------------------------------------------------*/
+
+// Allocate a new block with room for at least the given number of bytes and make it current
+void CArena::NewBlock
+(
+	const size_t iMinSize
+)
+{
+	// Double the block size each time so the number of blocks grows slowly, but always make room
+	// for the allocation
+	size_t iBlockSize = m_iNextBlockSize;
+	while (iBlockSize < kiHeaderSize + iMinSize)
+	{
+		iBlockSize *= 2;
+	}
+	m_iNextBlockSize = iBlockSize * 2;
+
+	SBlock* pBlock = static_cast<SBlock*>(::operator new( iBlockSize ));
+	pBlock->pNext = m_pBlocks;
+	pBlock->iSize = iBlockSize;
+	m_pBlocks = pBlock;
+	m_pFree = reinterpret_cast<TUInt8*>(pBlock) + kiHeaderSize;
+	m_pEnd = reinterpret_cast<TUInt8*>(pBlock) + iBlockSize;
+	++m_iNumBlocks;
+}
+
+
+} // namespace gen
@@ -0,0 +1,237 @@
+/**************************************************************************************************
+	Module:       Arena.h
+	Date created: 18/10/26
+
+	Monotonic memory arena for short-lived working memory, and an allocator to use it with standard
+	library containers
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_ARENA_H_INCLUDED
+#define GEN_ARENA_H_INCLUDED
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
+#include "Defines.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Arena
+ ------------------------------------------------------------------------------------------------*/
+
+// Default size of the first block allocated by an arena, later blocks double in size
+const TUInt32 kiDefaultArenaBlockSize = 64 * 1024;
+
+// Alignment of memory allocated from an arena, enough for any of the basic types
+const TUInt32 kiArenaAlignment = 16;
+
+
+// Monotonic arena - memory is allocated by moving a pointer through large blocks and is only
+// released all at once by Reset. Replaces many small heap allocations with a few large ones when
+// the memory is all released together (e.g. working memory for one file import). Not thread-safe
+class CArena
+{
+	GEN_CLASS( CArena )
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+public:
+	// Constructor, no memory is allocated until needed
+	CArena
+	(
+		const TUInt32 iFirstBlockSize = kiDefaultArenaBlockSize
+	);
+
+	// Destructor releases all blocks
+	~CArena();
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CArena( const CArena& );
+	CArena& operator=( const CArena& );
+
+
+/*-----------------------------------------------------------------------------------------
+	Public interface
+-----------------------------------------------------------------------------------------*/
+public:
+
+	// Allocate memory from the arena, aligned to kiArenaAlignment. A new block is allocated from
+	// the heap if the current one is full. Throws std::bad_alloc on failure
+	void* Allocate
+	(
+		const size_t iSize
+	);
+
+	// Release all memory allocated from the arena. Only the largest block is kept, so an arena
+	// reused for similar work settles on a single block. All memory from the arena must be unused
+	void Reset();
+
+
+	/////////////////////////////////////
+	// Statistics (accumulated over the life of the arena, Reset does not clear them)
+
+	// Number of allocations made from the arena
+	TUInt32 GetNumAllocations() const
+	{
+		return m_iNumAllocations;
+	}
+
+	// Number of blocks allocated from the heap
+	TUInt32 GetNumBlocks() const
+	{
+		return m_iNumBlocks;
+	}
+
+	// Total bytes allocated from the arena
+	TUInt64 GetBytesAllocated() const
+	{
+		return m_iBytesAllocated;
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Header at the start of each block, blocks form a list with the current block first
+	struct SBlock
+	{
+		SBlock* pNext;
+		size_t  iSize; // Including this header
+	};
+
+	// Size of the block header, rounded up to keep allocations aligned
+	static const size_t kiHeaderSize =
+		(sizeof(SBlock) + kiArenaAlignment - 1) & ~static_cast<size_t>(kiArenaAlignment - 1);
+
+	// Allocate a new block with room for at least the given number of bytes and make it current
+	void NewBlock
+	(
+		const size_t iMinSize
+	);
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	// List of blocks, the current block first, and the free space in the current block
+	SBlock*  m_pBlocks;
+	TUInt8*  m_pFree;
+	TUInt8*  m_pEnd;
+
+	// Size of the next block to allocate
+	size_t   m_iNextBlockSize;
+
+	// Statistics
+	TUInt32  m_iNumAllocations;
+	TUInt32  m_iNumBlocks;
+	TUInt64  m_iBytesAllocated;
+};
+
+
+/*------------------------------------------------------------------------------------------------
+	Arena allocator
+ ------------------------------------------------------------------------------------------------*/
+
+// Standard library allocator that allocates from an arena. Deallocation does nothing, the memory
+// is released when the arena is reset. Can be constructed from an arena, so an arena can be passed
+// wherever a container takes an allocator. Containers using it must be destroyed before the
+// arena is reset
+template <class T>
+class CArenaAllocator
+{
+public:
+	// Types required of an allocator
+	typedef T              value_type;
+	typedef T*             pointer;
+	typedef const T*       const_pointer;
+	typedef T&             reference;
+	typedef const T&       const_reference;
+	typedef size_t         size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	template <class U>
+	struct rebind
+	{
+		typedef CArenaAllocator<U> other;
+	};
+
+	// Construct from an arena, or from an allocator for another type using the same arena
+	CArenaAllocator( CArena& arena ) : m_pArena( &arena ) {}
+	template <class U>
+	CArenaAllocator( const CArenaAllocator<U>& other ) : m_pArena( other.GetArena() ) {}
+
+	CArena* GetArena() const
+	{
+		return m_pArena;
+	}
+
+	// Allocate / deallocate memory for a number of objects
+	pointer allocate
+	(
+		size_type   iNum,
+		const void* = 0
+	)
+	{
+		if (iNum > max_size())
+		{
+			throw std::bad_alloc();
+		}
+		return static_cast<pointer>(m_pArena->Allocate( iNum * sizeof(T) ));
+	}
+	void deallocate( pointer, size_type ) {}
+
+	// Construct / destroy an object in allocated memory
+	void construct( pointer p, const T& value )
+	{
+		new (static_cast<void*>(p)) T( value );
+	}
+	void destroy( pointer p )
+	{
+		p->~T();
+	}
+
+	pointer address( reference value ) const
+	{
+		return &value;
+	}
+	const_pointer address( const_reference value ) const
+	{
+		return &value;
+	}
+
+	size_type max_size() const
+	{
+		return std::numeric_limits<size_type>::max() / sizeof(T);
+	}
+
+private:
+	CArena* m_pArena;
+};
+
+// Allocators are equal if they use the same arena - memory from one can be released by the other
+template <class T, class U>
+inline bool operator==( const CArenaAllocator<T>& a, const CArenaAllocator<U>& b )
+{
+	return a.GetArena() == b.GetArena();
+}
+template <class T, class U>
+inline bool operator!=( const CArenaAllocator<T>& a, const CArenaAllocator<U>& b )
+{
+	return a.GetArena() != b.GetArena();
+}
+
+
+} // namespace gen
+
+#endif // GEN_ARENA_H_INCLUDED
@@ -0,0 +1,43 @@
+/**************************************************************************************************
+	Module:       GCCDefines.cpp
+	Date created: 18/10/26
+
+	Utility functions for GCC and Clang on POSIX platforms (e.g. Linux)
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <stdio.h>
+
+#include "Defines.h"
+#include "GCCDefines.h"
+#include "Error.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	System messages
+ ------------------------------------------------------------------------------------------------*/
+
+// There is no GUI on these platforms (e.g. headless servers), so messages are written to the
+// standard error stream. Yes/No questions cannot be answered and return false. Return value is
+// whether the OK button would have been pressed
+bool SystemMessageBox
+(
+	const string& sMessage, // Main message to display
+	const string& sCaption, // Caption to display before the message
+	const bool    bYesNo    // Question needing Yes or No (returns false)
+)
+{
+	GEN_GUARD;
+
+	fprintf( stderr, "%s: %s\n", sCaption.c_str(), sMessage.c_str() );
+	return !bYesNo;
+
+	GEN_ENDGUARD;
+}
+
+
+} // namespace gen
@@ -0,0 +1,99 @@
+/**************************************************************************************************
+	Module:       GCCDefines.h
+	Date created: 18/10/26
+
+	Utility functions for GCC and Clang on POSIX platforms (e.g. Linux)
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_GCC_DEFINES_H_INCLUDED
+#define GEN_GCC_DEFINES_H_INCLUDED
+
+#include <string>
+using namespace std;
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Compiler settings
+ ------------------------------------------------------------------------------------------------*/
+
+// Check compiler version - C++11 needed for the standard thread library
+#if __cplusplus < 201103L
+	#error "Compiler version not supported - C++11 or later required (e.g. -std=c++11)"
+#endif
+
+// Check compiler options
+#ifndef __EXCEPTIONS
+	#error "Bad compiler option: C++ exception handling must be enabled"
+#endif
+
+
+/*------------------------------------------------------------------------------------------------
+	Macros
+ ------------------------------------------------------------------------------------------------*/
+
+// Prefix to align a structure or class in memory to a multiple of the given amount
+#define GEN_ALIGN(a) __attribute__((aligned(a)))
+
+// Prefix for a static or global variable with a separate instance for each thread
+#define GEN_THREAD_LOCAL __thread
+
+
+/*------------------------------------------------------------------------------------------------
+	Constants
+ ------------------------------------------------------------------------------------------------*/
+
+// Define compiler name
+#if defined(__clang__)
+	static const string ksCompiler = "Clang";
+#else
+	static const string ksCompiler = "GCC";
+#endif
+
+
+// String locale
+const string ksPathSeparator = "/";
+const string ksNewline = "\n";
+
+
+/*------------------------------------------------------------------------------------------------
+	Types
+ ------------------------------------------------------------------------------------------------*/
+
+// Typedefs for fixed size types
+typedef signed char        TInt8;
+typedef signed short       TInt16;
+typedef signed int         TInt32;
+typedef signed long long   TInt64;
+
+typedef unsigned char      TUInt8;
+typedef unsigned short     TUInt16;
+typedef unsigned int       TUInt32;
+typedef unsigned long long TUInt64;
+
+typedef float              TFloat32;
+typedef double             TFloat64;
+
+
+/*------------------------------------------------------------------------------------------------
+	System messages
+ ------------------------------------------------------------------------------------------------*/
+
+// There is no GUI on these platforms (e.g. headless servers), so messages are written to the
+// standard error stream. Yes/No questions cannot be answered and return false. Return value is
+// whether the OK button would have been pressed
+bool SystemMessageBox
+(
+	const string& sMessage,                       // Main message to display
+	const string& sCaption = "TL-Engine Extreme", // Caption to display before the message
+	const bool    bYesNo = false                  // Question needing Yes or No (returns false)
+);
+
+
+} // namespace gen
+
+#endif // GEN_GCC_DEFINES_H_INCLUDED
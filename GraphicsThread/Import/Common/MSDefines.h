@@ -64,6 +64,12 @@ namespace gen
 // Prefix to align a structure or class in memory to a multiple of the given amount
 #define GEN_ALIGN(a) __declspec(align(a))
 
+// Prefix for a static or global variable with a separate instance for each thread
+#define GEN_THREAD_LOCAL __declspec(thread)
+
+// DirectX (Direct3D 9, D3DX and its X-file API) is available on this platform
+#define GEN_DIRECTX
+
 
 /*------------------------------------------------------------------------------------------------
 	Constants
@@ -0,0 +1,322 @@
+/**************************************************************************************************
+	Module:       Parallel.cpp
+	Date created: 18/10/26
+
+	Simple data-parallel processing - splitting a range of items across several threads
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+#include "Error.h"
+#include "Parallel.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Worker threads
+ ------------------------------------------------------------------------------------------------*/
+
+// A range of items processed by one thread in ParallelFor
+struct SParallelRange
+{
+	TParallelFunction pFunction;
+	void*             pData;
+	TUInt32           iBegin;
+	TUInt32           iEnd;
+	TUInt32           iRange;
+	bool              bFailed;
+};
+
+// The ranges of one call to ParallelFor. Ranges are claimed in order by whichever thread is free,
+// the calling thread included. Counts are protected by the pool's mutex
+struct SParallelJob
+{
+	SParallelRange aRanges[kiMaxParallelRanges];
+	TUInt32        iNumRanges;
+	TUInt32        iNextRange;     // Next range to be claimed
+	TUInt32        iNumCompleted;  // Ranges finished
+};
+
+// Process a range of items, catching exceptions so they do not escape from a thread
+static void ProcessRange
+(
+	SParallelRange* pRange
+)
+{
+	try
+	{
+		pRange->pFunction( pRange->iBegin, pRange->iEnd, pRange->iRange, pRange->pData );
+	}
+	catch (...)
+	{
+		pRange->bFailed = true;
+	}
+}
+
+
+// Worker threads shared by all calls to ParallelFor - one fewer than the number of processors, as
+// the calling thread also processes ranges. The threads are started on first use and kept until
+// the program ends, so a call to ParallelFor only costs waking them. Calls may be made from
+// several threads at once, and from within a range (a nested call) - a calling thread processes
+// any ranges of its own call that no worker has claimed, so it never waits for a thread that is
+// itself waiting
+class CParallelPool
+{
+	GEN_CLASS( CParallelPool )
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+public:
+	// Get the pool, starting the worker threads on first use
+	static CParallelPool& Get()
+	{
+		static CParallelPool pool;
+		return pool;
+	}
+
+private:
+	// Constructor starts the worker threads. If a thread cannot be started the pool works with
+	// those that were, ranges are always processed by the calling thread if no worker is free
+	CParallelPool()
+	{
+		m_bQuit = false;
+		TUInt32 iNumThreads = NumProcessors() - 1;
+		if (iNumThreads > kiMaxParallelRanges - 1)
+		{
+			iNumThreads = kiMaxParallelRanges - 1;
+		}
+		for (TUInt32 iThread = 0; iThread < iNumThreads; ++iThread)
+		{
+			try
+			{
+				m_Threads.push_back( thread( &CParallelPool::WorkerThread, this ) );
+			}
+			catch (...)
+			{
+				break;
+			}
+		}
+	}
+
+	// Destructor stops the worker threads once they have finished their current ranges
+	~CParallelPool()
+	{
+		{
+			lock_guard<mutex> lock( m_Mutex );
+			m_bQuit = true;
+		}
+		m_WorkAvailable.notify_all();
+		for (TUInt32 iThread = 0; iThread < m_Threads.size(); ++iThread)
+		{
+			m_Threads[iThread].join();
+		}
+	}
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CParallelPool( const CParallelPool& );
+	CParallelPool& operator=( const CParallelPool& );
+
+
+/*-----------------------------------------------------------------------------------------
+	Public interface
+-----------------------------------------------------------------------------------------*/
+public:
+
+	// Process all the ranges of a job with the calling thread and any free workers, returning
+	// when all are complete
+	void Run
+	(
+		SParallelJob* pJob
+	)
+	{
+		unique_lock<mutex> lock( m_Mutex );
+		m_Jobs.push_back( pJob );
+		if (pJob->iNumRanges > 1)
+		{
+			m_WorkAvailable.notify_all();
+		}
+		while (pJob->iNextRange < pJob->iNumRanges)
+		{
+			ProcessNextRange( pJob, &lock );
+		}
+		while (pJob->iNumCompleted < pJob->iNumRanges)
+		{
+			m_RangeCompleted.wait( lock );
+		}
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Claim the next range of a job and process it. The pool's mutex is locked on entry and
+	// exit, but not while processing the range
+	void ProcessNextRange
+	(
+		SParallelJob*       pJob,
+		unique_lock<mutex>* pLock
+	)
+	{
+		TUInt32 iRange = pJob->iNextRange++;
+		if (pJob->iNextRange == pJob->iNumRanges)
+		{
+			for (TUInt32 iJob = 0; iJob < m_Jobs.size(); ++iJob)
+			{
+				if (m_Jobs[iJob] == pJob)
+				{
+					m_Jobs.erase( m_Jobs.begin() + iJob );
+					break;
+				}
+			}
+		}
+
+		pLock->unlock();
+		ProcessRange( &pJob->aRanges[iRange] );
+		pLock->lock();
+
+		if (++pJob->iNumCompleted == pJob->iNumRanges)
+		{
+			m_RangeCompleted.notify_all();
+		}
+	}
+
+	// Worker thread function - process ranges from the oldest job until the pool is destroyed
+	void WorkerThread()
+	{
+		unique_lock<mutex> lock( m_Mutex );
+		while (true)
+		{
+			while (!m_bQuit && m_Jobs.empty())
+			{
+				m_WorkAvailable.wait( lock );
+			}
+			if (m_bQuit)
+			{
+				return;
+			}
+			ProcessNextRange( m_Jobs.front(), &lock );
+		}
+	}
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	// Jobs with ranges not yet claimed, oldest first. All job counts and the quit flag are
+	// protected by the mutex. Workers wait for jobs, calling threads wait for their ranges
+	mutex                m_Mutex;
+	condition_variable   m_WorkAvailable;
+	condition_variable   m_RangeCompleted;
+	deque<SParallelJob*> m_Jobs;
+	bool                 m_bQuit;
+
+	vector<thread>       m_Threads;
+};
+
+
+/*------------------------------------------------------------------------------------------------
+	Parallel for
+ ------------------------------------------------------------------------------------------------*/
+
+// Query the number of processors available, at least 1
+static TUInt32 ComputeNumProcessors()
+{
+	TUInt32 iHardwareThreads = thread::hardware_concurrency();
+	return iHardwareThreads ? iHardwareThreads : 1;
+}
+
+// Return the number of processors available. The count is queried once, by the first call - the
+// initialisation of a local static is thread-safe, so first calls may come from any thread
+TUInt32 NumProcessors()
+{
+	static const TUInt32 iNumProcessors = ComputeNumProcessors();
+	return iNumProcessors;
+}
+
+// Return the number of ranges to split the given number of items into - one per processor but
+// with at least the given number of items in each range. Always at least 1
+TUInt32 ParallelRanges
+(
+	const TUInt32 iNumItems,
+	const TUInt32 iMinItemsPerRange /*= kiDefaultMinParallelItems*/
+)
+{
+	TUInt32 iNumRanges = iMinItemsPerRange ? iNumItems / iMinItemsPerRange : iNumItems;
+	if (iNumRanges > NumProcessors())
+	{
+		iNumRanges = NumProcessors();
+	}
+	if (iNumRanges > kiMaxParallelRanges)
+	{
+		iNumRanges = kiMaxParallelRanges;
+	}
+	return iNumRanges ? iNumRanges : 1;
+}
+
+// Split the given number of items into equal ranges and call the function for each range, on
+// the calling thread and a pool of worker threads that is started on first use and reused by
+// every call. The function returns when all ranges are complete. If any range throws an
+// exception, an exception is thrown once all ranges are complete
+void ParallelFor
+(
+	const TUInt32           iNumItems,
+	const TUInt32           iNumRanges,
+	const TParallelFunction pFunction,
+	void*                   pData
+)
+{
+	GEN_GUARD;
+
+	GEN_ASSERT( iNumRanges > 0 && iNumRanges <= kiMaxParallelRanges, "Invalid number of ranges" );
+
+	// Single range, no threads needed
+	if (iNumRanges == 1)
+	{
+		pFunction( 0, iNumItems, 0, pData );
+		return;
+	}
+
+	// Split items into ranges of (almost) equal size
+	SParallelJob job;
+	TUInt64 iItems = iNumItems; // 64-bit to avoid overflow below
+	for (TUInt32 iRange = 0; iRange < iNumRanges; ++iRange)
+	{
+		job.aRanges[iRange].pFunction = pFunction;
+		job.aRanges[iRange].pData = pData;
+		job.aRanges[iRange].iBegin = static_cast<TUInt32>(iItems * iRange / iNumRanges);
+		job.aRanges[iRange].iEnd = static_cast<TUInt32>(iItems * (iRange + 1) / iNumRanges);
+		job.aRanges[iRange].iRange = iRange;
+		job.aRanges[iRange].bFailed = false;
+	}
+	job.iNumRanges = iNumRanges;
+	job.iNextRange = 0;
+	job.iNumCompleted = 0;
+
+	CParallelPool::Get().Run( &job );
+
+	for (TUInt32 iRange = 0; iRange < iNumRanges; ++iRange)
+	{
+		if (job.aRanges[iRange].bFailed)
+		{
+			GEN_ERROR( "Exception in parallel range" );
+		}
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+} // namespace gen
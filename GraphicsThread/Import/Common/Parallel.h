@@ -0,0 +1,68 @@
+/**************************************************************************************************
+	Module:       Parallel.h
+	Date created: 18/10/26
+
+	Simple data-parallel processing - splitting a range of items across several threads
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_PARALLEL_H_INCLUDED
+#define GEN_PARALLEL_H_INCLUDED
+
+#include "Defines.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Parallel for
+ ------------------------------------------------------------------------------------------------*/
+
+// Maximum number of ranges (and threads) that ParallelFor will use
+const TUInt32 kiMaxParallelRanges = 32;
+
+// Default minimum number of items per range. Waking a worker thread and waiting for it costs
+// several microseconds, so each range should have enough work to make that worthwhile
+const TUInt32 kiDefaultMinParallelItems = 16384;
+
+// Function called by ParallelFor to process the items from iBegin up to (not including) iEnd.
+// iRange is the index of the range being processed, from 0 to the number of ranges - 1, which
+// can be used to select per-thread storage. pData is passed through from ParallelFor
+typedef void (*TParallelFunction)
+(
+	TUInt32 iBegin,
+	TUInt32 iEnd,
+	TUInt32 iRange,
+	void*   pData
+);
+
+
+// Return the number of processors available
+TUInt32 NumProcessors();
+
+// Return the number of ranges to split the given number of items into - one per processor but
+// with at least the given number of items in each range. Always at least 1
+TUInt32 ParallelRanges
+(
+	const TUInt32 iNumItems,
+	const TUInt32 iMinItemsPerRange = kiDefaultMinParallelItems
+);
+
+// Split the given number of items into equal ranges and call the function for each range, on
+// the calling thread and a pool of worker threads that is started on first use and reused by
+// every call. The function returns when all ranges are complete. If any range throws an
+// exception, an exception is thrown once all ranges are complete
+void ParallelFor
+(
+	const TUInt32           iNumItems,
+	const TUInt32           iNumRanges,
+	const TParallelFunction pFunction,
+	void*                   pData
+);
+
+
+} // namespace gen
+
+#endif // GEN_PARALLEL_H_INCLUDED
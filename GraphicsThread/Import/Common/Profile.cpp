@@ -0,0 +1,225 @@
+/**************************************************************************************************
+	Module:       Profile.cpp
+	Date created: 18/10/26
+
+	Measurement of processing stages - wall time, bytes processed and memory allocations
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <cstdlib>
+#include <new>
+#if defined(_MSC_VER)
+	#include <windows.h>
+#else
+	#include <chrono>
+#endif
+
+#include "Profile.h"
+
+// Allocations are counted if GEN_COUNT_ALLOCATIONS is defined in the project settings, which
+// replaces the global operator new and delete of the whole program with counting versions that
+// use malloc / free. Only define it in builds made for profiling (e.g. the ImportBenchmark
+// project) - without it the standard allocator is used and allocation counts are 0
+
+
+/*------------------------------------------------------------------------------------------------
+	Allocation counting
+ ------------------------------------------------------------------------------------------------*/
+
+#ifdef GEN_COUNT_ALLOCATIONS
+
+// Allocations made by each thread. Per-thread so stages measured on one thread are not affected
+// by allocations on others (e.g. the renderer while models load in the background)
+static GEN_THREAD_LOCAL gen::TUInt32 iThreadAllocations = 0;
+
+// Replacement operator new and delete, counting the allocations
+void* operator new
+(
+	size_t iSize
+)
+{
+	++iThreadAllocations;
+	void* pMemory = malloc( iSize ? iSize : 1 );
+	if (!pMemory)
+	{
+		throw std::bad_alloc();
+	}
+	return pMemory;
+}
+
+void* operator new[]
+(
+	size_t iSize
+)
+{
+	return operator new( iSize );
+}
+
+void* operator new
+(
+	size_t                iSize,
+	const std::nothrow_t&
+) throw()
+{
+	++iThreadAllocations;
+	return malloc( iSize ? iSize : 1 );
+}
+
+void* operator new[]
+(
+	size_t                iSize,
+	const std::nothrow_t& nothrow
+) throw()
+{
+	return operator new( iSize, nothrow );
+}
+
+void operator delete
+(
+	void* pMemory
+) throw()
+{
+	free( pMemory );
+}
+
+void operator delete[]
+(
+	void* pMemory
+) throw()
+{
+	free( pMemory );
+}
+
+void operator delete
+(
+	void*                 pMemory,
+	const std::nothrow_t&
+) throw()
+{
+	free( pMemory );
+}
+
+void operator delete[]
+(
+	void*                 pMemory,
+	const std::nothrow_t&
+) throw()
+{
+	free( pMemory );
+}
+
+#endif // GEN_COUNT_ALLOCATIONS
+
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Time stamps and allocation counts
+ ------------------------------------------------------------------------------------------------*/
+
+#if defined(_MSC_VER)
+
+// Return a high resolution time stamp - the performance counter on Windows
+TUInt64 GetTimeStamp()
+{
+	LARGE_INTEGER timeStamp;
+	QueryPerformanceCounter( &timeStamp );
+	return static_cast<TUInt64>(timeStamp.QuadPart);
+}
+
+// Return the number of time stamp ticks per second
+TUInt64 GetTimeStampFrequency()
+{
+	static TUInt64 iFrequency = 0;
+	if (iFrequency == 0)
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency( &frequency );
+		iFrequency = static_cast<TUInt64>(frequency.QuadPart);
+	}
+	return iFrequency;
+}
+
+#else
+
+// Return a high resolution time stamp - the standard library's steady clock on other platforms
+TUInt64 GetTimeStamp()
+{
+	return static_cast<TUInt64>(chrono::steady_clock::now().time_since_epoch().count());
+}
+
+// Return the number of time stamp ticks per second
+TUInt64 GetTimeStampFrequency()
+{
+	return static_cast<TUInt64>(chrono::steady_clock::period::den /
+	                            chrono::steady_clock::period::num);
+}
+
+#endif
+
+// Return the number of memory allocations made with operator new by the calling thread so far
+TUInt32 GetThreadAllocations()
+{
+#ifdef GEN_COUNT_ALLOCATIONS
+	return iThreadAllocations;
+#else
+	return 0;
+#endif
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Stage measurement
+ ------------------------------------------------------------------------------------------------*/
+
+// Constructor starts measuring the stage, pausing the current stage if there is one
+CStageTimer::CStageTimer
+(
+	SStageStats*  pStats,
+	CStageTimer** ppCurrentStage
+)
+{
+	m_pStats = pStats;
+	m_ppCurrentStage = ppCurrentStage;
+	m_pParentStage = *ppCurrentStage;
+	if (m_pParentStage)
+	{
+		m_pParentStage->Stop();
+	}
+	*m_ppCurrentStage = this;
+	++m_pStats->iCalls;
+	Start();
+}
+
+// Destructor adds the measurements to the stage's statistics and resumes the enclosing stage
+CStageTimer::~CStageTimer()
+{
+	Stop();
+	*m_ppCurrentStage = m_pParentStage;
+	if (m_pParentStage)
+	{
+		m_pParentStage->Start();
+	}
+}
+
+
+// Start measuring
+void CStageTimer::Start()
+{
+	m_iStartAllocations = GetThreadAllocations();
+	m_iStartTime = GetTimeStamp();
+}
+
+// Stop measuring, adding the time and allocations since starting to the stats
+void CStageTimer::Stop()
+{
+	TUInt64 iTicks = GetTimeStamp() - m_iStartTime;
+	m_pStats->fSeconds += static_cast<TFloat64>(iTicks) / GetTimeStampFrequency();
+	m_pStats->iAllocations += GetThreadAllocations() - m_iStartAllocations;
+}
+
+
+} // namespace gen
@@ -0,0 +1,125 @@
+/**************************************************************************************************
+	Module:       Profile.h
+	Date created: 18/10/26
+
+	Measurement of processing stages - wall time, bytes processed and memory allocations
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_PROFILE_H_INCLUDED
+#define GEN_PROFILE_H_INCLUDED
+
+#include "Defines.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Time stamps and allocation counts
+ ------------------------------------------------------------------------------------------------*/
+
+// Return a high resolution time stamp, and the number of time stamp ticks per second
+TUInt64 GetTimeStamp();
+TUInt64 GetTimeStampFrequency();
+
+// Return the number of memory allocations made with operator new by the calling thread so far.
+// Always 0 unless GEN_COUNT_ALLOCATIONS is defined in the project settings (see Profile.cpp)
+TUInt32 GetThreadAllocations();
+
+
+/*------------------------------------------------------------------------------------------------
+	Stage measurement
+ ------------------------------------------------------------------------------------------------*/
+
+// Statistics gathered for a stage of processing
+struct SStageStats
+{
+	TUInt32  iCalls;       // Number of times the stage was entered
+	TFloat64 fSeconds;     // Wall time spent in the stage, excluding nested stages
+	TUInt64  iBytes;       // Bytes processed by the stage, meaning depends on the stage
+	TUInt32  iAllocations; // Memory allocations made by the stage, excluding nested stages
+
+	// Constructor sets empty statistics
+	SStageStats()
+	{
+		iCalls = 0;
+		fSeconds = 0.0;
+		iBytes = 0;
+		iAllocations = 0;
+	}
+};
+
+
+// Measures a stage while in scope and adds the results to the stage's statistics. Stages may be
+// nested - the enclosing stage is paused while a nested stage is measured, so nothing is counted
+// twice. The current stage pointer tracks the innermost stage, it should start as 0 and be used
+// by one thread only
+class CStageTimer
+{
+	GEN_CLASS( CStageTimer )
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+public:
+	// Constructor starts measuring the stage, pausing the current stage if there is one
+	CStageTimer
+	(
+		SStageStats*  pStats,
+		CStageTimer** ppCurrentStage
+	);
+
+	// Destructor adds the measurements to the stage's statistics and resumes the enclosing stage
+	~CStageTimer();
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CStageTimer( const CStageTimer& );
+	CStageTimer& operator=( const CStageTimer& );
+
+
+/*-----------------------------------------------------------------------------------------
+	Public interface
+-----------------------------------------------------------------------------------------*/
+public:
+
+	// Add to the number of bytes processed by the stage
+	void AddBytes
+	(
+		const TUInt64 iBytes
+	)
+	{
+		m_pStats->iBytes += iBytes;
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Start / stop measuring, stopping adds the time and allocations since starting to the stats
+	void Start();
+	void Stop();
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	// Statistics for this stage, the current stage pointer and the stage enclosing this one
+	SStageStats*  m_pStats;
+	CStageTimer** m_ppCurrentStage;
+	CStageTimer*  m_pParentStage;
+
+	// Time stamp and allocation count when measuring last started
+	TUInt64       m_iStartTime;
+	TUInt32       m_iStartAllocations;
+};
+
+
+} // namespace gen
+
+#endif // GEN_PROFILE_H_INCLUDED
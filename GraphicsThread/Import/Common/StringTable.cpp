@@ -0,0 +1,178 @@
+/**************************************************************************************************
+	Module:       StringTable.cpp
+	Date created: 18/10/26
+
+	Table of interned strings - each distinct string is stored once and identified by a compact
+	32-bit ID, so strings can be compared by comparing IDs
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <cstring>
+#include <algorithm>
+
+#include "Utility.h"
+#include "StringTable.h"
+
+namespace gen
+{
+
+// Initial number of slots in the hash table of a string table, must be a power of two
+const TUInt32 kiInitialStringSlots = 64;
+
+
+/*------------------------------------------------------------------------------------------------
+	Constructors/Destructors
+ ------------------------------------------------------------------------------------------------*/
+
+// Constructor, the table contains only the empty string
+CStringTable::CStringTable()
+{
+	m_Slots.resize( kiInitialStringSlots, kiEmptyString );
+	Clear();
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Public interface
+ ------------------------------------------------------------------------------------------------*/
+
+// Return the ID of the given string, adding it to the table if not already present. The string
+// need not be null terminated if the length is given
+TUInt32 CStringTable::Intern
+(
+	const char*   szString,
+	const TUInt32 iLength
+)
+{
+	if (iLength == 0)
+	{
+		return kiEmptyString;
+	}
+
+	TUInt32 iHash = HashData( szString, iLength );
+	TUInt32 iSlot = FindSlot( szString, iLength, iHash );
+	if (m_Slots[iSlot] != kiEmptyString)
+	{
+		return m_Slots[iSlot];
+	}
+
+	// Add the string, keeping the hash table at most half full
+	SEntry entry;
+	entry.iOffset = static_cast<TUInt32>(m_Characters.size());
+	entry.iLength = iLength;
+	entry.iHash = iHash;
+	m_Characters.insert( m_Characters.end(), szString, szString + iLength );
+	m_Characters.push_back( 0 );
+	TUInt32 iString = static_cast<TUInt32>(m_Entries.size());
+	m_Entries.push_back( entry );
+	m_Slots[iSlot] = iString;
+	if (m_Entries.size() * 2 > m_Slots.size())
+	{
+		GrowSlots();
+	}
+
+	return iString;
+}
+
+TUInt32 CStringTable::Intern
+(
+	const char* szString
+)
+{
+	return Intern( szString, static_cast<TUInt32>(strlen( szString )) );
+}
+
+TUInt32 CStringTable::Intern
+(
+	const string& sString
+)
+{
+	return Intern( sString.data(), static_cast<TUInt32>(sString.length()) );
+}
+
+
+// Return the ID of the given string, or kiNoString if it is not in the table
+TUInt32 CStringTable::Find
+(
+	const char* szString
+) const
+{
+	TUInt32 iLength = static_cast<TUInt32>(strlen( szString ));
+	if (iLength == 0)
+	{
+		return kiEmptyString;
+	}
+
+	TUInt32 iSlot = FindSlot( szString, iLength, HashData( szString, iLength ) );
+	return (m_Slots[iSlot] != kiEmptyString) ? m_Slots[iSlot] : kiNoString;
+}
+
+
+// Remove all strings except the empty string. IDs from before the call are invalid, but the
+// memory used is kept for reuse
+void CStringTable::Clear()
+{
+	m_Characters.clear();
+	m_Characters.push_back( 0 );
+
+	SEntry emptyEntry;
+	emptyEntry.iOffset = 0;
+	emptyEntry.iLength = 0;
+	emptyEntry.iHash = HashData( 0, 0 );
+	m_Entries.clear();
+	m_Entries.push_back( emptyEntry );
+
+	fill( m_Slots.begin(), m_Slots.end(), kiEmptyString );
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Private interface
+ ------------------------------------------------------------------------------------------------*/
+
+// Return the slot in the hash table holding the given string, or the empty slot where it should be
+// added if it is not present
+TUInt32 CStringTable::FindSlot
+(
+	const char*   szString,
+	const TUInt32 iLength,
+	const TUInt32 iHash
+) const
+{
+	// Linear probing, the table is never full. Compare hashes and lengths before characters
+	TUInt32 iSlotMask = static_cast<TUInt32>(m_Slots.size()) - 1;
+	TUInt32 iSlot = iHash & iSlotMask;
+	while (m_Slots[iSlot] != kiEmptyString)
+	{
+		const SEntry& entry = m_Entries[m_Slots[iSlot]];
+		if (entry.iHash == iHash && entry.iLength == iLength &&
+		    memcmp( &m_Characters[entry.iOffset], szString, iLength ) == 0)
+		{
+			break;
+		}
+		iSlot = (iSlot + 1) & iSlotMask;
+	}
+	return iSlot;
+}
+
+// Double the size of the hash table and re-add all the strings
+void CStringTable::GrowSlots()
+{
+	// The stored hashes are used, so no string is hashed again
+	vector<TUInt32>( m_Slots.size() * 2, kiEmptyString ).swap( m_Slots );
+	TUInt32 iSlotMask = static_cast<TUInt32>(m_Slots.size()) - 1;
+	for (TUInt32 iString = 1; iString < m_Entries.size(); ++iString)
+	{
+		TUInt32 iSlot = m_Entries[iString].iHash & iSlotMask;
+		while (m_Slots[iSlot] != kiEmptyString)
+		{
+			iSlot = (iSlot + 1) & iSlotMask;
+		}
+		m_Slots[iSlot] = iString;
+	}
+}
+
+
+} // namespace gen
@@ -0,0 +1,165 @@
+/**************************************************************************************************
+	Module:       StringTable.h
+	Date created: 18/10/26
+
+	Table of interned strings - each distinct string is stored once and identified by a compact
+	32-bit ID, so strings can be compared by comparing IDs
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_STRING_TABLE_H_INCLUDED
+#define GEN_STRING_TABLE_H_INCLUDED
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	String table
+ ------------------------------------------------------------------------------------------------*/
+
+// ID of the empty string, present in every string table
+const TUInt32 kiEmptyString = 0;
+
+// ID returned when looking up a string that is not in a table
+const TUInt32 kiNoString = 0xffffffff;
+
+
+// Table of interned strings. Interning a string returns its ID, which is the same for every string
+// with the same characters, so two strings from the same table are equal if their IDs are equal.
+// IDs are allocated in order from 0 (the empty string). The hash of each string is calculated once
+// when it is added. Strings are never removed except by clearing the whole table. Not thread-safe
+class CStringTable
+{
+	GEN_CLASS( CStringTable )
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+public:
+	// Constructor, the table contains only the empty string
+	CStringTable();
+
+
+/*-----------------------------------------------------------------------------------------
+	Public interface
+-----------------------------------------------------------------------------------------*/
+public:
+
+	// Return the ID of the given string, adding it to the table if not already present. The string
+	// need not be null terminated if the length is given
+	TUInt32 Intern
+	(
+		const char*   szString,
+		const TUInt32 iLength
+	);
+	TUInt32 Intern
+	(
+		const char* szString
+	);
+	TUInt32 Intern
+	(
+		const string& sString
+	);
+
+	// Return the ID of the given string, or kiNoString if it is not in the table
+	TUInt32 Find
+	(
+		const char* szString
+	) const;
+
+	// Remove all strings except the empty string. IDs from before the call are invalid, but the
+	// memory used is kept for reuse
+	void Clear();
+
+
+	/////////////////////////////////////
+	// String access
+
+	// Number of strings in the table, including the empty string. IDs are less than this
+	TUInt32 GetNumStrings() const
+	{
+		return static_cast<TUInt32>(m_Entries.size());
+	}
+
+	// Null terminated characters of the string with the given ID. The pointer is only valid until
+	// the next string is added to the table
+	const char* GetString
+	(
+		const TUInt32 iString
+	) const
+	{
+		return &m_Characters[m_Entries[iString].iOffset];
+	}
+
+	// Length of the string with the given ID, excluding the null terminator
+	TUInt32 GetLength
+	(
+		const TUInt32 iString
+	) const
+	{
+		return m_Entries[iString].iLength;
+	}
+
+	// Hash of the string with the given ID (see HashData)
+	TUInt32 GetHash
+	(
+		const TUInt32 iString
+	) const
+	{
+		return m_Entries[iString].iHash;
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// A string in the table - position in the character buffer, length and hash
+	struct SEntry
+	{
+		TUInt32 iOffset;
+		TUInt32 iLength;
+		TUInt32 iHash;
+	};
+
+	// Return the slot in the hash table holding the given string, or the empty slot where it should
+	// be added if it is not present
+	TUInt32 FindSlot
+	(
+		const char*   szString,
+		const TUInt32 iLength,
+		const TUInt32 iHash
+	) const;
+
+	// Double the size of the hash table and re-add all the strings
+	void GrowSlots();
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	// Characters of all strings, each followed by a null terminator
+	vector<char>    m_Characters;
+
+	// Strings in the table, indexed by ID
+	vector<SEntry>  m_Entries;
+
+	// Open addressing hash table of string IDs, with a power of two size. The empty string is not
+	// in the table, so ID 0 marks an empty slot
+	vector<TUInt32> m_Slots;
+};
+
+
+} // namespace gen
+
+#endif // GEN_STRING_TABLE_H_INCLUDED
@@ -16,6 +16,30 @@
 namespace gen
 {
 
+/*------------------------------------------------------------------------------------------------
+	Hashing utilities
+ ------------------------------------------------------------------------------------------------*/
+
+// Return a 32-bit hash (FNV-1a) of a block of memory. Hashes of several blocks can be chained by
+// passing the result of one call as the seed for the next
+TUInt32 HashData
+(
+	const void*   pData,
+	const TUInt32 iSize,
+	const TUInt32 iSeed /*= kiHashSeed*/
+)
+{
+	const TUInt8* pBytes = static_cast<const TUInt8*>(pData);
+	TUInt32 iHash = iSeed;
+	for (TUInt32 i = 0; i < iSize; ++i)
+	{
+		iHash ^= pBytes[i];
+		iHash *= 16777619u;
+	}
+	return iHash;
+}
+
+
 /*------------------------------------------------------------------------------------------------
 	String utilities
  ------------------------------------------------------------------------------------------------*/
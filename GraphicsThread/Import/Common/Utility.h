@@ -40,6 +40,23 @@ inline void Swap
 	s2 = temp;
 }
 
+/*------------------------------------------------------------------------------------------------
+	Hashing utilities
+ ------------------------------------------------------------------------------------------------*/
+
+// Initial value for the hash function below
+const TUInt32 kiHashSeed = 2166136261u;
+
+// Return a 32-bit hash (FNV-1a) of a block of memory. Hashes of several blocks can be chained by
+// passing the result of one call as the seed for the next
+TUInt32 HashData
+(
+	const void*   pData,
+	const TUInt32 iSize,
+	const TUInt32 iSeed = kiHashSeed
+);
+
+
 /*------------------------------------------------------------------------------------------------
 	String utilities
  ------------------------------------------------------------------------------------------------*/
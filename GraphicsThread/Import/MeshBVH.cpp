@@ -0,0 +1,537 @@
+/**************************************************************************************************
+	Module:       MeshBVH.cpp
+	Date created: 18/10/26
+
+	Bounding volume hierarchy over the faces of a mesh, for fast ray queries such as picking and
+	line-of-sight tests
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <algorithm>
+using namespace std;
+
+#include "BaseMath.h"
+#include "MeshBVH.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Building support
+ ------------------------------------------------------------------------------------------------*/
+
+// Number of bins along each axis used to evaluate splits with the surface area heuristic
+static const TUInt32 kiNumBVHBins = 16;
+
+// Axis-aligned bounding box used while building
+struct SBVHBounds
+{
+	CVector3 minBounds;
+	CVector3 maxBounds;
+};
+
+// A range of faces (in the face order) waiting to be made into a node
+struct SBVHBuildTask
+{
+	TUInt32 iNode;
+	TUInt32 iBegin;
+	TUInt32 iEnd;
+	TUInt32 iDepth;
+};
+
+// Comparison of faces by the position of their centres along one axis
+struct SBVHCentreLess
+{
+	const CVector3* pCentres;
+	TUInt32         iAxis;
+
+	bool operator()( const TUInt32 iFace1, const TUInt32 iFace2 ) const
+	{
+		return pCentres[iFace1][iAxis] < pCentres[iFace2][iAxis];
+	}
+};
+
+
+// Set bounds to be empty, ready to be grown
+static void ResetBounds
+(
+	SBVHBounds* pBounds
+)
+{
+	pBounds->minBounds = CVector3( 1.0e30f, 1.0e30f, 1.0e30f );
+	pBounds->maxBounds = CVector3( -1.0e30f, -1.0e30f, -1.0e30f );
+}
+
+// Grow bounds to contain a point
+static void GrowBounds
+(
+	SBVHBounds*     pBounds,
+	const CVector3& point
+)
+{
+	pBounds->minBounds.x = Min( pBounds->minBounds.x, point.x );
+	pBounds->minBounds.y = Min( pBounds->minBounds.y, point.y );
+	pBounds->minBounds.z = Min( pBounds->minBounds.z, point.z );
+	pBounds->maxBounds.x = Max( pBounds->maxBounds.x, point.x );
+	pBounds->maxBounds.y = Max( pBounds->maxBounds.y, point.y );
+	pBounds->maxBounds.z = Max( pBounds->maxBounds.z, point.z );
+}
+
+// Grow bounds to contain other bounds
+static void GrowBounds
+(
+	SBVHBounds*       pBounds,
+	const SBVHBounds& bounds
+)
+{
+	pBounds->minBounds.x = Min( pBounds->minBounds.x, bounds.minBounds.x );
+	pBounds->minBounds.y = Min( pBounds->minBounds.y, bounds.minBounds.y );
+	pBounds->minBounds.z = Min( pBounds->minBounds.z, bounds.minBounds.z );
+	pBounds->maxBounds.x = Max( pBounds->maxBounds.x, bounds.maxBounds.x );
+	pBounds->maxBounds.y = Max( pBounds->maxBounds.y, bounds.maxBounds.y );
+	pBounds->maxBounds.z = Max( pBounds->maxBounds.z, bounds.maxBounds.z );
+}
+
+// Return half the surface area of bounds, 0 if they are empty. Only relative areas matter for
+// the surface area heuristic
+static TFloat32 HalfSurfaceArea
+(
+	const SBVHBounds& bounds
+)
+{
+	CVector3 size = bounds.maxBounds - bounds.minBounds;
+	if (size.x < 0.0f || size.y < 0.0f || size.z < 0.0f)
+	{
+		return 0.0f;
+	}
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Building
+ ------------------------------------------------------------------------------------------------*/
+
+// Build the BVH over a triangle list using a binned surface area heuristic, with at most the
+// given number of faces in each leaf. The BVH keeps its own copy of the face positions, so the
+// mesh data is not needed for queries
+void CMeshBVH::Build
+(
+	const TUInt32*  piIndices,
+	const TUInt32   iNumFaces,
+	const CVector3* pPositions,
+	const TUInt32   iMaxLeafFaces /*= kiDefaultMaxBVHLeafFaces*/
+)
+{
+	GEN_GUARD;
+
+	Clear();
+	if (iNumFaces == 0)
+	{
+		return;
+	}
+
+	// Bounds and centre of each face
+	vector<SBVHBounds> faceBounds( iNumFaces );
+	vector<CVector3> faceCentres( iNumFaces );
+	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+	{
+		ResetBounds( &faceBounds[iFace] );
+		GrowBounds( &faceBounds[iFace], pPositions[piIndices[iFace * 3]] );
+		GrowBounds( &faceBounds[iFace], pPositions[piIndices[iFace * 3 + 1]] );
+		GrowBounds( &faceBounds[iFace], pPositions[piIndices[iFace * 3 + 2]] );
+		faceCentres[iFace] = (faceBounds[iFace].minBounds + faceBounds[iFace].maxBounds) * 0.5f;
+	}
+
+	// Faces are reordered so each node covers a contiguous range
+	vector<TUInt32> faceOrder( iNumFaces );
+	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+	{
+		faceOrder[iFace] = iFace;
+	}
+
+	// Build nodes depth-first, children of a node are always created together so are adjacent
+	m_Nodes.resize( 1 );
+	vector<SBVHBuildTask> tasks;
+	SBVHBuildTask rootTask = { 0, 0, iNumFaces, 0 };
+	tasks.push_back( rootTask );
+	while (!tasks.empty())
+	{
+		SBVHBuildTask task = tasks.back();
+		tasks.pop_back();
+		TUInt32 iTaskFaces = task.iEnd - task.iBegin;
+
+		// Bounds of the faces in the node, and of their centres
+		SBVHBounds nodeBounds, centreBounds;
+		ResetBounds( &nodeBounds );
+		ResetBounds( &centreBounds );
+		for (TUInt32 iOrder = task.iBegin; iOrder < task.iEnd; ++iOrder)
+		{
+			GrowBounds( &nodeBounds, faceBounds[faceOrder[iOrder]] );
+			GrowBounds( &centreBounds, faceCentres[faceOrder[iOrder]] );
+		}
+		m_Nodes[task.iNode].minBounds = nodeBounds.minBounds;
+		m_Nodes[task.iNode].maxBounds = nodeBounds.maxBounds;
+
+		// Small enough for a leaf
+		if (iTaskFaces <= iMaxLeafFaces || iTaskFaces == 1)
+		{
+			m_Nodes[task.iNode].iFirst = task.iBegin;
+			m_Nodes[task.iNode].iNumFaces = iTaskFaces;
+			continue;
+		}
+
+		// Find the split between bins (on any axis) with the lowest surface area heuristic cost -
+		// the sum of the area times number of faces of each side. Only used in the upper half of
+		// the hierarchy so its depth stays within the query stack size
+		TUInt32 iSplit = task.iBegin;
+		if (task.iDepth < kiMaxDepth / 2)
+		{
+			TFloat32 fBestCost = 0.0f;
+			TUInt32 iBestAxis = 3;
+			TUInt32 iBestBin = 0;
+			for (TUInt32 iAxis = 0; iAxis < 3; ++iAxis)
+			{
+				TFloat32 fMinCentre = centreBounds.minBounds[iAxis];
+				TFloat32 fExtent = centreBounds.maxBounds[iAxis] - fMinCentre;
+				if (fExtent <= 0.0f)
+				{
+					continue;
+				}
+
+				// Gather the faces into bins along the axis
+				SBVHBounds aBinBounds[kiNumBVHBins];
+				TUInt32 aiBinFaces[kiNumBVHBins];
+				for (TUInt32 iBin = 0; iBin < kiNumBVHBins; ++iBin)
+				{
+					ResetBounds( &aBinBounds[iBin] );
+					aiBinFaces[iBin] = 0;
+				}
+				TFloat32 fBinScale = kiNumBVHBins / fExtent;
+				for (TUInt32 iOrder = task.iBegin; iOrder < task.iEnd; ++iOrder)
+				{
+					TUInt32 iFace = faceOrder[iOrder];
+					TUInt32 iBin = static_cast<TUInt32>((faceCentres[iFace][iAxis] - fMinCentre) *
+					                                    fBinScale);
+					iBin = Min( iBin, kiNumBVHBins - 1 );
+					GrowBounds( &aBinBounds[iBin], faceBounds[iFace] );
+					++aiBinFaces[iBin];
+				}
+
+				// Sweep from the right to get the cost of the right side of each split, then from
+				// the left to complete the costs
+				TFloat32 afRightCost[kiNumBVHBins];
+				SBVHBounds sideBounds;
+				ResetBounds( &sideBounds );
+				TUInt32 iSideFaces = 0;
+				for (TUInt32 iBin = kiNumBVHBins - 1; iBin > 0; --iBin)
+				{
+					GrowBounds( &sideBounds, aBinBounds[iBin] );
+					iSideFaces += aiBinFaces[iBin];
+					afRightCost[iBin - 1] = HalfSurfaceArea( sideBounds ) * iSideFaces;
+				}
+				ResetBounds( &sideBounds );
+				iSideFaces = 0;
+				for (TUInt32 iBin = 0; iBin < kiNumBVHBins - 1; ++iBin)
+				{
+					GrowBounds( &sideBounds, aBinBounds[iBin] );
+					iSideFaces += aiBinFaces[iBin];
+					if (iSideFaces == 0 || iSideFaces == iTaskFaces)
+					{
+						continue;
+					}
+					TFloat32 fCost = HalfSurfaceArea( sideBounds ) * iSideFaces + afRightCost[iBin];
+					if (iBestAxis == 3 || fCost < fBestCost)
+					{
+						fBestCost = fCost;
+						iBestAxis = iAxis;
+						iBestBin = iBin;
+					}
+				}
+			}
+
+			// Partition the faces either side of the best split
+			if (iBestAxis < 3)
+			{
+				TFloat32 fMinCentre = centreBounds.minBounds[iBestAxis];
+				TFloat32 fBinScale = kiNumBVHBins /
+				                     (centreBounds.maxBounds[iBestAxis] - fMinCentre);
+				TUInt32 iEnd = task.iEnd;
+				iSplit = task.iBegin;
+				while (iSplit < iEnd)
+				{
+					TFloat32 fCentre = faceCentres[faceOrder[iSplit]][iBestAxis];
+					TUInt32 iBin = static_cast<TUInt32>((fCentre - fMinCentre) * fBinScale);
+					if (iBin <= iBestBin)
+					{
+						++iSplit;
+					}
+					else
+					{
+						swap( faceOrder[iSplit], faceOrder[--iEnd] );
+					}
+				}
+			}
+		}
+
+		// No useful split found (or too deep), split at the median face along the longest axis
+		if (iSplit == task.iBegin || iSplit == task.iEnd)
+		{
+			CVector3 extent = centreBounds.maxBounds - centreBounds.minBounds;
+			SBVHCentreLess centreLess;
+			centreLess.pCentres = &faceCentres[0];
+			centreLess.iAxis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 :
+			                   (extent.y >= extent.z ? 1 : 2);
+			iSplit = task.iBegin + iTaskFaces / 2;
+			nth_element( faceOrder.begin() + task.iBegin, faceOrder.begin() + iSplit,
+			             faceOrder.begin() + task.iEnd, centreLess );
+		}
+
+		// Create the two children and process the first next
+		TUInt32 iFirstChild = static_cast<TUInt32>(m_Nodes.size());
+		m_Nodes.resize( iFirstChild + 2 );
+		m_Nodes[task.iNode].iFirst = iFirstChild;
+		m_Nodes[task.iNode].iNumFaces = 0;
+		SBVHBuildTask rightTask = { iFirstChild + 1, iSplit, task.iEnd, task.iDepth + 1 };
+		SBVHBuildTask leftTask = { iFirstChild, task.iBegin, iSplit, task.iDepth + 1 };
+		tasks.push_back( rightTask );
+		tasks.push_back( leftTask );
+	}
+	vector<SNode>( m_Nodes ).swap( m_Nodes ); // Release unused capacity
+
+	// Store the faces in their new order in the form used for ray intersection
+	m_Faces.resize( iNumFaces );
+	for (TUInt32 iOrder = 0; iOrder < iNumFaces; ++iOrder)
+	{
+		const TUInt32* piFace = piIndices + faceOrder[iOrder] * 3;
+		m_Faces[iOrder].p0 = pPositions[piFace[0]];
+		m_Faces[iOrder].edge1 = pPositions[piFace[1]] - m_Faces[iOrder].p0;
+		m_Faces[iOrder].edge2 = pPositions[piFace[2]] - m_Faces[iOrder].p0;
+	}
+	m_FaceIndices.swap( faceOrder );
+
+	GEN_ENDGUARD;
+}
+
+// Remove all nodes and faces
+void CMeshBVH::Clear()
+{
+	m_Nodes.clear();
+	m_Faces.clear();
+	m_FaceIndices.clear();
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Queries
+ ------------------------------------------------------------------------------------------------*/
+
+// Find the closest face hit by a ray within the given distance (in multiples of the ray
+// direction, which need not be unit length). Faces are hit from either side. Returns true and
+// the hit details if a face was hit
+bool CMeshBVH::RayCastClosest
+(
+	const CVector3& origin,
+	const CVector3& direction,
+	const TFloat32  fMaxDistance,
+	SRayHit*        pHit
+) const
+{
+	return RayCast( origin, direction, fMaxDistance, false, pHit );
+}
+
+// Return true if a ray hits any face within the given distance - e.g. for line-of-sight tests.
+// Faster than RayCastClosest as it stops at the first hit found
+bool CMeshBVH::RayCastAny
+(
+	const CVector3& origin,
+	const CVector3& direction,
+	const TFloat32  fMaxDistance
+) const
+{
+	return RayCast( origin, direction, fMaxDistance, true, 0 );
+}
+
+
+// Test a ray against a node's bounds (slab test). Returns true and the distance the ray enters
+// the bounds if it does so before the given distance
+static inline bool IntersectBounds
+(
+	const CVector3& minBounds,
+	const CVector3& maxBounds,
+	const CVector3& origin,
+	const CVector3& invDirection,
+	const TFloat32  fMaxDistance,
+	TFloat32*       pfEntry
+)
+{
+	TFloat32 fNear1 = (minBounds.x - origin.x) * invDirection.x;
+	TFloat32 fFar1 = (maxBounds.x - origin.x) * invDirection.x;
+	TFloat32 fNear2 = (minBounds.y - origin.y) * invDirection.y;
+	TFloat32 fFar2 = (maxBounds.y - origin.y) * invDirection.y;
+	TFloat32 fNear3 = (minBounds.z - origin.z) * invDirection.z;
+	TFloat32 fFar3 = (maxBounds.z - origin.z) * invDirection.z;
+	TFloat32 fEntry = Max( Max( Min( fNear1, fFar1 ), Min( fNear2, fFar2 ) ),
+	                       Max( Min( fNear3, fFar3 ), 0.0f ) );
+	TFloat32 fExit = Min( Min( Max( fNear1, fFar1 ), Max( fNear2, fFar2 ) ),
+	                      Min( Max( fNear3, fFar3 ), fMaxDistance ) );
+	*pfEntry = fEntry;
+	return fEntry <= fExit;
+}
+
+// Shared implementation of the ray queries
+bool CMeshBVH::RayCast
+(
+	const CVector3& origin,
+	const CVector3& direction,
+	const TFloat32  fMaxDistance,
+	const bool      bAnyHit,
+	SRayHit*        pHit
+) const
+{
+	GEN_GUARD;
+
+	if (m_Nodes.empty())
+	{
+		return false;
+	}
+
+	// Reciprocal of the direction for the slab tests, with zero components replaced by tiny
+	// values to avoid infinities (which give undefined results for rays on a slab boundary)
+	const TFloat32 kfTiny = 1.0e-20f;
+	CVector3 invDirection;
+	for (TUInt32 iAxis = 0; iAxis < 3; ++iAxis)
+	{
+		TFloat32 fComponent = direction[iAxis];
+		if (Abs( fComponent ) < kfTiny)
+		{
+			fComponent = (fComponent < 0.0f) ? -kfTiny : kfTiny;
+		}
+		invDirection[iAxis] = 1.0f / fComponent;
+	}
+
+	TFloat32 fEntry;
+	if (!IntersectBounds( m_Nodes[0].minBounds, m_Nodes[0].maxBounds, origin, invDirection,
+	                      fMaxDistance, &fEntry ))
+	{
+		return false;
+	}
+
+	// Stack of nodes still to visit and the distance the ray enters each
+	struct SStackEntry
+	{
+		TUInt32  iNode;
+		TFloat32 fEntry;
+	};
+	SStackEntry aStack[kiMaxDepth];
+	TUInt32 iStackSize = 0;
+
+	TFloat32 fClosest = fMaxDistance;
+	TUInt32 iHitFace = 0;
+	TFloat32 fHitU = 0.0f, fHitV = 0.0f;
+	bool bHit = false;
+
+	TUInt32 iNode = 0;
+	while (true)
+	{
+		const SNode& node = m_Nodes[iNode];
+		if (node.iNumFaces > 0)
+		{
+			// Leaf - test ray against each face (Moller-Trumbore)
+			for (TUInt32 iFace = node.iFirst; iFace < node.iFirst + node.iNumFaces; ++iFace)
+			{
+				const SFace& face = m_Faces[iFace];
+				CVector3 p = Cross( direction, face.edge2 );
+				TFloat32 fDet = Dot( face.edge1, p );
+				if (fDet == 0.0f)
+				{
+					continue; // Ray parallel to face
+				}
+				TFloat32 fInvDet = 1.0f / fDet;
+				CVector3 t = origin - face.p0;
+				TFloat32 fU = Dot( t, p ) * fInvDet;
+				if (fU < 0.0f || fU > 1.0f)
+				{
+					continue;
+				}
+				CVector3 q = Cross( t, face.edge1 );
+				TFloat32 fV = Dot( direction, q ) * fInvDet;
+				if (fV < 0.0f || fU + fV > 1.0f)
+				{
+					continue;
+				}
+				TFloat32 fDistance = Dot( face.edge2, q ) * fInvDet;
+				if (fDistance < 0.0f || fDistance > fClosest)
+				{
+					continue;
+				}
+
+				fClosest = fDistance;
+				iHitFace = iFace;
+				fHitU = fU;
+				fHitV = fV;
+				bHit = true;
+				if (bAnyHit)
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			// Visit the nearer child hit by the ray first, push the other to visit later
+			TUInt32 iChild1 = node.iFirst;
+			TUInt32 iChild2 = node.iFirst + 1;
+			TFloat32 fEntry1, fEntry2;
+			bool bHit1 = IntersectBounds( m_Nodes[iChild1].minBounds, m_Nodes[iChild1].maxBounds,
+			                              origin, invDirection, fClosest, &fEntry1 );
+			bool bHit2 = IntersectBounds( m_Nodes[iChild2].minBounds, m_Nodes[iChild2].maxBounds,
+			                              origin, invDirection, fClosest, &fEntry2 );
+			if (bHit1 && bHit2)
+			{
+				if (fEntry2 < fEntry1)
+				{
+					swap( iChild1, iChild2 );
+					swap( fEntry1, fEntry2 );
+				}
+				aStack[iStackSize].iNode = iChild2;
+				aStack[iStackSize].fEntry = fEntry2;
+				++iStackSize;
+				iNode = iChild1;
+				continue;
+			}
+			if (bHit1 || bHit2)
+			{
+				iNode = bHit1 ? iChild1 : iChild2;
+				continue;
+			}
+		}
+
+		// Take the next node from the stack, skipping those beyond the closest hit so far
+		while (iStackSize > 0 && aStack[iStackSize - 1].fEntry > fClosest)
+		{
+			--iStackSize;
+		}
+		if (iStackSize == 0)
+		{
+			break;
+		}
+		iNode = aStack[--iStackSize].iNode;
+	}
+
+	if (bHit)
+	{
+		pHit->iFace = m_FaceIndices[iHitFace];
+		pHit->fDistance = fClosest;
+		pHit->fU = fHitU;
+		pHit->fV = fHitV;
+	}
+	return bHit;
+
+	GEN_ENDGUARD;
+}
+
+
+} // namespace gen
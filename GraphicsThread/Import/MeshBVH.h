@@ -0,0 +1,177 @@
+/**************************************************************************************************
+	Module:       MeshBVH.h
+	Date created: 18/10/26
+
+	Bounding volume hierarchy over the faces of a mesh, for fast ray queries such as picking and
+	line-of-sight tests
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_MESH_BVH_H_INCLUDED
+#define GEN_MESH_BVH_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+
+namespace gen
+{
+
+// Default maximum number of faces in a leaf of a mesh BVH
+const TUInt32 kiDefaultMaxBVHLeafFaces = 4;
+
+// Result of a ray query against a mesh BVH
+struct SRayHit
+{
+	TUInt32  iFace;     // Index of the face hit, in the face list the BVH was built from
+	TFloat32 fDistance; // Distance to the hit along the ray, in multiples of the ray direction
+	TFloat32 fU;        // Barycentric coordinates of the hit within the face - the weights of
+	TFloat32 fV;        // the face's second and third vertices
+};
+
+
+class CMeshBVH
+{
+	GEN_CLASS( CMeshBVH )
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+public:
+	// Constructor creates an empty BVH, use Build to fill it
+	CMeshBVH() {}
+
+
+/*-----------------------------------------------------------------------------------------
+	Public interface
+-----------------------------------------------------------------------------------------*/
+public:
+
+	/////////////////////////////////////
+	// Building
+
+	// Build the BVH over a triangle list using a binned surface area heuristic, with at most the
+	// given number of faces in each leaf. The BVH keeps its own copy of the face positions, so
+	// the mesh data is not needed for queries
+	void Build
+	(
+		const TUInt32*  piIndices,
+		const TUInt32   iNumFaces,
+		const CVector3* pPositions,
+		const TUInt32   iMaxLeafFaces = kiDefaultMaxBVHLeafFaces
+	);
+
+	// Remove all nodes and faces
+	void Clear();
+
+
+	/////////////////////////////////////
+	// Data access
+
+	// Return true if the BVH contains no faces
+	bool IsEmpty() const
+	{
+		return m_Nodes.empty();
+	}
+
+	// Get the number of nodes and faces in the BVH
+	TUInt32 GetNumNodes() const
+	{
+		return static_cast<TUInt32>(m_Nodes.size());
+	}
+	TUInt32 GetNumFaces() const
+	{
+		return static_cast<TUInt32>(m_FaceIndices.size());
+	}
+
+	// Get the memory used by the BVH's nodes and faces, in bytes
+	TUInt32 GetMemoryUsed() const
+	{
+		return static_cast<TUInt32>(m_Nodes.size() * sizeof(SNode) +
+		                            m_Faces.size() * sizeof(SFace) +
+		                            m_FaceIndices.size() * sizeof(TUInt32));
+	}
+
+
+	/////////////////////////////////////
+	// Queries
+
+	// Find the closest face hit by a ray within the given distance (in multiples of the ray
+	// direction, which need not be unit length). Faces are hit from either side. Returns true
+	// and the hit details if a face was hit
+	bool RayCastClosest
+	(
+		const CVector3& origin,
+		const CVector3& direction,
+		const TFloat32  fMaxDistance,
+		SRayHit*        pHit
+	) const;
+
+	// Return true if a ray hits any face within the given distance - e.g. for line-of-sight
+	// tests. Faster than RayCastClosest as it stops at the first hit found
+	bool RayCastAny
+	(
+		const CVector3& origin,
+		const CVector3& direction,
+		const TFloat32  fMaxDistance
+	) const;
+
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// A node of the hierarchy, 32 bytes so two fit in a cache line. Leaves hold a range of faces,
+	// other nodes hold the index of their first child - the second child always follows it
+	struct SNode
+	{
+		CVector3 minBounds;
+		TUInt32  iFirst;    // First face for leaves, first child for other nodes
+		CVector3 maxBounds;
+		TUInt32  iNumFaces; // 0 for nodes that are not leaves
+	};
+
+	// A face stored in the form used for ray intersection - a vertex and the two edges from it
+	struct SFace
+	{
+		CVector3 p0;
+		CVector3 edge1;
+		CVector3 edge2;
+	};
+
+	// Maximum depth of the hierarchy, limits the stack used by queries. Once the build reaches
+	// half this depth, nodes are split at their median face so the remaining levels are balanced
+	static const TUInt32 kiMaxDepth = 64;
+
+	// Shared implementation of the ray queries
+	bool RayCast
+	(
+		const CVector3& origin,
+		const CVector3& direction,
+		const TFloat32  fMaxDistance,
+		const bool      bAnyHit,
+		SRayHit*        pHit
+	) const;
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	// Nodes of the hierarchy, the first is the root
+	vector<SNode>   m_Nodes;
+
+	// Faces ordered so each leaf's faces are contiguous, and the original index of each face
+	vector<SFace>   m_Faces;
+	vector<TUInt32> m_FaceIndices;
+};
+
+
+} // namespace gen
+
+#endif // GEN_MESH_BVH_H_INCLUDED
@@ -0,0 +1,243 @@
+/**************************************************************************************************
+	Module:       MeshBounds.cpp
+	Date created: 18/10/26
+
+	Bounding volumes of mesh geometry - axis-aligned bounding boxes and bounding spheres - and
+	their combination through a node hierarchy
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include "BaseMath.h"
+#include "MeshBounds.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Bounds calculation
+ ------------------------------------------------------------------------------------------------*/
+
+// Return the position at the given index in a list of positions the given number of bytes apart
+static inline const CVector3& StridedPosition
+(
+	const CVector3* pPositions,
+	const TUInt32   iStride,
+	const TUInt32   iPosition
+)
+{
+	return *reinterpret_cast<const CVector3*>(reinterpret_cast<const TUInt8*>(pPositions) +
+	                                          iPosition * iStride);
+}
+
+// Return the index of the position furthest from the given point
+static TUInt32 FurthestPosition
+(
+	const CVector3* pPositions,
+	const TUInt32   iNumPositions,
+	const TUInt32   iStride,
+	const CVector3& point
+)
+{
+	TUInt32 iFurthest = 0;
+	TFloat32 fFurthestSquared = -1.0f;
+	for (TUInt32 iPosition = 0; iPosition < iNumPositions; ++iPosition)
+	{
+		TFloat32 fDistanceSquared =
+			(StridedPosition( pPositions, iStride, iPosition ) - point).LengthSquared();
+		if (fDistanceSquared > fFurthestSquared)
+		{
+			fFurthestSquared = fDistanceSquared;
+			iFurthest = iPosition;
+		}
+	}
+	return iFurthest;
+}
+
+
+// Set bounds to be empty - they contain nothing, and merging other bounds into them gives the
+// other bounds
+void ClearBounds
+(
+	SMeshBounds* pBounds
+)
+{
+	pBounds->minBounds = CVector3( 1.0e30f, 1.0e30f, 1.0e30f );
+	pBounds->maxBounds = CVector3( -1.0e30f, -1.0e30f, -1.0e30f );
+	pBounds->centre = CVector3::kOrigin;
+	pBounds->radius = -1.0f;
+}
+
+
+// Calculate the bounds of a list of positions, the given number of bytes apart (e.g. the size of
+// a vertex if the positions are in interleaved vertex data). The box is exact. The sphere is the
+// smaller of the sphere centred on the box and an approximation of the minimal bounding sphere
+// (Ritter's method), each with the smallest radius that contains all the positions
+void CalculateBounds
+(
+	const CVector3* pPositions,
+	const TUInt32   iNumPositions,
+	const TUInt32   iStride,
+	SMeshBounds*    pBounds
+)
+{
+	ClearBounds( pBounds );
+	if (iNumPositions == 0)
+	{
+		return;
+	}
+
+	// Box - separate minimum and maximum for each axis, with no dependency between iterations
+	// other than each running value, so the compiler can keep them all in registers
+	TFloat32 fMinX = pPositions->x, fMinY = pPositions->y, fMinZ = pPositions->z;
+	TFloat32 fMaxX = fMinX, fMaxY = fMinY, fMaxZ = fMinZ;
+	for (TUInt32 iPosition = 1; iPosition < iNumPositions; ++iPosition)
+	{
+		const CVector3& position = StridedPosition( pPositions, iStride, iPosition );
+		fMinX = Min( fMinX, position.x );
+		fMinY = Min( fMinY, position.y );
+		fMinZ = Min( fMinZ, position.z );
+		fMaxX = Max( fMaxX, position.x );
+		fMaxY = Max( fMaxY, position.y );
+		fMaxZ = Max( fMaxZ, position.z );
+	}
+	pBounds->minBounds = CVector3( fMinX, fMinY, fMinZ );
+	pBounds->maxBounds = CVector3( fMaxX, fMaxY, fMaxZ );
+
+	// Ritter's method - start with the sphere through two distant positions (the position
+	// furthest from an arbitrary one, and the position furthest from that), then grow the sphere
+	// to include each position outside it
+	const CVector3& first = StridedPosition( pPositions, iStride,
+		FurthestPosition( pPositions, iNumPositions, iStride, *pPositions ) );
+	const CVector3& second = StridedPosition( pPositions, iStride,
+		FurthestPosition( pPositions, iNumPositions, iStride, first ) );
+	CVector3 ritterCentre = (first + second) * 0.5f;
+	TFloat32 fRitterRadius = (second - first).Length() * 0.5f;
+	for (TUInt32 iPosition = 0; iPosition < iNumPositions; ++iPosition)
+	{
+		CVector3 offset = StridedPosition( pPositions, iStride, iPosition ) - ritterCentre;
+		TFloat32 fDistanceSquared = offset.LengthSquared();
+		if (fDistanceSquared > fRitterRadius * fRitterRadius)
+		{
+			// Move the centre towards the position so the sphere just touches it and still touches
+			// the far side of the old sphere
+			TFloat32 fDistance = Sqrt( fDistanceSquared );
+			TFloat32 fNewRadius = (fRitterRadius + fDistance) * 0.5f;
+			ritterCentre += offset * ((fNewRadius - fRitterRadius) / fDistance);
+			fRitterRadius = fNewRadius;
+		}
+	}
+
+	// The box centre gives a tighter sphere for some shapes (e.g. boxes), so find the radius
+	// needed around both centres - exactly, which also removes any rounding error from above
+	CVector3 boxCentre = (pBounds->minBounds + pBounds->maxBounds) * 0.5f;
+	TFloat32 fRitterSquared = 0.0f;
+	TFloat32 fBoxSquared = 0.0f;
+	for (TUInt32 iPosition = 0; iPosition < iNumPositions; ++iPosition)
+	{
+		const CVector3& position = StridedPosition( pPositions, iStride, iPosition );
+		fRitterSquared = Max( fRitterSquared, (position - ritterCentre).LengthSquared() );
+		fBoxSquared = Max( fBoxSquared, (position - boxCentre).LengthSquared() );
+	}
+	if (fRitterSquared < fBoxSquared)
+	{
+		pBounds->centre = ritterCentre;
+		pBounds->radius = Sqrt( fRitterSquared );
+	}
+	else
+	{
+		pBounds->centre = boxCentre;
+		pBounds->radius = Sqrt( fBoxSquared );
+	}
+}
+
+
+// Enlarge bounds to contain other bounds. The box is exact, the sphere is the smallest that
+// contains both spheres
+void MergeBounds
+(
+	SMeshBounds*       pBounds,
+	const SMeshBounds& bounds
+)
+{
+	if (IsEmptyBounds( bounds ))
+	{
+		return;
+	}
+	if (IsEmptyBounds( *pBounds ))
+	{
+		*pBounds = bounds;
+		return;
+	}
+
+	pBounds->minBounds.x = Min( pBounds->minBounds.x, bounds.minBounds.x );
+	pBounds->minBounds.y = Min( pBounds->minBounds.y, bounds.minBounds.y );
+	pBounds->minBounds.z = Min( pBounds->minBounds.z, bounds.minBounds.z );
+	pBounds->maxBounds.x = Max( pBounds->maxBounds.x, bounds.maxBounds.x );
+	pBounds->maxBounds.y = Max( pBounds->maxBounds.y, bounds.maxBounds.y );
+	pBounds->maxBounds.z = Max( pBounds->maxBounds.z, bounds.maxBounds.z );
+
+	// Keep either sphere if it contains the other, otherwise the new sphere spans both along the
+	// line between their centres
+	CVector3 offset = bounds.centre - pBounds->centre;
+	TFloat32 fDistance = offset.Length();
+	if (fDistance + bounds.radius <= pBounds->radius)
+	{
+		return;
+	}
+	if (fDistance + pBounds->radius <= bounds.radius)
+	{
+		pBounds->centre = bounds.centre;
+		pBounds->radius = bounds.radius;
+		return;
+	}
+	TFloat32 fNewRadius = (fDistance + pBounds->radius + bounds.radius) * 0.5f;
+	pBounds->centre += offset * ((fNewRadius - pBounds->radius) / fDistance);
+	pBounds->radius = fNewRadius;
+}
+
+
+// Transform bounds by an affine matrix, e.g. from a node's space to its parent's space. The box
+// is the box around the transformed box, the sphere's radius is scaled by the largest scale of
+// the matrix
+void TransformBounds
+(
+	const SMeshBounds& bounds,
+	const CMatrix4x4&  matrix,
+	SMeshBounds*       pTransformed
+)
+{
+	if (IsEmptyBounds( bounds ))
+	{
+		ClearBounds( pTransformed );
+		return;
+	}
+
+	// Each axis of the new box starts at the translation, then each row of the matrix adds the
+	// smaller / larger of its products with the old box's minimum and maximum (Arvo's method)
+	const TFloat32* pfMatrix = &matrix.e00;
+	const TFloat32* pfMin = &bounds.minBounds.x;
+	const TFloat32* pfMax = &bounds.maxBounds.x;
+	TFloat32 afNewMin[3], afNewMax[3];
+	for (TUInt32 iAxis = 0; iAxis < 3; ++iAxis)
+	{
+		afNewMin[iAxis] = afNewMax[iAxis] = pfMatrix[12 + iAxis];
+		for (TUInt32 iRow = 0; iRow < 3; ++iRow)
+		{
+			TFloat32 fA = pfMatrix[iRow * 4 + iAxis] * pfMin[iRow];
+			TFloat32 fB = pfMatrix[iRow * 4 + iAxis] * pfMax[iRow];
+			afNewMin[iAxis] += Min( fA, fB );
+			afNewMax[iAxis] += Max( fA, fB );
+		}
+	}
+	pTransformed->minBounds = CVector3( afNewMin[0], afNewMin[1], afNewMin[2] );
+	pTransformed->maxBounds = CVector3( afNewMax[0], afNewMax[1], afNewMax[2] );
+
+	TFloat32 fScale = Max( matrix.GetScaleX(), Max( matrix.GetScaleY(), matrix.GetScaleZ() ) );
+	pTransformed->centre = matrix.TransformPoint( bounds.centre );
+	pTransformed->radius = bounds.radius * fScale;
+}
+
+
+} // namespace gen
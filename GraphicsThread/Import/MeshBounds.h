@@ -0,0 +1,76 @@
+/**************************************************************************************************
+	Module:       MeshBounds.h
+	Date created: 18/10/26
+
+	Bounding volumes of mesh geometry - axis-aligned bounding boxes and bounding spheres - and
+	their combination through a node hierarchy
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_MESH_BOUNDS_H_INCLUDED
+#define GEN_MESH_BOUNDS_H_INCLUDED
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "MeshData.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Bounds calculation
+ ------------------------------------------------------------------------------------------------*/
+
+// Set bounds to be empty - they contain nothing, and merging other bounds into them gives the
+// other bounds
+void ClearBounds
+(
+	SMeshBounds* pBounds
+);
+
+// Return true if the bounds are empty (see ClearBounds)
+inline bool IsEmptyBounds
+(
+	const SMeshBounds& bounds
+)
+{
+	return bounds.radius < 0.0f;
+}
+
+// Calculate the bounds of a list of positions, the given number of bytes apart (e.g. the size of
+// a vertex if the positions are in interleaved vertex data). The box is exact. The sphere is the
+// smaller of the sphere centred on the box and an approximation of the minimal bounding sphere
+// (Ritter's method), each with the smallest radius that contains all the positions
+void CalculateBounds
+(
+	const CVector3* pPositions,
+	const TUInt32   iNumPositions,
+	const TUInt32   iStride,
+	SMeshBounds*    pBounds
+);
+
+// Enlarge bounds to contain other bounds. The box is exact, the sphere is the smallest that
+// contains both spheres
+void MergeBounds
+(
+	SMeshBounds*       pBounds,
+	const SMeshBounds& bounds
+);
+
+// Transform bounds by an affine matrix, e.g. from a node's space to its parent's space. The box
+// is the box around the transformed box, the sphere's radius is scaled by the largest scale of
+// the matrix
+void TransformBounds
+(
+	const SMeshBounds& bounds,
+	const CMatrix4x4&  matrix,
+	SMeshBounds*       pTransformed
+);
+
+
+} // namespace gen
+
+#endif // GEN_MESH_BOUNDS_H_INCLUDED
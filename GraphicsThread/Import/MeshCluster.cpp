@@ -0,0 +1,332 @@
+/**************************************************************************************************
+	Module:       MeshCluster.cpp
+	Date created: 18/10/26
+
+	Partitioning of triangle lists into meshlets - small clusters of neighbouring faces with
+	bounding spheres and normal cones - and culling of meshlets against a camera
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <algorithm>
+#include <numeric>
+using namespace std;
+
+#include "BaseMath.h"
+#include "MeshCluster.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Meshlet building
+ ------------------------------------------------------------------------------------------------*/
+
+// Calculate the bounding sphere and normal cone of a meshlet from its faces
+static void CalculateMeshletBounds
+(
+	const TUInt32*  piIndices,
+	const CVector3* pPositions,
+	SMeshlet*       pMeshlet
+)
+{
+	const TUInt32* piFaces = piIndices + pMeshlet->firstFace * 3;
+	TUInt32 iNumIndices = pMeshlet->numFaces * 3;
+
+	// Bounding sphere centred on the bounding box
+	CVector3 minBounds = pPositions[piFaces[0]];
+	CVector3 maxBounds = minBounds;
+	for (TUInt32 iIndex = 1; iIndex < iNumIndices; ++iIndex)
+	{
+		const CVector3& position = pPositions[piFaces[iIndex]];
+		minBounds.x = Min( minBounds.x, position.x );
+		minBounds.y = Min( minBounds.y, position.y );
+		minBounds.z = Min( minBounds.z, position.z );
+		maxBounds.x = Max( maxBounds.x, position.x );
+		maxBounds.y = Max( maxBounds.y, position.y );
+		maxBounds.z = Max( maxBounds.z, position.z );
+	}
+	pMeshlet->centre = (minBounds + maxBounds) * 0.5f;
+	TFloat32 fRadiusSquared = 0.0f;
+	for (TUInt32 iIndex = 0; iIndex < iNumIndices; ++iIndex)
+	{
+		CVector3 offset = pPositions[piFaces[iIndex]] - pMeshlet->centre;
+		fRadiusSquared = Max( fRadiusSquared, offset.LengthSquared() );
+	}
+	pMeshlet->radius = Sqrt( fRadiusSquared );
+
+	// Normal cone axis is the average of the unit face normals, the half-angle covers the normal
+	// furthest from it. Degenerate faces have no normal and are ignored
+	vector<CVector3> normals;
+	normals.reserve( pMeshlet->numFaces );
+	CVector3 axis = CVector3::kOrigin;
+	for (TUInt32 iFace = 0; iFace < pMeshlet->numFaces; ++iFace)
+	{
+		const CVector3& p0 = pPositions[piFaces[iFace * 3]];
+		const CVector3& p1 = pPositions[piFaces[iFace * 3 + 1]];
+		const CVector3& p2 = pPositions[piFaces[iFace * 3 + 2]];
+		CVector3 normal = Cross( p1 - p0, p2 - p0 );
+		TFloat32 fLength = normal.Length();
+		if (fLength > 0.0f)
+		{
+			normals.push_back( normal / fLength );
+			axis += normals.back();
+		}
+	}
+	TFloat32 fAxisLength = axis.Length();
+	if (normals.empty() || fAxisLength < 1e-6f * normals.size())
+	{
+		pMeshlet->coneAxis = CVector3( 0.0f, 0.0f, 1.0f );
+		pMeshlet->coneCos = -1.0f;
+		return;
+	}
+	pMeshlet->coneAxis = axis / fAxisLength;
+	pMeshlet->coneCos = 1.0f;
+	for (TUInt32 iNormal = 0; iNormal < normals.size(); ++iNormal)
+	{
+		pMeshlet->coneCos = Min( pMeshlet->coneCos, Dot( pMeshlet->coneAxis, normals[iNormal] ) );
+	}
+}
+
+
+// Partition a triangle list into meshlets of at most the given number of vertices and faces. Each
+// meshlet is grown from a seed face by adding neighbouring faces that add fewest new vertices,
+// preferring faces near the meshlet's centre. The faces are reordered in place so each meshlet is
+// a contiguous range, seeds are taken in the existing face order. Returns the meshlets with their
+// bounding spheres and normal cones
+void BuildMeshlets
+(
+	TUInt32*          piIndices,
+	const TUInt32     iNumFaces,
+	const CVector3*   pPositions,
+	const TUInt32     iNumVertices,
+	const TUInt32     iMaxVertices,
+	const TUInt32     iMaxFaces,
+	vector<SMeshlet>* pMeshlets
+)
+{
+	GEN_GUARD;
+
+	GEN_ASSERT( iMaxVertices >= 3 && iMaxFaces >= 1, "Invalid meshlet limits" );
+
+	pMeshlets->clear();
+	if (iNumFaces == 0)
+	{
+		return;
+	}
+
+	// List the faces using each vertex. Also track the number of faces not yet in a meshlet for
+	// each vertex, so exhausted vertices can be skipped when searching for faces to add
+	vector<TUInt32> vertexFaceStarts( iNumVertices + 1, 0 );
+	for (TUInt32 iIndex = 0; iIndex < iNumFaces * 3; ++iIndex)
+	{
+		++vertexFaceStarts[piIndices[iIndex] + 1];
+	}
+	partial_sum( vertexFaceStarts.begin(), vertexFaceStarts.end(), vertexFaceStarts.begin() );
+	vector<TUInt32> vertexFaces( iNumFaces * 3 );
+	vector<TUInt32> liveFaces( iNumVertices, 0 );
+	for (TUInt32 iIndex = 0; iIndex < iNumFaces * 3; ++iIndex)
+	{
+		TUInt32 iVertex = piIndices[iIndex];
+		vertexFaces[vertexFaceStarts[iVertex] + liveFaces[iVertex]++] = iIndex / 3;
+	}
+
+	// Face centres, used to keep meshlets compact
+	vector<CVector3> faceCentres( iNumFaces );
+	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+	{
+		const TUInt32* piFace = piIndices + iFace * 3;
+		faceCentres[iFace] = (pPositions[piFace[0]] + pPositions[piFace[1]] +
+		                      pPositions[piFace[2]]) * (1.0f / 3.0f);
+	}
+
+	// Mark of the meshlet (index + 1) each vertex was last added to, to test if a vertex is in the
+	// current meshlet
+	vector<TUInt32> vertexMeshlet( iNumVertices, 0 );
+	vector<bool> faceUsed( iNumFaces, false );
+	vector<TUInt32> newIndices( iNumFaces * 3 );
+	vector<TUInt32> meshletVertices;
+	meshletVertices.reserve( iMaxVertices );
+	TUInt32 iNumPlaced = 0;
+	TUInt32 iSeedFace = 0;
+	while (iNumPlaced < iNumFaces)
+	{
+		// Start a new meshlet
+		SMeshlet meshlet;
+		meshlet.firstFace = iNumPlaced;
+		meshlet.numFaces = 0;
+		TUInt32 iMark = static_cast<TUInt32>(pMeshlets->size()) + 1;
+		meshletVertices.clear();
+		CVector3 centreSum = CVector3::kOrigin;
+
+		// Seed with the next unused face in the existing order
+		while (faceUsed[iSeedFace])
+		{
+			++iSeedFace;
+		}
+		TUInt32 iFace = iSeedFace;
+		do
+		{
+			// Add the face to the meshlet
+			const TUInt32* piFace = piIndices + iFace * 3;
+			faceUsed[iFace] = true;
+			for (TUInt32 iCorner = 0; iCorner < 3; ++iCorner)
+			{
+				TUInt32 iVertex = piFace[iCorner];
+				newIndices[iNumPlaced * 3 + iCorner] = iVertex;
+				--liveFaces[iVertex];
+				if (vertexMeshlet[iVertex] != iMark)
+				{
+					vertexMeshlet[iVertex] = iMark;
+					meshletVertices.push_back( iVertex );
+				}
+			}
+			++iNumPlaced;
+			++meshlet.numFaces;
+			centreSum += faceCentres[iFace];
+			if (meshlet.numFaces == iMaxFaces || meshletVertices.size() == iMaxVertices)
+			{
+				break;
+			}
+			CVector3 centre = centreSum / static_cast<TFloat32>(meshlet.numFaces);
+
+			// Find the best unused face sharing a vertex with the meshlet - fewest new vertices
+			// then nearest to the centre - that still fits in the meshlet
+			TUInt32 iBestFace = iNumFaces;
+			TUInt32 iBestNew = 3;
+			TFloat32 fBestDistance = 0.0f;
+			for (TUInt32 iVert = 0; iVert < meshletVertices.size(); ++iVert)
+			{
+				TUInt32 iVertex = meshletVertices[iVert];
+				if (liveFaces[iVertex] == 0)
+				{
+					continue;
+				}
+				for (TUInt32 i = vertexFaceStarts[iVertex]; i < vertexFaceStarts[iVertex + 1]; ++i)
+				{
+					TUInt32 iCandidate = vertexFaces[i];
+					if (faceUsed[iCandidate])
+					{
+						continue;
+					}
+					const TUInt32* piCandidate = piIndices + iCandidate * 3;
+					TUInt32 iNew = (vertexMeshlet[piCandidate[0]] != iMark ? 1 : 0) +
+					               (vertexMeshlet[piCandidate[1]] != iMark ? 1 : 0) +
+					               (vertexMeshlet[piCandidate[2]] != iMark ? 1 : 0);
+					if (meshletVertices.size() + iNew > iMaxVertices || iNew > iBestNew)
+					{
+						continue;
+					}
+					TFloat32 fDistance = (faceCentres[iCandidate] - centre).LengthSquared();
+					if (iNew < iBestNew || iBestFace == iNumFaces || fDistance < fBestDistance)
+					{
+						iBestFace = iCandidate;
+						iBestNew = iNew;
+						fBestDistance = fDistance;
+					}
+				}
+			}
+			iFace = iBestFace;
+		} while (iFace != iNumFaces);
+
+		meshlet.numVertices = static_cast<TUInt32>(meshletVertices.size());
+		pMeshlets->push_back( meshlet );
+	}
+
+	// Copy the faces back in meshlet order, then calculate the bounds
+	copy( newIndices.begin(), newIndices.end(), piIndices );
+	for (TUInt32 iMeshlet = 0; iMeshlet < pMeshlets->size(); ++iMeshlet)
+	{
+		CalculateMeshletBounds( piIndices, pPositions, &(*pMeshlets)[iMeshlet] );
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Meshlet culling
+ ------------------------------------------------------------------------------------------------*/
+
+// Get the planes of the view frustum from a combined world-view-projection matrix, in the world
+// matrix's model space. Uses DirectX conventions (row vectors, clip space z from 0 to 1). Each
+// plane is (normal, distance) with the normal unit length and pointing into the frustum
+void GetFrustumPlanes
+(
+	const CMatrix4x4& m,
+	CVector4*         pPlanes
+)
+{
+	// A point p is inside if its clip space coordinates c = p.M satisfy -w <= x <= w,
+	// -w <= y <= w and 0 <= z <= w. Each inequality is a plane formed from columns of M
+	pPlanes[0] = CVector4( m.e03 + m.e00, m.e13 + m.e10, m.e23 + m.e20, m.e33 + m.e30 ); // Left
+	pPlanes[1] = CVector4( m.e03 - m.e00, m.e13 - m.e10, m.e23 - m.e20, m.e33 - m.e30 ); // Right
+	pPlanes[2] = CVector4( m.e03 + m.e01, m.e13 + m.e11, m.e23 + m.e21, m.e33 + m.e31 ); // Bottom
+	pPlanes[3] = CVector4( m.e03 - m.e01, m.e13 - m.e11, m.e23 - m.e21, m.e33 - m.e31 ); // Top
+	pPlanes[4] = CVector4( m.e02, m.e12, m.e22, m.e32 );                                 // Near
+	pPlanes[5] = CVector4( m.e03 - m.e02, m.e13 - m.e12, m.e23 - m.e22, m.e33 - m.e32 ); // Far
+
+	// Normalise so plane equations give distances
+	for (TUInt32 iPlane = 0; iPlane < kiNumFrustumPlanes; ++iPlane)
+	{
+		CVector4& plane = pPlanes[iPlane];
+		TFloat32 fLength = Sqrt( plane.x * plane.x + plane.y * plane.y + plane.z * plane.z );
+		if (fLength > 0.0f)
+		{
+			plane.x /= fLength;
+			plane.y /= fLength;
+			plane.z /= fLength;
+			plane.w /= fLength;
+		}
+	}
+}
+
+
+// Test if a meshlet may be visible - returns false if it is entirely outside the view frustum or
+// if all its faces point away from the camera. The camera position and frustum planes must be
+// in the meshlet's model space. The back-face test assumes the model space is not sheared or
+// non-uniformly scaled
+bool IsMeshletVisible
+(
+	const SMeshlet&   meshlet,
+	const CVector3&   cameraPosition,
+	const CVector4*   pPlanes,
+	const TUInt32     iNumPlanes /*= kiNumFrustumPlanes*/
+)
+{
+	// Outside the frustum if the bounding sphere is entirely behind any plane
+	for (TUInt32 iPlane = 0; iPlane < iNumPlanes; ++iPlane)
+	{
+		const CVector4& plane = pPlanes[iPlane];
+		TFloat32 fDistance = plane.x * meshlet.centre.x + plane.y * meshlet.centre.y +
+		                     plane.z * meshlet.centre.z + plane.w;
+		if (fDistance < -meshlet.radius)
+		{
+			return false;
+		}
+	}
+
+	// Back-facing if, for every point in the bounding sphere and every normal in the cone, the
+	// camera is behind the plane through the point. With d the vector from the camera to the
+	// sphere centre at angle b to the cone axis, and a the cone half-angle, that is when
+	// |d| cos(b + a) >= radius
+	if (meshlet.coneCos <= 0.0f)
+	{
+		return true;
+	}
+	CVector3 toCentre = meshlet.centre - cameraPosition;
+	TFloat32 fDistance = toCentre.Length();
+	if (fDistance <= meshlet.radius)
+	{
+		return true;
+	}
+	TFloat32 fCosB = Dot( toCentre, meshlet.coneAxis ) / fDistance;
+	TFloat32 fSinB = Sqrt( Max( 0.0f, 1.0f - fCosB * fCosB ) );
+	TFloat32 fSinA = Sqrt( Max( 0.0f, 1.0f - meshlet.coneCos * meshlet.coneCos ) );
+	TFloat32 fCosAB = fCosB * meshlet.coneCos - fSinB * fSinA;
+	return fDistance * fCosAB < meshlet.radius;
+}
+
+
+} // namespace gen
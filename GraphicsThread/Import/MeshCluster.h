@@ -0,0 +1,84 @@
+/**************************************************************************************************
+	Module:       MeshCluster.h
+	Date created: 18/10/26
+
+	Partitioning of triangle lists into meshlets - small clusters of neighbouring faces with
+	bounding spheres and normal cones - and culling of meshlets against a camera
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_MESH_CLUSTER_H_INCLUDED
+#define GEN_MESH_CLUSTER_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "CVector4.h"
+#include "CMatrix4x4.h"
+#include "MeshData.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Meshlet building
+ ------------------------------------------------------------------------------------------------*/
+
+// Default meshlet size limits - suit hardware that processes clusters in small groups, and keep
+// the clusters small enough to cull effectively
+const TUInt32 kiDefaultMaxMeshletVertices = 64;
+const TUInt32 kiDefaultMaxMeshletFaces = 124;
+
+// Partition a triangle list into meshlets of at most the given number of vertices and faces. Each
+// meshlet is grown from a seed face by adding neighbouring faces that add fewest new vertices,
+// preferring faces near the meshlet's centre. The faces are reordered in place so each meshlet is
+// a contiguous range, seeds are taken in the existing face order. Returns the meshlets with their
+// bounding spheres and normal cones
+void BuildMeshlets
+(
+	TUInt32*          piIndices,
+	const TUInt32     iNumFaces,
+	const CVector3*   pPositions,
+	const TUInt32     iNumVertices,
+	const TUInt32     iMaxVertices,
+	const TUInt32     iMaxFaces,
+	vector<SMeshlet>* pMeshlets
+);
+
+
+/*------------------------------------------------------------------------------------------------
+	Meshlet culling
+ ------------------------------------------------------------------------------------------------*/
+
+// Number of planes in a view frustum
+const TUInt32 kiNumFrustumPlanes = 6;
+
+// Get the planes of the view frustum from a combined world-view-projection matrix, in the world
+// matrix's model space. Uses DirectX conventions (row vectors, clip space z from 0 to 1). Each
+// plane is (normal, distance) with the normal unit length and pointing into the frustum
+void GetFrustumPlanes
+(
+	const CMatrix4x4& worldViewProj,
+	CVector4*         pPlanes
+);
+
+// Test if a meshlet may be visible - returns false if it is entirely outside the view frustum or
+// if all its faces point away from the camera. The camera position and frustum planes must be
+// in the meshlet's model space. The back-face test assumes the model space is not sheared or
+// non-uniformly scaled
+bool IsMeshletVisible
+(
+	const SMeshlet&   meshlet,
+	const CVector3&   cameraPosition,
+	const CVector4*   pPlanes,
+	const TUInt32     iNumPlanes = kiNumFrustumPlanes
+);
+
+
+} // namespace gen
+
+#endif // GEN_MESH_CLUSTER_H_INCLUDED
@@ -14,6 +14,7 @@ using namespace std;
 
 #include "Defines.h"
 #include "Colour.h"
+#include "CVector3.h"
 #include "CMatrix4x4.h"
 
 namespace gen
@@ -40,44 +41,125 @@ enum ERenderMethod
 /////////////////////////////////////
 // Mesh definitions
 
-// A single node in the hierarchy of a mesh. The hierarchy is flattened (depth-first) into a list
+// Bounds of some geometry - an axis-aligned bounding box and a bounding sphere. Empty bounds (of
+// no geometry) have a negative radius and a box with the minimum greater than the maximum
+struct SMeshBounds
+{
+	CVector3 minBounds;
+	CVector3 maxBounds;
+	CVector3 centre;
+	TFloat32 radius;
+};
+
+// A single node in the hierarchy of a mesh. The hierarchy is flattened (depth-first) into a list.
+// Names are IDs in the importer's name table, nodes with the same name have the same ID. The IDs
+// are only valid until the importer's next import
 struct SMeshNode
 { 
-	string     name;           // Name for the node
-	TUInt32    depth;          // Depth in hierachy of this node
-	TUInt32    parent;         // Index in hierarchy list of parent node
-	TUInt32    numChildren;    // Number of children of this node - the next node in the list will
-	                           // be the first child
-	CMatrix4x4 positionMatrix; // Default matrix of this node in parent space
-	CMatrix4x4 invMeshOffset;  // Inverse of the matrix of this node in mesh's root space
+	TUInt32     name;           // Name for the node (ID, see CImportXFile::GetName)
+	TUInt32     depth;          // Depth in hierachy of this node
+	TUInt32     parent;         // Index in hierarchy list of parent node
+	TUInt32     numChildren;    // Number of children of this node - the next node in the list will
+	                            // be the first child
+	CMatrix4x4  positionMatrix; // Default matrix of this node in parent space
+	CMatrix4x4  invMeshOffset;  // Inverse of the matrix of this node in mesh's root space
+	SMeshBounds bounds;         // Bounds of the sub-meshes of this node and its descendants, in
+	                            // this node's space with the default matrices (positionMatrix)
 };
 
 
-// A single face in a mesh - all faces are triangles
+// Layout of the vertex data in a sub-mesh
+enum EVertexLayout
+{
+	InterleavedVertices = 0, // All components of each vertex stored together (array of structures)
+	SeparateStreams     = 1, // Each vertex component stored in its own array (structure of arrays)
+};
+
+// A single face in a mesh - all faces are triangles. Sub-meshes with few enough vertices use
+// 16-bit indices, larger ones use 32-bit indices (see SSubMesh::indexSize)
 struct SMeshFace
 {
 	TUInt16 aiVertex[3];
 };
 typedef vector<SMeshFace> TMeshFaces;
 
+struct SMeshFace32
+{
+	TUInt32 aiVertex[3];
+};
+
+// Maximum number of vertices in a sub-mesh that uses 16-bit indices
+const TUInt32 kiMax16BitVertices = 0x10000;
+
+// A level of detail (LOD) of a sub-mesh - a range of faces in the sub-mesh's face list. All the
+// levels share the sub-mesh's vertices, which are ordered so that coarser levels use fewer of
+// the first vertices - a level only uses vertices below its vertex count, so only those need to
+// be processed when rendering it. The error is an estimate of how far the level's surface
+// deviates from the full detail mesh in model space units, used to select a level to suit the
+// size of the mesh on-screen
+struct SMeshLOD
+{
+	TUInt32  firstFace;
+	TUInt32  numFaces;
+	TUInt32  numVertices;
+	TFloat32 error;
+};
+
+// Maximum number of levels of detail in a sub-mesh (including the full detail level)
+const TUInt32 kiMaxLODs = 8;
+
+// A meshlet - a small cluster of neighbouring faces in the full detail level of a sub-mesh, with
+// bounds used to cull the whole cluster before rendering. Each meshlet is a range of faces, the
+// meshlets cover the full detail level in order. All faces have normals within the normal cone:
+// those within the cone's half-angle of its axis. If coneCos is not greater than 0 the faces
+// face too many ways for the cone to be used
+struct SMeshlet
+{
+	TUInt32  firstFace;
+	TUInt32  numFaces;
+	TUInt32  numVertices; // Distinct vertices used by the faces
+	CVector3 centre;      // Bounding sphere
+	TFloat32 radius;
+	CVector3 coneAxis;    // Normal cone - unit axis and cosine of half-angle
+	TFloat32 coneCos;
+};
+
+// Range of sizes of a bone palette - the bones used by a sub-mesh, indexed by the bone indices in
+// its vertex data. A face may need 12 bones (4 for each vertex), and bone indices are bytes
+const TUInt32 kiMinPaletteBones = 12;
+const TUInt32 kiMaxPaletteBones = 256;
+
 // A sub-mesh is a single block of geometry that uses the same material. It contains a set of faces
 // and vertices and is controlled by a single node. The vertices are pointed to as raw bytes,
-// because of the flexibility of vertex data
+// because of the flexibility of vertex data. Vertex components are stored in the order: position,
+// skinning data, normal, tangent, texture coordinate, vertex colour (absent components omitted).
+// With separate streams, a component that would be at byte offset N in an interleaved vertex
+// instead starts at byte offset N * numVertices in the vertex data, tightly packed
 struct SSubMesh
 {
-	TUInt32    node;        // Node in heirarchy controlling this submesh
-	TUInt32    material;    // Index of material used by this submesh
-	TUInt32    numVertices;
-	TUInt8*    vertices;    // Pointer to raw vertex data as a byte stream
-	TUInt32    vertexSize;  // Size in bytes of a single vertex
-	bool       hasSkinningData, hasNormals, hasTangents, // Components of each vertex
-	           hasTextureCoords, hasVertexColours;       // (Vertex coordinate assumed)
-	TUInt32    numFaces;
-	SMeshFace* faces;
+	TUInt32       node;         // Node in heirarchy controlling this submesh
+	TUInt32       material;     // Index of material used by this submesh
+	TUInt32       numVertices;
+	TUInt8*       vertices;     // Pointer to raw vertex data as a byte stream
+	TUInt32       vertexSize;   // Size in bytes of a single vertex (all components)
+	EVertexLayout vertexLayout; // Interleaved or separate streams
+	bool          hasSkinningData, hasNormals, hasTangents, // Components of each vertex
+	              hasTextureCoords, hasVertexColours;       // (Vertex coordinate assumed)
+	TUInt32       numFaces;     // Total faces in all levels of detail
+	TUInt32       indexSize;    // Size in bytes of a single index - 2 or 4
+	TUInt8*       faces;        // Pointer to raw face data - SMeshFace or SMeshFace32 depending on
+	                            // the index size
+	TUInt32       numLODs;      // Levels of detail in the face data, level 0 is full detail and
+	SMeshLOD      lods[kiMaxLODs]; // each further level has fewer faces
+	TUInt32       numMeshlets;  // Meshlets in the full detail level, 0 if none were built
+	SMeshBounds   bounds;       // Bounds of the vertex positions, in the space of the node
+	TUInt32       numPaletteBones; // Bones in the palette (nodes) that bone indices refer to, 0
+	                               // if bone indices are node indices
 };
 
 
-// A material indicating how to render a sub-mesh - each sub-mesh uses a single material
+// A material indicating how to render a sub-mesh - each sub-mesh uses a single material. Texture
+// file names are IDs in the importer's name table, only valid until the importer's next import
 struct SMeshMaterial
 {
 	ERenderMethod renderMethod;
@@ -87,7 +169,7 @@ struct SMeshMaterial
 	TFloat32      specularPower;
 
 	TUInt32       numTextures;
-	string        textureFileNames[kiMaxTextures];
+	TUInt32       textureFileNames[kiMaxTextures]; // IDs, see CImportXFile::GetName
 };
 
 
@@ -0,0 +1,489 @@
+/**************************************************************************************************
+	Module:       MeshOptimise.cpp
+	Date created: 18/10/26
+
+	Offline optimisation of triangle lists for the GPU - reordering of faces for the post-transform
+	vertex cache and overdraw, and of vertices for fetch locality. Also analysis of vertex cache
+	efficiency. All functions work on lists of 32-bit indices, three per face
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+using namespace std;
+
+#include "MeshOptimise.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Vertex cache analysis
+ ------------------------------------------------------------------------------------------------*/
+
+// Pass a face through a simulated FIFO vertex cache and return the number of cache misses. The
+// cache is represented by the time each vertex was last added to it, a vertex is in the cache if
+// fewer than iCacheSize vertices have been added since. The time is only advanced on a miss
+static TUInt32 CacheFace
+(
+	const TUInt32*   piFace,
+	vector<TUInt32>& cacheTimes,
+	TUInt32&         iTime,
+	const TUInt32    iCacheSize
+)
+{
+	TUInt32 iMisses = 0;
+	for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
+	{
+		TUInt32 iVertex = piFace[iIndex];
+		if (iTime - cacheTimes[iVertex] > iCacheSize)
+		{
+			cacheTimes[iVertex] = iTime++;
+			++iMisses;
+		}
+	}
+	return iMisses;
+}
+
+// Simulate rendering a triangle list through a FIFO vertex cache of the given size and return
+// the resulting statistics
+void AnalyseVertexCache
+(
+	const TUInt32*     piIndices,
+	const TUInt32      iNumFaces,
+	const TUInt32      iNumVertices,
+	SVertexCacheStats* pStats,
+	const TUInt32      iCacheSize /*= kiDefaultVertexCacheSize*/
+)
+{
+	GEN_GUARD;
+
+	// Initial time ensures all vertices start outside the cache (a cache time of 0)
+	vector<TUInt32> cacheTimes( iNumVertices, 0 );
+	TUInt32 iTime = iCacheSize + 1;
+
+	pStats->iNumFaces = iNumFaces;
+	pStats->iNumMisses = 0;
+	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+	{
+		pStats->iNumMisses += CacheFace( piIndices + iFace * 3, cacheTimes, iTime, iCacheSize );
+	}
+
+	// Count the vertices used - those that have ever been in the cache
+	pStats->iNumVertices = 0;
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		if (cacheTimes[iVertex] != 0)
+		{
+			++pStats->iNumVertices;
+		}
+	}
+
+	GEN_ENDGUARD;
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Mesh optimisation
+ ------------------------------------------------------------------------------------------------*/
+
+// Constants for the vertex scoring in Forsyth's algorithm. The cache modelled is LRU, the most
+// recent three vertices get a fixed score as they were used by the last face output, the
+// remainder decay with cache position. Vertices with few faces left get a boost so that they are
+// finished off rather than leaving isolated faces to be output later
+const TUInt32  kiForsythCacheSize = 32;
+const TUInt32  kiForsythMaxValence = 32; // Valences above this share a score
+const TFloat32 kfForsythCacheDecayPower = 1.5f;
+const TFloat32 kfForsythLastFaceScore = 0.75f;
+const TFloat32 kfForsythValenceBoostScale = 2.0f;
+const TFloat32 kfForsythValenceBoostPower = 0.5f;
+
+// Marker for a vertex outside the cache / no face found
+const TUInt32 kiForsythNone = 0xffffffff;
+
+// Score a vertex for Forsyth's algorithm given its position in the cache (or kiForsythNone) and
+// the number of faces still to be output that use it. Uses precalculated score tables
+static TFloat32 ForsythVertexScore
+(
+	const TUInt32   iCachePos,
+	const TUInt32   iNumActiveFaces,
+	const TFloat32* pfCacheScores,
+	const TFloat32* pfValenceScores
+)
+{
+	// Vertices with no faces remaining are of no interest
+	if (iNumActiveFaces == 0)
+	{
+		return -1.0f;
+	}
+
+	TFloat32 fScore = (iCachePos != kiForsythNone) ? pfCacheScores[iCachePos] : 0.0f;
+	return fScore + pfValenceScores[min( iNumActiveFaces, kiForsythMaxValence - 1 )];
+}
+
+// Reorder the faces of a triangle list to make best use of the post-transform vertex cache. Uses
+// Tom Forsyth's linear-speed algorithm, which does not depend on the exact cache size
+void OptimiseVertexCache
+(
+	TUInt32*      piIndices,
+	const TUInt32 iNumFaces,
+	const TUInt32 iNumVertices
+)
+{
+	GEN_GUARD;
+
+	if (iNumFaces == 0)
+	{
+		return;
+	}
+
+	// Precalculate vertex score tables
+	TFloat32 afCacheScores[kiForsythCacheSize];
+	for (TUInt32 iPos = 0; iPos < kiForsythCacheSize; ++iPos)
+	{
+		if (iPos < 3)
+		{
+			afCacheScores[iPos] = kfForsythLastFaceScore;
+		}
+		else
+		{
+			TFloat32 fScale = 1.0f / (kiForsythCacheSize - 3);
+			afCacheScores[iPos] = powf( 1.0f - (iPos - 3) * fScale, kfForsythCacheDecayPower );
+		}
+	}
+	TFloat32 afValenceScores[kiForsythMaxValence];
+	afValenceScores[0] = 0.0f;
+	for (TUInt32 iValence = 1; iValence < kiForsythMaxValence; ++iValence)
+	{
+		TFloat32 fValence = static_cast<TFloat32>(iValence);
+		afValenceScores[iValence] = kfForsythValenceBoostScale *
+		                            powf( fValence, -kfForsythValenceBoostPower );
+	}
+
+	// Build lists of faces using each vertex. The faces for each vertex are stored contiguously
+	// in a single list, the active (not yet output) faces are kept at the start of each range
+	TUInt32 iNumIndices = iNumFaces * 3;
+	vector<TUInt32> vertexFaceStart( iNumVertices + 1, 0 );
+	for (TUInt32 iIndex = 0; iIndex < iNumIndices; ++iIndex)
+	{
+		++vertexFaceStart[piIndices[iIndex] + 1];
+	}
+	partial_sum( vertexFaceStart.begin(), vertexFaceStart.end(), vertexFaceStart.begin() );
+	vector<TUInt32> vertexFaces( iNumIndices );
+	vector<TUInt32> numActiveFaces( iNumVertices, 0 );
+	for (TUInt32 iIndex = 0; iIndex < iNumIndices; ++iIndex)
+	{
+		TUInt32 iVertex = piIndices[iIndex];
+		vertexFaces[vertexFaceStart[iVertex] + numActiveFaces[iVertex]++] = iIndex / 3;
+	}
+
+	// Initial vertex and face scores, note the highest scoring face
+	vector<TUInt32> cachePos( iNumVertices, kiForsythNone );
+	vector<TFloat32> vertexScores( iNumVertices );
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		vertexScores[iVertex] = ForsythVertexScore( kiForsythNone, numActiveFaces[iVertex],
+		                                            afCacheScores, afValenceScores );
+	}
+	vector<TFloat32> faceScores( iNumFaces );
+	vector<TUInt8> faceOutput( iNumFaces, 0 );
+	TUInt32 iBestFace = 0;
+	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+	{
+		const TUInt32* piFace = piIndices + iFace * 3;
+		faceScores[iFace] = vertexScores[piFace[0]] + vertexScores[piFace[1]] +
+		                    vertexScores[piFace[2]];
+		if (faceScores[iFace] > faceScores[iBestFace])
+		{
+			iBestFace = iFace;
+		}
+	}
+
+	// The LRU cache has room for three extra entries, which are pushed out after each face
+	TUInt32 aiCache[kiForsythCacheSize + 3];
+	TUInt32 aiNewCache[kiForsythCacheSize + 3];
+	TUInt32 iCacheSize = 0;
+
+	// Output faces in order into a new list, searching in order through the original list when
+	// there is no face with vertices in the cache
+	vector<TUInt32> newIndices( iNumIndices );
+	TUInt32 iNextSearchFace = 0;
+	for (TUInt32 iOutFace = 0; iOutFace < iNumFaces; ++iOutFace)
+	{
+		if (iBestFace == kiForsythNone)
+		{
+			while (faceOutput[iNextSearchFace])
+			{
+				++iNextSearchFace;
+			}
+			iBestFace = iNextSearchFace;
+		}
+
+		// Output the face and remove it from the active face list of each of its vertices
+		const TUInt32* piFace = piIndices + iBestFace * 3;
+		faceOutput[iBestFace] = 1;
+		for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
+		{
+			TUInt32 iVertex = piFace[iIndex];
+			newIndices[iOutFace * 3 + iIndex] = iVertex;
+
+			TUInt32* piFaces = &vertexFaces[vertexFaceStart[iVertex]];
+			TUInt32 iLast = --numActiveFaces[iVertex];
+			TUInt32 iPos = 0;
+			while (piFaces[iPos] != iBestFace)
+			{
+				++iPos;
+			}
+			piFaces[iPos] = piFaces[iLast];
+			piFaces[iLast] = iBestFace;
+		}
+
+		// Update cache - the face's vertices move to the front, the others keep their order
+		TUInt32 iNewCacheSize = 0;
+		for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
+		{
+			TUInt32 iVertex = piFace[iIndex];
+			if (iIndex == 0 || (iVertex != piFace[0] && (iIndex == 1 || iVertex != piFace[1])))
+			{
+				aiNewCache[iNewCacheSize++] = iVertex;
+			}
+		}
+		for (TUInt32 iPos = 0; iPos < iCacheSize; ++iPos)
+		{
+			TUInt32 iVertex = aiCache[iPos];
+			if (iVertex != piFace[0] && iVertex != piFace[1] && iVertex != piFace[2])
+			{
+				aiNewCache[iNewCacheSize++] = iVertex;
+			}
+		}
+
+		// Rescore the vertices in the new cache, including those just pushed out of it
+		for (TUInt32 iPos = 0; iPos < iNewCacheSize; ++iPos)
+		{
+			TUInt32 iVertex = aiNewCache[iPos];
+			cachePos[iVertex] = (iPos < kiForsythCacheSize) ? iPos : kiForsythNone;
+			vertexScores[iVertex] = ForsythVertexScore( cachePos[iVertex], numActiveFaces[iVertex],
+			                                            afCacheScores, afValenceScores );
+		}
+
+		// Rescore the active faces using those vertices, selecting the best for output next. Only
+		// these faces' scores can have changed
+		iBestFace = kiForsythNone;
+		TFloat32 fBestScore = -1.0f;
+		for (TUInt32 iPos = 0; iPos < iNewCacheSize; ++iPos)
+		{
+			TUInt32 iVertex = aiNewCache[iPos];
+			const TUInt32* piFaces = &vertexFaces[vertexFaceStart[iVertex]];
+			for (TUInt32 iActive = 0; iActive < numActiveFaces[iVertex]; ++iActive)
+			{
+				TUInt32 iFace = piFaces[iActive];
+				const TUInt32* piActiveFace = piIndices + iFace * 3;
+				faceScores[iFace] = vertexScores[piActiveFace[0]] + vertexScores[piActiveFace[1]] +
+				                    vertexScores[piActiveFace[2]];
+				if (faceScores[iFace] > fBestScore)
+				{
+					fBestScore = faceScores[iFace];
+					iBestFace = iFace;
+				}
+			}
+		}
+
+		iCacheSize = min( iNewCacheSize, kiForsythCacheSize );
+		copy( aiNewCache, aiNewCache + iCacheSize, aiCache );
+	}
+
+	copy( newIndices.begin(), newIndices.end(), piIndices );
+
+	GEN_ENDGUARD;
+}
+
+
+// Reorder clusters of faces in a triangle list, already optimised for the vertex cache, to reduce
+// overdraw. Faces are split into clusters where the vertex cache efficiency allows (within the
+// given threshold of the cluster's ACMR), then clusters facing out from the centre of the mesh
+// are moved to the front as they are most likely to occlude others (Sander et al. 2007)
+void OptimiseOverdraw
+(
+	TUInt32*        piIndices,
+	const TUInt32   iNumFaces,
+	const CVector3* pPositions,
+	const TUInt32   iNumVertices,
+	const TFloat32  fThreshold /*= 1.05f*/
+)
+{
+	GEN_GUARD;
+
+	if (iNumFaces == 0)
+	{
+		return;
+	}
+
+	// Hard cluster boundaries are where the vertex cache has effectively been flushed - faces
+	// with all three vertices missing the cache. Reordering at these points costs nothing
+	const TUInt32 iCacheSize = kiDefaultVertexCacheSize;
+	vector<TUInt32> cacheTimes( iNumVertices, 0 );
+	TUInt32 iTime = iCacheSize + 1;
+	vector<TUInt32> hardClusters;
+	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+	{
+		TUInt32 iMisses = CacheFace( piIndices + iFace * 3, cacheTimes, iTime, iCacheSize );
+		if (iFace == 0 || iMisses == 3)
+		{
+			hardClusters.push_back( iFace );
+		}
+	}
+	hardClusters.push_back( iNumFaces );
+
+	// Split hard clusters further at points where the ACMR so far is within the threshold of
+	// the ACMR of the whole cluster - splitting here costs little cache efficiency. The cache is
+	// flushed at each split, as the clusters may be reordered
+	vector<TUInt32> clusters;
+	for (TUInt32 iHard = 0; iHard + 1 < hardClusters.size(); ++iHard)
+	{
+		TUInt32 iStart = hardClusters[iHard];
+		TUInt32 iEnd = hardClusters[iHard + 1];
+
+		iTime += iCacheSize + 1;
+		TUInt32 iClusterMisses = 0;
+		for (TUInt32 iFace = iStart; iFace < iEnd; ++iFace)
+		{
+			iClusterMisses += CacheFace( piIndices + iFace * 3, cacheTimes, iTime, iCacheSize );
+		}
+		TFloat32 fMaxACMR = fThreshold * iClusterMisses / (iEnd - iStart);
+
+		clusters.push_back( iStart );
+		iTime += iCacheSize + 1;
+		TUInt32 iMisses = 0;
+		TUInt32 iClusterStart = iStart;
+		for (TUInt32 iFace = iStart; iFace < iEnd; ++iFace)
+		{
+			iMisses += CacheFace( piIndices + iFace * 3, cacheTimes, iTime, iCacheSize );
+			if (iFace + 1 < iEnd && iMisses <= fMaxACMR * (iFace + 1 - iClusterStart))
+			{
+				clusters.push_back( iFace + 1 );
+				iClusterStart = iFace + 1;
+				iMisses = 0;
+				iTime += iCacheSize + 1;
+			}
+		}
+	}
+	TUInt32 iNumClusters = static_cast<TUInt32>(clusters.size());
+	clusters.push_back( iNumFaces );
+
+	// Get area-weighted centroid and normal of each cluster and of the whole mesh
+	vector<CVector3> clusterCentroids( iNumClusters, CVector3::kOrigin );
+	vector<CVector3> clusterNormals( iNumClusters, CVector3::kOrigin );
+	CVector3 meshCentroid = CVector3::kOrigin;
+	TFloat32 fMeshArea = 0.0f;
+	for (TUInt32 iCluster = 0; iCluster < iNumClusters; ++iCluster)
+	{
+		TFloat32 fArea = 0.0f;
+		for (TUInt32 iFace = clusters[iCluster]; iFace < clusters[iCluster + 1]; ++iFace)
+		{
+			const TUInt32* piFace = piIndices + iFace * 3;
+			const CVector3& p0 = pPositions[piFace[0]];
+			const CVector3& p1 = pPositions[piFace[1]];
+			const CVector3& p2 = pPositions[piFace[2]];
+			CVector3 normal = Cross( p1 - p0, p2 - p0 ); // Length is twice face area
+			TFloat32 fFaceArea = normal.Length();
+			clusterCentroids[iCluster] += (p0 + p1 + p2) * (fFaceArea / 3.0f);
+			clusterNormals[iCluster] += normal;
+			fArea += fFaceArea;
+		}
+		meshCentroid += clusterCentroids[iCluster];
+		fMeshArea += fArea;
+		if (fArea > 0.0f)
+		{
+			clusterCentroids[iCluster] /= fArea;
+		}
+	}
+	if (fMeshArea > 0.0f)
+	{
+		meshCentroid /= fMeshArea;
+	}
+
+	// Sort clusters by how far they face out from the centre of the mesh - the outermost are
+	// drawn first. Stable sort to keep the existing order where there is no preference
+	vector<TFloat32> clusterKeys( iNumClusters );
+	for (TUInt32 iCluster = 0; iCluster < iNumClusters; ++iCluster)
+	{
+		TFloat32 fNormalLength = clusterNormals[iCluster].Length();
+		if (fNormalLength > 0.0f)
+		{
+			CVector3 offset = clusterCentroids[iCluster] - meshCentroid;
+			clusterKeys[iCluster] = Dot( offset, clusterNormals[iCluster] ) / fNormalLength;
+		}
+		else
+		{
+			clusterKeys[iCluster] = 0.0f;
+		}
+	}
+	vector<TUInt32> clusterOrder( iNumClusters );
+	iota( clusterOrder.begin(), clusterOrder.end(), 0 );
+	stable_sort( clusterOrder.begin(), clusterOrder.end(), [&clusterKeys]( TUInt32 i1, TUInt32 i2 )
+	{
+		return clusterKeys[i1] > clusterKeys[i2];
+	} );
+
+	// Output the faces in cluster order
+	vector<TUInt32> newIndices;
+	newIndices.reserve( iNumFaces * 3 );
+	for (TUInt32 iCluster = 0; iCluster < iNumClusters; ++iCluster)
+	{
+		TUInt32 iStart = clusters[clusterOrder[iCluster]];
+		TUInt32 iEnd = clusters[clusterOrder[iCluster] + 1];
+		newIndices.insert( newIndices.end(), piIndices + iStart * 3, piIndices + iEnd * 3 );
+	}
+	copy( newIndices.begin(), newIndices.end(), piIndices );
+
+	GEN_ENDGUARD;
+}
+
+
+// Renumber the vertices of a triangle list in the order they are first used, so that vertex
+// data is fetched sequentially. Returns the map from old to new vertex indices, which the caller
+// uses to reorder the vertex data (see RemapVertexData). Unused vertices are mapped after all the
+// used ones. Returns the number of used vertices
+TUInt32 OptimiseVertexFetch
+(
+	TUInt32*      piIndices,
+	const TUInt32 iNumFaces,
+	const TUInt32 iNumVertices,
+	TUInt32*      piRemap
+)
+{
+	GEN_GUARD;
+
+	// Any out of range value marks a vertex as not yet renumbered
+	const TUInt32 iUnused = iNumVertices;
+	fill( piRemap, piRemap + iNumVertices, iUnused );
+
+	TUInt32 iNextVertex = 0;
+	for (TUInt32 iIndex = 0; iIndex < iNumFaces * 3; ++iIndex)
+	{
+		TUInt32 iVertex = piIndices[iIndex];
+		if (piRemap[iVertex] == iUnused)
+		{
+			piRemap[iVertex] = iNextVertex++;
+		}
+		piIndices[iIndex] = piRemap[iVertex];
+	}
+
+	TUInt32 iNumUsed = iNextVertex;
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		if (piRemap[iVertex] == iUnused)
+		{
+			piRemap[iVertex] = iNextVertex++;
+		}
+	}
+	return iNumUsed;
+
+	GEN_ENDGUARD;
+}
+
+
+} // namespace gen
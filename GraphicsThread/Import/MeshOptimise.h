@@ -0,0 +1,151 @@
+/**************************************************************************************************
+	Module:       MeshOptimise.h
+	Date created: 18/10/26
+
+	Offline optimisation of triangle lists for the GPU - reordering of faces for the post-transform
+	vertex cache and overdraw, and of vertices for fetch locality. Also analysis of vertex cache
+	efficiency. All functions work on lists of 32-bit indices, three per face
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_MESH_OPTIMISE_H_INCLUDED
+#define GEN_MESH_OPTIMISE_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Vertex cache analysis
+ ------------------------------------------------------------------------------------------------*/
+
+// Size of the FIFO vertex cache simulated when analysing meshes - typical of current hardware
+const TUInt32 kiDefaultVertexCacheSize = 16;
+
+// Vertex cache statistics for one or more meshes. Stored as totals so that the statistics for
+// several meshes can be accumulated
+struct SVertexCacheStats
+{
+	TUInt32 iNumFaces;
+	TUInt32 iNumVertices; // Vertices used by the faces
+	TUInt32 iNumMisses;   // Vertices transformed, i.e. cache misses
+
+	// Constructor sets empty statistics
+	SVertexCacheStats()
+	{
+		iNumFaces = 0;
+		iNumVertices = 0;
+		iNumMisses = 0;
+	}
+
+	// Average cache miss ratio - vertices transformed per face. 0.5 is the ideal for large
+	// regular meshes, 3.0 the worst case
+	TFloat32 ACMR() const
+	{
+		return iNumFaces ? static_cast<TFloat32>(iNumMisses) / iNumFaces : 0.0f;
+	}
+
+	// Average transform to vertex ratio - vertices transformed per vertex used. 1.0 is ideal
+	TFloat32 ATVR() const
+	{
+		return iNumVertices ? static_cast<TFloat32>(iNumMisses) / iNumVertices : 0.0f;
+	}
+
+	// Add the statistics for another mesh to these
+	SVertexCacheStats& operator+=( const SVertexCacheStats& stats )
+	{
+		iNumFaces += stats.iNumFaces;
+		iNumVertices += stats.iNumVertices;
+		iNumMisses += stats.iNumMisses;
+		return *this;
+	}
+};
+
+
+// Simulate rendering a triangle list through a FIFO vertex cache of the given size and return
+// the resulting statistics
+void AnalyseVertexCache
+(
+	const TUInt32*     piIndices,
+	const TUInt32      iNumFaces,
+	const TUInt32      iNumVertices,
+	SVertexCacheStats* pStats,
+	const TUInt32      iCacheSize = kiDefaultVertexCacheSize
+);
+
+
+/*------------------------------------------------------------------------------------------------
+	Mesh optimisation
+ ------------------------------------------------------------------------------------------------*/
+
+// Reorder the faces of a triangle list to make best use of the post-transform vertex cache. Uses
+// Tom Forsyth's linear-speed algorithm, which does not depend on the exact cache size
+void OptimiseVertexCache
+(
+	TUInt32*      piIndices,
+	const TUInt32 iNumFaces,
+	const TUInt32 iNumVertices
+);
+
+// Reorder clusters of faces in a triangle list, already optimised for the vertex cache, to reduce
+// overdraw. Faces are split into clusters where the vertex cache efficiency allows (within the
+// given threshold of the cluster's ACMR), then clusters facing out from the centre of the mesh
+// are moved to the front as they are most likely to occlude others (Sander et al. 2007)
+void OptimiseOverdraw
+(
+	TUInt32*        piIndices,
+	const TUInt32   iNumFaces,
+	const CVector3* pPositions,
+	const TUInt32   iNumVertices,
+	const TFloat32  fThreshold = 1.05f
+);
+
+// Renumber the vertices of a triangle list in the order they are first used, so that vertex
+// data is fetched sequentially. Returns the map from old to new vertex indices, which the caller
+// uses to reorder the vertex data (see RemapVertexData). Unused vertices are mapped after all the
+// used ones. Returns the number of used vertices
+TUInt32 OptimiseVertexFetch
+(
+	TUInt32*      piIndices,
+	const TUInt32 iNumFaces,
+	const TUInt32 iNumVertices,
+	TUInt32*      piRemap
+);
+
+// Reorder a list of per-vertex data given a map from old to new vertex indices. Vertices mapped
+// to an index at or beyond the new vertex count are discarded. An empty list is left empty
+template <class T>
+void RemapVertexData
+(
+	vector<T>&     data,
+	const TUInt32* piRemap,
+	const TUInt32  iNumNewVertices
+)
+{
+	if (data.empty())
+	{
+		return;
+	}
+
+	vector<T> newData( iNumNewVertices );
+	for (TUInt32 iVertex = 0; iVertex < data.size(); ++iVertex)
+	{
+		if (piRemap[iVertex] < iNumNewVertices)
+		{
+			newData[piRemap[iVertex]] = data[iVertex];
+		}
+	}
+	data.swap( newData );
+}
+
+
+} // namespace gen
+
+#endif // GEN_MESH_OPTIMISE_H_INCLUDED
@@ -0,0 +1,712 @@
+/**************************************************************************************************
+	Module:       MeshSimplify.cpp
+	Date created: 18/10/26
+
+	Simplification of triangle lists by edge collapse using quadric error metrics, used to
+	generate levels of detail for meshes at import time
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+using namespace std;
+
+#include "Utility.h"
+#include "MeshSimplify.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Quadrics
+ ------------------------------------------------------------------------------------------------*/
+
+// Symmetric 4x4 matrix representing the sum of squared distances to a set of planes, weighted by
+// area. Stored as the upper 3x3 matrix A, vector b and constant c, giving the error at a point p
+// as p.A.p + 2b.p + c. The total weight is kept to convert the error into an average distance
+struct SQuadric
+{
+	TFloat64 a00, a01, a02, a11, a12, a22;
+	TFloat64 b0, b1, b2;
+	TFloat64 c;
+	TFloat64 w;
+};
+
+// Add the quadric for a plane n.p + d = 0 to the given quadric with the given weight. The total
+// weight is not changed, so constraint planes do not dilute the average error of the faces
+static void AddPlaneQuadric
+(
+	const TFloat64 nx,
+	const TFloat64 ny,
+	const TFloat64 nz,
+	const TFloat64 d,
+	const TFloat64 w,
+	SQuadric*      pQuadric
+)
+{
+	pQuadric->a00 += w * nx * nx;
+	pQuadric->a01 += w * nx * ny;
+	pQuadric->a02 += w * nx * nz;
+	pQuadric->a11 += w * ny * ny;
+	pQuadric->a12 += w * ny * nz;
+	pQuadric->a22 += w * nz * nz;
+	pQuadric->b0 += w * nx * d;
+	pQuadric->b1 += w * ny * d;
+	pQuadric->b2 += w * nz * d;
+	pQuadric->c += w * d * d;
+}
+
+// Add the quadric for a face plane to the given quadric, weighted by the face area
+static void AddFaceQuadric
+(
+	const CVector3& p0,
+	const CVector3& p1,
+	const CVector3& p2,
+	SQuadric*       pQuadric
+)
+{
+	CVector3 normal = Cross( p1 - p0, p2 - p0 );
+	TFloat64 fLength = normal.Length();
+	if (fLength == 0.0)
+	{
+		return;
+	}
+
+	// Plane n.p + d = 0, weighted by area (half the length of the cross product)
+	TFloat64 nx = normal.x / fLength;
+	TFloat64 ny = normal.y / fLength;
+	TFloat64 nz = normal.z / fLength;
+	TFloat64 d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+	TFloat64 w = fLength * 0.5;
+	AddPlaneQuadric( nx, ny, nz, d, w, pQuadric );
+	pQuadric->w += w;
+}
+
+// Add the quadric for a plane through the edge p0-p1 of a face, perpendicular to the face, to
+// the given quadric. Keeps collapses along a seam close to the seam's path. Weighted by the face
+// area like the face planes, so thin faces along a seam do not dominate the error
+static void AddEdgeQuadric
+(
+	const CVector3& p0,
+	const CVector3& p1,
+	const CVector3& p2,
+	SQuadric*       pQuadric
+)
+{
+	CVector3 edge = p1 - p0;
+	CVector3 faceNormal = Cross( edge, p2 - p0 );
+	CVector3 normal = Cross( faceNormal, edge );
+	TFloat64 fLength = normal.Length();
+	if (fLength == 0.0)
+	{
+		return;
+	}
+	TFloat64 nx = normal.x / fLength;
+	TFloat64 ny = normal.y / fLength;
+	TFloat64 nz = normal.z / fLength;
+	TFloat64 d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+	AddPlaneQuadric( nx, ny, nz, d, faceNormal.Length() * 0.5, pQuadric );
+}
+
+// Add one quadric to another
+static void AddQuadric
+(
+	const SQuadric& quadric,
+	SQuadric*       pQuadric
+)
+{
+	pQuadric->a00 += quadric.a00;
+	pQuadric->a01 += quadric.a01;
+	pQuadric->a02 += quadric.a02;
+	pQuadric->a11 += quadric.a11;
+	pQuadric->a12 += quadric.a12;
+	pQuadric->a22 += quadric.a22;
+	pQuadric->b0 += quadric.b0;
+	pQuadric->b1 += quadric.b1;
+	pQuadric->b2 += quadric.b2;
+	pQuadric->c += quadric.c;
+	pQuadric->w += quadric.w;
+}
+
+// Return the squared error at a point for the sum of two quadrics, as an average squared
+// distance to their planes
+static TFloat64 QuadricError
+(
+	const SQuadric& q1,
+	const SQuadric& q2,
+	const CVector3& p
+)
+{
+	TFloat64 a00 = q1.a00 + q2.a00, a01 = q1.a01 + q2.a01, a02 = q1.a02 + q2.a02;
+	TFloat64 a11 = q1.a11 + q2.a11, a12 = q1.a12 + q2.a12, a22 = q1.a22 + q2.a22;
+	TFloat64 x = p.x, y = p.y, z = p.z;
+	TFloat64 fError = a00 * x * x + a11 * y * y + a22 * z * z +
+	                  2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+	                  2.0 * ((q1.b0 + q2.b0) * x + (q1.b1 + q2.b1) * y + (q1.b2 + q2.b2) * z) +
+	                  q1.c + q2.c;
+	TFloat64 w = q1.w + q2.w;
+	return (w > 0.0 && fError > 0.0) ? fError / w : 0.0;
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Mesh simplification
+ ------------------------------------------------------------------------------------------------*/
+
+// A candidate edge collapse - the first vertex is merged into the second. Collapses along an
+// attribute seam also merge the twin of the first vertex (on the other side of the seam) into
+// the vertex at the second's position on that side, so both sides of the seam stay together
+struct SCollapse
+{
+	TUInt32  iFrom;
+	TUInt32  iTo;
+	TUInt32  iTwinFrom;
+	TUInt32  iTwinTo;
+	TFloat64 fError;
+};
+
+// How a vertex may be removed by simplification
+enum EVertexClass
+{
+	kFreeVertex,   // The only vertex at its position, not on a border - collapses along any edge
+	kSeamVertex,   // One of two vertices at a position along an attribute seam - collapses along
+	               // the seam together with its twin
+	kLockedVertex, // On a border, at the end or junction of seams, or unused - never removed
+};
+
+// The class of each vertex, and for seam vertices the twin vertex at the same position and the
+// two neighbouring vertices along the seam
+struct SVertexTopology
+{
+	vector<TUInt8>  vertexClass;
+	vector<TUInt32> seamTwin;
+	vector<TUInt32> seamNeighbours;
+	vector<TUInt32> seamEdges; // Face edges on a seam between two sides, as face * 3 + edge
+};
+
+// Return true if two positions are exactly equal (the vector equality operator allows for error)
+static bool SamePosition
+(
+	const CVector3& p1,
+	const CVector3& p2
+)
+{
+	return p1.x == p2.x && p1.y == p2.y && p1.z == p2.z;
+}
+
+// Return a key for the edge between two indices, the same in either direction
+static TUInt64 EdgeKey
+(
+	const TUInt32 i1,
+	const TUInt32 i2
+)
+{
+	return (static_cast<TUInt64>(min( i1, i2 )) << 32) | max( i1, i2 );
+}
+
+// Find the first vertex at the position of each vertex using an open addressing hash table
+static void FindPositionVertices
+(
+	const CVector3*  pPositions,
+	const TUInt32    iNumVertices,
+	vector<TUInt32>& positionVertex
+)
+{
+	TUInt32 iTableSize = 1;
+	while (iTableSize < iNumVertices * 2)
+	{
+		iTableSize <<= 1;
+	}
+	const TUInt32 iEmpty = iNumVertices;
+	vector<TUInt32> table( iTableSize, iEmpty );
+	positionVertex.resize( iNumVertices );
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		// -0 and +0 are the same position so must hash equally
+		TFloat32 afPosition[3] = { pPositions[iVertex].x, pPositions[iVertex].y,
+		                           pPositions[iVertex].z };
+		for (TUInt32 i = 0; i < 3; ++i)
+		{
+			if (afPosition[i] == 0.0f)
+			{
+				afPosition[i] = 0.0f;
+			}
+		}
+
+		TUInt32 iSlot = HashData( afPosition, sizeof(afPosition) ) & (iTableSize - 1);
+		while (table[iSlot] != iEmpty &&
+		       !SamePosition( pPositions[table[iSlot]], pPositions[iVertex] ))
+		{
+			iSlot = (iSlot + 1) & (iTableSize - 1);
+		}
+		if (table[iSlot] == iEmpty)
+		{
+			table[iSlot] = iVertex;
+		}
+		positionVertex[iVertex] = table[iSlot];
+	}
+}
+
+// Classify the vertices used by a face list. Edges are compared by position so that seams are not
+// mistaken for borders: a position edge not shared by exactly two faces is a border (or
+// non-manifold) and locks its positions. A seam edge is a vertex edge used by one face whose
+// position edge is used by two - the faces either side of it use different vertices. A position
+// with two vertices, each with exactly two seam edges leading to the same two positions, is in
+// the middle of a seam and its vertices can be collapsed along it in pairs. Any other position
+// with more than one vertex is the end or junction of seams and is locked. A position with one
+// vertex is free even if seams end there, as the vertex takes all its faces with it
+static void ClassifyVertices
+(
+	const TUInt32*         piIndices,
+	const TUInt32          iNumFaces,
+	const vector<TUInt32>& positionVertex,
+	SVertexTopology&       topology
+)
+{
+	const TUInt32 iNumVertices = static_cast<TUInt32>(positionVertex.size());
+	const TUInt32 iNone = iNumVertices;
+
+	// Count the faces using each edge between vertices and between positions
+	unordered_map<TUInt64, TUInt32> vertexEdges;
+	unordered_map<TUInt64, TUInt32> positionEdges;
+	vertexEdges.reserve( iNumFaces * 3 );
+	positionEdges.reserve( iNumFaces * 3 );
+	for (TUInt32 iIndex = 0; iIndex < iNumFaces * 3; ++iIndex)
+	{
+		TUInt32 i1 = piIndices[iIndex];
+		TUInt32 i2 = piIndices[iIndex - iIndex % 3 + (iIndex + 1) % 3];
+		if (positionVertex[i1] == positionVertex[i2])
+		{
+			continue;
+		}
+		++vertexEdges[EdgeKey( i1, i2 )];
+		++positionEdges[EdgeKey( positionVertex[i1], positionVertex[i2] )];
+	}
+
+	// Lock positions on any border edge
+	vector<TUInt8> lockedPositions( iNumVertices, 0 );
+	for (unordered_map<TUInt64, TUInt32>::const_iterator itEdge = positionEdges.begin();
+	     itEdge != positionEdges.end(); ++itEdge)
+	{
+		if (itEdge->second != 2)
+		{
+			lockedPositions[static_cast<TUInt32>(itEdge->first >> 32)] = 1;
+			lockedPositions[static_cast<TUInt32>(itEdge->first & 0xffffffff)] = 1;
+		}
+	}
+
+	// Count the vertices used at each position and pair them up as twins (only meaningful where
+	// there are exactly two)
+	vector<TUInt8> used( iNumVertices, 0 );
+	for (TUInt32 iIndex = 0; iIndex < iNumFaces * 3; ++iIndex)
+	{
+		used[piIndices[iIndex]] = 1;
+	}
+	vector<TUInt32> positionCount( iNumVertices, 0 );
+	vector<TUInt32> positionFirst( iNumVertices, iNone );
+	topology.seamTwin.assign( iNumVertices, iNone );
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		if (used[iVertex])
+		{
+			TUInt32 iPosition = positionVertex[iVertex];
+			if (positionCount[iPosition]++ == 0)
+			{
+				positionFirst[iPosition] = iVertex;
+			}
+			else
+			{
+				topology.seamTwin[iVertex] = positionFirst[iPosition];
+				topology.seamTwin[positionFirst[iPosition]] = iVertex;
+			}
+		}
+	}
+
+	// Find the seam edges at each vertex. Those with several vertices at both ends are listed as
+	// the seams between separate sides, rather than where seams meet at a single vertex
+	vector<TUInt8> numSeamEdges( iNumVertices, 0 );
+	topology.seamNeighbours.assign( iNumVertices * 2, iNone );
+	topology.seamEdges.clear();
+	for (TUInt32 iIndex = 0; iIndex < iNumFaces * 3; ++iIndex)
+	{
+		TUInt32 i1 = piIndices[iIndex];
+		TUInt32 i2 = piIndices[iIndex - iIndex % 3 + (iIndex + 1) % 3];
+		if (positionVertex[i1] != positionVertex[i2] && vertexEdges[EdgeKey( i1, i2 )] == 1 &&
+		    positionEdges[EdgeKey( positionVertex[i1], positionVertex[i2] )] == 2)
+		{
+			if (positionCount[positionVertex[i1]] > 1 && positionCount[positionVertex[i2]] > 1)
+			{
+				topology.seamEdges.push_back( iIndex );
+			}
+			for (TUInt32 iDir = 0; iDir < 2; ++iDir)
+			{
+				if (numSeamEdges[i1] < 2)
+				{
+					topology.seamNeighbours[i1 * 2 + numSeamEdges[i1]] = i2;
+				}
+				numSeamEdges[i1] = min( numSeamEdges[i1] + 1, 3 );
+				swap( i1, i2 );
+			}
+		}
+	}
+
+	// Classify each vertex
+	topology.vertexClass.assign( iNumVertices, kLockedVertex );
+	for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+	{
+		TUInt32 iPosition = positionVertex[iVertex];
+		if (!used[iVertex] || lockedPositions[iPosition])
+		{
+			continue;
+		}
+		if (positionCount[iPosition] == 1)
+		{
+			topology.vertexClass[iVertex] = kFreeVertex;
+		}
+		else if (positionCount[iPosition] == 2 && numSeamEdges[iVertex] == 2)
+		{
+			// Both sides of the seam must run to the same two positions
+			TUInt32 iTwin = topology.seamTwin[iVertex];
+			if (numSeamEdges[iTwin] != 2)
+			{
+				continue;
+			}
+			TUInt32 iA0 = positionVertex[topology.seamNeighbours[iVertex * 2]];
+			TUInt32 iA1 = positionVertex[topology.seamNeighbours[iVertex * 2 + 1]];
+			TUInt32 iB0 = positionVertex[topology.seamNeighbours[iTwin * 2]];
+			TUInt32 iB1 = positionVertex[topology.seamNeighbours[iTwin * 2 + 1]];
+			if (iA0 != iA1 && ((iA0 == iB0 && iA1 == iB1) || (iA0 == iB1 && iA1 == iB0)))
+			{
+				topology.vertexClass[iVertex] = kSeamVertex;
+			}
+		}
+	}
+}
+
+// Return true if moving a vertex of a face to a new position would flip the face over, make it
+// degenerate, or turn it through a large angle (more than about 75 degrees)
+static bool FaceFlips
+(
+	const CVector3& p0,
+	const CVector3& p1,
+	const CVector3& p2,
+	const TUInt32   iMoved,
+	const CVector3& newPosition
+)
+{
+	CVector3 oldNormal = Cross( p1 - p0, p2 - p0 );
+	CVector3 q0 = (iMoved == 0) ? newPosition : p0;
+	CVector3 q1 = (iMoved == 1) ? newPosition : p1;
+	CVector3 q2 = (iMoved == 2) ? newPosition : p2;
+	CVector3 newNormal = Cross( q1 - q0, q2 - q0 );
+	TFloat32 fDot = Dot( oldNormal, newNormal );
+	TFloat32 fLengthsSq = LengthSquared( oldNormal ) * LengthSquared( newNormal );
+	return fDot <= 0.0f || fDot * fDot < 0.0625f * fLengthsSq; // cos^2 75 is about 0.0625
+}
+
+// Test merging one vertex into another against the faces around the removed vertex. Returns false
+// if any of the remaining faces would flip, otherwise returns true and the number of faces that
+// will be removed (those sharing the edge)
+static bool CanCollapse
+(
+	const TUInt32          iFrom,
+	const TUInt32          iTo,
+	const TUInt32*         piIndices,
+	const CVector3*        pPositions,
+	const vector<TUInt32>& vertexFaces,
+	const vector<TUInt32>& vertexFaceStart,
+	TUInt32*               piNumRemoved
+)
+{
+	*piNumRemoved = 0;
+	for (TUInt32 iFace = vertexFaceStart[iFrom]; iFace < vertexFaceStart[iFrom + 1]; ++iFace)
+	{
+		const TUInt32* piFace = piIndices + vertexFaces[iFace] * 3;
+		if (piFace[0] == iTo || piFace[1] == iTo || piFace[2] == iTo)
+		{
+			++*piNumRemoved;
+		}
+		else
+		{
+			TUInt32 iMoved = (piFace[0] == iFrom) ? 0 : (piFace[1] == iFrom) ? 1 : 2;
+			if (FaceFlips( pPositions[piFace[0]], pPositions[piFace[1]], pPositions[piFace[2]],
+			               iMoved, pPositions[iTo] ))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Mark all vertices of the faces around a vertex as changed, so flip tests for later collapses in
+// the same pass remain valid
+static void MarkChanged
+(
+	const TUInt32          iVertex,
+	const TUInt32*         piIndices,
+	const vector<TUInt32>& vertexFaces,
+	const vector<TUInt32>& vertexFaceStart,
+	vector<TUInt8>&        vertexChanged
+)
+{
+	for (TUInt32 iFace = vertexFaceStart[iVertex]; iFace < vertexFaceStart[iVertex + 1]; ++iFace)
+	{
+		const TUInt32* piFace = piIndices + vertexFaces[iFace] * 3;
+		vertexChanged[piFace[0]] = 1;
+		vertexChanged[piFace[1]] = 1;
+		vertexChanged[piFace[2]] = 1;
+	}
+}
+
+
+// Simplify a triangle list towards a target number of faces by collapsing edges, choosing the
+// collapses that add least error as measured by quadric error metrics (Garland & Heckbert 1997).
+// Each collapse merges a vertex into one of its neighbours - no vertices are moved or created, so
+// vertex data such as normals, UVs and bone weights is preserved and the simplified faces can
+// share the original vertices. Vertices on attribute seams (vertices sharing a position but with
+// different normals, UVs etc.) only collapse along the seam, together with the vertex on the
+// other side, so seams do not open up. Seam edges also add planes to the quadrics to keep the seam
+// on its path. Vertices on mesh borders and at the ends or junctions of seams are never removed.
+// Simplification stops at the target face count or when the next collapse would exceed the given
+// error (a distance in model units). Writes the new faces to the output index list, which must
+// have room for all the original indices, and returns the new face count. Optionally returns the
+// estimated error of the result
+TUInt32 SimplifyMesh
+(
+	const TUInt32*  piIndices,
+	const TUInt32   iNumFaces,
+	const CVector3* pPositions,
+	const TUInt32   iNumVertices,
+	const TUInt32   iTargetFaces,
+	const TFloat32  fMaxError,
+	TUInt32*        piOutIndices,
+	TFloat32*       pfError /*= 0*/
+)
+{
+	GEN_GUARD;
+
+	// Work on the output list
+	copy( piIndices, piIndices + iNumFaces * 3, piOutIndices );
+	TUInt32 iNumOutFaces = iNumFaces;
+	TFloat64 fResultError = 0.0;
+	if (pfError)
+	{
+		*pfError = 0.0f;
+	}
+	if (iNumFaces <= iTargetFaces || iNumVertices == 0)
+	{
+		return iNumFaces;
+	}
+
+	vector<TUInt32> positionVertex;
+	FindPositionVertices( pPositions, iNumVertices, positionVertex );
+	SVertexTopology topology;
+	ClassifyVertices( piIndices, iNumFaces, positionVertex, topology );
+
+	// Sum the quadrics of the faces around each vertex, and of the seam edges at each vertex
+	SQuadric zeroQuadric = SQuadric(); // Value-initialised, all zero
+	vector<SQuadric> quadrics( iNumVertices, zeroQuadric );
+	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
+	{
+		const TUInt32* piFace = piIndices + iFace * 3;
+		SQuadric faceQuadric = zeroQuadric;
+		AddFaceQuadric( pPositions[piFace[0]], pPositions[piFace[1]], pPositions[piFace[2]],
+		                &faceQuadric );
+		for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
+		{
+			AddQuadric( faceQuadric, &quadrics[piFace[iIndex]] );
+		}
+	}
+	for (TUInt32 iSeamEdge = 0; iSeamEdge < topology.seamEdges.size(); ++iSeamEdge)
+	{
+		TUInt32 iIndex = topology.seamEdges[iSeamEdge];
+		const TUInt32* piFace = piIndices + (iIndex - iIndex % 3);
+		TUInt32 i1 = piFace[iIndex % 3];
+		TUInt32 i2 = piFace[(iIndex + 1) % 3];
+		TUInt32 i3 = piFace[(iIndex + 2) % 3];
+		SQuadric edgeQuadric = zeroQuadric;
+		AddEdgeQuadric( pPositions[i1], pPositions[i2], pPositions[i3], &edgeQuadric );
+		AddQuadric( edgeQuadric, &quadrics[i1] );
+		AddQuadric( edgeQuadric, &quadrics[i2] );
+	}
+
+	// Collapse in a series of passes. Each pass sorts all possible collapses by error then performs
+	// them cheapest first, skipping any that affect faces already changed in the pass
+	const TUInt32 iNone = iNumVertices;
+	TFloat64 fMaxErrorSq = static_cast<TFloat64>(fMaxError) * fMaxError;
+	vector<TUInt32> vertexFaceStart( iNumVertices + 1 );
+	vector<TUInt32> vertexFaces;
+	vector<TUInt32> vertexFacePos;
+	vector<SCollapse> collapses;
+	vector<TUInt32> collapseOrder;
+	vector<TUInt32> collapseTarget( iNumVertices );
+	vector<TUInt8> vertexChanged( iNumVertices );
+	bool bFirstPass = true;
+	while (iNumOutFaces > iTargetFaces)
+	{
+		// The first pass uses the classification made for the quadrics above
+		if (!bFirstPass)
+		{
+			ClassifyVertices( piOutIndices, iNumOutFaces, positionVertex, topology );
+		}
+		bFirstPass = false;
+
+		// Build lists of faces using each vertex
+		vertexFaceStart.assign( iNumVertices + 1, 0 );
+		for (TUInt32 iIndex = 0; iIndex < iNumOutFaces * 3; ++iIndex)
+		{
+			++vertexFaceStart[piOutIndices[iIndex] + 1];
+		}
+		partial_sum( vertexFaceStart.begin(), vertexFaceStart.end(), vertexFaceStart.begin() );
+		vertexFaces.resize( iNumOutFaces * 3 );
+		vertexFacePos.assign( vertexFaceStart.begin(), vertexFaceStart.end() - 1 );
+		for (TUInt32 iIndex = 0; iIndex < iNumOutFaces * 3; ++iIndex)
+		{
+			vertexFaces[vertexFacePos[piOutIndices[iIndex]]++] = iIndex / 3;
+		}
+
+		// Get error of collapsing each edge in each direction. Free vertices collapse along any
+		// edge, seam vertices only along their seam edges - each seam pair is found once, from the
+		// side with the lower vertex index. Locked vertices do not collapse
+		collapses.clear();
+		for (TUInt32 iFace = 0; iFace < iNumOutFaces; ++iFace)
+		{
+			const TUInt32* piFace = piOutIndices + iFace * 3;
+			for (TUInt32 iEdge = 0; iEdge < 3; ++iEdge)
+			{
+				TUInt32 i1 = piFace[iEdge];
+				TUInt32 i2 = piFace[(iEdge + 1) % 3];
+				for (TUInt32 iDir = 0; iDir < 2; ++iDir)
+				{
+					SCollapse collapse = { i1, i2, iNone, iNone, 0.0 };
+					bool bCandidate = false;
+					if (topology.vertexClass[i1] == kFreeVertex && i1 != i2)
+					{
+						collapse.fError = QuadricError( quadrics[i1], quadrics[i2],
+						                                pPositions[i2] );
+						bCandidate = true;
+					}
+					else if (topology.vertexClass[i1] == kSeamVertex &&
+					         i1 < topology.seamTwin[i1] &&
+					         (topology.seamNeighbours[i1 * 2] == i2 ||
+					          topology.seamNeighbours[i1 * 2 + 1] == i2))
+					{
+						// The twin collapses to its seam neighbour at the same position as i2
+						collapse.iTwinFrom = topology.seamTwin[i1];
+						const TUInt32* piTwinNeighbours =
+							&topology.seamNeighbours[collapse.iTwinFrom * 2];
+						collapse.iTwinTo = (positionVertex[piTwinNeighbours[0]] ==
+						                    positionVertex[i2]) ? piTwinNeighbours[0] :
+						                                          piTwinNeighbours[1];
+						collapse.fError = max( QuadricError( quadrics[i1], quadrics[i2],
+						                                     pPositions[i2] ),
+						                       QuadricError( quadrics[collapse.iTwinFrom],
+						                                     quadrics[collapse.iTwinTo],
+						                                     pPositions[i2] ) );
+						bCandidate = true;
+					}
+					if (bCandidate && collapse.fError <= fMaxErrorSq)
+					{
+						collapses.push_back( collapse );
+					}
+					swap( i1, i2 );
+				}
+			}
+		}
+		if (collapses.empty())
+		{
+			break;
+		}
+		collapseOrder.resize( collapses.size() );
+		iota( collapseOrder.begin(), collapseOrder.end(), 0 );
+		sort( collapseOrder.begin(), collapseOrder.end(), [&collapses]( TUInt32 i1, TUInt32 i2 )
+		{
+			return collapses[i1].fError < collapses[i2].fError;
+		} );
+
+		// Perform the collapses in order
+		iota( collapseTarget.begin(), collapseTarget.end(), 0 );
+		vertexChanged.assign( iNumVertices, 0 );
+		TUInt32 iFacesToRemove = iNumOutFaces - iTargetFaces;
+		TUInt32 iFacesRemoved = 0;
+		for (TUInt32 iCollapse = 0; iCollapse < collapseOrder.size() &&
+		                            iFacesRemoved < iFacesToRemove; ++iCollapse)
+		{
+			const SCollapse& collapse = collapses[collapseOrder[iCollapse]];
+			bool bSeam = (collapse.iTwinFrom != iNone);
+			if (vertexChanged[collapse.iFrom] || vertexChanged[collapse.iTo] ||
+			    (bSeam && (vertexChanged[collapse.iTwinFrom] || vertexChanged[collapse.iTwinTo])))
+			{
+				continue;
+			}
+
+			// Reject the collapse if any of the remaining faces around the removed vertices flip
+			TUInt32 iNumRemoved = 0;
+			TUInt32 iNumTwinRemoved = 0;
+			if (!CanCollapse( collapse.iFrom, collapse.iTo, piOutIndices, pPositions,
+			                  vertexFaces, vertexFaceStart, &iNumRemoved ) ||
+			    (bSeam && !CanCollapse( collapse.iTwinFrom, collapse.iTwinTo, piOutIndices,
+			                            pPositions, vertexFaces, vertexFaceStart,
+			                            &iNumTwinRemoved )))
+			{
+				continue;
+			}
+
+			// Collapse, the removed vertex's quadric is merged into the remaining vertex
+			collapseTarget[collapse.iFrom] = collapse.iTo;
+			AddQuadric( quadrics[collapse.iFrom], &quadrics[collapse.iTo] );
+			MarkChanged( collapse.iFrom, piOutIndices, vertexFaces, vertexFaceStart,
+			             vertexChanged );
+			if (bSeam)
+			{
+				collapseTarget[collapse.iTwinFrom] = collapse.iTwinTo;
+				if (collapse.iTwinTo != collapse.iTo)
+				{
+					AddQuadric( quadrics[collapse.iTwinFrom], &quadrics[collapse.iTwinTo] );
+				}
+				MarkChanged( collapse.iTwinFrom, piOutIndices, vertexFaces, vertexFaceStart,
+				             vertexChanged );
+			}
+			iFacesRemoved += iNumRemoved + iNumTwinRemoved;
+			fResultError = max( fResultError, collapse.fError );
+		}
+		if (iFacesRemoved == 0)
+		{
+			break;
+		}
+
+		// Apply the collapses to the faces and remove those that have become degenerate
+		TUInt32 iNumKept = 0;
+		for (TUInt32 iFace = 0; iFace < iNumOutFaces; ++iFace)
+		{
+			TUInt32 i0 = collapseTarget[piOutIndices[iFace * 3]];
+			TUInt32 i1 = collapseTarget[piOutIndices[iFace * 3 + 1]];
+			TUInt32 i2 = collapseTarget[piOutIndices[iFace * 3 + 2]];
+			if (i0 != i1 && i1 != i2 && i2 != i0)
+			{
+				piOutIndices[iNumKept * 3] = i0;
+				piOutIndices[iNumKept * 3 + 1] = i1;
+				piOutIndices[iNumKept * 3 + 2] = i2;
+				++iNumKept;
+			}
+		}
+		iNumOutFaces = iNumKept;
+	}
+
+	if (pfError)
+	{
+		*pfError = static_cast<TFloat32>(sqrt( fResultError ));
+	}
+	return iNumOutFaces;
+
+	GEN_ENDGUARD;
+}
+
+
+} // namespace gen
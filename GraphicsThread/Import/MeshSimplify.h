@@ -0,0 +1,52 @@
+/**************************************************************************************************
+	Module:       MeshSimplify.h
+	Date created: 18/10/26
+
+	Simplification of triangle lists by edge collapse using quadric error metrics, used to
+	generate levels of detail for meshes at import time
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_MESH_SIMPLIFY_H_INCLUDED
+#define GEN_MESH_SIMPLIFY_H_INCLUDED
+
+#include "Defines.h"
+#include "CVector3.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Mesh simplification
+ ------------------------------------------------------------------------------------------------*/
+
+// Simplify a triangle list towards a target number of faces by collapsing edges, choosing the
+// collapses that add least error as measured by quadric error metrics (Garland & Heckbert 1997).
+// Each collapse merges a vertex into one of its neighbours - no vertices are moved or created, so
+// vertex data such as normals, UVs and bone weights is preserved and the simplified faces can
+// share the original vertices. Vertices on attribute seams (vertices sharing a position but with
+// different normals, UVs etc.) only collapse along the seam, together with the vertex on the
+// other side, so seams do not open up. Vertices on mesh borders and at the ends or junctions of
+// seams are never removed.
+// Simplification stops at the target face count or when the next collapse would exceed the given
+// error (a distance in model units). Writes the new faces to the output index list, which must
+// have room for all the original indices, and returns the new face count. Optionally returns the
+// estimated error of the result
+TUInt32 SimplifyMesh
+(
+	const TUInt32*  piIndices,
+	const TUInt32   iNumFaces,
+	const CVector3* pPositions,
+	const TUInt32   iNumVertices,
+	const TUInt32   iTargetFaces,
+	const TFloat32  fMaxError,
+	TUInt32*        piOutIndices,
+	TFloat32*       pfError = 0
+);
+
+
+} // namespace gen
+
+#endif // GEN_MESH_SIMPLIFY_H_INCLUDED
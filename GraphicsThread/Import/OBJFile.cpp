@@ -0,0 +1,923 @@
+/**************************************************************************************************
+	Module:       OBJFile.cpp
+	Date created: 18/10/26
+
+	Parsing of Wavefront OBJ geometry files and their MTL material libraries
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+using namespace std;
+
+#include "Parallel.h"
+#include "OBJFile.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Text parsing
+ ------------------------------------------------------------------------------------------------*/
+
+// Powers of ten that are exactly representable as doubles, used to scale parsed mantissas
+static const TFloat64 kafPowersOf10[] =
+{
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const TInt32 kiMaxExactPowerOf10 = 22;
+
+// Maximum significant digits gathered into the mantissa of a parsed number
+static const TUInt32 kiMaxMantissaDigits = 19;
+
+// Largest mantissa that is exactly representable as a double
+static const TUInt64 kiMaxExactMantissa = static_cast<TUInt64>(1) << 53;
+
+// Bytes of text that must remain to parse a number eight digits at a time - a sign, then a word
+// of whole digits and a word of fractional digits either side of the point
+static const TInt32 kiMinWordFloatBytes = 17;
+static const TInt32 kiMinWordIntBytes = 9;
+
+
+static inline bool IsDigit( const char c )
+{
+	return static_cast<unsigned char>(c - '0') < 10;
+}
+
+static inline bool IsSpace( const char c )
+{
+	return c == ' ' || c == '\t';
+}
+
+// Is the character at the end of a statement - a line end or a comment
+static inline bool IsStatementEnd( const char c )
+{
+	return c == '\n' || c == '\r' || c == '#';
+}
+
+static inline const char* SkipSpaces( const char* p )
+{
+	while (IsSpace( *p ))
+	{
+		++p;
+	}
+	return p;
+}
+
+
+// Load eight bytes of text as a word, the first character in the lowest byte (all supported
+// platforms are little-endian)
+static inline TUInt64 LoadWord( const char* p )
+{
+	TUInt64 iWord;
+	memcpy( &iWord, p, sizeof(iWord) );
+	return iWord;
+}
+
+// Count the digits at the start of a word of text (0 to 8), testing all eight bytes at once. A
+// byte is a digit if its top four bits are 3 both before and after adding 6. Carries from bytes
+// that are not digits only affect the bytes after them, which are not counted
+static inline TUInt32 CountWordDigits( const TUInt64 iWord )
+{
+	const TUInt64 kiHighNibbles = 0xF0F0F0F0F0F0F0F0ull;
+	const TUInt64 kiThrees      = 0x3030303030303030ull;
+	TUInt64 iNotDigits = ((iWord & kiHighNibbles) ^ kiThrees) |
+	                     (((iWord + 0x0606060606060606ull) & kiHighNibbles) ^ kiThrees);
+
+	// Move any set bit in each byte to its top bit, then isolate the lowest byte that is set. The
+	// multiply brings the byte's index to the top of the word
+	iNotDigits = (((iNotDigits & 0x7070707070707070ull) + 0x7070707070707070ull) | iNotDigits) &
+	             0x8080808080808080ull;
+	if (iNotDigits == 0)
+	{
+		return 8;
+	}
+	return static_cast<TUInt32>((((iNotDigits & (0 - iNotDigits)) >> 7) *
+	                             0x0001020304050607ull) >> 56);
+}
+
+// Convert the given number of digits (0 to 8) at the start of a word of text into an integer.
+// The digits are shifted to the top of the word, leaving zeros before them, then pairs, fours
+// and eights of digits are combined with three multiplies
+static inline TUInt32 ParseWordDigits( TUInt64 iWord, const TUInt32 iNumDigits )
+{
+	if (iNumDigits == 0)
+	{
+		return 0;
+	}
+	iWord = (iWord - 0x3030303030303030ull) << (64 - 8 * iNumDigits);
+	iWord = iWord * 10 + (iWord >> 8);
+	iWord = ((iWord & 0x000000FF000000FFull) * (100 + (1000000ull << 32)) +
+	         ((iWord >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32))) >> 32;
+	return static_cast<TUInt32>(iWord);
+}
+
+// Return the start of the next line. The text must contain a newline before the given end.
+// Statements that have been parsed usually stop at the newline, so that is checked first
+static inline const char* SkipLine( const char* p, const char* pEnd )
+{
+	if (*p == '\n')
+	{
+		return p + 1;
+	}
+	return static_cast<const char*>(memchr( p, '\n', pEnd - p )) + 1;
+}
+
+// Does the text start with the given keyword followed by a space or the end of the line
+static bool IsKeyword( const char* p, const char* szKeyword )
+{
+	// The keyword contains no newlines, so the comparison stops at the end of the line
+	while (*szKeyword)
+	{
+		if (*p++ != *szKeyword++)
+		{
+			return false;
+		}
+	}
+	return IsSpace( *p ) || *p == '\n' || *p == '\r';
+}
+
+
+// Parse a decimal number, moving the pointer past it. Numbers with fewer than eight digits either
+// side of the point and no exponent (almost all numbers in OBJ files) are read eight digits at a
+// time, if the text does not end within a couple of words. Otherwise numbers with at most 19
+// significant digits and a small enough exponent are read a digit at a time. Both are converted
+// exactly with a single multiply or divide, with no locale handling, others are converted by the
+// C library. Returns false if there is no number
+static bool ParseFloat( const char*& p, const char* pEnd, TFloat32* pfValue )
+{
+	const char* pStart = p;
+	if (pEnd - p >= kiMinWordFloatBytes)
+	{
+		const char* pDigits = p + (*p == '-' || *p == '+');
+		TUInt64 iWholeWord = LoadWord( pDigits );
+		TUInt32 iNumWhole = CountWordDigits( iWholeWord );
+		const char* pNext = pDigits + iNumWhole;
+		TUInt64 iFractionWord = 0;
+		TUInt32 iNumFraction = 0;
+		if (*pNext == '.')
+		{
+			iFractionWord = LoadWord( pNext + 1 );
+			iNumFraction = CountWordDigits( iFractionWord );
+			pNext += 1 + iNumFraction;
+		}
+		if (iNumWhole < 8 && iNumFraction < 8 && iNumWhole + iNumFraction > 0 &&
+		    *pNext != 'e' && *pNext != 'E')
+		{
+			// At most 14 digits, so the mantissa is exact
+			TUInt64 iMantissa = static_cast<TUInt64>(ParseWordDigits( iWholeWord, iNumWhole )) *
+			                    static_cast<TUInt64>(kafPowersOf10[iNumFraction]) +
+			                    ParseWordDigits( iFractionWord, iNumFraction );
+			TFloat64 fValue = static_cast<TFloat64>(iMantissa) / kafPowersOf10[iNumFraction];
+			*pfValue = static_cast<TFloat32>((*p == '-') ? -fValue : fValue);
+			p = pNext;
+			return true;
+		}
+	}
+
+	bool bNegative = (*p == '-');
+	if (*p == '-' || *p == '+')
+	{
+		++p;
+	}
+
+	// Gather the significant digits into an integer mantissa with a decimal exponent
+	TUInt64 iMantissa = 0;
+	TUInt32 iNumDigits = 0;
+	TInt32  iExponent = 0;
+	bool    bDigits = false;
+	while (IsDigit( *p ))
+	{
+		if (iNumDigits < kiMaxMantissaDigits)
+		{
+			iMantissa = iMantissa * 10 + (*p - '0');
+			iNumDigits += (iMantissa != 0);
+		}
+		else
+		{
+			++iExponent;
+		}
+		++p;
+		bDigits = true;
+	}
+	if (*p == '.')
+	{
+		++p;
+		while (IsDigit( *p ))
+		{
+			if (iNumDigits < kiMaxMantissaDigits)
+			{
+				iMantissa = iMantissa * 10 + (*p - '0');
+				iNumDigits += (iMantissa != 0);
+				--iExponent;
+			}
+			++p;
+			bDigits = true;
+		}
+	}
+	if (!bDigits)
+	{
+		p = pStart;
+		return false;
+	}
+	if (*p == 'e' || *p == 'E')
+	{
+		const char* pExponent = p + 1;
+		bool bNegativeExponent = (*pExponent == '-');
+		if (*pExponent == '-' || *pExponent == '+')
+		{
+			++pExponent;
+		}
+		if (IsDigit( *pExponent ))
+		{
+			TInt32 iValue = 0;
+			while (IsDigit( *pExponent ))
+			{
+				iValue = (iValue < 10000) ? iValue * 10 + (*pExponent - '0') : iValue;
+				++pExponent;
+			}
+			iExponent += bNegativeExponent ? -iValue : iValue;
+			p = pExponent;
+		}
+	}
+
+	// Fast conversion if exact, otherwise use the library (which handles the sign itself)
+	if (iMantissa == 0)
+	{
+		*pfValue = bNegative ? -0.0f : 0.0f;
+	}
+	else if (iMantissa < kiMaxExactMantissa &&
+	         iExponent >= -kiMaxExactPowerOf10 && iExponent <= kiMaxExactPowerOf10)
+	{
+		TFloat64 fValue = static_cast<TFloat64>(iMantissa);
+		fValue = (iExponent < 0) ? fValue / kafPowersOf10[-iExponent] :
+		                           fValue * kafPowersOf10[iExponent];
+		*pfValue = static_cast<TFloat32>(bNegative ? -fValue : fValue);
+	}
+	else
+	{
+		*pfValue = static_cast<TFloat32>(strtod( pStart, 0 ));
+	}
+	return true;
+}
+
+// Parse a given number of numbers separated by spaces, moving the pointer past them. Returns
+// false if there are not enough numbers
+static bool ParseFloats
+(
+	const char*&   p,
+	const char*    pEnd,
+	TFloat32*      pfValues,
+	const TUInt32  iNumValues
+)
+{
+	for (TUInt32 iValue = 0; iValue < iNumValues; ++iValue)
+	{
+		p = SkipSpaces( p );
+		if (!ParseFloat( p, pEnd, &pfValues[iValue] ))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Parse a decimal integer, moving the pointer past it. Integers with fewer than eight digits are
+// read eight digits at a time if the text does not end within a word. Returns false if there is
+// no integer or it is out of range
+static bool ParseInt( const char*& p, const char* pEnd, TInt32* piValue )
+{
+	bool bNegative = (*p == '-');
+	if (*p == '-' || *p == '+')
+	{
+		++p;
+	}
+	if (!IsDigit( *p ))
+	{
+		return false;
+	}
+	if (pEnd - p >= kiMinWordIntBytes)
+	{
+		TUInt64 iWord = LoadWord( p );
+		TUInt32 iNumDigits = CountWordDigits( iWord );
+		if (iNumDigits < 8)
+		{
+			TInt32 iValue = static_cast<TInt32>(ParseWordDigits( iWord, iNumDigits ));
+			*piValue = bNegative ? -iValue : iValue;
+			p += iNumDigits;
+			return true;
+		}
+	}
+
+	TUInt32 iValue = 0;
+	while (IsDigit( *p ))
+	{
+		iValue = iValue * 10 + (*p - '0');
+		if (iValue > 0x7fffffff / 10 && IsDigit( p[1] ))
+		{
+			return false;
+		}
+		++p;
+	}
+	if (iValue > 0x7fffffff)
+	{
+		return false;
+	}
+	*piValue = bNegative ? -static_cast<TInt32>(iValue) : static_cast<TInt32>(iValue);
+	return true;
+}
+
+// Add the rest of the line (without surrounding spaces) to a name table and return its ID
+static TUInt32 ParseName( const char* p, const char* pEnd, CStringTable* pNames )
+{
+	p = SkipSpaces( p );
+	const char* pNameEnd = SkipLine( p, pEnd ) - 1;
+	while (pNameEnd > p && (IsSpace( pNameEnd[-1] ) || pNameEnd[-1] == '\r'))
+	{
+		--pNameEnd;
+	}
+	return pNames->Intern( p, static_cast<TUInt32>(pNameEnd - p) );
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	OBJ parsing
+ ------------------------------------------------------------------------------------------------*/
+
+// Offset subtracted from negative (relative) indices while a chunk is parsed on its own. They are
+// stored relative to the start of the chunk's lists, biased so they are negative when read as
+// signed integers, until the chunk's position in the whole file is known (see JoinIndex)
+static const TInt32 kiRelativeIndexBias = 0x40000000;
+
+// Name given before the following faces in a chunk
+enum EOBJChange
+{
+	kOBJObject,
+	kOBJGroup,
+	kOBJMaterial,
+};
+
+struct SOBJChange
+{
+	TUInt32    iTriangle;  // In the chunk
+	EOBJChange eChange;
+	TUInt32    iName;      // In the chunk's name table
+};
+
+// A chunk of an OBJ file, parsed separately from the others. The runs in its data are unused,
+// the changes of name are joined into runs for the whole file instead
+struct SOBJChunk
+{
+	const char*        pBegin;
+	const char*        pEnd;
+	SOBJData           data;
+	vector<SOBJChange> changes;
+	bool               bValid;
+
+	// Position of the chunk's lists in the lists of the whole file
+	TUInt32            iFirstPosition;
+	TUInt32            iFirstTextureCoord;
+	TUInt32            iFirstNormal;
+	TUInt32            iFirstCorner;
+	TUInt32            iNumCorners;
+};
+
+// Data shared by the threads parsing and joining chunks
+struct SOBJParseTask
+{
+	SOBJChunk* pChunks;
+	SOBJData*  pData;
+};
+
+
+// Convert an OBJ index (counting from 1, or back from the end of the list if negative) into a
+// list index, given the number of items so far in the chunk. Returns false if the index is 0 or
+// too far back
+static inline bool ResolveIndex( const TInt32 iIndex, const TUInt32 iNumInChunk, TUInt32* piOut )
+{
+	if (iIndex > 0)
+	{
+		*piOut = static_cast<TUInt32>(iIndex - 1);
+		return true;
+	}
+	if (iIndex < 0 && iIndex >= -kiRelativeIndexBias)
+	{
+		TInt32 iRelative = static_cast<TInt32>(iNumInChunk) + iIndex - kiRelativeIndexBias;
+		*piOut = static_cast<TUInt32>(iRelative);
+		return true;
+	}
+	return false;
+}
+
+// Make an index from a chunk relative to the whole file, given the number of items before the
+// chunk, and check it is within the list of the given size
+static inline bool JoinIndex( TUInt32* piIndex, const TUInt32 iChunkFirst, const TUInt32 iListSize )
+{
+	if (static_cast<TInt32>(*piIndex) < 0)
+	{
+		// Indices too far back wrap around to large values, which fail the range check
+		*piIndex = iChunkFirst + static_cast<TUInt32>(static_cast<TInt32>(*piIndex) +
+		                                              kiRelativeIndexBias);
+	}
+	return *piIndex < iListSize;
+}
+
+
+// Parse the corners of a face statement, splitting the polygon into triangles. Returns false if
+// the face is not valid
+static bool ParseOBJFace( const char*& p, const char* pEnd, SOBJData* pData )
+{
+	TUInt32 iNumPositions = static_cast<TUInt32>(pData->positions.size());
+	TUInt32 iNumTextureCoords = static_cast<TUInt32>(pData->textureCoords.size());
+	TUInt32 iNumNormals = static_cast<TUInt32>(pData->normals.size());
+
+	TUInt32 iNumCorners = 0;
+	SOBJCorner firstCorner, prevCorner;
+	p = SkipSpaces( p );
+	while (!IsStatementEnd( *p ))
+	{
+		// Corner is position[/[texture coord][/normal]]
+		SOBJCorner corner;
+		corner.iTextureCoord = kiOBJNoIndex;
+		corner.iNormal = kiOBJNoIndex;
+		TInt32 iIndex;
+		if (!ParseInt( p, pEnd, &iIndex ) ||
+		    !ResolveIndex( iIndex, iNumPositions, &corner.iPosition ))
+		{
+			return false;
+		}
+		if (*p == '/')
+		{
+			++p;
+			if (*p != '/')
+			{
+				if (!ParseInt( p, pEnd, &iIndex ) ||
+				    !ResolveIndex( iIndex, iNumTextureCoords, &corner.iTextureCoord ))
+				{
+					return false;
+				}
+			}
+			if (*p == '/')
+			{
+				++p;
+				if (!ParseInt( p, pEnd, &iIndex ) ||
+				    !ResolveIndex( iIndex, iNumNormals, &corner.iNormal ))
+				{
+					return false;
+				}
+			}
+		}
+		if (!IsSpace( *p ) && !IsStatementEnd( *p ))
+		{
+			return false;
+		}
+
+		// Split polygons into a fan of triangles around the first corner
+		if (iNumCorners == 0)
+		{
+			firstCorner = corner;
+		}
+		else if (iNumCorners >= 2)
+		{
+			pData->corners.push_back( firstCorner );
+			pData->corners.push_back( prevCorner );
+			pData->corners.push_back( corner );
+		}
+		prevCorner = corner;
+		++iNumCorners;
+
+		p = SkipSpaces( p );
+	}
+
+	return iNumCorners >= 3;
+}
+
+// Parse a chunk of an OBJ file on its own. Returns false if the chunk is not valid
+static bool ParseOBJChunk( SOBJChunk* pChunk )
+{
+	SOBJData& data = pChunk->data;
+	const char* p = pChunk->pBegin;
+	const char* pEnd = pChunk->pEnd;
+	while (p < pEnd)
+	{
+		p = SkipSpaces( p );
+		if (p[0] == 'v')
+		{
+			// Vertex position, ignoring any w coordinate or colour
+			if (IsSpace( p[1] ))
+			{
+				p += 2;
+				CVector3 position;
+				if (!ParseFloats( p, pEnd, &position.x, 3 ))
+				{
+					return false;
+				}
+				data.positions.push_back( position );
+			}
+
+			// Texture coordinate, the v coordinate is optional
+			else if (p[1] == 't' && IsSpace( p[2] ))
+			{
+				p += 3;
+				SOBJTextureCoord textureCoord;
+				textureCoord.fV = 0.0f;
+				if (!ParseFloats( p, pEnd, &textureCoord.fU, 1 ))
+				{
+					return false;
+				}
+				p = SkipSpaces( p );
+				if (!IsStatementEnd( *p ) && !ParseFloat( p, pEnd, &textureCoord.fV ))
+				{
+					return false;
+				}
+				data.textureCoords.push_back( textureCoord );
+			}
+
+			// Normal
+			else if (p[1] == 'n' && IsSpace( p[2] ))
+			{
+				p += 3;
+				CVector3 normal;
+				if (!ParseFloats( p, pEnd, &normal.x, 3 ))
+				{
+					return false;
+				}
+				data.normals.push_back( normal );
+			}
+		}
+		else if (p[0] == 'f' && IsSpace( p[1] ))
+		{
+			++p;
+			if (!ParseOBJFace( p, pEnd, &data ))
+			{
+				return false;
+			}
+		}
+		else if ((p[0] == 'o' || p[0] == 'g') && (IsSpace( p[1] ) || IsStatementEnd( p[1] )))
+		{
+			SOBJChange change;
+			change.iTriangle = static_cast<TUInt32>(data.corners.size() / 3);
+			change.eChange = (p[0] == 'o') ? kOBJObject : kOBJGroup;
+			change.iName = ParseName( p + 1, pEnd, &data.names );
+			pChunk->changes.push_back( change );
+		}
+		else if (IsKeyword( p, "usemtl" ))
+		{
+			SOBJChange change;
+			change.iTriangle = static_cast<TUInt32>(data.corners.size() / 3);
+			change.eChange = kOBJMaterial;
+			change.iName = ParseName( p + 6, pEnd, &data.names );
+			pChunk->changes.push_back( change );
+		}
+		else if (IsKeyword( p, "mtllib" ))
+		{
+			data.materialLibraries.push_back( ParseName( p + 6, pEnd, &data.names ) );
+		}
+		// Other statements and comments are ignored
+
+		// Move to the next line, statements stop at or before the end of their line
+		p = SkipLine( p, pEnd );
+	}
+
+	return true;
+}
+
+// Parse a range of chunks, called by ParallelFor
+static void ParseOBJChunks( TUInt32 iBegin, TUInt32 iEnd, TUInt32, void* pTask )
+{
+	SOBJParseTask& task = *static_cast<SOBJParseTask*>(pTask);
+	for (TUInt32 iChunk = iBegin; iChunk < iEnd; ++iChunk)
+	{
+		task.pChunks[iChunk].bValid = ParseOBJChunk( &task.pChunks[iChunk] );
+	}
+}
+
+// Copy the lists of a range of chunks into the lists of the whole file, making indices relative
+// to the whole file. Lists already moved into place (those of the first chunk) are left empty in
+// the chunk, their indices are updated in place. Called by ParallelFor
+static void JoinOBJChunks( TUInt32 iBegin, TUInt32 iEnd, TUInt32, void* pTask )
+{
+	SOBJParseTask& task = *static_cast<SOBJParseTask*>(pTask);
+	SOBJData& data = *task.pData;
+	TUInt32 iNumPositions = static_cast<TUInt32>(data.positions.size());
+	TUInt32 iNumTextureCoords = static_cast<TUInt32>(data.textureCoords.size());
+	TUInt32 iNumNormals = static_cast<TUInt32>(data.normals.size());
+	for (TUInt32 iChunk = iBegin; iChunk < iEnd; ++iChunk)
+	{
+		SOBJChunk& chunk = task.pChunks[iChunk];
+		copy( chunk.data.positions.begin(), chunk.data.positions.end(),
+		      data.positions.begin() + chunk.iFirstPosition );
+		copy( chunk.data.textureCoords.begin(), chunk.data.textureCoords.end(),
+		      data.textureCoords.begin() + chunk.iFirstTextureCoord );
+		copy( chunk.data.normals.begin(), chunk.data.normals.end(),
+		      data.normals.begin() + chunk.iFirstNormal );
+
+		SOBJCorner* pCorner = data.corners.empty() ? 0 : &data.corners[chunk.iFirstCorner];
+		const SOBJCorner* pChunkCorner =
+			chunk.data.corners.empty() ? pCorner : &chunk.data.corners[0];
+		for (TUInt32 iCorner = 0; iCorner < chunk.iNumCorners; ++iCorner, ++pCorner)
+		{
+			*pCorner = pChunkCorner[iCorner];
+			bool bValid = JoinIndex( &pCorner->iPosition, chunk.iFirstPosition, iNumPositions );
+			if (pCorner->iTextureCoord != kiOBJNoIndex)
+			{
+				bValid &= JoinIndex( &pCorner->iTextureCoord, chunk.iFirstTextureCoord,
+				                     iNumTextureCoords );
+			}
+			if (pCorner->iNormal != kiOBJNoIndex)
+			{
+				bValid &= JoinIndex( &pCorner->iNormal, chunk.iFirstNormal, iNumNormals );
+			}
+			if (!bValid)
+			{
+				chunk.bValid = false;
+				break;
+			}
+		}
+
+		// Release the chunk's lists as soon as they are copied
+		vector<CVector3>().swap( chunk.data.positions );
+		vector<SOBJTextureCoord>().swap( chunk.data.textureCoords );
+		vector<CVector3>().swap( chunk.data.normals );
+		vector<SOBJCorner>().swap( chunk.data.corners );
+	}
+}
+
+
+// Parse the text of an OBJ file. The text is split into chunks at line boundaries, with at least
+// the given number of bytes in each, and the chunks are parsed in parallel then joined. Supports
+// vertex positions, texture coordinates and normals, faces (including negative indices), objects,
+// groups, materials and material libraries - other statements are ignored. The text must end
+// with a newline. Returns false if the text is not a valid OBJ file
+bool ParseOBJ
+(
+	const char*   pText,
+	const TUInt32 iSize,
+	SOBJData*     pData,
+	const TUInt32 iMinChunkBytes /*= kiDefaultMinOBJChunkBytes*/
+)
+{
+	GEN_GUARD;
+
+	pData->positions.clear();
+	pData->textureCoords.clear();
+	pData->normals.clear();
+	pData->corners.clear();
+	pData->runs.clear();
+	pData->materialLibraries.clear();
+	pData->names.Clear();
+	if (iSize == 0 || pText[iSize - 1] != '\n')
+	{
+		return false;
+	}
+
+	// Split the text into chunks, moving each split forward to the start of a line
+	const char* pEnd = pText + iSize;
+	TUInt32 iNumChunks = ParallelRanges( iSize, iMinChunkBytes );
+	vector<SOBJChunk> chunks( iNumChunks );
+	chunks[0].pBegin = pText;
+	for (TUInt32 iChunk = 1; iChunk < iNumChunks; ++iChunk)
+	{
+		const char* pSplit = pText + static_cast<TUInt64>(iSize) * iChunk / iNumChunks;
+		pSplit = max( pSplit - 1, chunks[iChunk - 1].pBegin );
+		chunks[iChunk].pBegin = (pSplit < pEnd) ? SkipLine( pSplit, pEnd ) : pEnd;
+		chunks[iChunk - 1].pEnd = chunks[iChunk].pBegin;
+	}
+	chunks[iNumChunks - 1].pEnd = pEnd;
+
+	SOBJParseTask task;
+	task.pChunks = &chunks[0];
+	task.pData = pData;
+	ParallelFor( iNumChunks, iNumChunks, ParseOBJChunks, &task );
+
+	// Find where each chunk's lists go in the lists of the whole file
+	TUInt32 iNumPositions = 0, iNumTextureCoords = 0, iNumNormals = 0, iNumCorners = 0;
+	for (TUInt32 iChunk = 0; iChunk < iNumChunks; ++iChunk)
+	{
+		SOBJChunk& chunk = chunks[iChunk];
+		if (!chunk.bValid)
+		{
+			return false;
+		}
+		chunk.iFirstPosition = iNumPositions;
+		chunk.iFirstTextureCoord = iNumTextureCoords;
+		chunk.iFirstNormal = iNumNormals;
+		chunk.iFirstCorner = iNumCorners;
+		chunk.iNumCorners = static_cast<TUInt32>(chunk.data.corners.size());
+		iNumPositions += static_cast<TUInt32>(chunk.data.positions.size());
+		iNumTextureCoords += static_cast<TUInt32>(chunk.data.textureCoords.size());
+		iNumNormals += static_cast<TUInt32>(chunk.data.normals.size());
+		iNumCorners += static_cast<TUInt32>(chunk.data.corners.size());
+	}
+
+	// Join the lists in parallel. The first chunk's lists are moved rather than copied, which
+	// leaves nothing to copy when there is a single chunk
+	pData->positions.swap( chunks[0].data.positions );
+	pData->textureCoords.swap( chunks[0].data.textureCoords );
+	pData->normals.swap( chunks[0].data.normals );
+	pData->corners.swap( chunks[0].data.corners );
+	pData->positions.resize( iNumPositions );
+	pData->textureCoords.resize( iNumTextureCoords );
+	pData->normals.resize( iNumNormals );
+	pData->corners.resize( iNumCorners );
+	ParallelFor( iNumChunks, iNumChunks, JoinOBJChunks, &task );
+
+	// Join the changes of name into runs of triangles. Where several names change before the same
+	// triangle, the run is updated rather than an empty run added
+	SOBJRun run;
+	run.iFirstTriangle = 0;
+	run.iObject = kiEmptyString;
+	run.iGroup = kiEmptyString;
+	run.iMaterial = kiEmptyString;
+	pData->runs.push_back( run );
+	for (TUInt32 iChunk = 0; iChunk < iNumChunks; ++iChunk)
+	{
+		const SOBJChunk& chunk = chunks[iChunk];
+		if (!chunk.bValid)
+		{
+			return false;
+		}
+
+		for (TUInt32 iChange = 0; iChange < chunk.changes.size(); ++iChange)
+		{
+			const SOBJChange& change = chunk.changes[iChange];
+			TUInt32 iName = pData->names.Intern( chunk.data.names.GetString( change.iName ),
+			                                     chunk.data.names.GetLength( change.iName ) );
+			run.iFirstTriangle = chunk.iFirstCorner / 3 + change.iTriangle;
+			if (change.eChange == kOBJObject)
+			{
+				// A new object starts with no group
+				run.iObject = iName;
+				run.iGroup = kiEmptyString;
+			}
+			else if (change.eChange == kOBJGroup)
+			{
+				run.iGroup = iName;
+			}
+			else
+			{
+				run.iMaterial = iName;
+			}
+			if (pData->runs.back().iFirstTriangle == run.iFirstTriangle)
+			{
+				pData->runs.back() = run;
+			}
+			else
+			{
+				pData->runs.push_back( run );
+			}
+		}
+
+		for (TUInt32 iLibrary = 0; iLibrary < chunk.data.materialLibraries.size(); ++iLibrary)
+		{
+			TUInt32 iName = chunk.data.materialLibraries[iLibrary];
+			pData->materialLibraries.push_back(
+				pData->names.Intern( chunk.data.names.GetString( iName ),
+				                     chunk.data.names.GetLength( iName ) ) );
+		}
+	}
+
+	return true;
+
+	GEN_ENDGUARD;
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	MTL parsing
+ ------------------------------------------------------------------------------------------------*/
+
+// Parse a colour - one or three numbers, a single number is used for all three components.
+// Returns false if there is no colour
+static bool ParseColour( const char*& p, const char* pEnd, TFloat32* pfColour )
+{
+	if (!ParseFloats( p, pEnd, pfColour, 1 ))
+	{
+		return false;
+	}
+	p = SkipSpaces( p );
+	if (IsStatementEnd( *p ))
+	{
+		pfColour[1] = pfColour[2] = pfColour[0];
+		return true;
+	}
+	return ParseFloats( p, pEnd, pfColour + 1, 2 );
+}
+
+// Parse the text of an MTL file, adding its materials to the given list. Supports the diffuse,
+// specular and emissive colours, specular power, transparency and diffuse map - other statements
+// are ignored. Names are added to the given table. The text must end with a newline. Returns
+// false if the text is not a valid MTL file
+bool ParseMTL
+(
+	const char*           pText,
+	const TUInt32         iSize,
+	CStringTable*         pNames,
+	vector<SOBJMaterial>* pMaterials
+)
+{
+	GEN_GUARD;
+
+	if (iSize == 0)
+	{
+		return true;
+	}
+	if (pText[iSize - 1] != '\n')
+	{
+		return false;
+	}
+
+	// Statements before the first material are ignored
+	const char* p = pText;
+	const char* pEnd = pText + iSize;
+	SOBJMaterial* pMaterial = 0;
+	while (p < pEnd)
+	{
+		p = SkipSpaces( p );
+		bool bValid = true;
+		if (IsKeyword( p, "newmtl" ))
+		{
+			SOBJMaterial material;
+			material.iName = ParseName( p + 6, pEnd, pNames );
+			material.afDiffuse[0] = material.afDiffuse[1] = material.afDiffuse[2] = 1.0f;
+			material.fAlpha = 1.0f;
+			material.afSpecular[0] = material.afSpecular[1] = material.afSpecular[2] = 0.0f;
+			material.fSpecularPower = 0.0f;
+			material.afEmissive[0] = material.afEmissive[1] = material.afEmissive[2] = 0.0f;
+			material.iDiffuseMap = kiEmptyString;
+			pMaterials->push_back( material );
+			pMaterial = &pMaterials->back();
+		}
+		else if (pMaterial)
+		{
+			if (IsKeyword( p, "Kd" ))
+			{
+				p += 2;
+				bValid = ParseColour( p, pEnd, pMaterial->afDiffuse );
+			}
+			else if (IsKeyword( p, "Ks" ))
+			{
+				p += 2;
+				bValid = ParseColour( p, pEnd, pMaterial->afSpecular );
+			}
+			else if (IsKeyword( p, "Ke" ))
+			{
+				p += 2;
+				bValid = ParseColour( p, pEnd, pMaterial->afEmissive );
+			}
+			else if (IsKeyword( p, "Ns" ))
+			{
+				p += 2;
+				bValid = ParseFloats( p, pEnd, &pMaterial->fSpecularPower, 1 );
+			}
+			else if (IsKeyword( p, "d" ))
+			{
+				p += 1;
+				bValid = ParseFloats( p, pEnd, &pMaterial->fAlpha, 1 );
+			}
+			else if (IsKeyword( p, "Tr" ))
+			{
+				p += 2;
+				TFloat32 fTransparency;
+				bValid = ParseFloats( p, pEnd, &fTransparency, 1 );
+				pMaterial->fAlpha = 1.0f - fTransparency;
+			}
+			else if (IsKeyword( p, "map_Kd" ))
+			{
+				// Options may precede the file name, which is then taken to be the last word
+				const char* pName = SkipSpaces( p + 6 );
+				if (*pName == '-')
+				{
+					const char* pLineEnd = SkipLine( pName, pEnd ) - 1;
+					while (pLineEnd > pName && (IsSpace( pLineEnd[-1] ) || pLineEnd[-1] == '\r'))
+					{
+						--pLineEnd;
+					}
+					pName = pLineEnd;
+					while (pName > p && !IsSpace( pName[-1] ))
+					{
+						--pName;
+					}
+				}
+				pMaterial->iDiffuseMap = ParseName( pName, pEnd, pNames );
+			}
+		}
+		if (!bValid)
+		{
+			return false;
+		}
+
+		p = SkipLine( p, pEnd );
+	}
+
+	return true;
+
+	GEN_ENDGUARD;
+}
+
+
+} // namespace gen
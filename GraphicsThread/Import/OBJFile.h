@@ -0,0 +1,120 @@
+/**************************************************************************************************
+	Module:       OBJFile.h
+	Date created: 18/10/26
+
+	Parsing of Wavefront OBJ geometry files and their MTL material libraries
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_OBJ_FILE_H_INCLUDED
+#define GEN_OBJ_FILE_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "StringTable.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	OBJ data
+ ------------------------------------------------------------------------------------------------*/
+
+// Index used in a face corner for a missing texture coordinate or normal
+const TUInt32 kiOBJNoIndex = 0xffffffff;
+
+// Texture coordinate as given in an OBJ file (V axis upwards)
+struct SOBJTextureCoord
+{
+	TFloat32 fU;
+	TFloat32 fV;
+};
+
+// Corner of a face - indices into the position, texture coordinate and normal lists of the file,
+// counting from 0. Texture coordinate and normal indices may be kiOBJNoIndex
+struct SOBJCorner
+{
+	TUInt32 iPosition;
+	TUInt32 iTextureCoord;
+	TUInt32 iNormal;
+};
+
+// Run of consecutive triangles with the same object, group and material (the last names given
+// before the triangles). Names are IDs in the data's name table, kiEmptyString if not given
+struct SOBJRun
+{
+	TUInt32 iFirstTriangle;
+	TUInt32 iObject;
+	TUInt32 iGroup;
+	TUInt32 iMaterial;
+};
+
+// Contents of an OBJ file. Polygons are split into triangles (as fans), three corners each. The
+// runs cover all the triangles in order, a run may be empty
+struct SOBJData
+{
+	vector<CVector3>         positions;
+	vector<SOBJTextureCoord> textureCoords;
+	vector<CVector3>         normals;
+	vector<SOBJCorner>       corners;
+	vector<SOBJRun>          runs;
+	vector<TUInt32>          materialLibraries; // Names of the MTL files used (IDs)
+	CStringTable             names;
+};
+
+
+// Material from an MTL file. Names are IDs in the name table passed to ParseMTL, the diffuse map
+// is kiEmptyString if not given
+struct SOBJMaterial
+{
+	TUInt32  iName;
+	TFloat32 afDiffuse[3];
+	TFloat32 fAlpha;
+	TFloat32 afSpecular[3];
+	TFloat32 fSpecularPower;
+	TFloat32 afEmissive[3];
+	TUInt32  iDiffuseMap;
+};
+
+
+/*------------------------------------------------------------------------------------------------
+	OBJ parsing
+ ------------------------------------------------------------------------------------------------*/
+
+// Default minimum size of the chunks of an OBJ file parsed in parallel
+const TUInt32 kiDefaultMinOBJChunkBytes = 1024 * 1024;
+
+// Parse the text of an OBJ file. The text is split into chunks at line boundaries, with at least
+// the given number of bytes in each, and the chunks are parsed in parallel then joined. Supports
+// vertex positions, texture coordinates and normals, faces (including negative indices), objects,
+// groups, materials and material libraries - other statements are ignored. The text must end
+// with a newline. Returns false if the text is not a valid OBJ file
+bool ParseOBJ
+(
+	const char*   pText,
+	const TUInt32 iSize,
+	SOBJData*     pData,
+	const TUInt32 iMinChunkBytes = kiDefaultMinOBJChunkBytes
+);
+
+// Parse the text of an MTL file, adding its materials to the given list. Supports the diffuse,
+// specular and emissive colours, specular power, transparency and diffuse map - other statements
+// are ignored. Names are added to the given table. The text must end with a newline. Returns
+// false if the text is not a valid MTL file
+bool ParseMTL
+(
+	const char*           pText,
+	const TUInt32         iSize,
+	CStringTable*         pNames,
+	vector<SOBJMaterial>* pMaterials
+);
+
+
+} // namespace gen
+
+#endif // GEN_OBJ_FILE_H_INCLUDED
@@ -0,0 +1,1105 @@
+/**************************************************************************************************
+	Module:       SoftwareRaster.cpp
+	Date created: 18/10/26
+
+	Tiled software rasteriser - renders sub-meshes into a colour buffer on the CPU, without a
+	graphics device, using all the processors
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+#include "BaseMath.h"
+#include "CVector4.h"
+#include "SoftwareRaster.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Textures
+ ------------------------------------------------------------------------------------------------*/
+
+// Return the average of four X8R8G8B8 pixels. Red and blue are summed together as their sums
+// cannot overlap, as are the sums of green alone
+static inline TUInt32 AveragePixels
+(
+	const TUInt32 iPixel0,
+	const TUInt32 iPixel1,
+	const TUInt32 iPixel2,
+	const TUInt32 iPixel3
+)
+{
+	TUInt32 iRedBlue = (iPixel0 & 0xff00ff) + (iPixel1 & 0xff00ff) + (iPixel2 & 0xff00ff) +
+	                   (iPixel3 & 0xff00ff) + 0x020002;
+	TUInt32 iGreen = (iPixel0 & 0xff00) + (iPixel1 & 0xff00) + (iPixel2 & 0xff00) +
+	                 (iPixel3 & 0xff00) + 0x0200;
+	return ((iRedBlue >> 2) & 0xff00ff) | ((iGreen >> 2) & 0xff00);
+}
+
+// Create a texture for software rendering from 32-bit X8R8G8B8 pixels, row by row. The width and
+// height must be powers of two. Optionally create mip-maps down to a single pixel
+void CreateRasterTexture
+(
+	const TUInt32*  pPixels,
+	const TUInt32   iWidth,
+	const TUInt32   iHeight,
+	const bool      bMipMaps,
+	SRasterTexture* pTexture
+)
+{
+	pTexture->levels.resize( 1 );
+	pTexture->levels[0].iWidth = iWidth;
+	pTexture->levels[0].iHeight = iHeight;
+	pTexture->levels[0].pixels.assign( pPixels, pPixels + iWidth * iHeight );
+	if (!bMipMaps)
+	{
+		return;
+	}
+
+	// Each level averages squares of four pixels in the last, or pairs of pixels once one side
+	// reaches a single pixel
+	while (pTexture->levels.back().iWidth > 1 || pTexture->levels.back().iHeight > 1)
+	{
+		pTexture->levels.push_back( SRasterTextureLevel() );
+		const SRasterTextureLevel& source = pTexture->levels[pTexture->levels.size() - 2];
+		SRasterTextureLevel& level = pTexture->levels.back();
+		level.iWidth = Max( source.iWidth / 2, 1u );
+		level.iHeight = Max( source.iHeight / 2, 1u );
+		level.pixels.resize( level.iWidth * level.iHeight );
+		for (TUInt32 iY = 0; iY < level.iHeight; ++iY)
+		{
+			const TUInt32* pRow0 =
+				&source.pixels[Min( iY * 2, source.iHeight - 1 ) * source.iWidth];
+			const TUInt32* pRow1 = &source.pixels[Min( iY * 2 + 1, source.iHeight - 1 ) *
+			                                      source.iWidth];
+			for (TUInt32 iX = 0; iX < level.iWidth; ++iX)
+			{
+				TUInt32 iX0 = Min( iX * 2, source.iWidth - 1 );
+				TUInt32 iX1 = Min( iX * 2 + 1, source.iWidth - 1 );
+				level.pixels[iY * level.iWidth + iX] =
+					AveragePixels( pRow0[iX0], pRow0[iX1], pRow1[iX0], pRow1[iX1] );
+			}
+		}
+	}
+}
+
+
+// Approximate base 2 logarithm of a positive float, accurate to a few hundredths - the exponent
+// plus the mantissa taken as linear. Good enough to select mip-map levels
+static inline TFloat32 ApproxLog2
+(
+	const TFloat32 f
+)
+{
+	TInt32 iBits;
+	memcpy( &iBits, &f, sizeof(iBits) );
+	return static_cast<TFloat32>(iBits) * (1.0f / (1 << 23)) - 127.0f;
+}
+
+// Sample a texture level at the given texture coordinate with bilinear filtering and wrapping,
+// adding the sampled colour (0-255 per channel) multiplied by the given weight to an RGB colour
+static inline void SampleBilinear
+(
+	const SRasterTextureLevel& level,
+	const TFloat32             fU,
+	const TFloat32             fV,
+	const TFloat32             fWeight,
+	TFloat32*                  pfColour
+)
+{
+	// Find the four texels around the coordinate, texel centres are at half texel positions
+	TFloat32 fX = fU * level.iWidth - 0.5f;
+	TFloat32 fY = fV * level.iHeight - 0.5f;
+	TFloat32 fFloorX = Floor( fX );
+	TFloat32 fFloorY = Floor( fY );
+	TFloat32 fFracX = fX - fFloorX;
+	TFloat32 fFracY = fY - fFloorY;
+	TUInt32 iX0 = static_cast<TUInt32>(static_cast<TInt32>(fFloorX)) & (level.iWidth - 1);
+	TUInt32 iY0 = static_cast<TUInt32>(static_cast<TInt32>(fFloorY)) & (level.iHeight - 1);
+	TUInt32 iX1 = (iX0 + 1) & (level.iWidth - 1);
+	TUInt32 iY1 = (iY0 + 1) & (level.iHeight - 1);
+	const TUInt32* pRow0 = &level.pixels[iY0 * level.iWidth];
+	const TUInt32* pRow1 = &level.pixels[iY1 * level.iWidth];
+	TUInt32 aiTexels[4] = { pRow0[iX0], pRow0[iX1], pRow1[iX0], pRow1[iX1] };
+	TFloat32 afWeights[4] = { (1.0f - fFracX) * (1.0f - fFracY) * fWeight,
+	                          fFracX * (1.0f - fFracY) * fWeight,
+	                          (1.0f - fFracX) * fFracY * fWeight,
+	                          fFracX * fFracY * fWeight };
+	for (TUInt32 iTexel = 0; iTexel < 4; ++iTexel)
+	{
+		pfColour[0] += afWeights[iTexel] * ((aiTexels[iTexel] >> 16) & 0xff);
+		pfColour[1] += afWeights[iTexel] * ((aiTexels[iTexel] >> 8) & 0xff);
+		pfColour[2] += afWeights[iTexel] * (aiTexels[iTexel] & 0xff);
+	}
+}
+
+// Sample a texture at the given texture coordinate, giving an RGB colour from 0 to 1. The rate of
+// change of the coordinate across the screen (U and V per pixel along X, then along Y) selects
+// the mip-map levels to blend between
+static void SampleTexture
+(
+	const SRasterTexture& texture,
+	const TFloat32        fU,
+	const TFloat32        fV,
+	const TFloat32*       pfDerivatives,
+	TFloat32*             pfColour
+)
+{
+	pfColour[0] = pfColour[1] = pfColour[2] = 0.0f;
+	const SRasterTextureLevel& level0 = texture.levels[0];
+	TUInt32 iLastLevel = static_cast<TUInt32>(texture.levels.size()) - 1;
+	TFloat32 fLevel = 0.0f;
+	if (iLastLevel > 0)
+	{
+		// Level from the larger of the texel steps along the two screen axes
+		TFloat32 fDUDX = pfDerivatives[0] * level0.iWidth;
+		TFloat32 fDVDX = pfDerivatives[1] * level0.iHeight;
+		TFloat32 fDUDY = pfDerivatives[2] * level0.iWidth;
+		TFloat32 fDVDY = pfDerivatives[3] * level0.iHeight;
+		TFloat32 fStepSquared = Max( fDUDX * fDUDX + fDVDX * fDVDX,
+		                             fDUDY * fDUDY + fDVDY * fDVDY );
+		fLevel = Min( Max( 0.5f * ApproxLog2( fStepSquared ), 0.0f ),
+		              static_cast<TFloat32>(iLastLevel) );
+	}
+
+	TUInt32 iLevel = static_cast<TUInt32>(fLevel);
+	TFloat32 fBlend = fLevel - iLevel;
+	SampleBilinear( texture.levels[iLevel], fU, fV, (1.0f - fBlend) * (1.0f / 255.0f), pfColour );
+	if (fBlend > 0.0f)
+	{
+		SampleBilinear( texture.levels[iLevel + 1], fU, fV, fBlend * (1.0f / 255.0f), pfColour );
+	}
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Shading
+ ------------------------------------------------------------------------------------------------*/
+
+// Positions of the values in a clip vertex - the clip space position then the attributes
+enum EClipValue
+{
+	kClipX = 0, kClipY, kClipZ, kClipW,
+	kClipU, kClipV,
+	kClipWorldX, kClipWorldY, kClipWorldZ,
+	kClipNormalX, kClipNormalY, kClipNormalZ,
+	kNumClipValues
+};
+
+// Positions of the planes of a triangle - depth and 1/w then each attribute / w, in the same
+// order as the clip vertex
+enum ETrianglePlane
+{
+	kPlaneDepth = 0,
+	kPlaneOneOverW = 1,
+	kPlaneFirstAttribute = 2
+};
+
+// Return true if the render method multiplies a texture into the colour
+static inline bool IsTexturedMethod
+(
+	const ERenderMethod renderMethod
+)
+{
+	return renderMethod == PlainTexture || renderMethod == VertexLitTex ||
+	       renderMethod == PixelLitTex;
+}
+
+// Return true if the render method is lit
+static inline bool IsLitMethod
+(
+	const ERenderMethod renderMethod
+)
+{
+	return renderMethod >= VertexLit;
+}
+
+// Return an X8R8G8B8 pixel from red, green and blue values, clamped to the range 0 to 1
+static inline TUInt32 PackPixel
+(
+	const TFloat32* pfColour
+)
+{
+	TUInt32 iPixel = 0;
+	for (TUInt32 iChannel = 0; iChannel < 3; ++iChannel)
+	{
+		TFloat32 fChannel = Min( Max( pfColour[iChannel], 0.0f ), 1.0f );
+		iPixel = (iPixel << 8) | static_cast<TUInt32>(fChannel * 255.0f + 0.5f);
+	}
+	return iPixel;
+}
+
+// Return the colour of a pixel given its attributes (in clip vertex order, from kClipU) and the
+// screen derivatives of its texture coordinate (see SampleTexture), as an X8R8G8B8 pixel. Lit
+// methods use the same equations as the pixel lighting shaders, except that specular light is
+// skipped where the cosine of the angle to the halfway vector is below the given cutoff
+static TUInt32 ShadePixel
+(
+	const SRasterMaterial& material,
+	const SRasterLighting& lighting,
+	const CVector3&        cameraPosition,
+	const TFloat32         fSpecularCutoff,
+	const TFloat32*        pfAttributes,
+	const TFloat32*        pfTextureDerivatives
+)
+{
+	TFloat32 afColour[3] = { material.colour.r, material.colour.g, material.colour.b };
+	if (material.pTexture && IsTexturedMethod( material.renderMethod ))
+	{
+		TFloat32 afTexture[3];
+		SampleTexture( *material.pTexture, pfAttributes[kClipU - kClipU],
+		               pfAttributes[kClipV - kClipU], pfTextureDerivatives, afTexture );
+		afColour[0] *= afTexture[0];
+		afColour[1] *= afTexture[1];
+		afColour[2] *= afTexture[2];
+	}
+
+	if (IsLitMethod( material.renderMethod ))
+	{
+		// The interpolated normal is not unit length, so renormalise it
+		CVector3 worldPosition( &pfAttributes[kClipWorldX - kClipU] );
+		CVector3 worldNormal( &pfAttributes[kClipNormalX - kClipU] );
+		worldNormal.Normalise();
+		CVector3 cameraDir = cameraPosition - worldPosition;
+		cameraDir.Normalise();
+
+		// Ambient light is included in the diffuse light, specular light is tinted by the diffuse
+		// light from each light
+		TFloat32 afDiffuse[3] = { lighting.ambientColour.r, lighting.ambientColour.g,
+		                          lighting.ambientColour.b };
+		TFloat32 afSpecular[3] = { 0.0f, 0.0f, 0.0f };
+		for (TUInt32 iLight = 0; iLight < lighting.iNumLights; ++iLight)
+		{
+			CVector3 lightDir = lighting.aLightPositions[iLight] - worldPosition;
+			TFloat32 fDistance = lightDir.Length();
+			if (fDistance <= 0.0f)
+			{
+				continue;
+			}
+			lightDir *= 1.0f / fDistance;
+			TFloat32 fStrength = Min( lighting.afLightBrightness[iLight] / fDistance, 1.0f ) *
+			                     Max( worldNormal.Dot( lightDir ), 0.0f );
+			if (fStrength <= 0.0f)
+			{
+				continue;
+			}
+			CVector3 halfway = cameraDir + lightDir;
+			halfway.Normalise();
+			TFloat32 fNormalDotHalfway = worldNormal.Dot( halfway );
+			TFloat32 fSpecular = 0.0f;
+			if (fNormalDotHalfway > fSpecularCutoff)
+			{
+				fSpecular = Min( Pow( fNormalDotHalfway, lighting.fSpecularPower ), 1.0f );
+			}
+
+			const SColourRGBA& lightColour = lighting.aLightColours[iLight];
+			afDiffuse[0] += fStrength * lightColour.r;
+			afDiffuse[1] += fStrength * lightColour.g;
+			afDiffuse[2] += fStrength * lightColour.b;
+			afSpecular[0] += fStrength * lightColour.r * fSpecular;
+			afSpecular[1] += fStrength * lightColour.g * fSpecular;
+			afSpecular[2] += fStrength * lightColour.b * fSpecular;
+		}
+		for (TUInt32 iChannel = 0; iChannel < 3; ++iChannel)
+		{
+			afColour[iChannel] = afColour[iChannel] * afDiffuse[iChannel] + afSpecular[iChannel];
+		}
+	}
+
+	return PackPixel( afColour );
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Binning support
+ ------------------------------------------------------------------------------------------------*/
+
+// Triangles are clipped to a guard band this many times the size of the screen (in normalised
+// device coordinates) rather than the screen itself. Few triangles need clipping, and the
+// screen positions of the rest stay small enough for precise fixed point edge equations
+static const TFloat32 kfGuardBand = 4.0f;
+
+// Specular light less than this (a fraction of an 8-bit colour step) is not calculated
+static const TFloat32 kfMinSpecular = 1.0f / 1024.0f;
+
+// Minimum numbers of vertices and faces worth giving to each thread while binning a sub-mesh
+static const TUInt32 kiMinParallelVertices = 1024;
+static const TUInt32 kiMinParallelFaces = 512;
+
+// Flags for the planes a clip space position is outside - the screen, near and far planes, then
+// the guard band
+static const TUInt32 kiOutsideLeft   = 0x01;
+static const TUInt32 kiOutsideRight  = 0x02;
+static const TUInt32 kiOutsideTop    = 0x04;
+static const TUInt32 kiOutsideBottom = 0x08;
+static const TUInt32 kiOutsideNear   = 0x10;
+static const TUInt32 kiOutsideFar    = 0x20;
+static const TUInt32 kiOutsideGuardBand = 0x40;
+
+// Number of planes a triangle is clipped against - near and the four sides of the guard band.
+// Each plane can add one vertex to the clipped polygon
+static const TUInt32 kiNumClipPlanes = 5;
+static const TUInt32 kiMaxClippedVertices = 3 + kiNumClipPlanes;
+
+// Location of a vertex component in sub-mesh vertex data - the first vertex's component and the
+// number of bytes between vertices
+struct SVertexComponent
+{
+	const TUInt8* pFirst;
+	TUInt32       iStride;
+};
+
+// Data shared by the threads drawing a sub-mesh
+struct SRasterDrawTask
+{
+	CSoftwareRaster* pRaster;
+	const SSubMesh*  pSubMesh;
+	CMatrix4x4       worldMatrix;
+	CMatrix4x4       worldViewProjMatrix;
+	SVertexComponent position;
+	SVertexComponent normal;
+	SVertexComponent textureCoord;
+	TUInt32          iFirstFace;
+	TUInt32          iMaterial;
+};
+
+// Get the location of a vertex component, given its offset in an interleaved vertex
+static SVertexComponent GetVertexComponent
+(
+	const SSubMesh& subMesh,
+	const TUInt32   iOffset,
+	const TUInt32   iSize
+)
+{
+	SVertexComponent component;
+	if (subMesh.vertexLayout == InterleavedVertices)
+	{
+		component.pFirst = subMesh.vertices + iOffset;
+		component.iStride = subMesh.vertexSize;
+	}
+	else
+	{
+		component.pFirst = subMesh.vertices + iOffset * subMesh.numVertices;
+		component.iStride = iSize;
+	}
+	return component;
+}
+
+// Return the planes a clip space position is outside (kiOutside... flags)
+static inline TUInt32 OutsideFlags
+(
+	const TFloat32* pfPosition
+)
+{
+	TFloat32 fX = pfPosition[kClipX], fY = pfPosition[kClipY], fZ = pfPosition[kClipZ];
+	TFloat32 fW = pfPosition[kClipW];
+	TUInt32 iFlags = (fX < -fW ? kiOutsideLeft : 0) | (fX > fW ? kiOutsideRight : 0) |
+	                 (fY > fW ? kiOutsideTop : 0) | (fY < -fW ? kiOutsideBottom : 0) |
+	                 (fZ < 0.0f ? kiOutsideNear : 0) | (fZ > fW ? kiOutsideFar : 0);
+	TFloat32 fGuardW = fW * kfGuardBand;
+	if (fX < -fGuardW || fX > fGuardW || fY < -fGuardW || fY > fGuardW)
+	{
+		iFlags |= kiOutsideGuardBand;
+	}
+	return iFlags;
+}
+
+// Return the signed distance of a clip space position inside one of the clipping planes, in
+// the order near, left, right, bottom and top of the guard band
+static inline TFloat32 ClipPlaneDistance
+(
+	const TFloat32* pfPosition,
+	const TUInt32   iPlane
+)
+{
+	TFloat32 fGuardW = pfPosition[kClipW] * kfGuardBand;
+	switch (iPlane)
+	{
+		case 0:  return pfPosition[kClipZ];
+		case 1:  return pfPosition[kClipX] + fGuardW;
+		case 2:  return fGuardW - pfPosition[kClipX];
+		case 3:  return pfPosition[kClipY] + fGuardW;
+		default: return fGuardW - pfPosition[kClipY];
+	}
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Buffers
+ ------------------------------------------------------------------------------------------------*/
+
+// Number of blocks in each tile
+static const TUInt32 kiBlocksPerTileSide = kiRasterTileSize / kiRasterBlockSize;
+static const TUInt32 kiBlocksPerTile = kiBlocksPerTileSide * kiBlocksPerTileSide;
+
+// Set the size of the colour and depth buffers in pixels
+void CSoftwareRaster::SetSize
+(
+	const TUInt32 iWidth,
+	const TUInt32 iHeight
+)
+{
+	m_iWidth = iWidth;
+	m_iHeight = iHeight;
+	m_iNumTilesX = (iWidth + kiRasterTileSize - 1) / kiRasterTileSize;
+	m_iNumTilesY = (iHeight + kiRasterTileSize - 1) / kiRasterTileSize;
+	TUInt32 iNumTiles = m_iNumTilesX * m_iNumTilesY;
+
+	m_Pixels.assign( iWidth * iHeight, 0 );
+	m_Depths.assign( iNumTiles * kiRasterTileSize * kiRasterTileSize, 1.0f );
+	m_BlockDepths.assign( iNumTiles * kiBlocksPerTile, 1.0f );
+	m_TileDepths.assign( iNumTiles, 1.0f );
+	m_Bins.resize( iNumTiles );
+	for (TUInt32 iRange = 0; iRange < kiMaxParallelRanges; ++iRange)
+	{
+		m_RangeBins[iRange].clear();
+	}
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Binning
+ ------------------------------------------------------------------------------------------------*/
+
+// Start a frame, given the combined view / projection matrix, the camera position and the
+// lighting for the lit render methods. The buffers are cleared to the given colour and the
+// farthest depth when the frame is rendered
+void CSoftwareRaster::BeginFrame
+(
+	const CMatrix4x4&      viewProjMatrix,
+	const CVector3&        cameraPosition,
+	const SRasterLighting& lighting,
+	const SColourRGBA&     clearColour
+)
+{
+	m_ViewProjMatrix = viewProjMatrix;
+	m_CameraPosition = cameraPosition;
+	m_Lighting = lighting;
+	m_fSpecularCutoff = lighting.fSpecularPower > 0.0f ?
+	                    Pow( kfMinSpecular, 1.0f / lighting.fSpecularPower ) : 0.0f;
+	m_ClearColour = PackPixel( &clearColour.r );
+	m_Materials.clear();
+	m_Triangles.clear();
+	for (TUInt32 iTile = 0; iTile < m_Bins.size(); ++iTile)
+	{
+		m_Bins[iTile].clear();
+	}
+	memset( &m_Stats, 0, sizeof(m_Stats) );
+}
+
+
+// Draw a level of detail of a sub-mesh with the given world matrix and material, placing its
+// triangles in the tile bins. The sub-mesh's vertex positions are required, normals and
+// texture coordinates are used if present. The vertex and face data may be released after
+// the call, but the material's texture must remain until EndFrame
+void CSoftwareRaster::DrawSubMesh
+(
+	const SSubMesh&        subMesh,
+	const CMatrix4x4&      worldMatrix,
+	const SRasterMaterial& material,
+	const TUInt32          iLOD /*= 0*/
+)
+{
+	if (m_iWidth == 0 || m_iHeight == 0 || iLOD >= Max( subMesh.numLODs, 1u ))
+	{
+		return;
+	}
+	m_Materials.push_back( material );
+
+	// Vertex components are in the order: position, skinning data, normal, tangent, texture
+	// coordinate. Skinning data is 4 weights and 4 byte indices
+	TUInt32 iNormalOffset = sizeof(CVector3) +
+	                        (subMesh.hasSkinningData ? 4 * sizeof(TFloat32) + sizeof(TUInt32) : 0);
+	TUInt32 iTextureCoordOffset = iNormalOffset + (subMesh.hasNormals ? sizeof(CVector3) : 0) +
+	                              (subMesh.hasTangents ? sizeof(CVector3) : 0);
+	SRasterDrawTask task;
+	task.pRaster = this;
+	task.pSubMesh = &subMesh;
+	task.worldMatrix = worldMatrix;
+	task.worldViewProjMatrix = worldMatrix * m_ViewProjMatrix;
+	task.position = GetVertexComponent( subMesh, 0, sizeof(CVector3) );
+	task.normal = GetVertexComponent( subMesh, iNormalOffset, sizeof(CVector3) );
+	task.textureCoord = GetVertexComponent( subMesh, iTextureCoordOffset, 2 * sizeof(TFloat32) );
+	task.iMaterial = static_cast<TUInt32>(m_Materials.size()) - 1;
+
+	// Transform the vertices, only those used by the level of detail
+	TUInt32 iNumVertices = subMesh.numVertices;
+	TUInt32 iNumFaces = subMesh.numFaces;
+	task.iFirstFace = 0;
+	if (subMesh.numLODs > 0)
+	{
+		iNumVertices = subMesh.lods[iLOD].numVertices;
+		task.iFirstFace = subMesh.lods[iLOD].firstFace;
+		iNumFaces = subMesh.lods[iLOD].numFaces;
+	}
+	m_Vertices.resize( iNumVertices );
+	ParallelFor( iNumVertices, ParallelRanges( iNumVertices, kiMinParallelVertices ),
+	             TransformVertices, &task );
+	m_Stats.iNumVertices += iNumVertices;
+
+	// Set up and bin the faces, each thread into its own lists
+	TUInt32 iNumRanges = ParallelRanges( iNumFaces, kiMinParallelFaces );
+	TUInt32 iNumTiles = m_iNumTilesX * m_iNumTilesY;
+	for (TUInt32 iRange = 0; iRange < iNumRanges; ++iRange)
+	{
+		m_RangeTriangles[iRange].clear();
+		m_RangeBins[iRange].resize( iNumTiles );
+	}
+	ParallelFor( iNumFaces, iNumRanges, BinFaces, &task );
+	m_Stats.iNumTriangles += iNumFaces;
+
+	// Join the threads' lists in order of their ranges, which keeps the triangles in the order
+	// of the faces
+	for (TUInt32 iRange = 0; iRange < iNumRanges; ++iRange)
+	{
+		TUInt32 iFirstTriangle = static_cast<TUInt32>(m_Triangles.size());
+		m_Triangles.insert( m_Triangles.end(), m_RangeTriangles[iRange].begin(),
+		                    m_RangeTriangles[iRange].end() );
+		for (TUInt32 iTile = 0; iTile < iNumTiles; ++iTile)
+		{
+			vector<TUInt32>& rangeBin = m_RangeBins[iRange][iTile];
+			for (TUInt32 iEntry = 0; iEntry < rangeBin.size(); ++iEntry)
+			{
+				m_Bins[iTile].push_back( iFirstTriangle + rangeBin[iEntry] );
+			}
+			m_Stats.iNumBinEntries += static_cast<TUInt32>(rangeBin.size());
+			rangeBin.clear();
+		}
+	}
+	m_Stats.iNumBinned = static_cast<TUInt32>(m_Triangles.size());
+}
+
+
+// Transform a range of vertices of the sub-mesh being drawn, called by ParallelFor
+void CSoftwareRaster::TransformVertices
+(
+	TUInt32 iBegin,
+	TUInt32 iEnd,
+	TUInt32,
+	void*   pTask
+)
+{
+	const SRasterDrawTask& task = *static_cast<SRasterDrawTask*>(pTask);
+	const SSubMesh& subMesh = *task.pSubMesh;
+	SClipVertex* pVertex = &task.pRaster->m_Vertices[iBegin];
+	for (TUInt32 iVertex = iBegin; iVertex < iEnd; ++iVertex, ++pVertex)
+	{
+		TFloat32* pfValues = pVertex->afValues;
+		const CVector3& position = *reinterpret_cast<const CVector3*>(
+			task.position.pFirst + iVertex * task.position.iStride);
+		CVector4 clipPosition = task.worldViewProjMatrix.Transform( CVector4( position, 1.0f ) );
+		pfValues[kClipX] = clipPosition.x;
+		pfValues[kClipY] = clipPosition.y;
+		pfValues[kClipZ] = clipPosition.z;
+		pfValues[kClipW] = clipPosition.w;
+
+		pfValues[kClipU] = pfValues[kClipV] = 0.0f;
+		if (subMesh.hasTextureCoords)
+		{
+			const TFloat32* pfUV = reinterpret_cast<const TFloat32*>(
+				task.textureCoord.pFirst + iVertex * task.textureCoord.iStride);
+			pfValues[kClipU] = pfUV[0];
+			pfValues[kClipV] = pfUV[1];
+		}
+
+		CVector3 worldPosition = task.worldMatrix.TransformPoint( position );
+		pfValues[kClipWorldX] = worldPosition.x;
+		pfValues[kClipWorldY] = worldPosition.y;
+		pfValues[kClipWorldZ] = worldPosition.z;
+
+		CVector3 worldNormal = CVector3::kZero;
+		if (subMesh.hasNormals)
+		{
+			worldNormal = task.worldMatrix.TransformVector( *reinterpret_cast<const CVector3*>(
+				task.normal.pFirst + iVertex * task.normal.iStride) );
+		}
+		pfValues[kClipNormalX] = worldNormal.x;
+		pfValues[kClipNormalY] = worldNormal.y;
+		pfValues[kClipNormalZ] = worldNormal.z;
+	}
+}
+
+
+// Clip, cull and bin a range of faces of the sub-mesh being drawn, called by ParallelFor
+void CSoftwareRaster::BinFaces
+(
+	TUInt32 iBegin,
+	TUInt32 iEnd,
+	TUInt32 iRange,
+	void*   pTask
+)
+{
+	const SRasterDrawTask& task = *static_cast<SRasterDrawTask*>(pTask);
+	const SSubMesh& subMesh = *task.pSubMesh;
+	const CSoftwareRaster& raster = *task.pRaster;
+	vector<STriangle>* pTriangles = &task.pRaster->m_RangeTriangles[iRange];
+	vector<TUInt32>* pBins = &task.pRaster->m_RangeBins[iRange][0];
+
+	SClipVertex aPolygons[2][kiMaxClippedVertices];
+	for (TUInt32 iFace = task.iFirstFace + iBegin; iFace < task.iFirstFace + iEnd; ++iFace)
+	{
+		TUInt32 aiIndices[3];
+		for (TUInt32 iCorner = 0; iCorner < 3; ++iCorner)
+		{
+			aiIndices[iCorner] = subMesh.indexSize == 2 ?
+				reinterpret_cast<const SMeshFace*>(subMesh.faces)[iFace].aiVertex[iCorner] :
+				reinterpret_cast<const SMeshFace32*>(subMesh.faces)[iFace].aiVertex[iCorner];
+		}
+		const SClipVertex& v0 = raster.m_Vertices[aiIndices[0]];
+		const SClipVertex& v1 = raster.m_Vertices[aiIndices[1]];
+		const SClipVertex& v2 = raster.m_Vertices[aiIndices[2]];
+
+		// Discard faces wholly outside any side of the screen or beyond the near / far planes,
+		// set up the faces within the guard band directly, and clip the rest
+		TUInt32 iOutside0 = OutsideFlags( v0.afValues );
+		TUInt32 iOutside1 = OutsideFlags( v1.afValues );
+		TUInt32 iOutside2 = OutsideFlags( v2.afValues );
+		if (iOutside0 & iOutside1 & iOutside2)
+		{
+			continue;
+		}
+		if (((iOutside0 | iOutside1 | iOutside2) & (kiOutsideNear | kiOutsideGuardBand)) == 0)
+		{
+			raster.SetupTriangle( v0, v1, v2, task.iMaterial, pTriangles, pBins );
+			continue;
+		}
+
+		// Clip the face against each plane in turn (Sutherland-Hodgman), interpolating all the
+		// vertex values together, which is correct for attributes before the perspective divide
+		aPolygons[0][0] = v0;
+		aPolygons[0][1] = v1;
+		aPolygons[0][2] = v2;
+		TUInt32 iNumVertices = 3;
+		TUInt32 iCurrent = 0;
+		for (TUInt32 iPlane = 0; iPlane < kiNumClipPlanes && iNumVertices >= 3; ++iPlane)
+		{
+			const SClipVertex* pInput = aPolygons[iCurrent];
+			SClipVertex* pOutput = aPolygons[1 - iCurrent];
+			TUInt32 iNumOutput = 0;
+			for (TUInt32 iVertex = 0; iVertex < iNumVertices; ++iVertex)
+			{
+				const SClipVertex& start = pInput[iVertex];
+				const SClipVertex& end = pInput[(iVertex + 1) % iNumVertices];
+				TFloat32 fStart = ClipPlaneDistance( start.afValues, iPlane );
+				TFloat32 fEnd = ClipPlaneDistance( end.afValues, iPlane );
+				if (fStart >= 0.0f)
+				{
+					pOutput[iNumOutput++] = start;
+				}
+				if ((fStart >= 0.0f) != (fEnd >= 0.0f))
+				{
+					TFloat32 fT = fStart / (fStart - fEnd);
+					SClipVertex& clipped = pOutput[iNumOutput++];
+					for (TUInt32 iValue = 0; iValue < kNumClipValues; ++iValue)
+					{
+						clipped.afValues[iValue] = start.afValues[iValue] +
+							(end.afValues[iValue] - start.afValues[iValue]) * fT;
+					}
+				}
+			}
+			iNumVertices = iNumOutput;
+			iCurrent = 1 - iCurrent;
+		}
+
+		// Set up the clipped polygon as a fan of triangles
+		for (TUInt32 iVertex = 2; iVertex < iNumVertices; ++iVertex)
+		{
+			raster.SetupTriangle( aPolygons[iCurrent][0], aPolygons[iCurrent][iVertex - 1],
+			                      aPolygons[iCurrent][iVertex], task.iMaterial, pTriangles, pBins );
+		}
+	}
+}
+
+
+// Set up a triangle from three clip space vertices, and add it to the given list and the given
+// bins if any of it is visible. Returns false if it was culled
+bool CSoftwareRaster::SetupTriangle
+(
+	const SClipVertex& v0,
+	const SClipVertex& v1,
+	const SClipVertex& v2,
+	const TUInt32      iMaterial,
+	vector<STriangle>* pTriangles,
+	vector<TUInt32>*   pBins
+) const
+{
+	// Project the vertices to the screen, and snap them to fixed point positions so the edge
+	// equations are exact - neighbouring triangles then cover each pixel exactly once
+	const SClipVertex* apVertices[3] = { &v0, &v1, &v2 };
+	const TFloat32 fSubPixels = static_cast<TFloat32>(1 << kiSubPixelBits);
+	TFloat32 afOneOverW[3], afX[3], afY[3];
+	TInt64 aiX[3], aiY[3];
+	for (TUInt32 iVertex = 0; iVertex < 3; ++iVertex)
+	{
+		const TFloat32* pfValues = apVertices[iVertex]->afValues;
+		afOneOverW[iVertex] = 1.0f / pfValues[kClipW];
+		TFloat32 fX = (pfValues[kClipX] * afOneOverW[iVertex] * 0.5f + 0.5f) * m_iWidth;
+		TFloat32 fY = (0.5f - pfValues[kClipY] * afOneOverW[iVertex] * 0.5f) * m_iHeight;
+		aiX[iVertex] = static_cast<TInt64>(Floor( fX * fSubPixels + 0.5f ));
+		aiY[iVertex] = static_cast<TInt64>(Floor( fY * fSubPixels + 0.5f ));
+		afX[iVertex] = aiX[iVertex] / fSubPixels;
+		afY[iVertex] = aiY[iVertex] / fSubPixels;
+	}
+
+	// Cull faces that are anticlockwise on the screen (facing away), or have no area
+	TInt64 iArea = (aiX[1] - aiX[0]) * (aiY[2] - aiY[0]) - (aiX[2] - aiX[0]) * (aiY[1] - aiY[0]);
+	if (iArea <= 0)
+	{
+		return false;
+	}
+
+	// Find the pixels whose centres may be inside, culling faces between pixel centres
+	const TInt64 iHalfPixel = 1 << (kiSubPixelBits - 1);
+	const TInt64 iPixelMask = (1 << kiSubPixelBits) - 1;
+	TInt64 iMinX = Min( aiX[0], Min( aiX[1], aiX[2] ) );
+	TInt64 iMaxX = Max( aiX[0], Max( aiX[1], aiX[2] ) );
+	TInt64 iMinY = Min( aiY[0], Min( aiY[1], aiY[2] ) );
+	TInt64 iMaxY = Max( aiY[0], Max( aiY[1], aiY[2] ) );
+	iMinX = Max<TInt64>( (iMinX - iHalfPixel + iPixelMask) >> kiSubPixelBits, 0 );
+	iMinY = Max<TInt64>( (iMinY - iHalfPixel + iPixelMask) >> kiSubPixelBits, 0 );
+	iMaxX = Min<TInt64>( (iMaxX - iHalfPixel) >> kiSubPixelBits, m_iWidth - 1 );
+	iMaxY = Min<TInt64>( (iMaxY - iHalfPixel) >> kiSubPixelBits, m_iHeight - 1 );
+	STriangle triangle;
+	triangle.iMinX = static_cast<TInt32>(iMinX);
+	triangle.iMinY = static_cast<TInt32>(iMinY);
+	triangle.iMaxX = static_cast<TInt32>(iMaxX);
+	triangle.iMaxY = static_cast<TInt32>(iMaxY);
+	if (triangle.iMinX > triangle.iMaxX || triangle.iMinY > triangle.iMaxY)
+	{
+		return false;
+	}
+
+	// Edge equations, positive inside. Pixel centres exactly on an edge belong to the triangle
+	// only if it is a top or left edge, so the equations of other edges are moved inwards by the
+	// smallest step
+	for (TUInt32 iEdge = 0; iEdge < 3; ++iEdge)
+	{
+		TUInt32 iStart = iEdge, iEnd = (iEdge + 1) % 3;
+		TInt64 iA = aiY[iStart] - aiY[iEnd];
+		TInt64 iB = aiX[iEnd] - aiX[iStart];
+		TInt64 iC = -(iA * aiX[iStart] + iB * aiY[iStart]);
+		if (!(iA > 0 || (iA == 0 && iB > 0)))
+		{
+			--iC;
+		}
+		triangle.aiEdgeA[iEdge] = iA;
+		triangle.aiEdgeB[iEdge] = iB;
+		triangle.aiEdgeC[iEdge] = iC;
+	}
+
+	// Planes of depth, 1/w and each attribute / w, all linear in screen space
+	TFloat32 fDX1 = afX[1] - afX[0], fDY1 = afY[1] - afY[0];
+	TFloat32 fDX2 = afX[2] - afX[0], fDY2 = afY[2] - afY[0];
+	TFloat32 fInvArea = 1.0f / (fDX1 * fDY2 - fDX2 * fDY1);
+	triangle.fX0 = afX[0];
+	triangle.fY0 = afY[0];
+	for (TUInt32 iPlane = 0; iPlane < kiNumPlanes; ++iPlane)
+	{
+		TFloat32 afValues[3];
+		for (TUInt32 iVertex = 0; iVertex < 3; ++iVertex)
+		{
+			const TFloat32* pfValues = apVertices[iVertex]->afValues;
+			if (iPlane == kPlaneDepth)
+			{
+				afValues[iVertex] = pfValues[kClipZ] * afOneOverW[iVertex];
+			}
+			else if (iPlane == kPlaneOneOverW)
+			{
+				afValues[iVertex] = afOneOverW[iVertex];
+			}
+			else
+			{
+				afValues[iVertex] = pfValues[kClipU + iPlane - kPlaneFirstAttribute] *
+				                    afOneOverW[iVertex];
+			}
+		}
+		SPlane& plane = triangle.aPlanes[iPlane];
+		TFloat32 fDelta1 = afValues[1] - afValues[0], fDelta2 = afValues[2] - afValues[0];
+		plane.fValue = afValues[0];
+		plane.fDX = (fDelta1 * fDY2 - fDelta2 * fDY1) * fInvArea;
+		plane.fDY = (fDelta2 * fDX1 - fDelta1 * fDX2) * fInvArea;
+		if (iPlane == kPlaneDepth)
+		{
+			triangle.fMinDepth = Min( afValues[0], Min( afValues[1], afValues[2] ) );
+		}
+	}
+	triangle.iMaterial = iMaterial;
+
+	// Add the triangle to the bins of the tiles its pixels overlap
+	TUInt32 iTriangle = static_cast<TUInt32>(pTriangles->size());
+	pTriangles->push_back( triangle );
+	for (TUInt32 iTileY = triangle.iMinY / kiRasterTileSize;
+	     iTileY <= triangle.iMaxY / kiRasterTileSize; ++iTileY)
+	{
+		for (TUInt32 iTileX = triangle.iMinX / kiRasterTileSize;
+		     iTileX <= triangle.iMaxX / kiRasterTileSize; ++iTileX)
+		{
+			pBins[iTileY * m_iNumTilesX + iTileX].push_back( iTriangle );
+		}
+	}
+	return true;
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Tile rendering
+ ------------------------------------------------------------------------------------------------*/
+
+// Data shared by the threads rendering tiles
+struct SRasterTileTask
+{
+	CSoftwareRaster* pRaster;
+	TUInt32          iNumThreads;
+	SRasterStats     aStats[kiMaxParallelRanges];
+};
+
+// Render the triangles drawn since BeginFrame into the colour buffer, each tile on one of the
+// processors
+void CSoftwareRaster::EndFrame()
+{
+	if (m_iWidth == 0 || m_iHeight == 0)
+	{
+		return;
+	}
+
+	SRasterTileTask task;
+	task.pRaster = this;
+	task.iNumThreads = ParallelRanges( m_iNumTilesX * m_iNumTilesY, 1 );
+	memset( task.aStats, 0, sizeof(task.aStats) );
+	ParallelFor( task.iNumThreads, task.iNumThreads, RenderTiles, &task );
+
+	for (TUInt32 iThread = 0; iThread < task.iNumThreads; ++iThread)
+	{
+		m_Stats.iNumBlocksRejected += task.aStats[iThread].iNumBlocksRejected;
+		m_Stats.iNumPixelsShaded += task.aStats[iThread].iNumPixelsShaded;
+	}
+}
+
+// Render every n-th tile, starting with the given one, called by ParallelFor with one item per
+// thread. Neighbouring tiles are given to different threads, which spreads expensive parts of
+// the screen evenly
+void CSoftwareRaster::RenderTiles
+(
+	TUInt32 iBegin,
+	TUInt32,
+	TUInt32,
+	void*   pTask
+)
+{
+	SRasterTileTask& task = *static_cast<SRasterTileTask*>(pTask);
+	CSoftwareRaster& raster = *task.pRaster;
+	TUInt32 iNumTiles = raster.m_iNumTilesX * raster.m_iNumTilesY;
+	for (TUInt32 iTile = iBegin; iTile < iNumTiles; iTile += task.iNumThreads)
+	{
+		raster.RenderTile( iTile, &task.aStats[iBegin] );
+	}
+}
+
+
+// Render the triangles in a tile's bin into the tile, gathering statistics
+void CSoftwareRaster::RenderTile
+(
+	const TUInt32 iTile,
+	SRasterStats* pStats
+)
+{
+	const TInt32 iTileLeft = (iTile % m_iNumTilesX) * kiRasterTileSize;
+	const TInt32 iTileTop = (iTile / m_iNumTilesX) * kiRasterTileSize;
+	const TInt32 iTileRight = Min( iTileLeft + kiRasterTileSize, m_iWidth ) - 1;
+	const TInt32 iTileBottom = Min( iTileTop + kiRasterTileSize, m_iHeight ) - 1;
+	TFloat32* pfDepths = &m_Depths[iTile * kiRasterTileSize * kiRasterTileSize];
+	TFloat32* pfBlockDepths = &m_BlockDepths[iTile * kiBlocksPerTile];
+
+	// Clear the tile here rather than in BeginFrame, so it is done in parallel and leaves the
+	// tile in the cache
+	for (TInt32 iY = iTileTop; iY <= iTileBottom; ++iY)
+	{
+		fill( &m_Pixels[iY * m_iWidth + iTileLeft], &m_Pixels[iY * m_iWidth + iTileRight] + 1,
+		      m_ClearColour );
+	}
+	fill( pfDepths, pfDepths + kiRasterTileSize * kiRasterTileSize, 1.0f );
+	fill( pfBlockDepths, pfBlockDepths + kiBlocksPerTile, 1.0f );
+	m_TileDepths[iTile] = 1.0f;
+
+	const TInt64 iSubPixels = 1 << kiSubPixelBits;
+	const TInt64 iHalfPixel = iSubPixels / 2;
+	const TInt32 iBlockSize = static_cast<TInt32>(kiRasterBlockSize);
+	const vector<TUInt32>& bin = m_Bins[iTile];
+	for (TUInt32 iEntry = 0; iEntry < bin.size(); ++iEntry)
+	{
+		// Skip triangles wholly behind everything in the tile
+		const STriangle& triangle = m_Triangles[bin[iEntry]];
+		if (triangle.fMinDepth > m_TileDepths[iTile])
+		{
+			pStats->iNumBlocksRejected += kiBlocksPerTile;
+			continue;
+		}
+		const SRasterMaterial& material = m_Materials[triangle.iMaterial];
+		const bool bTextured = material.pTexture && IsTexturedMethod( material.renderMethod );
+		const bool bAttributes = bTextured || IsLitMethod( material.renderMethod );
+
+		// Pixels of the tile the triangle may cover, and the blocks they are in
+		TInt32 iMinX = Max( triangle.iMinX, iTileLeft ), iMaxX = Min( triangle.iMaxX, iTileRight );
+		TInt32 iMinY = Max( triangle.iMinY, iTileTop ), iMaxY = Min( triangle.iMaxY, iTileBottom );
+		bool bTileChanged = false;
+		for (TInt32 iBlockTop = iTileTop + ((iMinY - iTileTop) & ~(iBlockSize - 1));
+		     iBlockTop <= iMaxY; iBlockTop += iBlockSize)
+		{
+			for (TInt32 iBlockLeft = iTileLeft + ((iMinX - iTileLeft) & ~(iBlockSize - 1));
+			     iBlockLeft <= iMaxX; iBlockLeft += iBlockSize)
+			{
+				// Pixels of the block to test
+				TInt32 iLeft = Max( iBlockLeft, iMinX );
+				TInt32 iRight = Min( iBlockLeft + iBlockSize - 1, iMaxX );
+				TInt32 iTop = Max( iBlockTop, iMinY );
+				TInt32 iBottom = Min( iBlockTop + iBlockSize - 1, iMaxY );
+				TInt64 iLeftX = iLeft * iSubPixels + iHalfPixel;
+				TInt64 iRightX = iRight * iSubPixels + iHalfPixel;
+				TInt64 iTopY = iTop * iSubPixels + iHalfPixel;
+				TInt64 iBottomY = iBottom * iSubPixels + iHalfPixel;
+
+				// Test the edges at the block's corners - skip the block if all its corners are
+				// outside one edge, and skip testing pixels if all its corners are inside all edges
+				bool bOutside = false, bInside = true;
+				for (TUInt32 iEdge = 0; iEdge < 3; ++iEdge)
+				{
+					TInt64 iA = triangle.aiEdgeA[iEdge], iB = triangle.aiEdgeB[iEdge];
+					TInt64 iMaxCorner = iA * (iA > 0 ? iRightX : iLeftX) +
+					                    iB * (iB > 0 ? iBottomY : iTopY) + triangle.aiEdgeC[iEdge];
+					TInt64 iMinCorner = iA * (iA > 0 ? iLeftX : iRightX) +
+					                    iB * (iB > 0 ? iTopY : iBottomY) + triangle.aiEdgeC[iEdge];
+					bOutside = bOutside || iMaxCorner < 0;
+					bInside = bInside && iMinCorner >= 0;
+				}
+				if (bOutside)
+				{
+					continue;
+				}
+
+				// Hierarchical depth test - skip the block if the nearest depth of the triangle
+				// within it is behind the farthest depth in the block
+				const SPlane& depthPlane = triangle.aPlanes[kPlaneDepth];
+				TFloat32 fLeft = iLeft + 0.5f - triangle.fX0, fRight = iRight + 0.5f - triangle.fX0;
+				TFloat32 fTop = iTop + 0.5f - triangle.fY0, fBottom = iBottom + 0.5f - triangle.fY0;
+				TFloat32 fNearest = depthPlane.fValue +
+				                    Min( depthPlane.fDX * fLeft, depthPlane.fDX * fRight ) +
+				                    Min( depthPlane.fDY * fTop, depthPlane.fDY * fBottom );
+				TUInt32 iBlock = ((iBlockTop - iTileTop) / iBlockSize) * kiBlocksPerTileSide +
+				                 (iBlockLeft - iTileLeft) / iBlockSize;
+				if (Max( fNearest, triangle.fMinDepth ) > pfBlockDepths[iBlock])
+				{
+					++pStats->iNumBlocksRejected;
+					continue;
+				}
+
+				// Test each pixel against the edges (stepping the equations along each row) and the
+				// depth buffer, then shade those that pass
+				bool bBlockChanged = false;
+				for (TInt32 iY = iTop; iY <= iBottom; ++iY)
+				{
+					TInt64 iPixelY = iY * iSubPixels + iHalfPixel;
+					TInt64 aiEdges[3];
+					for (TUInt32 iEdge = 0; iEdge < 3; ++iEdge)
+					{
+						aiEdges[iEdge] = triangle.aiEdgeA[iEdge] * iLeftX +
+						                 triangle.aiEdgeB[iEdge] * iPixelY +
+						                 triangle.aiEdgeC[iEdge];
+					}
+					TFloat32 fDY = iY + 0.5f - triangle.fY0;
+					TFloat32* pfDepth =
+						&pfDepths[(iY - iTileTop) * kiRasterTileSize + iLeft - iTileLeft];
+					TUInt32* pPixel = &m_Pixels[iY * m_iWidth + iLeft];
+					for (TInt32 iX = iLeft; iX <= iRight; ++iX, ++pfDepth, ++pPixel)
+					{
+						bool bCovered = bInside || (aiEdges[0] | aiEdges[1] | aiEdges[2]) >= 0;
+						aiEdges[0] += triangle.aiEdgeA[0] * iSubPixels;
+						aiEdges[1] += triangle.aiEdgeA[1] * iSubPixels;
+						aiEdges[2] += triangle.aiEdgeA[2] * iSubPixels;
+						if (!bCovered)
+						{
+							continue;
+						}
+						TFloat32 fDX = iX + 0.5f - triangle.fX0;
+						TFloat32 fDepth = depthPlane.fValue + depthPlane.fDX * fDX +
+						                  depthPlane.fDY * fDY;
+						if (fDepth > *pfDepth)
+						{
+							continue;
+						}
+						*pfDepth = fDepth;
+						bBlockChanged = true;
+						++pStats->iNumPixelsShaded;
+						if (!bAttributes)
+						{
+							*pPixel = ShadePixel( material, m_Lighting, m_CameraPosition,
+							                      0.0f, 0, 0 );
+							continue;
+						}
+
+						// Perspective correct attributes - divide the interpolated attribute / w by
+						// the interpolated 1/w
+						const SPlane& oneOverWPlane = triangle.aPlanes[kPlaneOneOverW];
+						TFloat32 fW = 1.0f / (oneOverWPlane.fValue + oneOverWPlane.fDX * fDX +
+						                      oneOverWPlane.fDY * fDY);
+						TFloat32 afAttributes[kiNumAttributes];
+						for (TUInt32 iAttribute = 0; iAttribute < kiNumAttributes; ++iAttribute)
+						{
+							const SPlane& plane =
+								triangle.aPlanes[kPlaneFirstAttribute + iAttribute];
+							afAttributes[iAttribute] = (plane.fValue + plane.fDX * fDX +
+							                            plane.fDY * fDY) * fW;
+						}
+
+						// Screen derivatives of the texture coordinate for mip-mapping, from the
+						// derivatives of U/w, V/w and 1/w
+						TFloat32 afDerivatives[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+						if (bTextured)
+						{
+							const SPlane& planeU = triangle.aPlanes[kPlaneFirstAttribute];
+							const SPlane& planeV = triangle.aPlanes[kPlaneFirstAttribute + 1];
+							const SPlane& planeW = oneOverWPlane;
+							afDerivatives[0] = (planeU.fDX - afAttributes[0] * planeW.fDX) * fW;
+							afDerivatives[1] = (planeV.fDX - afAttributes[1] * planeW.fDX) * fW;
+							afDerivatives[2] = (planeU.fDY - afAttributes[0] * planeW.fDY) * fW;
+							afDerivatives[3] = (planeV.fDY - afAttributes[1] * planeW.fDY) * fW;
+						}
+						*pPixel = ShadePixel( material, m_Lighting, m_CameraPosition,
+						                      m_fSpecularCutoff, afAttributes, afDerivatives );
+					}
+				}
+
+				// Update the farthest depth of a block that has changed
+				if (bBlockChanged)
+				{
+					TFloat32* pfBlock = &pfDepths[(iBlockTop - iTileTop) * kiRasterTileSize +
+					                              iBlockLeft - iTileLeft];
+					TFloat32 fFarthest = 0.0f;
+					for (TUInt32 iRow = 0; iRow < kiRasterBlockSize; ++iRow)
+					{
+						for (TUInt32 iColumn = 0; iColumn < kiRasterBlockSize; ++iColumn)
+						{
+							fFarthest = Max( fFarthest,
+							                 pfBlock[iRow * kiRasterTileSize + iColumn] );
+						}
+					}
+					pfBlockDepths[iBlock] = fFarthest;
+					bTileChanged = true;
+				}
+			}
+		}
+
+		// Update the farthest depth of the tile if any block has changed
+		if (bTileChanged)
+		{
+			m_TileDepths[iTile] = *max_element( pfBlockDepths, pfBlockDepths + kiBlocksPerTile );
+		}
+	}
+}
+
+
+} // namespace gen
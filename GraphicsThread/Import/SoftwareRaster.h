@@ -0,0 +1,349 @@
+/**************************************************************************************************
+	Module:       SoftwareRaster.h
+	Date created: 18/10/26
+
+	Tiled software rasteriser - renders sub-meshes into a colour buffer on the CPU, without a
+	graphics device, using all the processors
+
+	Change history:
+		V1.0    Created 18/10/26
+**************************************************************************************************/
+
+#ifndef GEN_SOFTWARE_RASTER_H_INCLUDED
+#define GEN_SOFTWARE_RASTER_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "Parallel.h"
+#include "MeshData.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Software rendering data
+ ------------------------------------------------------------------------------------------------*/
+
+// Size of the square screen tiles that triangles are binned into, in pixels. Each tile is
+// rendered by a single thread, with its colour and depth held in that processor's cache
+const TUInt32 kiRasterTileSize = 64;
+
+// Size of the square blocks of pixels within a tile that are tested against a triangle together.
+// The hierarchical depth buffer holds the farthest depth in each block
+const TUInt32 kiRasterBlockSize = 8;
+
+// Maximum number of point lights used by the lit render methods
+const TUInt32 kiMaxRasterLights = 2;
+
+
+// A level of a texture - 32-bit X8R8G8B8 pixels, row by row
+struct SRasterTextureLevel
+{
+	TUInt32         iWidth;
+	TUInt32         iHeight;
+	vector<TUInt32> pixels;
+};
+
+// Texture for software rendering, see CreateRasterTexture. Level 0 is full size, each further
+// level is half the size of the last. Texture coordinates wrap, and textures are filtered
+// bilinearly within a level and linearly between levels (as trilinear filtering in hardware)
+struct SRasterTexture
+{
+	vector<SRasterTextureLevel> levels;
+};
+
+// Lighting for the lit render methods - ambient light and point lights, whose strength is their
+// brightness divided by distance (up to full strength). Specular light is tinted by each light's
+// diffuse contribution. This matches the pixel lighting shaders used for hardware rendering
+struct SRasterLighting
+{
+	SColourRGBA ambientColour;
+	TUInt32     iNumLights;
+	CVector3    aLightPositions[kiMaxRasterLights];
+	SColourRGBA aLightColours[kiMaxRasterLights];
+	TFloat32    afLightBrightness[kiMaxRasterLights];
+	TFloat32    fSpecularPower;
+};
+
+// How to render a sub-mesh. Methods using a texture (PlainTexture, VertexLitTex and PixelLitTex)
+// multiply the texture into the colour. Lit methods (VertexLit onwards) are all lit per-pixel
+struct SRasterMaterial
+{
+	ERenderMethod         renderMethod;
+	SColourRGBA           colour;   // Plain colour, or diffuse colour of lit methods
+	const SRasterTexture* pTexture; // Ignored by methods that do not use a texture
+};
+
+// Statistics of the last frame rendered, to show where the time is spent
+struct SRasterStats
+{
+	TUInt32 iNumVertices;       // Vertices transformed for the sub-meshes drawn
+	TUInt32 iNumTriangles;      // Triangles in the sub-meshes drawn
+	TUInt32 iNumBinned;         // Triangles left after culling and clipping, placed in bins
+	TUInt32 iNumBinEntries;     // Total triangles in all the tiles' bins
+	TUInt32 iNumBlocksRejected; // Blocks of pixels skipped by the hierarchical depth buffer
+	TUInt32 iNumPixelsShaded;   // Pixels that passed the depth test
+};
+
+
+// Create a texture for software rendering from 32-bit X8R8G8B8 pixels, row by row. The width and
+// height must be powers of two. Optionally create mip-maps down to a single pixel
+void CreateRasterTexture
+(
+	const TUInt32*  pPixels,
+	const TUInt32   iWidth,
+	const TUInt32   iHeight,
+	const bool      bMipMaps,
+	SRasterTexture* pTexture
+);
+
+
+/*------------------------------------------------------------------------------------------------
+	Software rasteriser
+ ------------------------------------------------------------------------------------------------*/
+
+// Renders sub-meshes into its own colour and depth buffers, using conventions that match Direct3D
+// - row vector matrices, depth from 0 to 1, clockwise faces visible. Rendering a frame has two
+// passes. Each draw call transforms the sub-mesh's vertices, clips and culls its triangles and
+// adds each remaining triangle to the bins of the screen tiles it overlaps, spreading the
+// triangles across the processors. Then the tiles are rendered in parallel, each thread taking
+// whole tiles and drawing the triangles in its bins in the order they were drawn. Perspective
+// correct attributes are interpolated for each pixel. The farthest depth of each block of
+// pixels in a tile, and of the tile as a whole, is kept so hidden triangles can be skipped
+// without testing their pixels
+class CSoftwareRaster
+{
+	GEN_CLASS( CSoftwareRaster )
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+public:
+	// Constructor creates a rasteriser with no buffers, use SetSize before rendering
+	CSoftwareRaster()
+	{
+		m_iWidth = 0;
+		m_iHeight = 0;
+		m_iNumTilesX = 0;
+		m_iNumTilesY = 0;
+	}
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CSoftwareRaster( const CSoftwareRaster& );
+	CSoftwareRaster& operator=( const CSoftwareRaster& );
+
+
+/*-----------------------------------------------------------------------------------------
+	Public interface
+-----------------------------------------------------------------------------------------*/
+public:
+
+	/////////////////////////////////////
+	// Buffers
+
+	// Set the size of the colour and depth buffers in pixels
+	void SetSize
+	(
+		const TUInt32 iWidth,
+		const TUInt32 iHeight
+	);
+
+	// Get the size of the buffers
+	TUInt32 GetWidth() const
+	{
+		return m_iWidth;
+	}
+	TUInt32 GetHeight() const
+	{
+		return m_iHeight;
+	}
+
+	// Get the colour buffer rendered by the last EndFrame - 32-bit X8R8G8B8 pixels, row by row
+	const TUInt32* GetPixels() const
+	{
+		return &m_Pixels[0];
+	}
+
+
+	/////////////////////////////////////
+	// Rendering
+
+	// Start a frame, given the combined view / projection matrix, the camera position and the
+	// lighting for the lit render methods. The buffers are cleared to the given colour and the
+	// farthest depth when the frame is rendered
+	void BeginFrame
+	(
+		const CMatrix4x4&      viewProjMatrix,
+		const CVector3&        cameraPosition,
+		const SRasterLighting& lighting,
+		const SColourRGBA&     clearColour
+	);
+
+	// Draw a level of detail of a sub-mesh with the given world matrix and material, placing its
+	// triangles in the tile bins. The sub-mesh's vertex positions are required, normals and
+	// texture coordinates are used if present. The vertex and face data may be released after
+	// the call, but the material's texture must remain until EndFrame
+	void DrawSubMesh
+	(
+		const SSubMesh&        subMesh,
+		const CMatrix4x4&      worldMatrix,
+		const SRasterMaterial& material,
+		const TUInt32          iLOD = 0
+	);
+
+	// Render the triangles drawn since BeginFrame into the colour buffer, each tile on one of the
+	// processors
+	void EndFrame();
+
+	// Get statistics of the last frame rendered
+	const SRasterStats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	// Values interpolated across a triangle's vertices - texture coordinate, world position and
+	// world normal
+	static const TUInt32 kiNumAttributes = 8;
+
+	// Values interpolated across the screen for a triangle - depth, 1/w and each attribute / w,
+	// all of which vary linearly in screen space
+	static const TUInt32 kiNumPlanes = kiNumAttributes + 2;
+
+	// Bits of sub-pixel precision in the fixed point screen positions of triangle vertices
+	static const TUInt32 kiSubPixelBits = 4;
+
+	// A vertex after transformation - its position in clip space followed by its attributes, so
+	// clipping can interpolate all the values together
+	struct SClipVertex
+	{
+		TFloat32 afValues[4 + kiNumAttributes];
+	};
+
+	// A value varying linearly across the screen - its value at the triangle's first vertex and
+	// its change per pixel along each screen axis
+	struct SPlane
+	{
+		TFloat32 fValue;
+		TFloat32 fDX;
+		TFloat32 fDY;
+	};
+
+	// A triangle ready to render. Each edge has an equation A*x + B*y + C in fixed point screen
+	// space that is at least 0 for the pixel centres inside the triangle
+	struct STriangle
+	{
+		TInt64   aiEdgeA[3];
+		TInt64   aiEdgeB[3];
+		TInt64   aiEdgeC[3];
+		TInt32   iMinX, iMinY, iMaxX, iMaxY; // Pixels that may be covered (inclusive)
+		TFloat32 fX0, fY0;                   // Screen position of first vertex, origin of planes
+		TFloat32 fMinDepth;                  // Nearest depth of the vertices
+		SPlane   aPlanes[kiNumPlanes];
+		TUInt32  iMaterial;                  // Index in the frame's material list
+	};
+
+	// Transform a range of vertices of the sub-mesh being drawn, called by ParallelFor
+	static void TransformVertices
+	(
+		TUInt32 iBegin,
+		TUInt32 iEnd,
+		TUInt32 iRange,
+		void*   pTask
+	);
+
+	// Clip, cull and bin a range of faces of the sub-mesh being drawn, called by ParallelFor
+	static void BinFaces
+	(
+		TUInt32 iBegin,
+		TUInt32 iEnd,
+		TUInt32 iRange,
+		void*   pTask
+	);
+
+	// Render every n-th tile, starting with the given one, called by ParallelFor with one item
+	// per thread. Neighbouring tiles are given to different threads, which spreads expensive
+	// parts of the screen evenly
+	static void RenderTiles
+	(
+		TUInt32 iBegin,
+		TUInt32 iEnd,
+		TUInt32 iRange,
+		void*   pTask
+	);
+
+	// Set up a triangle from three clip space vertices, and add it to the given list and the
+	// given bins if any of it is visible. Returns false if it was culled
+	bool SetupTriangle
+	(
+		const SClipVertex& v0,
+		const SClipVertex& v1,
+		const SClipVertex& v2,
+		const TUInt32      iMaterial,
+		vector<STriangle>* pTriangles,
+		vector<TUInt32>*   pBins
+	) const;
+
+	// Render the triangles in a tile's bin into the tile, gathering statistics
+	void RenderTile
+	(
+		const TUInt32 iTile,
+		SRasterStats* pStats
+	);
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	// Size of the buffers in pixels and tiles
+	TUInt32 m_iWidth;
+	TUInt32 m_iHeight;
+	TUInt32 m_iNumTilesX;
+	TUInt32 m_iNumTilesY;
+
+	// Colour buffer, row by row, and depth buffer, tile by tile so each tile's depths are
+	// together. The hierarchical depth buffer holds the farthest depth of each block of pixels,
+	// again tile by tile, and of each tile
+	vector<TUInt32>  m_Pixels;
+	vector<TFloat32> m_Depths;
+	vector<TFloat32> m_BlockDepths;
+	vector<TFloat32> m_TileDepths;
+
+	// Settings for the frame being drawn
+	CMatrix4x4              m_ViewProjMatrix;
+	CVector3                m_CameraPosition;
+	SRasterLighting         m_Lighting;
+	TFloat32                m_fSpecularCutoff; // Cosine below which specular light is negligible
+	TUInt32                 m_ClearColour;
+	vector<SRasterMaterial> m_Materials;
+
+	// Triangles of the frame, and the indices of the triangles overlapping each tile, in the
+	// order they were drawn
+	vector<STriangle>         m_Triangles;
+	vector< vector<TUInt32> > m_Bins;
+
+	// Working space for each thread while binning a sub-mesh - the triangles it set up and the
+	// bins it placed them in, joined into the frame's lists afterwards so the order is kept
+	vector<SClipVertex>       m_Vertices;
+	vector<STriangle>         m_RangeTriangles[kiMaxParallelRanges];
+	vector< vector<TUInt32> > m_RangeBins[kiMaxParallelRanges];
+
+	// Statistics of the frame being drawn / the last frame rendered
+	SRasterStats m_Stats;
+};
+
+
+} // namespace gen
+
+#endif // GEN_SOFTWARE_RASTER_H_INCLUDED
@@ -0,0 +1,1869 @@
+/**********************************************
+	Mesh.cpp
+
+	Implementation of mesh class for DirectX
+***********************************************/
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <climits>
+#include <process.h> // Use standard library to create / destroy threads
+using namespace std;
+
+#include "Defines.h"
+#include "Mesh.h"
+
+#include "CImportXFile.h"    // Class to load meshes (taken from a full graphics engine)
+#include "Profile.h"         // Time stamps to measure upload time
+
+
+/////////////////////////////
+// Mesh Cache
+
+// Meshes loaded from files, keyed by the normalised file name and load options (see
+// GetCachedMesh). Only used on the rendering thread
+map<string, CMesh*> MeshCache;
+
+// Get a normalised version of a file name, so different names for the same file give the same
+// result - a full path, lower case (file names are not case sensitive) with backslash separators
+string NormaliseFileName( const string& fileName )
+{
+	char fullPath[MAX_PATH];
+	DWORD length = GetFullPathNameA( fileName.c_str(), MAX_PATH, fullPath, NULL );
+	string normalised = (length > 0 && length < MAX_PATH) ? fullPath : fileName;
+	for (unsigned int i = 0; i < normalised.size(); ++i)
+	{
+		normalised[i] = (normalised[i] == '/') ? '\\' : static_cast<char>(tolower( normalised[i] ));
+	}
+	return normalised;
+}
+
+
+/////////////////////////////
+// Geometry Store
+
+// Key of a block of vertex, index or material data - a hash of its contents, its size and format.
+// The hash is 64-bit so blocks with different contents are very unlikely to share a key
+struct SGeometryKey
+{
+	gen::TUInt64 hash;
+	unsigned int bytes;
+	DWORD        format; // Index format for index data, 0 for vertex data (which may mix formats),
+	                     // MaterialKeyFormat for material data
+	unsigned int stride; // Size of an index, 0 for vertex and material data
+
+	bool operator<( const SGeometryKey& other ) const
+	{
+		if (hash != other.hash)
+		{
+			return hash < other.hash;
+		}
+		if (bytes != other.bytes)
+		{
+			return bytes < other.bytes;
+		}
+		if (format != other.format)
+		{
+			return format < other.format;
+		}
+		return stride < other.stride;
+	}
+};
+
+// Format in the key of material data, which is not a valid index format
+const DWORD MaterialKeyFormat = 0xffffffff;
+
+// A block of vertex or index data in a buffer, or of a material, shared by all the meshes using the
+// same data. The buffer or material is released with the last reference to the block
+struct SGeometryBlock
+{
+	SGeometryKey        key;
+	IDirect3DResource9* buffer;   // NULL for material data
+	CMesh::SMaterial*   material; // NULL for vertex and index data
+	unsigned int        refCount;
+};
+
+// Blocks of geometry data used by meshes, keyed by their contents, and the totals reported by
+// CMesh::GetGeometryStats. Only used on the rendering thread
+map<SGeometryKey, SGeometryBlock*> GeometryStore;
+unsigned int GeometryBlocksUsed = 0;
+unsigned int GeometryBytesUsed = 0;
+unsigned int GeometryBytesStored = 0;
+
+
+// Make the key for a block of geometry data - the data is hashed with 64-bit FNV-1a
+SGeometryKey MakeGeometryKey( const void* data, unsigned int bytes, DWORD format,
+                              unsigned int stride )
+{
+	const gen::TUInt8* dataBytes = static_cast<const gen::TUInt8*>(data);
+	gen::TUInt64 hash = 14695981039346656037ull;
+	for (unsigned int i = 0; i < bytes; ++i)
+	{
+		hash = (hash ^ dataBytes[i]) * 1099511628211ull;
+	}
+
+	SGeometryKey key;
+	key.hash = hash;
+	key.bytes = bytes;
+	key.format = format;
+	key.stride = stride;
+	return key;
+}
+
+// Make the key for a material - its render method, diffuse colour and texture name are written in
+// turn and hashed as for geometry data
+SGeometryKey MakeMaterialKey( const CMesh::SMaterial& material )
+{
+	vector<gen::TUInt8> data( sizeof(material.renderMethod) + sizeof(material.diffuseColour) +
+	                          material.textureName.size() );
+	memcpy( &data[0], &material.renderMethod, sizeof(material.renderMethod) );
+	memcpy( &data[sizeof(material.renderMethod)], &material.diffuseColour,
+	        sizeof(material.diffuseColour) );
+	if (!material.textureName.empty())
+	{
+		memcpy( &data[sizeof(material.renderMethod) + sizeof(material.diffuseColour)],
+		        material.textureName.c_str(), material.textureName.size() );
+	}
+	return MakeGeometryKey( &data[0], static_cast<unsigned int>(data.size()), MaterialKeyFormat,
+	                        0 );
+}
+
+// Get the FVF code (vertex format descriptor) for the vertices of a sub-mesh
+DWORD SubMeshFVF( const gen::SSubMesh& subMesh )
+{
+	return D3DFVF_XYZ + (subMesh.hasNormals ? D3DFVF_NORMAL : 0) + 
+	                    (subMesh.hasTextureCoords ? D3DFVF_TEX1 : 0) + 
+	                    (subMesh.hasVertexColours ? D3DFVF_DIFFUSE : 0);
+}
+
+// Get the index format for indices of the given size - 2-byte (WORD) or 4-byte (DWORD)
+D3DFORMAT IndexFormat( unsigned int indexSize )
+{
+	return (indexSize == sizeof(DWORD)) ? D3DFMT_INDEX32 : D3DFMT_INDEX16;
+}
+
+
+// Get the stored block with the given key, adding a reference for the caller. Returns NULL if no
+// block with the key is stored
+SGeometryBlock* FindGeometryBlock( const SGeometryKey& key )
+{
+	map<SGeometryKey, SGeometryBlock*>::iterator stored = GeometryStore.find( key );
+	if (stored == GeometryStore.end())
+	{
+		return NULL;
+	}
+	++stored->second->refCount;
+	++GeometryBlocksUsed;
+	GeometryBytesUsed += key.bytes;
+	return stored->second;
+}
+
+// Store a buffer holding the data with the given key, adding a reference for the caller. The store
+// takes over the buffer. If a block with the key has been stored since the buffer was created (e.g.
+// by another background load), the buffer is released and that block returned instead. The buffer
+// is NULL for material data, which the caller adds to a new block
+SGeometryBlock* AddGeometryBlock( const SGeometryKey& key, IDirect3DResource9* buffer )
+{
+	SGeometryBlock* block = FindGeometryBlock( key );
+	if (block != NULL)
+	{
+		if (buffer != NULL)
+		{
+			buffer->Release();
+		}
+		return block;
+	}
+
+	block = new SGeometryBlock;
+	block->key = key;
+	block->buffer = buffer;
+	block->material = NULL;
+	block->refCount = 1;
+	GeometryStore[key] = block;
+	++GeometryBlocksUsed;
+	GeometryBytesUsed += key.bytes;
+	GeometryBytesStored += key.bytes;
+	return block;
+}
+
+// Release a reference to a block, removing it from the store and releasing its buffer or material
+// if it was the last. Does nothing if the block is NULL
+void ReleaseGeometryBlock( SGeometryBlock* block )
+{
+	if (block == NULL)
+	{
+		return;
+	}
+	--GeometryBlocksUsed;
+	GeometryBytesUsed -= block->key.bytes;
+	if (--block->refCount == 0)
+	{
+		GeometryStore.erase( block->key );
+		GeometryBytesStored -= block->key.bytes;
+		if (block->buffer != NULL)
+		{
+			block->buffer->Release();
+		}
+		delete block->material;
+		delete block;
+	}
+}
+
+
+// Create a vertex buffer of the given size. Returns false on failure
+bool CreateVertexBuffer( unsigned int bytes, LPDIRECT3DVERTEXBUFFER9* vertexBuffer )
+{
+	*vertexBuffer = NULL;
+	return SUCCEEDED(g_pd3dDevice->CreateVertexBuffer( bytes, D3DUSAGE_WRITEONLY, 0,
+	                                                   D3DPOOL_DEFAULT, vertexBuffer, NULL ));
+}
+
+// Create an index buffer of the given size for indices of the given size into the given number of
+// vertices. 4-byte (DWORD) indices must be supported by the device. Returns false on failure
+bool CreateIndexBuffer( unsigned int bytes, unsigned int indexSize, unsigned int numVertices,
+                        LPDIRECT3DINDEXBUFFER9* indexBuffer )
+{
+	*indexBuffer = NULL;
+	if (indexSize == sizeof(DWORD))
+	{
+		D3DCAPS9 caps;
+		g_pd3dDevice->GetDeviceCaps( &caps );
+		if (caps.MaxVertexIndex < numVertices - 1)
+		{
+			return false;
+		}
+	}
+	return SUCCEEDED(g_pd3dDevice->CreateIndexBuffer( bytes, D3DUSAGE_WRITEONLY,
+	                                                  IndexFormat( indexSize ), D3DPOOL_DEFAULT,
+	                                                  indexBuffer, NULL ));
+}
+
+
+// Get the stored block holding the given vertex data, or create a vertex buffer, copy the data in
+// and store it. A reference is added for the caller. Returns NULL on failure
+SGeometryBlock* StoreVertexData( const void* vertices, const SGeometryKey& key )
+{
+	SGeometryBlock* block = FindGeometryBlock( key );
+	if (block != NULL)
+	{
+		return block;
+	}
+
+	LPDIRECT3DVERTEXBUFFER9 vertexBuffer;
+	if (!CreateVertexBuffer( key.bytes, &vertexBuffer ))
+	{
+		return NULL;
+	}
+
+	// "Lock" the vertex buffer so we can write to it, copy the vertex data, then unlock the buffer
+	// again so it can be used for rendering
+	void* bufferData;
+	if (FAILED(vertexBuffer->Lock( 0, key.bytes, (void**)&bufferData, 0 )))
+	{
+		vertexBuffer->Release();
+		return NULL;
+	}
+	memcpy( bufferData, vertices, key.bytes );
+	vertexBuffer->Unlock();
+
+	return AddGeometryBlock( key, vertexBuffer );
+}
+
+// Get the stored block holding the given index data, or create an index buffer, copy the data in
+// and store it. The indices refer to the given number of vertices. A reference is added for the
+// caller. Returns NULL on failure
+SGeometryBlock* StoreIndexData( const void* indices, const SGeometryKey& key,
+                                unsigned int numVertices )
+{
+	SGeometryBlock* block = FindGeometryBlock( key );
+	if (block != NULL)
+	{
+		return block;
+	}
+
+	LPDIRECT3DINDEXBUFFER9 indexBuffer;
+	if (!CreateIndexBuffer( key.bytes, key.stride, numVertices, &indexBuffer ))
+	{
+		return NULL;
+	}
+
+	// Lock, copy and unlock as for vertex data above
+	void* bufferData;
+	if (FAILED(indexBuffer->Lock( 0, key.bytes, (void**)&bufferData, 0 )))
+	{
+		indexBuffer->Release();
+		return NULL;
+	}
+	memcpy( bufferData, indices, key.bytes );
+	indexBuffer->Unlock();
+
+	return AddGeometryBlock( key, indexBuffer );
+}
+
+// Get the stored block holding the given material, or store a copy of it. A reference is added for
+// the caller
+SGeometryBlock* StoreMaterial( const CMesh::SMaterial& material, const SGeometryKey& key )
+{
+	SGeometryBlock* block = FindGeometryBlock( key );
+	if (block == NULL)
+	{
+		block = AddGeometryBlock( key, NULL );
+		block->material = new CMesh::SMaterial( material );
+	}
+	return block;
+}
+
+
+// Get statistics of the blocks of vertex and index data in the geometry store
+void CMesh::GetGeometryStats( SGeometryStats* stats )
+{
+	stats->numBlocksUsed = GeometryBlocksUsed;
+	stats->numBlocksStored = static_cast<unsigned int>(GeometryStore.size());
+	stats->bytesUsed = GeometryBytesUsed;
+	stats->bytesStored = GeometryBytesStored;
+	stats->sharingRatio = (GeometryBytesStored > 0) ?
+		static_cast<float>(GeometryBytesUsed) / static_cast<float>(GeometryBytesStored) : 1.0f;
+}
+
+
+/////////////////////////////
+// Mesh Geometry
+
+// Geometry of the sub-meshes read from one mesh in a file (or all of a created mesh) in system
+// memory - their vertex and index data gathered into single blocks, ready to be looked up in the
+// geometry store, and the index in the file and hash of the mesh they came from (together they
+// identify the part, as meshes with equal data have equal hashes). Indices are gathered as 4-byte
+// values, then packed into the index data by FinishGeometry - as 2-byte values unless a sub-mesh
+// needs 4-byte indices. A part that is kept (unchanged when reloading) has no data, the blocks
+// the mesh already uses for it are kept instead, but the sizes of its data are still counted so
+// its sub-mesh ranges are the same. The part holds references to the blocks found or stored for
+// it, and the buffers its data is being uploaded to in a background load
+struct SGeometryPart
+{
+	vector<gen::TUInt8>     vertexData;
+	unsigned int            vertexBytes;
+	unsigned int            numVertices; // Range of vertex indices used by the sub-meshes
+	vector<gen::TUInt32>    indices;
+	unsigned int            numIndices;
+	vector<gen::TUInt8>     indexData;
+	unsigned int            indexSize;
+	unsigned int            sourceMesh;
+	unsigned int            sourceHash;
+	bool                    kept;
+	SGeometryKey            vertexKey;
+	SGeometryKey            indexKey;
+	SGeometryBlock*         vertexBlock;
+	SGeometryBlock*         indexBlock;
+	LPDIRECT3DVERTEXBUFFER9 vertexBuffer;
+	LPDIRECT3DINDEXBUFFER9  indexBuffer;
+
+	SGeometryPart() : vertexBytes( 0 ), numVertices( 0 ), numIndices( 0 ),
+	                  indexSize( sizeof(WORD) ), sourceMesh( 0 ), sourceHash( 0 ), kept( false ),
+	                  vertexBlock( NULL ), indexBlock( NULL ), vertexBuffer( NULL ),
+	                  indexBuffer( NULL ) {}
+};
+
+// Geometry for a mesh in system memory - its parts, the sub-mesh ranges with their materials and
+// the materials' keys in the geometry store (the ranges' material pointers are set when the
+// materials are stored), meshlets, hierarchies for ray queries (one for each sub-mesh, NULL if not
+// built), bounds and the hashes of the meshes in the file it came from, indexed by their position
+// in the file. When reloading, a part is not gathered if its mesh has the same hash at the same
+// index in the given hashes to keep. References to blocks and buffers not taken by a mesh are
+// released with the geometry
+struct SMeshGeometry
+{
+	vector<SGeometryPart>        parts;
+	vector<CMesh::SSubMeshRange> subMeshes;
+	vector<CMesh::SMaterial>     materials;
+	vector<SGeometryKey>         materialKeys;
+	vector<gen::SMeshlet>        meshlets;
+	vector<gen::CMeshBVH*>       bvhs;
+	gen::SMeshBounds             bounds;
+	vector<unsigned int>         sourceHashes;
+	vector<unsigned int>         keepHashes;
+
+	SMeshGeometry()
+	{
+		gen::ClearBounds( &bounds );
+	}
+	~SMeshGeometry()
+	{
+		for (unsigned int part = 0; part < parts.size(); ++part)
+		{
+			ReleaseGeometryBlock( parts[part].indexBlock );
+			ReleaseGeometryBlock( parts[part].vertexBlock );
+			SAFE_RELEASE( parts[part].indexBuffer );
+			SAFE_RELEASE( parts[part].vertexBuffer );
+		}
+		for (unsigned int bvh = 0; bvh < bvhs.size(); ++bvh)
+		{
+			delete bvhs[bvh];
+		}
+	}
+};
+
+
+// Add a sub-mesh from an imported file to the given geometry, with the render method, texture and
+// colour of its material. Sub-meshes split from one mesh in the file share its index and source
+// hash (see gen::CImportXFile::GetSubMeshSourceMesh / GetSubMeshSourceHash) and are added to one
+// part for that mesh. Sub-meshes with no faces are skipped. Returns false on failure
+bool AddSubMeshGeometry( gen::CImportXFile& importFile, unsigned int subMesh,
+                         bool buildBVH, SMeshGeometry* geometry )
+{
+	// Record the hashes of the meshes in the file by index, as a hash-only import would give them.
+	// A mesh that gives no sub-meshes is left with a zero hash, so it does not match when reloading
+	unsigned int sourceMesh = importFile.GetSubMeshSourceMesh( subMesh );
+	unsigned int sourceHash = importFile.GetSubMeshSourceHash( subMesh );
+	if (sourceMesh >= geometry->sourceHashes.size())
+	{
+		geometry->sourceHashes.resize( sourceMesh + 1, 0 );
+	}
+	geometry->sourceHashes[sourceMesh] = sourceHash;
+
+	// Get the sub-mesh specification to size its data
+	gen::SSubMesh spec;
+	importFile.GetSubMeshSpec( subMesh, &spec );
+	if (spec.numVertices == 0 || spec.numFaces == 0)
+	{
+		return true;
+	}
+
+	// Find the part for this mesh in the file, or start one. The part is kept if the mesh in the
+	// file at the same index had the same hash when the mesh was last loaded
+	unsigned int partIndex = 0;
+	while (partIndex < geometry->parts.size() &&
+	       geometry->parts[partIndex].sourceMesh != sourceMesh)
+	{
+		++partIndex;
+	}
+	if (partIndex == geometry->parts.size())
+	{
+		geometry->parts.push_back( SGeometryPart() );
+		geometry->parts.back().sourceMesh = sourceMesh;
+		geometry->parts.back().sourceHash = sourceHash;
+		geometry->parts.back().kept = sourceMesh < geometry->keepHashes.size() &&
+		                              geometry->keepHashes[sourceMesh] == sourceHash;
+	}
+	SGeometryPart& part = geometry->parts[partIndex];
+
+	// Write the vertices after those already in the part. They start at a multiple of the vertex
+	// size so the indices can be offset by a whole number of vertices to reach them. Only the sizes
+	// are counted for a kept part
+	unsigned int firstVertex = (part.vertexBytes + spec.vertexSize - 1) / spec.vertexSize;
+	unsigned int firstIndex = part.numIndices;
+	unsigned int numIndices = spec.numFaces * 3;
+	part.vertexBytes = (firstVertex + spec.numVertices) * spec.vertexSize;
+	part.numVertices = firstVertex + spec.numVertices;
+	part.numIndices = firstIndex + numIndices;
+	if (!part.kept)
+	{
+		part.vertexData.resize( part.vertexBytes );
+		vector<gen::TUInt8> faceData( numIndices * spec.indexSize );
+		gen::TUInt8* vertices = &part.vertexData[firstVertex * spec.vertexSize];
+		if (importFile.GetSubMeshData( subMesh, &spec, vertices, &faceData[0] ) != gen::kSuccess)
+		{
+			return false;
+		}
+
+		// Gather the indices as 4-byte values
+		part.indices.resize( part.numIndices );
+		if (spec.indexSize == sizeof(DWORD))
+		{
+			memcpy( &part.indices[firstIndex], &faceData[0], numIndices * sizeof(DWORD) );
+			part.indexSize = sizeof(DWORD);
+		}
+		else
+		{
+			const WORD* faceIndices = reinterpret_cast<const WORD*>(&faceData[0]);
+			for (unsigned int index = 0; index < numIndices; ++index)
+			{
+				part.indices[firstIndex + index] = faceIndices[index];
+			}
+		}
+	}
+
+	// Describe the sub-mesh - its material, vertex format and ranges of its part's data
+	CMesh::SMaterial material;
+	gen::SMeshMaterial meshMaterial;
+	importFile.GetMaterial( spec.material, &meshMaterial );
+	material.renderMethod = meshMaterial.renderMethod;
+	material.textureName = (meshMaterial.numTextures > 0) ?
+	                       importFile.GetName( meshMaterial.textureFileNames[0] ) : "";
+	const gen::SColourRGBA& colour = meshMaterial.diffuseColour;
+	material.diffuseColour = D3DXCOLOR( colour.r, colour.g, colour.b, colour.a );
+	geometry->materials.push_back( material );
+
+	CMesh::SSubMeshRange range;
+	range.material = NULL;
+	range.vertexFVF = SubMeshFVF( spec );
+	range.vertexSize = spec.vertexSize;
+	range.part = partIndex;
+	range.firstVertex = firstVertex;
+	range.numVertices = spec.numVertices;
+	range.numLODs = (spec.numLODs < CMesh::MaxLODs) ? spec.numLODs : CMesh::MaxLODs;
+	for (unsigned int lod = 0; lod < range.numLODs; ++lod)
+	{
+		range.lods[lod].startIndex = firstIndex + spec.lods[lod].firstFace * 3;
+		range.lods[lod].numIndices = spec.lods[lod].numFaces * 3;
+		range.lods[lod].numVertices = spec.lods[lod].numVertices;
+		range.lods[lod].error = spec.lods[lod].error;
+	}
+
+	// Meshlet faces are counted from the start of the part's index data
+	range.firstMeshlet = static_cast<unsigned int>(geometry->meshlets.size());
+	range.numMeshlets = spec.numMeshlets;
+	geometry->meshlets.resize( range.firstMeshlet + range.numMeshlets );
+	if (range.numMeshlets > 0)
+	{
+		importFile.GetSubMeshMeshlets( subMesh, &geometry->meshlets[range.firstMeshlet] );
+		for (unsigned int meshlet = 0; meshlet < range.numMeshlets; ++meshlet)
+		{
+			geometry->meshlets[range.firstMeshlet + meshlet].firstFace += firstIndex / 3;
+		}
+	}
+	geometry->subMeshes.push_back( range );
+
+	geometry->bvhs.push_back( buildBVH ? new gen::CMeshBVH( importFile.GetSubMeshBVH( subMesh ) ) :
+	                                     NULL );
+	gen::MergeBounds( &geometry->bounds, spec.bounds );
+	return true;
+}
+
+// Pack the gathered indices of each part of the given geometry (except kept parts) into its index
+// data and make the keys of its vertex and index data, and of its materials, in the geometry
+// store. Returns false if the geometry has no sub-meshes
+bool FinishGeometry( SMeshGeometry* geometry )
+{
+	if (geometry->subMeshes.empty())
+	{
+		return false;
+	}
+
+	geometry->materialKeys.resize( geometry->materials.size() );
+	for (unsigned int material = 0; material < geometry->materials.size(); ++material)
+	{
+		geometry->materialKeys[material] = MakeMaterialKey( geometry->materials[material] );
+	}
+
+	for (unsigned int partIndex = 0; partIndex < geometry->parts.size(); ++partIndex)
+	{
+		SGeometryPart& part = geometry->parts[partIndex];
+		if (part.kept)
+		{
+			continue;
+		}
+
+		unsigned int numIndices = static_cast<unsigned int>(part.indices.size());
+		part.indexData.resize( numIndices * part.indexSize );
+		if (part.indexSize == sizeof(DWORD))
+		{
+			memcpy( &part.indexData[0], &part.indices[0], numIndices * sizeof(DWORD) );
+		}
+		else
+		{
+			WORD* indices = reinterpret_cast<WORD*>(&part.indexData[0]);
+			for (unsigned int index = 0; index < numIndices; ++index)
+			{
+				indices[index] = static_cast<WORD>(part.indices[index]);
+			}
+		}
+		vector<gen::TUInt32>().swap( part.indices );
+
+		// The vertex data may hold several vertex formats, so its key is only given by its
+		// contents
+		part.vertexKey = MakeGeometryKey( &part.vertexData[0],
+		                                  static_cast<unsigned int>(part.vertexData.size()), 0, 0 );
+		part.indexKey = MakeGeometryKey( &part.indexData[0],
+		                                 static_cast<unsigned int>(part.indexData.size()),
+		                                 IndexFormat( part.indexSize ), part.indexSize );
+	}
+	return true;
+}
+
+// Get the stored blocks holding the vertex and index data of each part of the given geometry, or
+// create and store them. The parts hold references to the blocks. Returns false on failure
+bool StoreGeometry( SMeshGeometry* geometry )
+{
+	for (unsigned int partIndex = 0; partIndex < geometry->parts.size(); ++partIndex)
+	{
+		SGeometryPart& part = geometry->parts[partIndex];
+		part.vertexBlock = StoreVertexData( &part.vertexData[0], part.vertexKey );
+		if (part.vertexBlock == NULL)
+		{
+			return false;
+		}
+		part.indexBlock = StoreIndexData( &part.indexData[0], part.indexKey, part.numVertices );
+		if (part.indexBlock == NULL)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+// Mesh constructor, used by the creation functions below
+CMesh::CMesh()
+{
+	// Initialise member variables
+	m_RefCount = 1;
+
+	m_NumLODs = 0;
+
+	m_Meshlets = NULL;
+	m_NumMeshlets = 0;
+	m_BoundsRadius = -1.0f;
+
+	m_HasGeometry = false;
+	m_Version = 0;
+	m_LoadRequest = NULL;
+
+	m_LoadLODs = 0;
+	m_LoadMeshlets = false;
+	m_LoadBVH = false;
+	m_FileChanged = false;
+	m_FileChangeTime = 0;
+}
+
+// Mesh destructor, called when the last reference is released
+CMesh::~CMesh()
+{
+	ReleaseResources();
+	UnwatchFile();
+	if (!m_CacheKey.empty())
+	{
+		MeshCache.erase( m_CacheKey );
+	}
+}
+
+// Release the geometry and stop any background load, the loader will discard it
+void CMesh::ReleaseResources()
+{
+	CancelLoad();
+
+	// Release resources (where necessary) - cleared so they are not released again if the mesh is
+	// reloaded
+	ReleaseBlocks();
+	m_SourceHashes.clear();
+	m_SubMeshes.clear();
+	m_NumLODs = 0;
+	delete[] m_Meshlets;
+	m_Meshlets = NULL;
+	m_NumMeshlets = 0;
+	for (unsigned int bvh = 0; bvh < m_BVHs.size(); ++bvh)
+	{
+		delete m_BVHs[bvh];
+	}
+	m_BVHs.clear();
+	m_BoundsRadius = -1.0f;
+	m_HasGeometry = false;
+}
+
+
+/////////////////////////////
+// Creation / Reference Counting
+
+// Get the cached mesh for a file and options, creating an empty one if not cached. A reference is
+// added for the caller
+CMesh* CMesh::GetCachedMesh( const string& fileName, unsigned int numLODs, bool meshlets,
+                             bool rayQueries )
+{
+	// The key combines the normalised file name with the options that affect the geometry
+	string normalisedName = NormaliseFileName( fileName );
+	ostringstream key;
+	key << normalisedName << '|' << numLODs << '|' << meshlets << '|' << rayQueries;
+
+	map<string, CMesh*>::iterator cached = MeshCache.find( key.str() );
+	if (cached != MeshCache.end())
+	{
+		cached->second->AddRef();
+		return cached->second;
+	}
+
+	// Create a new mesh and watch its file for changes
+	CMesh* mesh = new CMesh;
+	mesh->m_CacheKey = key.str();
+	mesh->m_FileName = normalisedName;
+	mesh->m_LoadLODs = numLODs;
+	mesh->m_LoadMeshlets = meshlets;
+	mesh->m_LoadBVH = rayQueries;
+	mesh->WatchFile();
+	MeshCache[mesh->m_CacheKey] = mesh;
+	return mesh;
+}
+
+
+// Get the mesh for a file, loading it if not already cached. A mesh that is still loading in the
+// background is loaded immediately instead, as is one that previously failed to load
+CMesh* CMesh::Load( const string& fileName, unsigned int numLODs /*= 0*/,
+                    bool meshlets /*= false*/, bool rayQueries /*= false*/ )
+{
+	CMesh* mesh = GetCachedMesh( fileName, numLODs, meshlets, rayQueries );
+	if (!mesh->m_HasGeometry)
+	{
+		mesh->LoadFile();
+	}
+	return mesh;
+}
+
+// Create a mesh from arrays of vertices and indices. The mesh is not cached. Returns NULL on
+// failure
+CMesh* CMesh::Create
+(
+	void*        vertices,   // Pointer to vertex array (void* because we allow custom types)
+	unsigned int numVertices,// Number of vertices in the mesh
+	DWORD        vertexFVF,  // DirectX FVF code describing the vertex format (look up D3DFVF)
+	WORD*        indices,    // Pointer to index array (assuming 2-byte values, WORD in DirectX)
+	unsigned int numIndices  // Number of indices in the mesh
+)
+{
+	// Single sub-mesh with a single level of detail. There is no material, so use the importer's
+	// default method for an untextured material, in white
+	SMeshGeometry geometry;
+	CMesh::SMaterial material;
+	material.renderMethod = gen::PixelLit;
+	material.diffuseColour = D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f );
+	geometry.materials.push_back( material );
+	CMesh::SSubMeshRange range;
+	range.material = NULL;
+	range.vertexFVF = vertexFVF;
+	range.vertexSize = D3DXGetFVFVertexSize( vertexFVF ); // Size of a single vertex from the FVF
+	range.part = 0;
+	range.firstVertex = 0;
+	range.numVertices = numVertices;
+	range.numLODs = 1;
+	range.lods[0].startIndex = 0;
+	range.lods[0].numIndices = numIndices;
+	range.lods[0].numVertices = numVertices;
+	range.lods[0].error = 0.0f;
+	range.firstMeshlet = 0;
+	range.numMeshlets = 0;
+	geometry.subMeshes.push_back( range );
+	geometry.bvhs.push_back( NULL );
+
+	// Copy the vertex data and indices (assuming 2-byte (WORD) index data) into a single part
+	geometry.parts.push_back( SGeometryPart() );
+	SGeometryPart& part = geometry.parts.back();
+	const gen::TUInt8* vertexBytes = static_cast<const gen::TUInt8*>(vertices);
+	part.vertexData.assign( vertexBytes, vertexBytes + numVertices * range.vertexSize );
+	part.numVertices = numVertices;
+	part.indices.assign( indices, indices + numIndices );
+	if (part.vertexData.empty() || !FinishGeometry( &geometry ) || part.indexData.empty())
+	{
+		return NULL;
+	}
+
+	// Bounds of the vertex positions, which are first in every vertex format
+	gen::CalculateBounds( static_cast<gen::CVector3*>(vertices), numVertices, range.vertexSize,
+	                      &geometry.bounds );
+
+	// Store the data, sharing the buffers of any identical data already stored
+	if (!StoreGeometry( &geometry ))
+	{
+		return NULL;
+	}
+	CMesh* mesh = new CMesh;
+	mesh->SetGeometry( &geometry );
+	return mesh;
+}
+
+
+// Release a reference to the mesh, deleting it if it was the last
+void CMesh::Release()
+{
+	if (--m_RefCount == 0)
+	{
+		delete this;
+	}
+}
+
+
+/////////////////////////////
+// Mesh Loading
+
+// Load the mesh's file, replacing any current geometry. Cancels any background load. Each material
+// in the file becomes a sub-mesh. Sub-meshes are in model space - the transforms of the nodes
+// (frames) holding them are not applied
+bool CMesh::LoadFile()
+{
+	CancelLoad();
+
+	// Use CImportXFile class (from another application) to load the given file
+	// The import code is wrapped in the namespace 'gen'
+	gen::CImportXFile mesh;
+	gen::SImportOptions options;
+	options.iNumLODs = m_LoadLODs;
+	options.bBuildMeshlets = m_LoadMeshlets;
+	options.bBuildBVH = m_LoadBVH;
+	if (mesh.ImportFile( m_FileName.c_str(), options ) != gen::kSuccess)
+	{
+		return false;
+	}
+
+	// Gather all the sub-meshes into system memory so the data can be looked up in the geometry
+	// store, then store it, sharing the buffers of any identical data already stored
+	SMeshGeometry geometry;
+	for (unsigned int subMesh = 0; subMesh < mesh.GetNumSubMeshes(); ++subMesh)
+	{
+		if (!AddSubMeshGeometry( mesh, subMesh, m_LoadBVH, &geometry ))
+		{
+			return false;
+		}
+	}
+	if (!FinishGeometry( &geometry ) || !StoreGeometry( &geometry ))
+	{
+		return false;
+	}
+	SetGeometry( &geometry );
+	return true;
+}
+
+
+// Replace the current geometry with the given geometry, whose parts hold the blocks from the
+// geometry store with their vertex and index data. The mesh takes over the parts' references to
+// the blocks, and the geometry's sub-meshes and hierarchies
+void CMesh::SetGeometry( SMeshGeometry* geometry )
+{
+	ReleaseBlocks();
+	m_Parts.resize( geometry->parts.size() );
+	for (unsigned int part = 0; part < m_Parts.size(); ++part)
+	{
+		SGeometryPart& geometryPart = geometry->parts[part];
+		m_Parts[part].vertexBlock = geometryPart.vertexBlock;
+		m_Parts[part].indexBlock = geometryPart.indexBlock;
+		m_Parts[part].vertexBuffer =
+			static_cast<LPDIRECT3DVERTEXBUFFER9>(geometryPart.vertexBlock->buffer);
+		m_Parts[part].indexBuffer =
+			static_cast<LPDIRECT3DINDEXBUFFER9>(geometryPart.indexBlock->buffer);
+		m_Parts[part].sourceMesh = geometryPart.sourceMesh;
+		m_Parts[part].sourceHash = geometryPart.sourceHash;
+		geometryPart.vertexBlock = NULL;
+		geometryPart.indexBlock = NULL;
+	}
+	m_SourceHashes.swap( geometry->sourceHashes );
+	m_SubMeshes.swap( geometry->subMeshes );
+
+	// Share the materials of identical sub-meshes, in this mesh or any other
+	m_MaterialBlocks.resize( m_SubMeshes.size() );
+	for (unsigned int subMesh = 0; subMesh < m_SubMeshes.size(); ++subMesh)
+	{
+		m_MaterialBlocks[subMesh] = StoreMaterial( geometry->materials[subMesh],
+		                                           geometry->materialKeys[subMesh] );
+		m_SubMeshes[subMesh].material = m_MaterialBlocks[subMesh]->material;
+	}
+
+	// The mesh has as many levels of detail as its most detailed sub-mesh. The error of each level
+	// is the largest error of any sub-mesh at that level (or its lowest detail level if it has
+	// fewer)
+	m_NumLODs = 0;
+	for (unsigned int subMesh = 0; subMesh < m_SubMeshes.size(); ++subMesh)
+	{
+		m_NumLODs = max( m_NumLODs, m_SubMeshes[subMesh].numLODs );
+	}
+	for (unsigned int lod = 0; lod < m_NumLODs; ++lod)
+	{
+		m_LODErrors[lod] = 0.0f;
+		for (unsigned int subMesh = 0; subMesh < m_SubMeshes.size(); ++subMesh)
+		{
+			const SSubMeshRange& range = m_SubMeshes[subMesh];
+			float error = range.lods[(lod < range.numLODs) ? lod : range.numLODs - 1].error;
+			m_LODErrors[lod] = max( m_LODErrors[lod], error );
+		}
+	}
+
+	// Copy the meshlets, and take the hierarchies for ray queries
+	delete[] m_Meshlets;
+	m_Meshlets = NULL;
+	m_NumMeshlets = static_cast<unsigned int>(geometry->meshlets.size());
+	if (m_NumMeshlets > 0)
+	{
+		m_Meshlets = new gen::SMeshlet[m_NumMeshlets];
+		memcpy( m_Meshlets, &geometry->meshlets[0], m_NumMeshlets * sizeof(gen::SMeshlet) );
+	}
+	for (unsigned int bvh = 0; bvh < m_BVHs.size(); ++bvh)
+	{
+		delete m_BVHs[bvh];
+	}
+	m_BVHs.swap( geometry->bvhs );
+	geometry->bvhs.clear();
+
+	SetBounds( geometry->bounds );
+	m_HasGeometry = true;
+	++m_Version;
+}
+
+// Release the references to the blocks of the mesh's parts and materials and remove them
+void CMesh::ReleaseBlocks()
+{
+	for (unsigned int part = 0; part < m_Parts.size(); ++part)
+	{
+		ReleaseGeometryBlock( m_Parts[part].indexBlock );
+		ReleaseGeometryBlock( m_Parts[part].vertexBlock );
+	}
+	m_Parts.clear();
+	for (unsigned int material = 0; material < m_MaterialBlocks.size(); ++material)
+	{
+		ReleaseGeometryBlock( m_MaterialBlocks[material] );
+	}
+	m_MaterialBlocks.clear();
+}
+
+// Copy the given bounds
+void CMesh::SetBounds( const gen::SMeshBounds& bounds )
+{
+	m_BoundsMin = D3DXVECTOR3( bounds.minBounds.x, bounds.minBounds.y, bounds.minBounds.z );
+	m_BoundsMax = D3DXVECTOR3( bounds.maxBounds.x, bounds.maxBounds.y, bounds.maxBounds.z );
+	m_BoundsCentre = D3DXVECTOR3( bounds.centre.x, bounds.centre.y, bounds.centre.z );
+	m_BoundsRadius = bounds.radius;
+}
+
+
+/////////////////////////////
+// Asynchronous Loading
+
+// A mesh load in progress. Requests are queued by LoadAsync, prepared by the loader thread, then
+// copied into buffers by UploadLoadedMeshes
+struct SMeshLoadRequest
+{
+	// Mesh being loaded, set to NULL if the load is cancelled. Guarded by LoaderLock while the
+	// request is queued
+	CMesh*              mesh;
+
+	// Load parameters. A reload replaces the mesh's geometry, but is skipped if the hashes of the
+	// meshes in the file are unchanged, and keeps the parts of meshes whose hash is unchanged
+	string              fileName;
+	unsigned int        numLODs;
+	bool                buildMeshlets;
+	bool                buildBVH;
+	bool                reload;
+
+	// Results from the loader thread - the geometry of all the sub-meshes, passed on to the mesh
+	// on upload. The hashes of the meshes in the file are the mesh's current ones, compared with
+	// the file's when reloading
+	bool                succeeded;
+	bool                unchanged;
+	SMeshGeometry       geometry;
+	vector<unsigned int> sourceHashes;
+
+	// The part being uploaded, whether its data has been looked up in the geometry store yet and
+	// the bytes of it copied so far, vertex data first then index data. Each part holds the blocks
+	// already in the geometry store with the same vertex / index data (or the mesh's blocks if
+	// kept), which is then not uploaded, or the buffers the data is uploaded to, stored once all
+	// parts are complete
+	unsigned int        uploadPart;
+	bool                partFound;
+	unsigned int        bytesUploaded;
+};
+
+// Loader thread and queues of requests. Requests wait in the pending queue for the loader thread,
+// then in the loaded queue for upload. The queues are guarded by the critical section and the
+// semaphore counts the pending requests
+HANDLE                     LoaderThreadHandle = NULL;
+HANDLE                     LoaderSemaphore = NULL;
+CRITICAL_SECTION           LoaderLock;
+volatile bool              LoaderShutDown;
+deque<SMeshLoadRequest*>   PendingLoads;
+deque<SMeshLoadRequest*>   LoadedMeshes;
+
+// Time of the upload calls since the statistics were last read, only used on the rendering thread.
+// Calls longer than the slow time are counted, the target is to keep all calls under it
+const double               SlowUploadMilliseconds = 1.0;
+CMesh::SUploadStats        UploadStats = CMesh::SUploadStats();
+
+
+// Add a sub-mesh streamed from a file to the geometry of a load request. Called by the importer as
+// each sub-mesh is ready, so each mesh in the file is freed as soon as it has been gathered
+void StreamLoadRequest( gen::CImportXFile& importFile, gen::TUInt32 subMesh,
+                        gen::TUInt32 /*streamIndex*/, void* data )
+{
+	SMeshLoadRequest* request = static_cast<SMeshLoadRequest*>(data);
+	if (request->succeeded &&
+	    !AddSubMeshGeometry( importFile, subMesh, request->buildBVH, &request->geometry ))
+	{
+		request->succeeded = false;
+	}
+}
+
+// Read and prepare the mesh for a load request - the slow part of loading, called on the loader
+// thread. The mesh data is written to system memory ready for upload
+void PrepareLoadRequest( SMeshLoadRequest* request )
+{
+	request->succeeded = false;
+
+	// A reload is not needed if the data of every mesh in the file is unchanged (e.g. only the
+	// file's formatting was edited) - hashing the file is much quicker than importing it. Otherwise
+	// the meshes whose hash is unchanged at the same index in the file keep the mesh's current
+	// parts, so their data is neither gathered nor uploaded again
+	if (request->reload)
+	{
+		gen::CImportXFile hashFile;
+		gen::SImportOptions hashOptions;
+		hashOptions.bHashOnly = true;
+		if (hashFile.ImportFile( request->fileName.c_str(), hashOptions ) == gen::kSuccess)
+		{
+			// After a hash-only import there is one sub-mesh for each mesh in the file, in order
+			vector<unsigned int> hashes( hashFile.GetNumSubMeshes() );
+			for (unsigned int subMesh = 0; subMesh < hashFile.GetNumSubMeshes(); ++subMesh)
+			{
+				hashes[subMesh] = hashFile.GetSubMeshSourceHash( subMesh );
+			}
+			if (hashes == request->sourceHashes)
+			{
+				request->unchanged = true;
+				request->succeeded = true;
+				return;
+			}
+		}
+		request->geometry.keepHashes = request->sourceHashes;
+	}
+
+	// Import the file with the same options as CMesh::LoadFile, streaming the sub-meshes so only
+	// one mesh from the file is held in memory at a time, as well as the geometry gathered. The
+	// data is hashed here, off the rendering thread, to look it up in the geometry store on upload
+	gen::CImportXFile mesh;
+	gen::SImportOptions options;
+	options.iNumLODs = request->numLODs;
+	options.bBuildMeshlets = request->buildMeshlets;
+	options.bBuildBVH = request->buildBVH;
+	options.pfnSubMeshCallback = StreamLoadRequest;
+	options.pSubMeshCallbackData = request;
+	request->succeeded = true;
+	if (mesh.ImportFile( request->fileName.c_str(), options ) != gen::kSuccess ||
+	    !request->succeeded || !FinishGeometry( &request->geometry ))
+	{
+		request->succeeded = false;
+	}
+}
+
+// Loader thread function, prepares requests from the pending queue until shut down
+unsigned int __stdcall LoaderThread( void* )
+{
+	while (true)
+	{
+		// Wait for a request (or shut down)
+		WaitForSingleObject( LoaderSemaphore, INFINITE );
+		if (LoaderShutDown)
+		{
+			break;
+		}
+		EnterCriticalSection( &LoaderLock );
+		SMeshLoadRequest* request = PendingLoads.front();
+		PendingLoads.pop_front();
+		bool cancelled = (request->mesh == NULL);
+		LeaveCriticalSection( &LoaderLock );
+
+		// Prepare the mesh unless cancelled while waiting. Errors in the import code are thrown as
+		// exceptions, which must not leave the thread
+		if (!cancelled)
+		{
+			try
+			{
+				PrepareLoadRequest( request );
+			}
+			catch (...)
+			{
+				request->succeeded = false;
+			}
+		}
+
+		// Pass on for upload, or discard if cancelled
+		EnterCriticalSection( &LoaderLock );
+		if (request->mesh != NULL)
+		{
+			LoadedMeshes.push_back( request );
+			request = NULL;
+		}
+		LeaveCriticalSection( &LoaderLock );
+		delete request;
+	}
+
+	return 0;
+}
+
+
+// Start the worker thread that loads meshes in the background
+bool CMesh::StartLoader()
+{
+	LoaderShutDown = false;
+	LoaderSemaphore = CreateSemaphore( NULL, 0, LONG_MAX, NULL );
+	if (LoaderSemaphore == NULL)
+	{
+		return false;
+	}
+	InitializeCriticalSection( &LoaderLock );
+
+	LoaderThreadHandle =
+		reinterpret_cast<HANDLE>(_beginthreadex( NULL,         // Default security attributes
+		                                         0,            // Default stack size
+		                                         LoaderThread, // Thread entry function
+		                                         NULL,         // Data to initialise thread
+		                                         0,            // Initial thread state (0 = running)
+		                                         NULL ));      // Thread UID, not needed here
+	if (LoaderThreadHandle == NULL)
+	{
+		DeleteCriticalSection( &LoaderLock );
+		CloseHandle( LoaderSemaphore );
+		LoaderSemaphore = NULL;
+		return false;
+	}
+	return true;
+}
+
+// Stop the loader thread, cancelling any loads in progress
+void CMesh::StopLoader()
+{
+	if (LoaderThreadHandle == NULL)
+	{
+		return;
+	}
+
+	// Signal the thread to finish and wait for it - it will complete the current request first
+	LoaderShutDown = true;
+	ReleaseSemaphore( LoaderSemaphore, 1, NULL );
+	WaitForSingleObject( LoaderThreadHandle, INFINITE );
+	CloseHandle( LoaderThreadHandle );
+	CloseHandle( LoaderSemaphore );
+	LoaderThreadHandle = NULL;
+	LoaderSemaphore = NULL;
+
+	// Discard remaining requests, including buffers of those part way through upload. Meshes keep
+	// any geometry they already had
+	PendingLoads.insert( PendingLoads.end(), LoadedMeshes.begin(), LoadedMeshes.end() );
+	LoadedMeshes.clear();
+	while (!PendingLoads.empty())
+	{
+		SMeshLoadRequest* request = PendingLoads.front();
+		PendingLoads.pop_front();
+		if (request->mesh != NULL)
+		{
+			request->mesh->m_LoadRequest = NULL;
+		}
+		delete request;
+	}
+	DeleteCriticalSection( &LoaderLock );
+}
+
+
+// Get the mesh for a file, loading it in the background if not already cached or loading. Also
+// retries a background load of a mesh that previously failed to load
+CMesh* CMesh::LoadAsync( const string& fileName, unsigned int numLODs /*= 0*/,
+                         bool meshlets /*= false*/, bool rayQueries /*= false*/ )
+{
+	if (LoaderThreadHandle == NULL)
+	{
+		return NULL;
+	}
+	CMesh* mesh = GetCachedMesh( fileName, numLODs, meshlets, rayQueries );
+	if (!mesh->m_HasGeometry && mesh->m_LoadRequest == NULL)
+	{
+		mesh->QueueLoad( false );
+	}
+	return mesh;
+}
+
+// Queue a background load of the mesh's file. A reload keeps the current geometry until the new
+// geometry is ready
+bool CMesh::QueueLoad( bool reload )
+{
+	if (LoaderThreadHandle == NULL)
+	{
+		return false;
+	}
+
+	// A mesh without geometry is always fully loaded
+	SMeshLoadRequest* request = new SMeshLoadRequest;
+	request->mesh = this;
+	request->fileName = m_FileName;
+	request->numLODs = m_LoadLODs;
+	request->buildMeshlets = m_LoadMeshlets;
+	request->buildBVH = m_LoadBVH;
+	request->reload = reload && m_HasGeometry;
+	request->succeeded = false;
+	request->unchanged = false;
+	if (request->reload)
+	{
+		request->sourceHashes = m_SourceHashes;
+	}
+	request->uploadPart = 0;
+	request->partFound = false;
+	request->bytesUploaded = 0;
+	m_LoadRequest = request;
+
+	EnterCriticalSection( &LoaderLock );
+	PendingLoads.push_back( request );
+	LeaveCriticalSection( &LoaderLock );
+	ReleaseSemaphore( LoaderSemaphore, 1, NULL );
+	return true;
+}
+
+// Cancel any background load in progress. The request is deleted by whichever thread holds it
+void CMesh::CancelLoad()
+{
+	if (m_LoadRequest == NULL)
+	{
+		return;
+	}
+	EnterCriticalSection( &LoaderLock );
+	m_LoadRequest->mesh = NULL;
+	LeaveCriticalSection( &LoaderLock );
+	m_LoadRequest = NULL;
+}
+
+
+// Create buffers for meshes loaded in the background and copy their geometry in, at most the
+// given number of bytes per call. The time of each call is added to the upload statistics
+void CMesh::UploadLoadedMeshes( unsigned int maxBytes /*= DefaultUploadBytes*/ )
+{
+	if (LoaderThreadHandle == NULL)
+	{
+		return;
+	}
+
+	gen::TUInt64 startTime = gen::GetTimeStamp();
+	UploadLoadedMeshData( maxBytes );
+	gen::TUInt64 ticks = gen::GetTimeStamp() - startTime;
+
+	float milliseconds = static_cast<float>(ticks * 1000.0 / gen::GetTimeStampFrequency());
+	++UploadStats.numCalls;
+	if (milliseconds > SlowUploadMilliseconds)
+	{
+		++UploadStats.numSlowCalls;
+	}
+	if (milliseconds > UploadStats.maxMilliseconds)
+	{
+		UploadStats.maxMilliseconds = milliseconds;
+	}
+	UploadStats.totalMilliseconds += milliseconds;
+}
+
+// Get the upload statistics since the last call, and reset them
+void CMesh::GetUploadStats( SUploadStats* stats )
+{
+	*stats = UploadStats;
+	UploadStats = SUploadStats();
+}
+
+// Upload for UploadLoadedMeshes. Meshes are uploaded in the order they finished loading. Creating
+// a buffer counts its size against the budget, as well as copying data into it
+void CMesh::UploadLoadedMeshData( unsigned int maxBytes )
+{
+	const unsigned int budget = maxBytes;
+	while (maxBytes > 0)
+	{
+		// Get the oldest loaded mesh - leave it in the queue until fully uploaded
+		EnterCriticalSection( &LoaderLock );
+		SMeshLoadRequest* request = LoadedMeshes.empty() ? NULL : LoadedMeshes.front();
+		LeaveCriticalSection( &LoaderLock );
+		if (request == NULL)
+		{
+			return;
+		}
+
+		// Upload the parts in turn. When the upload reaches a part, its data is looked up in the
+		// geometry store - kept parts take another reference to the blocks of the mesh's part for
+		// the same mesh in the file (with the same index and hash). Cancelled requests, failed
+		// loads and reloads of unchanged meshes finish here
+		CMesh* mesh = request->mesh;
+		SMeshGeometry& geometry = request->geometry;
+		bool finished = (mesh == NULL || !request->succeeded || request->unchanged);
+		while (!finished && maxBytes > 0 && request->uploadPart < geometry.parts.size())
+		{
+			SGeometryPart& part = geometry.parts[request->uploadPart];
+			if (!request->partFound)
+			{
+				request->partFound = true;
+				if (part.kept)
+				{
+					unsigned int meshPart = 0;
+					while (meshPart < mesh->m_Parts.size() &&
+					       (mesh->m_Parts[meshPart].sourceMesh != part.sourceMesh ||
+					        mesh->m_Parts[meshPart].sourceHash != part.sourceHash))
+					{
+						++meshPart;
+					}
+					if (meshPart == mesh->m_Parts.size())
+					{
+						finished = true;
+						break;
+					}
+					const SPart& meshPartData = mesh->m_Parts[meshPart];
+					part.vertexBlock = FindGeometryBlock( meshPartData.vertexBlock->key );
+					part.indexBlock = FindGeometryBlock( meshPartData.indexBlock->key );
+				}
+				else
+				{
+					part.vertexBlock = FindGeometryBlock( part.vertexKey );
+					part.indexBlock = FindGeometryBlock( part.indexKey );
+				}
+			}
+
+			// Create buffers for the part's data not already stored. Creation counts the size of
+			// the buffers against the budget, as the driver allocates that memory. The buffers
+			// wait for the next call if the budget left does not cover them, unless nothing has
+			// been uploaded yet in this call, so parts larger than the budget still progress
+			bool createVertices = (part.vertexBlock == NULL && part.vertexBuffer == NULL);
+			bool createIndices = (part.indexBlock == NULL && part.indexBuffer == NULL);
+			unsigned int createBytes = (createVertices ? part.vertexKey.bytes : 0) +
+			                           (createIndices ? part.indexKey.bytes : 0);
+			if (createBytes > 0)
+			{
+				if (createBytes > maxBytes && maxBytes < budget)
+				{
+					break;
+				}
+				if ((createVertices &&
+				     !CreateVertexBuffer( part.vertexKey.bytes, &part.vertexBuffer )) ||
+				    (createIndices &&
+				     !CreateIndexBuffer( part.indexKey.bytes, part.indexSize, part.numVertices,
+				                         &part.indexBuffer )))
+				{
+					finished = true;
+					break;
+				}
+				UploadStats.numBuffersCreated += (createVertices ? 1 : 0) + (createIndices ? 1 : 0);
+				maxBytes -= (createBytes < maxBytes) ? createBytes : maxBytes;
+				continue;
+			}
+
+			// Copy the next part of the data into the vertex buffer, then the index buffer - only
+			// the data not already stored
+			unsigned int vertexBytes = (part.vertexBuffer != NULL) ? part.vertexKey.bytes : 0;
+			unsigned int indexBytes = (part.indexBuffer != NULL) ? part.indexKey.bytes : 0;
+			if (request->bytesUploaded == vertexBytes + indexBytes)
+			{
+				++request->uploadPart;
+				request->bytesUploaded = 0;
+				request->partFound = false;
+				continue;
+			}
+
+			// Select the buffer and range to copy
+			bool vertices = (request->bytesUploaded < vertexBytes);
+			unsigned int offset = vertices ? request->bytesUploaded :
+			                                 request->bytesUploaded - vertexBytes;
+			unsigned int size = (vertices ? vertexBytes : indexBytes) - offset;
+			if (size > maxBytes)
+			{
+				size = maxBytes;
+			}
+			const gen::TUInt8* source = vertices ? &part.vertexData[offset] :
+			                                       &part.indexData[offset];
+
+			// Lock only the range being written, copy the data and unlock
+			void* bufferData;
+			HRESULT result = vertices ?
+				part.vertexBuffer->Lock( offset, size, (void**)&bufferData, 0 ) :
+				part.indexBuffer->Lock( offset, size, (void**)&bufferData, 0 );
+			if (FAILED(result))
+			{
+				finished = true;
+				break;
+			}
+			memcpy( bufferData, source, size );
+			if (vertices)
+			{
+				part.vertexBuffer->Unlock();
+			}
+			else
+			{
+				part.indexBuffer->Unlock();
+			}
+			request->bytesUploaded += size;
+			UploadStats.bytesCopied += size;
+			maxBytes -= size;
+		}
+
+		// Once all data is copied the new buffers are stored, and the new geometry replaces any the
+		// mesh had (when reloading), so the mesh is ready to render
+		if (!finished && request->uploadPart == geometry.parts.size())
+		{
+			for (unsigned int partIndex = 0; partIndex < geometry.parts.size(); ++partIndex)
+			{
+				SGeometryPart& part = geometry.parts[partIndex];
+				if (part.vertexBlock == NULL)
+				{
+					part.vertexBlock = AddGeometryBlock( part.vertexKey, part.vertexBuffer );
+					part.vertexBuffer = NULL;
+				}
+				if (part.indexBlock == NULL)
+				{
+					part.indexBlock = AddGeometryBlock( part.indexKey, part.indexBuffer );
+					part.indexBuffer = NULL;
+				}
+			}
+			mesh->SetGeometry( &geometry );
+			finished = true;
+		}
+		else if (!finished)
+		{
+			return; // Upload continues next call
+		}
+
+		// Remove the request. A failed load leaves the mesh with the geometry it had before (none
+		// unless reloading) and not loading
+		if (mesh != NULL)
+		{
+			mesh->m_LoadRequest = NULL;
+		}
+		EnterCriticalSection( &LoaderLock );
+		LoadedMeshes.pop_front();
+		LeaveCriticalSection( &LoaderLock );
+		delete request;
+	}
+}
+
+
+/////////////////////////////
+// Hot Reload
+
+// Watcher thread and the folders it watches. The folder list is guarded by the critical section,
+// the update event signals that folders have been added and the stop event shuts the thread down.
+// The thread sets the changed flag when anything in a watched folder changes
+HANDLE           WatcherThreadHandle = NULL;
+HANDLE           WatcherStopEvent = NULL;
+HANDLE           WatcherUpdateEvent = NULL;
+CRITICAL_SECTION WatcherLock;
+vector<string>   WatchedFolders;
+volatile LONG    WatchedFilesChanged = 0;
+
+// Meshes loaded from files, which are reloaded when their file changes. Only used on the
+// rendering thread
+vector<CMesh*>  FileMeshes;
+
+
+// Get the last write time of a file. Returns false if the file cannot be found
+bool GetFileWriteTime( const string& fileName, FILETIME* writeTime )
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA( fileName.c_str(), GetFileExInfoStandard, &attributes ))
+	{
+		return false;
+	}
+	*writeTime = attributes.ftLastWriteTime;
+	return true;
+}
+
+// Get the folder containing a file, including the final separator
+string GetFolder( const string& fileName )
+{
+	string::size_type separator = fileName.find_last_of( "\\/" );
+	return (separator == string::npos) ? ".\\" : fileName.substr( 0, separator + 1 );
+}
+
+// Add a folder to those watched by the watcher thread
+void WatchFolder( const string& folder )
+{
+	EnterCriticalSection( &WatcherLock );
+	if (find( WatchedFolders.begin(), WatchedFolders.end(), folder ) == WatchedFolders.end())
+	{
+		WatchedFolders.push_back( folder );
+		SetEvent( WatcherUpdateEvent );
+	}
+	LeaveCriticalSection( &WatcherLock );
+}
+
+
+// Watcher thread function, waits for changes in the watched folders and flags them for
+// ReloadChangedMeshes, which finds the files that changed. Runs until the stop event is set
+unsigned int __stdcall WatcherThread( void* )
+{
+	// Wait on the stop and update events, then a change notification for each watched folder
+	vector<HANDLE> handles;
+	handles.push_back( WatcherStopEvent );
+	handles.push_back( WatcherUpdateEvent );
+	unsigned int numFoldersWatched = 0;
+	while (true)
+	{
+		DWORD result = WaitForMultipleObjects( static_cast<DWORD>(handles.size()), &handles[0],
+		                                       FALSE, INFINITE );
+		if (result == WAIT_OBJECT_0 || result == WAIT_FAILED)
+		{
+			break;
+		}
+
+		// Folders added - start watching them (up to the limit of objects that can be waited on)
+		if (result == WAIT_OBJECT_0 + 1)
+		{
+			EnterCriticalSection( &WatcherLock );
+			while (numFoldersWatched < WatchedFolders.size() &&
+			       handles.size() < MAXIMUM_WAIT_OBJECTS)
+			{
+				const DWORD changes = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME |
+				                      FILE_NOTIFY_CHANGE_SIZE;
+				HANDLE notification =
+					FindFirstChangeNotificationA( WatchedFolders[numFoldersWatched].c_str(), FALSE,
+					                              changes );
+				if (notification != INVALID_HANDLE_VALUE)
+				{
+					handles.push_back( notification );
+				}
+				++numFoldersWatched;
+			}
+			LeaveCriticalSection( &WatcherLock );
+		}
+
+		// A folder has changed - flag it and continue watching
+		else
+		{
+			InterlockedExchange( &WatchedFilesChanged, 1 );
+			FindNextChangeNotification( handles[result - WAIT_OBJECT_0] );
+		}
+	}
+
+	for (unsigned int handle = 2; handle < handles.size(); ++handle)
+	{
+		FindCloseChangeNotification( handles[handle] );
+	}
+	return 0;
+}
+
+
+// Start watching the files of meshes loaded from files
+bool CMesh::StartHotReload()
+{
+	WatcherStopEvent = CreateEvent( NULL, TRUE, FALSE, NULL );
+	WatcherUpdateEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
+	if (WatcherStopEvent == NULL || WatcherUpdateEvent == NULL)
+	{
+		if (WatcherStopEvent != NULL) CloseHandle( WatcherStopEvent );
+		if (WatcherUpdateEvent != NULL) CloseHandle( WatcherUpdateEvent );
+		WatcherStopEvent = WatcherUpdateEvent = NULL;
+		return false;
+	}
+	InitializeCriticalSection( &WatcherLock );
+	WatchedFilesChanged = 0;
+
+	WatcherThreadHandle =
+		reinterpret_cast<HANDLE>(_beginthreadex( NULL,          // Default security attributes
+		                                         0,             // Default stack size
+		                                         WatcherThread, // Thread entry function
+		                                         NULL,          // Data to initialise thread
+		                                         0,             // Initial state (0 = running)
+		                                         NULL ));       // Thread UID, not needed here
+	if (WatcherThreadHandle == NULL)
+	{
+		DeleteCriticalSection( &WatcherLock );
+		CloseHandle( WatcherStopEvent );
+		CloseHandle( WatcherUpdateEvent );
+		WatcherStopEvent = WatcherUpdateEvent = NULL;
+		return false;
+	}
+
+	// Watch the files of meshes already loaded
+	for (unsigned int mesh = 0; mesh < FileMeshes.size(); ++mesh)
+	{
+		WatchFolder( GetFolder( FileMeshes[mesh]->m_FileName ) );
+	}
+	return true;
+}
+
+// Stop watching mesh files
+void CMesh::StopHotReload()
+{
+	if (WatcherThreadHandle == NULL)
+	{
+		return;
+	}
+
+	SetEvent( WatcherStopEvent );
+	WaitForSingleObject( WatcherThreadHandle, INFINITE );
+	CloseHandle( WatcherThreadHandle );
+	CloseHandle( WatcherStopEvent );
+	CloseHandle( WatcherUpdateEvent );
+	WatcherThreadHandle = NULL;
+	WatcherStopEvent = WatcherUpdateEvent = NULL;
+	DeleteCriticalSection( &WatcherLock );
+	WatchedFolders.clear();
+}
+
+
+// Reload meshes whose files have changed. A file must be left unchanged for a short time before
+// its mesh is reloaded, so each save is only loaded once
+void CMesh::ReloadChangedMeshes()
+{
+	if (WatcherThreadHandle == NULL)
+	{
+		return;
+	}
+
+	// When a watched folder has changed, find the mesh files whose write time has changed. A file
+	// changing again restarts the delay before it is reloaded
+	DWORD time = GetTickCount();
+	if (InterlockedExchange( &WatchedFilesChanged, 0 ) != 0)
+	{
+		for (unsigned int i = 0; i < FileMeshes.size(); ++i)
+		{
+			CMesh* mesh = FileMeshes[i];
+			FILETIME fileTime;
+			if (GetFileWriteTime( mesh->m_FileName, &fileTime ) &&
+			    CompareFileTime( &fileTime, &mesh->m_FileTime ) != 0)
+			{
+				mesh->m_FileTime = fileTime;
+				mesh->m_FileChanged = true;
+				mesh->m_FileChangeTime = time;
+			}
+		}
+	}
+
+	// Reload meshes whose files have settled, replacing any load already in progress
+	for (unsigned int i = 0; i < FileMeshes.size(); ++i)
+	{
+		CMesh* mesh = FileMeshes[i];
+		if (mesh->m_FileChanged && time - mesh->m_FileChangeTime >= ReloadDelay)
+		{
+			mesh->m_FileChanged = false;
+			mesh->CancelLoad();
+			mesh->QueueLoad( true );
+		}
+	}
+}
+
+
+// Watch the mesh's file for changes, to reload it, and watch the file's folder
+void CMesh::WatchFile()
+{
+	m_FileChanged = false;
+	if (!GetFileWriteTime( m_FileName, &m_FileTime ))
+	{
+		m_FileTime.dwLowDateTime = m_FileTime.dwHighDateTime = 0; // Reload if the file appears
+	}
+
+	FileMeshes.push_back( this );
+	if (WatcherThreadHandle != NULL)
+	{
+		WatchFolder( GetFolder( m_FileName ) );
+	}
+}
+
+// Stop watching the mesh's file. The folder is still watched, it may hold other mesh files
+void CMesh::UnwatchFile()
+{
+	if (m_FileName.empty())
+	{
+		return;
+	}
+	FileMeshes.erase( find( FileMeshes.begin(), FileMeshes.end(), this ) );
+}
+
+
+/////////////////////////////
+// Data Access
+
+// Bounding box of the geometry in model space, calculated when the mesh is imported
+void CMesh::GetBoundingBox( gen::CVector3* minBounds, gen::CVector3* maxBounds )
+{
+	*minBounds = gen::CVector3( m_BoundsMin.x, m_BoundsMin.y, m_BoundsMin.z );
+	*maxBounds = gen::CVector3( m_BoundsMax.x, m_BoundsMax.y, m_BoundsMax.z );
+}
+
+// Bounding sphere of the geometry in model space, calculated when the mesh is imported. The
+// radius is negative if the mesh has no geometry
+void CMesh::GetBoundingSphere( gen::CVector3* centre, float* radius )
+{
+	*centre = gen::CVector3( m_BoundsCentre.x, m_BoundsCentre.y, m_BoundsCentre.z );
+	*radius = m_BoundsRadius;
+}
+
+
+/////////////////////////////
+// Mesh Usage
+
+// Collect the ranges of indices of the meshlets that are inside the given frustum planes and not
+// facing away from the camera, all in model space. Neighbouring meshlets are merged into single
+// ranges to reduce draw calls. Returns false if the mesh has no meshlets
+bool CMesh::CullMeshlets( const gen::CVector3& camera, const gen::CVector4* frustumPlanes,
+                          vector<SIndexRange>* visibleRanges )
+{
+	visibleRanges->clear();
+	if (m_NumMeshlets == 0)
+	{
+		return false;
+	}
+
+	// No meshlets are visible if the bounding sphere of the whole mesh is outside the frustum
+	for (unsigned int plane = 0; plane < gen::kiNumFrustumPlanes; ++plane)
+	{
+		const gen::CVector4& p = frustumPlanes[plane];
+		if (p.x * m_BoundsCentre.x + p.y * m_BoundsCentre.y + p.z * m_BoundsCentre.z + p.w <
+		    -m_BoundsRadius)
+		{
+			return true;
+		}
+	}
+
+	// Ranges are merged within each sub-mesh, they are drawn with the sub-mesh's vertex range
+	for (unsigned int subMesh = 0; subMesh < m_SubMeshes.size(); ++subMesh)
+	{
+		unsigned int firstMeshlet = m_SubMeshes[subMesh].firstMeshlet;
+		unsigned int endMeshlet = firstMeshlet + m_SubMeshes[subMesh].numMeshlets;
+		for (unsigned int meshlet = firstMeshlet; meshlet < endMeshlet; ++meshlet)
+		{
+			if (gen::IsMeshletVisible( m_Meshlets[meshlet], camera, frustumPlanes ))
+			{
+				unsigned int startIndex = m_Meshlets[meshlet].firstFace * 3;
+				unsigned int numIndices = m_Meshlets[meshlet].numFaces * 3;
+				SIndexRange* last = visibleRanges->empty() ? NULL : &visibleRanges->back();
+				if (last != NULL && last->subMesh == subMesh &&
+				    last->startIndex + last->numIndices == startIndex)
+				{
+					last->numIndices += numIndices;
+				}
+				else
+				{
+					SIndexRange range = { startIndex, numIndices, subMesh };
+					visibleRanges->push_back( range );
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Find where a model space ray first hits the mesh's full detail geometry, within the given
+// distance (in multiples of the direction). Returns false if there is no hit or the mesh was not
+// loaded with ray queries
+bool CMesh::RayCast( const gen::CVector3& origin, const gen::CVector3& direction, float maxDistance,
+                     float* hitDistance )
+{
+	// Find the closest hit on any sub-mesh - each hit found limits the search of the others
+	bool hasHit = false;
+	for (unsigned int subMesh = 0; subMesh < m_BVHs.size(); ++subMesh)
+	{
+		gen::SRayHit hit;
+		if (m_BVHs[subMesh] != NULL &&
+		    m_BVHs[subMesh]->RayCastClosest( origin, direction, maxDistance, &hit ))
+		{
+			maxDistance = hit.fDistance;
+			*hitDistance = hit.fDistance;
+			hasHit = true;
+		}
+	}
+	return hasHit;
+}
+
+// Return true if a model space ray hits the mesh within the given distance
+bool CMesh::RayHits( const gen::CVector3& origin, const gen::CVector3& direction,
+                     float maxDistance )
+{
+	for (unsigned int subMesh = 0; subMesh < m_BVHs.size(); ++subMesh)
+	{
+		if (m_BVHs[subMesh] != NULL &&
+		    m_BVHs[subMesh]->RayCastAny( origin, direction, maxDistance ))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// Return true if two sub-meshes are in the same part and have the same vertex format, so they use
+// the same buffers
+bool SameBuffers( const CMesh::SSubMeshRange& subMesh1, const CMesh::SSubMeshRange& subMesh2 )
+{
+	return subMesh1.part == subMesh2.part && subMesh1.vertexFVF == subMesh2.vertexFVF &&
+	       subMesh1.vertexSize == subMesh2.vertexSize;
+}
+
+// Render the given level of detail of every sub-mesh (using current material)
+void CMesh::Render( unsigned int lod )
+{
+	// Don't render if no geometry
+	if (!m_HasGeometry)
+	{
+		return;
+	}
+
+	// Draw each sub-mesh, selecting the buffers again only when the part or vertex format changes
+	for (unsigned int subMesh = 0; subMesh < m_SubMeshes.size(); ++subMesh)
+	{
+		if (subMesh == 0 || !SameBuffers( m_SubMeshes[subMesh], m_SubMeshes[subMesh - 1] ))
+		{
+			SetSubMeshBuffers( subMesh );
+		}
+		DrawSubMesh( subMesh, lod );
+	}
+}
+
+// Render the given ranges of indices (using current material), e.g. those from CullMeshlets
+void CMesh::Render( const vector<SIndexRange>& ranges )
+{
+	if (!m_HasGeometry)
+	{
+		return;
+	}
+
+	// Draw each range with the buffers of its sub-mesh, as above
+	for (unsigned int range = 0; range < ranges.size(); ++range)
+	{
+		unsigned int subMesh = ranges[range].subMesh;
+		if (range == 0 ||
+		    !SameBuffers( m_SubMeshes[subMesh], m_SubMeshes[ranges[range - 1].subMesh] ))
+		{
+			SetSubMeshBuffers( subMesh );
+		}
+		const SSubMeshRange& subMeshRange = m_SubMeshes[subMesh];
+		g_pd3dDevice->DrawIndexedPrimitive( D3DPT_TRIANGLELIST, subMeshRange.firstVertex, 0,
+		                                    subMeshRange.numVertices, ranges[range].startIndex,
+		                                    ranges[range].numIndices / 3 );
+	}
+}
+
+
+// Select the buffers and vertex format used by a sub-mesh
+void CMesh::SetSubMeshBuffers( unsigned int subMesh )
+{
+	// Tell DirectX the vertex buffer to use and indicate its type (using the FVF code). The buffer
+	// is shared by all sub-meshes in the part, so the vertex size is the sub-mesh's
+	const SSubMeshRange& subMeshRange = m_SubMeshes[subMesh];
+	const SPart& part = m_Parts[subMeshRange.part];
+	g_pd3dDevice->SetStreamSource( 0, part.vertexBuffer, 0, subMeshRange.vertexSize );
+	g_pd3dDevice->SetFVF( subMeshRange.vertexFVF );
+
+	// Now tell DirectX the index buffer to use
+	g_pd3dDevice->SetIndices( part.indexBuffer );
+}
+
+// Draw the given level of detail of a sub-mesh (using current material and buffers). Returns the
+// number of draw calls made
+unsigned int CMesh::DrawSubMesh( unsigned int subMesh, unsigned int lod )
+{
+	// Draw the primitives from the vertex buffer - a triangle list, the range of the index buffer
+	// used by the level of detail. The sub-mesh's indices count from its first vertex
+	const SSubMeshRange& subMeshRange = m_SubMeshes[subMesh];
+	const SLOD& lodRange =
+		subMeshRange.lods[(lod < subMeshRange.numLODs) ? lod : subMeshRange.numLODs - 1];
+	g_pd3dDevice->DrawIndexedPrimitive( D3DPT_TRIANGLELIST,  // Primitive type - usually tri-list or strip
+										subMeshRange.firstVertex, // Offset to add to all indices
+										0,                   // Minimum index used (allows for optimisation) 
+										lodRange.numVertices, // Range of vertices refered to,
+															 //     = maximum index - minimum index + 1
+										lodRange.startIndex, // Position to start at in index buffer
+										lodRange.numIndices / 3 );// Number of primitives to render (triangles)
+	return 1;
+}
+
+// Draw the given ranges of indices that belong to a sub-mesh (using current material and buffers).
+// Returns the number of draw calls made
+unsigned int CMesh::DrawSubMesh( unsigned int subMesh, const vector<SIndexRange>& ranges )
+{
+	const SSubMeshRange& subMeshRange = m_SubMeshes[subMesh];
+	unsigned int numDraws = 0;
+	for (unsigned int range = 0; range < ranges.size(); ++range)
+	{
+		if (ranges[range].subMesh == subMesh)
+		{
+			g_pd3dDevice->DrawIndexedPrimitive( D3DPT_TRIANGLELIST, subMeshRange.firstVertex, 0,
+			                                    subMeshRange.numVertices, ranges[range].startIndex,
+			                                    ranges[range].numIndices / 3 );
+			++numDraws;
+		}
+	}
+	return numDraws;
+}
@@ -0,0 +1,407 @@
+/**********************************************
+	Mesh.h
+
+	Declaration of mesh class for DirectX - the
+	geometry shared by models
+***********************************************/
+
+#pragma once // Prevent file being included more than once (would cause errors)
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <d3d9.h>
+#include <d3dx9.h>
+
+namespace gen // Types from import code
+{
+	struct SSubMesh; struct SMeshlet; struct SMeshBounds; class CMeshBVH; class CVector3;
+	class CVector4;
+}
+struct SMeshLoadRequest;            // Background mesh load, defined in Mesh.cpp
+struct SGeometryBlock;              // Block of vertex or index data, defined in Mesh.cpp
+struct SMeshGeometry;               // Mesh geometry in system memory, defined in Mesh.cpp
+
+//-----------------------------------------------------------------------------
+// DirectX Mesh Class
+//-----------------------------------------------------------------------------
+
+// Geometry for models - vertex and index buffers, levels of detail, meshlets and a hierarchy for
+// ray queries, all in model space. The geometry is split into sub-meshes, one for each material.
+// The sub-meshes from each mesh in the file share a vertex buffer and index buffer (a part), so a
+// reload keeps the parts of meshes that are unchanged. A mesh is shared by every model that uses
+// it. Meshes loaded from files are cached, loading a file again with the same options returns the
+// same mesh. Meshes are reference counted - each Load, LoadAsync or Create returns a reference
+// that must be released with Release, and the mesh is deleted when its last reference is released.
+// Vertex and index data is held in a store addressed by its contents, so meshes with identical
+// data (e.g. the same prop exported to several files) share the buffers holding it
+class CMesh
+{
+/////////////////////////////
+// Public types
+public:
+
+	// A range of indices in the index buffer, used by the given sub-mesh
+	struct SIndexRange
+	{
+		unsigned int startIndex;
+		unsigned int numIndices;
+		unsigned int subMesh;
+	};
+
+	// Level of detail of a sub-mesh - a range of indices in the index buffer, the number of the
+	// sub-mesh's vertices it uses (always the first ones) and an estimate of its error (distance
+	// from the full detail surface in model space). Level 0 is full detail
+	static const unsigned int MaxLODs = 8;
+	struct SLOD
+	{
+		unsigned int startIndex;
+		unsigned int numIndices;
+		unsigned int numVertices;
+		float        error;
+	};
+
+	// Material of a sub-mesh - its render method (a gen::ERenderMethod), texture file (empty if
+	// none) and diffuse colour select how to render it. Materials are held in the geometry store
+	// with the vertex and index data, so sub-meshes with identical materials share one
+	struct SMaterial
+	{
+		unsigned int renderMethod;
+		string       textureName;
+		D3DXCOLOR    diffuseColour;
+	};
+
+	// The part of the mesh using a single material. Its vertices are a range of the vertex buffer
+	// of its part, its indices are relative to its first vertex, and it has a range of the part's
+	// index buffer for each level of detail and a range of the mesh's meshlets
+	struct SSubMeshRange
+	{
+		const SMaterial* material;
+		DWORD            vertexFVF;  // DirectX FVF code for vertex format (look up D3DFVF)
+		unsigned int     vertexSize;
+		unsigned int     part;       // Index of the part whose buffers hold the sub-mesh's data
+		unsigned int     firstVertex;
+		unsigned int     numVertices;
+		SLOD             lods[MaxLODs];
+		unsigned int     numLODs;
+		unsigned int     firstMeshlet;
+		unsigned int     numMeshlets;
+	};
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	/////////////////////////////
+	// Creation / Reference Counting
+
+	// Get the mesh for a file, loading it if it is not already cached, optionally generating
+	// levels of detail, building meshlets (see CullMeshlets) and building a hierarchy for ray
+	// queries (see RayCast). Always returns a mesh, use IsReady to see if it loaded successfully -
+	// a mesh that failed to load is reloaded when its file changes (see StartHotReload)
+	static CMesh* Load( const string& fileName, unsigned int numLODs = 0, bool meshlets = false,
+	                    bool rayQueries = false );
+
+	// Get the mesh for a file as Load, but if the mesh is not cached, load it in the background.
+	// Returns immediately - the file is read and the mesh prepared on the loader thread, then the
+	// geometry is copied into buffers by UploadLoadedMeshes. Use IsLoading / IsReady to check
+	// progress. Returns NULL if the load could not be started
+	static CMesh* LoadAsync( const string& fileName, unsigned int numLODs = 0,
+	                         bool meshlets = false, bool rayQueries = false );
+
+	// Create a mesh from arrays of vertices and indices. The mesh is not cached. Returns NULL on
+	// failure
+	static CMesh* Create
+	(
+		void*        vertices,   // Pointer to vertex array (void* because we allow custom types)
+		unsigned int numVertices,// Number of vertices in the mesh
+		DWORD        vertexFVF,  // DirectX FVF code describing the vertex format (look up D3DFVF)
+		WORD*        indices,    // Pointer to index array (assuming 2-byte values, WORD in DirectX)
+		unsigned int numIndices  // Number of indices in the mesh
+	);
+
+	// Add a reference to the mesh / release a reference, deleting the mesh if it was the last
+	void AddRef()
+	{
+		++m_RefCount;
+	}
+	void Release();
+
+
+	/////////////////////////////
+	// Asynchronous Loading
+
+	// Default number of bytes of geometry uploaded per frame by UploadLoadedMeshes, counting both
+	// the buffers created and the data copied. Intended to keep each call under a millisecond -
+	// check with GetUploadStats on the target hardware
+	static const unsigned int DefaultUploadBytes = 256 * 1024;
+
+	// Start / stop the worker thread that loads meshes in the background. The loader must be
+	// started before using LoadAsync and stopped before the DirectX device is released
+	static bool StartLoader();
+	static void StopLoader();
+
+	// Create buffers for meshes loaded in the background and copy their geometry in. Call once per
+	// frame on the rendering thread. Buffers are created as the upload reaches them and at most
+	// the given number of bytes are created or copied per call, so loading does not cause frame
+	// rate hitches - large meshes are uploaded over several frames. A single buffer larger than
+	// the budget is still created in one call
+	static void UploadLoadedMeshes( unsigned int maxBytes = DefaultUploadBytes );
+
+	// Statistics of the UploadLoadedMeshes calls since the stats were last read: the number of
+	// calls, the calls taking over a millisecond, the longest and total time, and the bytes copied
+	// and buffers created
+	struct SUploadStats
+	{
+		unsigned int numCalls;
+		unsigned int numSlowCalls;
+		float        maxMilliseconds;
+		float        totalMilliseconds;
+		unsigned int bytesCopied;
+		unsigned int numBuffersCreated;
+	};
+	static void GetUploadStats( SUploadStats* stats );
+
+	// Is the mesh waiting for a background load to complete
+	bool IsLoading()
+	{
+		return m_LoadRequest != NULL;
+	}
+
+	// Does the mesh have geometry to render. A mesh that is neither loading nor ready has no
+	// geometry or failed to load
+	bool IsReady()
+	{
+		return m_HasGeometry;
+	}
+
+
+	/////////////////////////////
+	// Hot Reload
+
+	// Time in milliseconds a changed mesh file must be left unchanged before it is reloaded, so
+	// files are not read while still being saved
+	static const unsigned int ReloadDelay = 250;
+
+	// Start / stop watching the files of meshes loaded from files. When a file changes the mesh is
+	// reloaded in the background, the old geometry is rendered until the new geometry has been
+	// uploaded. If the data of every mesh in the file is unchanged (e.g. only the formatting was
+	// edited) the mesh is left as it is, otherwise the parts of meshes whose data is unchanged are
+	// kept rather than uploaded again. The loader must be running (see StartLoader)
+	static bool StartHotReload();
+	static void StopHotReload();
+
+	// Reload meshes whose files have changed. Call once per frame on the rendering thread, before
+	// UploadLoadedMeshes
+	static void ReloadChangedMeshes();
+
+
+	/////////////////////////////
+	// Geometry Store
+
+	// Statistics of the blocks of vertex, index and material data in the geometry store. The blocks
+	// used are counted once for each mesh (or sub-mesh for materials) using them, the blocks stored
+	// once each. The sharing ratio is the bytes used over the bytes stored - the saving in memory
+	// and upload from sharing data
+	struct SGeometryStats
+	{
+		unsigned int numBlocksUsed;
+		unsigned int numBlocksStored;
+		unsigned int bytesUsed;
+		unsigned int bytesStored;
+		float        sharingRatio;
+	};
+	static void GetGeometryStats( SGeometryStats* stats );
+
+
+	/////////////////////////////
+	// Data access
+
+	// Version of the geometry, which changes each time new geometry replaces the old (e.g. when
+	// reloaded). Data derived from the geometry, such as culled meshlets, is out of date if the
+	// version has changed since
+	unsigned int GetVersion()
+	{
+		return m_Version;
+	}
+
+	// Number of levels of detail and the error of each (distance from the full detail surface in
+	// model space). Level 0 is full detail. Sub-meshes with fewer levels use their lowest detail
+	// level for the remaining levels, the error of a level is the largest of its sub-meshes
+	unsigned int GetNumLODs()
+	{
+		return m_NumLODs;
+	}
+	float GetLODError( unsigned int lod )
+	{
+		return m_LODErrors[lod];
+	}
+
+	// Sub-meshes of the geometry, one for each material
+	unsigned int GetNumSubMeshes()
+	{
+		return static_cast<unsigned int>(m_SubMeshes.size());
+	}
+	const SSubMeshRange& GetSubMesh( unsigned int subMesh )
+	{
+		return m_SubMeshes[subMesh];
+	}
+
+	// Bounding box and bounding sphere of the geometry in model space, calculated when the mesh is
+	// imported. The radius is negative if the mesh has no geometry
+	void GetBoundingBox( gen::CVector3* minBounds, gen::CVector3* maxBounds );
+	void GetBoundingSphere( gen::CVector3* centre, float* radius );
+
+
+	/////////////////////////////
+	// Mesh Usage
+
+	// Collect the ranges of indices of the meshlets that are inside the given frustum planes and
+	// not facing away from the camera, all in model space. Neighbouring meshlets are merged into
+	// single ranges. Returns false if the mesh has no meshlets
+	bool CullMeshlets( const gen::CVector3& camera, const gen::CVector4* frustumPlanes,
+	                   vector<SIndexRange>* visibleRanges );
+
+	// Find where a model space ray first hits the mesh's full detail geometry, within the given
+	// distance (in multiples of the direction). Returns false if there is no hit or the mesh was
+	// not loaded with ray queries
+	bool RayCast( const gen::CVector3& origin, const gen::CVector3& direction, float maxDistance,
+	              float* hitDistance );
+
+	// Return true if a model space ray hits the mesh within the given distance. Faster than
+	// RayCast as it stops at the first hit found
+	bool RayHits( const gen::CVector3& origin, const gen::CVector3& direction, float maxDistance );
+
+	// Render the given level of detail (clamped to the available levels), or the given ranges of
+	// indices, for every sub-mesh. Nothing is rendered if the mesh is not ready
+	void Render( unsigned int lod );
+	void Render( const vector<SIndexRange>& ranges );
+
+	// Select the buffers and vertex format used by a sub-mesh, then draw the sub-mesh's given
+	// level of detail (clamped to its levels), or the given ranges of indices that belong to it.
+	// Sub-meshes in the same part with the same vertex format use the same buffers and format,
+	// which need not be selected again. The draw functions return the number of draw calls made
+	void SetSubMeshBuffers( unsigned int subMesh );
+	unsigned int DrawSubMesh( unsigned int subMesh, unsigned int lod );
+	unsigned int DrawSubMesh( unsigned int subMesh, const vector<SIndexRange>& ranges );
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Constructor / destructor, meshes are created and deleted through the functions above
+	CMesh();
+	~CMesh();
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CMesh( const CMesh& );
+	CMesh& operator=( const CMesh& );
+
+	// Get the cached mesh for a file and options, creating an empty one if not cached. A
+	// reference is added for the caller
+	static CMesh* GetCachedMesh( const string& fileName, unsigned int numLODs, bool meshlets,
+	                             bool rayQueries );
+
+	// Release the geometry
+	void ReleaseResources();
+
+	// Load the mesh's file, replacing any current geometry
+	bool LoadFile();
+
+	// Replace the current geometry with the given geometry, whose parts hold the blocks from the
+	// geometry store with their vertex and index data. The mesh takes over the parts' references
+	// to the blocks, and the geometry's sub-meshes and hierarchies. The sub-meshes' materials are
+	// looked up in the store, or stored
+	void SetGeometry( SMeshGeometry* geometry );
+
+	// Release the references to the blocks of the mesh's parts and materials and remove them
+	void ReleaseBlocks();
+
+	// Copy the given bounds
+	void SetBounds( const gen::SMeshBounds& bounds );
+
+	// Queue a background load of the mesh's file. A reload keeps the current geometry until the
+	// new geometry is ready
+	bool QueueLoad( bool reload );
+
+	// Cancel any background load in progress
+	void CancelLoad();
+
+	// Create buffers for meshes loaded in the background and copy their geometry in, creating or
+	// copying at most the given number of bytes (see UploadLoadedMeshes)
+	static void UploadLoadedMeshData( unsigned int maxBytes );
+
+	// Watch the mesh's file for changes / stop
+	void WatchFile();
+	void UnwatchFile();
+
+
+/////////////////////////////
+// Private member variables
+private:
+
+	// Number of references to this mesh and its key in the mesh cache (empty if not cached)
+	unsigned int            m_RefCount;
+	string                  m_CacheKey;
+
+	// Parts - the vertex data of the sub-meshes from one mesh in the file stored in a vertex
+	// buffer, and their index data in an index buffer, with the blocks in the geometry store that
+	// own the buffers, and the index and hash of the mesh in the file (see
+	// gen::CImportXFile::GetSubMeshSourceMesh / GetSubMeshSourceHash). Sub-meshes may have
+	// different vertex formats
+	struct SPart
+	{
+		SGeometryBlock*         vertexBlock;
+		SGeometryBlock*         indexBlock;
+		LPDIRECT3DVERTEXBUFFER9 vertexBuffer;
+		LPDIRECT3DINDEXBUFFER9  indexBuffer;
+		unsigned int            sourceMesh;
+		unsigned int            sourceHash;
+	};
+	vector<SPart>           m_Parts;
+
+	// Sub-meshes - the ranges of the part buffers used by each material - and the blocks in the
+	// geometry store holding their materials
+	vector<SSubMeshRange>   m_SubMeshes;
+	vector<SGeometryBlock*> m_MaterialBlocks;
+
+	// Number of levels of detail and the error of each (see GetLODError)
+	float                   m_LODErrors[MaxLODs];
+	unsigned int            m_NumLODs;
+
+	// Meshlets - clusters of faces in the full detail level with bounds for culling. The faces are
+	// counted from the start of their sub-mesh's part index buffer
+	gen::SMeshlet*          m_Meshlets;
+	unsigned int            m_NumMeshlets;
+
+	// Hierarchy over the full detail faces of each sub-mesh for ray queries, NULL if not built
+	vector<gen::CMeshBVH*>  m_BVHs;
+
+	// Bounds of the geometry - a box and a sphere. The radius is negative if there is no geometry
+	D3DXVECTOR3             m_BoundsMin;
+	D3DXVECTOR3             m_BoundsMax;
+	D3DXVECTOR3             m_BoundsCentre;
+	float                   m_BoundsRadius;
+
+	// Does this mesh have any geometry to render, and the version of the geometry
+	bool          m_HasGeometry;
+	unsigned int  m_Version;
+
+	// Background load in progress for this mesh, NULL if none
+	SMeshLoadRequest* m_LoadRequest;
+
+	// File the mesh was loaded from and its load options, kept to reload the mesh when the file
+	// changes. Also the file's last write time, whether it has changed and when it last changed,
+	// and the hashes of the meshes in the file the mesh was loaded from, by index in the file
+	string        m_FileName;
+	unsigned int  m_LoadLODs;
+	bool          m_LoadMeshlets;
+	bool          m_LoadBVH;
+	FILETIME      m_FileTime;
+	bool          m_FileChanged;
+	DWORD         m_FileChangeTime;
+	vector<unsigned int> m_SourceHashes;
+};
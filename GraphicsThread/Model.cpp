@@ -4,10 +4,14 @@
 	Implementation of model class for DirectX
 ***********************************************/
 
+#include <map>
+#include <algorithm>
+using namespace std;
+
 #include "Defines.h"
 #include "Model.h"
 
-#include "CImportXFile.h"    // Class to load meshes (taken from a full graphics engine)
+#include "CImportXFile.h"    // Import code types for meshlet culling, ray queries, render methods
 
 ///////////////////////////////
 // Constructors / Destructors
@@ -16,14 +20,12 @@
 CModel::CModel()
 {
 	// Initialise member variables
-	m_VertexBuffer = NULL;
-	m_NumVertices = 0;
-	m_VertexSize = 0;
-
-	m_IndexBuffer = NULL;
-	m_NumIndices = 0;
-
-	m_HasGeometry = false;
+	m_Mesh = NULL;
+	m_RenderMethod = MaterialRenderMethod;
+	m_Texture = NULL;
+	m_CurrentLOD = 0;
+	m_MeshletsCulled = false;
+	m_CulledVersion = 0;
 
 	m_Position = D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
 	m_Rotation = D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
@@ -36,19 +38,17 @@ CModel::~CModel()
 	ReleaseResources();
 }
 
-// Release resources used by model
+// Release the model's reference to its mesh, the mesh is deleted if no other model uses it
 void CModel::ReleaseResources()
 {
-	// Release resources (where necessary)
-	if (m_IndexBuffer != NULL)
-	{
-		m_IndexBuffer->Release();
-	}
-	if (m_VertexBuffer != NULL)
+	if (m_Mesh != NULL)
 	{
-		m_VertexBuffer->Release();
+		m_Mesh->Release();
+		m_Mesh = NULL;
 	}
-	m_HasGeometry = false;
+	m_CurrentLOD = 0;
+	m_VisibleRanges.clear();
+	m_MeshletsCulled = false;
 }
 
 
@@ -65,183 +65,197 @@ bool CModel::CreateGeometry
 	unsigned int numIndices  // Number of indices in the model mesh
 )
 {
-	// Release any existing geometry
+	// Release any existing mesh
 	ReleaseResources();
 
-	// Store FVF (vertex format descriptor) and use it to get size of a single vertex
-	m_VertexFVF = vertexFVF;
-	m_VertexSize = D3DXGetFVFVertexSize( m_VertexFVF );
-
-	// Create the vertex buffer
-	unsigned int bufferSize = numVertices * m_VertexSize;
-    if (FAILED(g_pd3dDevice->CreateVertexBuffer( bufferSize, D3DUSAGE_WRITEONLY, 0,
-                                                 D3DPOOL_DEFAULT, &m_VertexBuffer, NULL )))
-    {
-        return false;
-    }
-	m_NumVertices = numVertices;
+	m_Mesh = CMesh::Create( vertices, numVertices, vertexFVF, indices, numIndices );
+	return m_Mesh != NULL;
+}
 
-    // "Lock" the vertex buffer so we can write to it
-    void* bufferData;
-    if (FAILED(m_VertexBuffer->Lock( 0, bufferSize, (void**)&bufferData, 0 )))
-	{
-        return false;
-	}
 
-	// Copy the vertex data
-    memcpy( bufferData, vertices, bufferSize );
+// Use the mesh for a file, loading it if it is not already loaded with the same options
+bool CModel::Load( const string& fileName, unsigned int numLODs /*= 0*/,
+                   bool meshlets /*= false*/, bool rayQueries /*= false*/ )
+{
+	// Release any existing mesh
+	ReleaseResources();
 
-	// Unlock the vertex buffer again so it can be used for rendering
-    m_VertexBuffer->Unlock();
+	m_Mesh = CMesh::Load( fileName, numLODs, meshlets, rayQueries );
+	return m_Mesh->IsReady();
+}
 
+// Use the mesh for a file, loading it in the background if it is not already loaded
+bool CModel::LoadAsync( const string& fileName, unsigned int numLODs /*= 0*/,
+                        bool meshlets /*= false*/, bool rayQueries /*= false*/ )
+{
+	// Release any existing mesh
+	ReleaseResources();
 
-    // Create the index buffer - assuming 2-byte (WORD) index data
-	bufferSize = numIndices * sizeof(WORD);
-    if (FAILED(g_pd3dDevice->CreateIndexBuffer( bufferSize, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
-                                                D3DPOOL_DEFAULT, &m_IndexBuffer, NULL )))
-    {
-        return false;
-    }
-	m_NumIndices = numIndices;
+	m_Mesh = CMesh::LoadAsync( fileName, numLODs, meshlets, rayQueries );
+	return m_Mesh != NULL;
+}
 
-    // "Lock" the index buffer so we can write to it
-    if (FAILED(m_IndexBuffer->Lock( 0, bufferSize, (void**)&bufferData, 0 )))
-	{
-        return false;
-	}
+// Model used in place of models that are still loading
+CModel* CModel::m_Placeholder = NULL;
 
-	// Copy the index data
-    memcpy( bufferData, indices, bufferSize );
 
-	// Unlock the index buffer again so it can be used for rendering
-    m_IndexBuffer->Unlock();
+/////////////////////////////
+// Model Usage
 
-	m_HasGeometry = true;
-	return true;
+// Calculate the model's world matrix from its current position, orientation and scale
+// Don't send matrix to DirectX (with SetTransform) as using a vertex shader for matrix work
+void CModel::CalculateMatrix()
+{
+	// Build the matrix for the model from its position, rotation and scaling
+	D3DXMATRIXA16 MatScale, MatX, MatY, MatZ, MatTrans;
+	D3DXMatrixScaling( &MatScale, m_Scale, m_Scale, m_Scale );
+	D3DXMatrixRotationX( &MatX, m_Rotation.x );
+	D3DXMatrixRotationY( &MatY, m_Rotation.y );
+	D3DXMatrixRotationZ( &MatZ, m_Rotation.z );
+	D3DXMatrixTranslation( &MatTrans, m_Position.x, m_Position.y, m_Position.z );
+	m_Matrix = MatScale * MatZ * MatX * MatY * MatTrans;
 }
 
-
-// Load the model geometry from a file. This model class only supports a single material 
-// per model. Real world models often use several materials for different parts of the
-// geometry. This function only reads the geometry using the first material in the file,
-// so multi-material models will load but will have parts missing
-bool CModel::Load( const string& fileName )
+// Select the level of detail to render from the model's on-screen size - the lowest detail level
+// whose error, projected onto the screen, is no more than the given number of pixels
+void CModel::SelectLOD( const D3DXVECTOR3& cameraPosition, const D3DXMATRIXA16& projMatrix,
+                        float maxPixelError /*= 1.0f*/ )
 {
-	// Release any existing geometry
-	ReleaseResources();
-
-	// Use CImportXFile class (from another application) to load the given file
-	// The import code is wrapped in the namespace 'gen'
-	gen::CImportXFile mesh;
-	if (mesh.ImportFile( fileName.c_str() ) != gen::kSuccess)
+	m_CurrentLOD = 0;
+	if (m_Mesh == NULL || m_Mesh->GetNumLODs() < 2)
 	{
-		return false;
+		return;
 	}
 
-	// Just use first sub-mesh from loaded file
-	gen::SSubMesh subMesh;
-	if (mesh.GetSubMesh( 0, &subMesh ) != gen::kSuccess)
+	// Get the number of pixels covered by one unit at the model's distance. Element _22 of the
+	// projection matrix scales view space y so the viewport height covers a range of 2 units
+	D3DVIEWPORT9 viewport;
+	g_pd3dDevice->GetViewport( &viewport );
+	D3DXVECTOR3 cameraToModel = m_Position - cameraPosition;
+	float distance = D3DXVec3Length( &cameraToModel );
+	if (distance <= 0.0f)
 	{
-		return false;
+		return;
 	}
+	float pixelsPerUnit = projMatrix._22 * viewport.Height * 0.5f / distance;
 
-	// Calculate FVF (vertex format descriptor) and use it to get size of a single vertex
-	m_VertexFVF = D3DFVF_XYZ + (subMesh.hasNormals ? D3DFVF_NORMAL : 0) + 
-	                           (subMesh.hasTextureCoords ? D3DFVF_TEX1 : 0) + 
-	                           (subMesh.hasVertexColours ? D3DFVF_DIFFUSE : 0);
-	m_VertexSize = subMesh.vertexSize;
-
-	// Create the vertex buffer
-	m_NumVertices = subMesh.numVertices;
-	unsigned int bufferSize = m_NumVertices * m_VertexSize;
-    if (FAILED(g_pd3dDevice->CreateVertexBuffer( bufferSize, D3DUSAGE_WRITEONLY, 0,
-                                                 D3DPOOL_DEFAULT, &m_VertexBuffer, NULL )))
-    {
-        return false;
-    }
-
-    // "Lock" the vertex buffer so we can write to it
-    void* bufferData;
-    if (FAILED(m_VertexBuffer->Lock( 0, bufferSize, (void**)&bufferData, 0 )))
+	// Errors increase with each level, so step through levels until the error is too large
+	while (m_CurrentLOD + 1 < m_Mesh->GetNumLODs() &&
+	       m_Mesh->GetLODError( m_CurrentLOD + 1 ) * m_Scale * pixelsPerUnit <= maxPixelError)
 	{
-        return false;
+		++m_CurrentLOD;
 	}
+}
 
-	// Copy the vertex data from the sub-mesh
-	memcpy( bufferData, subMesh.vertices, bufferSize );
-
-	// Unlock the vertex buffer again so it can be used for rendering
-    m_VertexBuffer->Unlock();
-
-
-    // Create the index buffer - assuming 2-byte (WORD) index data
-	m_NumIndices = static_cast<unsigned int>(subMesh.numFaces) * 3;
-	bufferSize = m_NumIndices * sizeof(WORD);
-    if (FAILED(g_pd3dDevice->CreateIndexBuffer( bufferSize, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
-                                                D3DPOOL_DEFAULT, &m_IndexBuffer, NULL )))
-    {
-        return false;
-    }
-
-    // "Lock" the index buffer so we can write to it
-    if (FAILED(m_IndexBuffer->Lock( 0, bufferSize, (void**)&bufferData, 0 )))
+// Cull the model's meshlets against the camera - those outside the view frustum or facing away
+// from the camera are not rendered. Only affects the full detail level and models loaded with
+// meshlets. Call after CalculateMatrix, the result is used until the next call
+void CModel::CullMeshlets( const D3DXVECTOR3& cameraPosition, const D3DXMATRIXA16& viewProjMatrix )
+{
+	m_VisibleRanges.clear();
+	m_MeshletsCulled = false;
+	if (m_Mesh == NULL || !m_Mesh->IsReady())
 	{
-        return false;
+		return;
 	}
 
-	// Copy the vertex data from the sub-mesh
-	memcpy( bufferData, subMesh.faces, bufferSize );
+	// Meshlet bounds are in model space, so transform the camera position and frustum into model
+	// space. The matrix classes in the import code have the same layout as DirectX matrices
+	D3DXMATRIXA16 invWorldMatrix;
+	D3DXMatrixInverse( &invWorldMatrix, NULL, &m_Matrix );
+	D3DXVECTOR3 modelCamera;
+	D3DXVec3TransformCoord( &modelCamera, &cameraPosition, &invWorldMatrix );
+	D3DXMATRIXA16 worldViewProjMatrix = m_Matrix * viewProjMatrix;
+	gen::CVector4 frustumPlanes[gen::kiNumFrustumPlanes];
+	gen::GetFrustumPlanes( *reinterpret_cast<gen::CMatrix4x4*>(&worldViewProjMatrix),
+	                       frustumPlanes );
+
+	// Collect the visible meshlets from the mesh. The ranges are only used while the mesh has the
+	// same geometry
+	gen::CVector3 camera( modelCamera.x, modelCamera.y, modelCamera.z );
+	m_MeshletsCulled = m_Mesh->CullMeshlets( camera, frustumPlanes, &m_VisibleRanges );
+	m_CulledVersion = m_Mesh->GetVersion();
+}
 
-	// Unlock the index buffer again so it can be used for rendering
-    m_IndexBuffer->Unlock();
+// Find where a world space ray first hits the model's full detail geometry, within the given
+// distance (in multiples of the direction). Returns false if there is no hit or the model was not
+// loaded with ray queries
+bool CModel::RayCast( const D3DXVECTOR3& origin, const D3DXVECTOR3& direction, float maxDistance,
+                      float* hitDistance )
+{
+	if (m_Mesh == NULL)
+	{
+		return false;
+	}
 
-	m_HasGeometry = true;
-	return true;
+	// Transform the ray into model space. The direction is not normalised, so distances along the
+	// ray are the same in both spaces
+	D3DXMATRIXA16 invWorldMatrix;
+	D3DXMatrixInverse( &invWorldMatrix, NULL, &m_Matrix );
+	D3DXVECTOR3 modelOrigin, modelDirection;
+	D3DXVec3TransformCoord( &modelOrigin, &origin, &invWorldMatrix );
+	D3DXVec3TransformNormal( &modelDirection, &direction, &invWorldMatrix );
+
+	gen::CVector3 rayOrigin( modelOrigin.x, modelOrigin.y, modelOrigin.z );
+	gen::CVector3 rayDirection( modelDirection.x, modelDirection.y, modelDirection.z );
+	return m_Mesh->RayCast( rayOrigin, rayDirection, maxDistance, hitDistance );
 }
 
+// Return true if a world space ray hits the model within the given distance
+bool CModel::RayHits( const D3DXVECTOR3& origin, const D3DXVECTOR3& direction, float maxDistance )
+{
+	if (m_Mesh == NULL)
+	{
+		return false;
+	}
 
-/////////////////////////////
-// Model Usage
+	// Transform the ray into model space, as RayCast
+	D3DXMATRIXA16 invWorldMatrix;
+	D3DXMatrixInverse( &invWorldMatrix, NULL, &m_Matrix );
+	D3DXVECTOR3 modelOrigin, modelDirection;
+	D3DXVec3TransformCoord( &modelOrigin, &origin, &invWorldMatrix );
+	D3DXVec3TransformNormal( &modelDirection, &direction, &invWorldMatrix );
 
-// Calculate the model's world matrix from its current position, orientation and scale
-// Don't send matrix to DirectX (with SetTransform) as using a vertex shader for matrix work
-void CModel::CalculateMatrix()
-{
-	// Build the matrix for the model from its position, rotation and scaling
-	D3DXMATRIXA16 MatScale, MatX, MatY, MatZ, MatTrans;
-	D3DXMatrixScaling( &MatScale, m_Scale, m_Scale, m_Scale );
-	D3DXMatrixRotationX( &MatX, m_Rotation.x );
-	D3DXMatrixRotationY( &MatY, m_Rotation.y );
-	D3DXMatrixRotationZ( &MatZ, m_Rotation.z );
-	D3DXMatrixTranslation( &MatTrans, m_Position.x, m_Position.y, m_Position.z );
-	m_Matrix = MatScale * MatZ * MatX * MatY * MatTrans;
+	gen::CVector3 rayOrigin( modelOrigin.x, modelOrigin.y, modelOrigin.z );
+	gen::CVector3 rayDirection( modelDirection.x, modelDirection.y, modelDirection.z );
+	return m_Mesh->RayHits( rayOrigin, rayDirection, maxDistance );
 }
 
 // Render the model (using current material)
 void CModel::Render()
 {
-	// Don't render if no geometry
-	if (!m_HasGeometry)
+	// Don't render if no geometry. Render the placeholder instead if still loading
+	if (!IsReady())
 	{
+		if (IsLoading() && m_Placeholder != NULL && m_Placeholder != this)
+		{
+			m_Placeholder->Render();
+		}
 		return;
 	}
 
-	// Tell DirectX the vertex buffer to use and indicate its type (using the FVF code)
-	g_pd3dDevice->SetStreamSource( 0, m_VertexBuffer, 0, m_VertexSize );
-	g_pd3dDevice->SetFVF( m_VertexFVF );
-
-	// Now tell DirectX the index buffer to use
-	g_pd3dDevice->SetIndices( m_IndexBuffer );
+	// Draw only the visible meshlets if they have been culled (full detail level only), unless
+	// the mesh has been reloaded since
+	if (m_CurrentLOD == 0 && m_MeshletsCulled && m_CulledVersion == m_Mesh->GetVersion())
+	{
+		m_Mesh->Render( m_VisibleRanges );
+		return;
+	}
 
+	// Draw the current level of detail
+	m_Mesh->Render( m_CurrentLOD );
+}
 
-	// Draw the primitives from the vertex buffer - a triangle list
-	g_pd3dDevice->DrawIndexedPrimitive( D3DPT_TRIANGLELIST,  // Primitive type - usually tri-list or strip
-										0,                   // Offset to add to all indices (0 in simple cases)
-										0,                   // Minimum index used (allows for optimisation) 
-										m_NumVertices,       // Range of vertices refered to, effectively =
-															 //     maximum index - minimum index + 1
-										0,                   // Position to start at in index buffer
-										m_NumIndices / 3 );  // Number of primitives to render (triangles)
+// Draw a sub-mesh of the model's mesh (using the selected level of detail), with the current
+// shaders, texture and buffers. Uses the culled meshlets as Render. Returns the number of draw
+// calls made
+unsigned int CModel::DrawSubMesh( unsigned int subMesh )
+{
+	if (m_CurrentLOD == 0 && m_MeshletsCulled && m_CulledVersion == m_Mesh->GetVersion())
+	{
+		return m_Mesh->DrawSubMesh( subMesh, m_VisibleRanges );
+	}
+	return m_Mesh->DrawSubMesh( subMesh, m_CurrentLOD );
 }
 
 
@@ -292,3 +306,294 @@ void CModel::Control( EKeyCode turnUp, EKeyCode turnDown,
 }
 
 
+/////////////////////////////
+// Render Queue
+
+// Shaders and constant functions for each render method, see SetRenderMethodShaders
+struct SRenderMethodShaders
+{
+	LPDIRECT3DVERTEXSHADER9     vertexShader;
+	LPDIRECT3DPIXELSHADER9      pixelShader;
+	CModel::TSetShaderConstants setShaderConstants;
+	CModel::TSetModelConstants  setModelConstants;
+};
+SRenderMethodShaders RenderMethodShaders[gen::NumRenderMethods];
+
+// A sub-mesh in the render queue - the states it is rendered with, the model it is rendered for
+// (which sets the constants) and the model whose geometry is drawn (the placeholder if the model
+// is still loading)
+struct SRenderItem
+{
+	unsigned int            renderMethod;
+	LPDIRECT3DVERTEXSHADER9 vertexShader;
+	LPDIRECT3DPIXELSHADER9  pixelShader;
+	LPDIRECT3DTEXTURE9      texture;
+	CMesh*                  mesh;
+	unsigned int            subMesh;
+	CModel*                 model;
+	CModel*                 geometry;
+
+	// Order items by render method, shaders, texture then mesh, so items sharing states are
+	// rendered together
+	bool operator<( const SRenderItem& other ) const
+	{
+		if (renderMethod != other.renderMethod)
+		{
+			return renderMethod < other.renderMethod;
+		}
+		if (vertexShader != other.vertexShader)
+		{
+			return vertexShader < other.vertexShader;
+		}
+		if (pixelShader != other.pixelShader)
+		{
+			return pixelShader < other.pixelShader;
+		}
+		if (texture != other.texture)
+		{
+			return texture < other.texture;
+		}
+		if (mesh != other.mesh)
+		{
+			return mesh < other.mesh;
+		}
+		return subMesh < other.subMesh;
+	}
+};
+
+// States used by the last item rendered from the queue. The mesh is NULL before the first item,
+// when every state must be set
+struct SRenderState
+{
+	unsigned int            renderMethod;
+	LPDIRECT3DVERTEXSHADER9 vertexShader;
+	LPDIRECT3DPIXELSHADER9  pixelShader;
+	LPDIRECT3DTEXTURE9      texture;
+	CMesh*                  mesh;
+	unsigned int            part;
+	DWORD                   vertexFVF;
+	unsigned int            vertexSize;
+};
+
+// State changes needed to render an item, combined as flags
+const unsigned int RenderMethodChange = 1;
+const unsigned int VertexShaderChange = 2;
+const unsigned int PixelShaderChange = 4;
+const unsigned int TextureChange = 8;
+const unsigned int BufferChange = 16;
+
+// The render queue and the counts from the last time it was rendered. Only used on the rendering
+// thread
+vector<SRenderItem> QueuedItems;
+CModel::SRenderStats RenderStats;
+
+// Textures of sub-mesh materials, keyed by file name, loaded when first queued. Textures that
+// could not be loaded are kept as NULL so they are not loaded again. Only used on the rendering
+// thread
+map<string, LPDIRECT3DTEXTURE9> MaterialTextures;
+
+
+// Get the texture for a material's texture file, loading it if it is not already loaded. Returns
+// NULL if there is no file or it could not be loaded
+LPDIRECT3DTEXTURE9 GetMaterialTexture( const string& fileName )
+{
+	if (fileName.empty())
+	{
+		return NULL;
+	}
+	map<string, LPDIRECT3DTEXTURE9>::iterator loaded = MaterialTextures.find( fileName );
+	if (loaded != MaterialTextures.end())
+	{
+		return loaded->second;
+	}
+
+	LPDIRECT3DTEXTURE9 texture = NULL;
+	if (FAILED(D3DXCreateTextureFromFile( g_pd3dDevice, fileName.c_str(), &texture )))
+	{
+		texture = NULL;
+	}
+	MaterialTextures[fileName] = texture;
+	return texture;
+}
+
+// Get the state changes needed to render an item after the given states, add them to the given
+// counts, and update the states to the item's
+unsigned int ChangeRenderState( const SRenderItem& item, SRenderState* state,
+                                CModel::SRenderStats* stats )
+{
+	const CMesh::SSubMeshRange& subMesh = item.mesh->GetSubMesh( item.subMesh );
+	bool first = (state->mesh == NULL);
+	unsigned int changes = 0;
+	if (first || item.renderMethod != state->renderMethod)
+	{
+		changes |= RenderMethodChange;
+	}
+	if (first || item.vertexShader != state->vertexShader)
+	{
+		changes |= VertexShaderChange;
+		++stats->numShaderChanges;
+	}
+	if (first || item.pixelShader != state->pixelShader)
+	{
+		changes |= PixelShaderChange;
+		++stats->numShaderChanges;
+	}
+	if (first || item.texture != state->texture)
+	{
+		changes |= TextureChange;
+		++stats->numTextureChanges;
+	}
+	if (first || item.mesh != state->mesh || subMesh.part != state->part ||
+	    subMesh.vertexFVF != state->vertexFVF || subMesh.vertexSize != state->vertexSize)
+	{
+		changes |= BufferChange;
+		++stats->numBufferChanges;
+	}
+	stats->numStateChanges = stats->numShaderChanges + stats->numTextureChanges +
+	                         stats->numBufferChanges;
+
+	state->renderMethod = item.renderMethod;
+	state->vertexShader = item.vertexShader;
+	state->pixelShader = item.pixelShader;
+	state->texture = item.texture;
+	state->mesh = item.mesh;
+	state->part = subMesh.part;
+	state->vertexFVF = subMesh.vertexFVF;
+	state->vertexSize = subMesh.vertexSize;
+	return changes;
+}
+
+
+// Set the shaders used to render sub-meshes with a render method and the functions to set their
+// constants
+void CModel::SetRenderMethodShaders( unsigned int renderMethod,
+                                     LPDIRECT3DVERTEXSHADER9 vertexShader,
+                                     LPDIRECT3DPIXELSHADER9 pixelShader,
+                                     TSetShaderConstants setShaderConstants,
+                                     TSetModelConstants setModelConstants )
+{
+	if (renderMethod >= gen::NumRenderMethods)
+	{
+		return;
+	}
+	RenderMethodShaders[renderMethod].vertexShader = vertexShader;
+	RenderMethodShaders[renderMethod].pixelShader = pixelShader;
+	RenderMethodShaders[renderMethod].setShaderConstants = setShaderConstants;
+	RenderMethodShaders[renderMethod].setModelConstants = setModelConstants;
+}
+
+// Add the model's sub-meshes to the render queue (using the selected level of detail)
+void CModel::Queue()
+{
+	// Queue the placeholder's geometry in place of a model still loading, it is rendered with this
+	// model's constants, render method and texture
+	CModel* geometry = this;
+	if (!IsReady())
+	{
+		if (!IsLoading() || m_Placeholder == NULL || m_Placeholder == this ||
+		    !m_Placeholder->IsReady())
+		{
+			return;
+		}
+		geometry = m_Placeholder;
+	}
+
+	// Queue each sub-mesh with the states it is rendered with
+	CMesh* mesh = geometry->m_Mesh;
+	for (unsigned int subMesh = 0; subMesh < mesh->GetNumSubMeshes(); ++subMesh)
+	{
+		const CMesh::SSubMeshRange& range = mesh->GetSubMesh( subMesh );
+		SRenderItem item;
+		item.renderMethod = (m_RenderMethod != MaterialRenderMethod) ? m_RenderMethod :
+		                                                               range.material->renderMethod;
+		if (item.renderMethod >= gen::NumRenderMethods ||
+		    RenderMethodShaders[item.renderMethod].vertexShader == NULL)
+		{
+			continue;
+		}
+		item.vertexShader = RenderMethodShaders[item.renderMethod].vertexShader;
+		item.pixelShader = RenderMethodShaders[item.renderMethod].pixelShader;
+		item.texture = (m_Texture != NULL) ? m_Texture :
+		                                     GetMaterialTexture( range.material->textureName );
+		item.mesh = mesh;
+		item.subMesh = subMesh;
+		item.model = this;
+		item.geometry = geometry;
+		QueuedItems.push_back( item );
+	}
+}
+
+// Render the queued sub-meshes, sorted by render method, shaders, texture and mesh, then empty the
+// queue. Each state is only set when it differs from the last item's
+void CModel::RenderQueue()
+{
+	RenderStats = SRenderStats();
+
+	// Count the state changes needed to render the queue in the order it was queued, to compare
+	SRenderState state;
+	state.mesh = NULL;
+	SRenderStats unsortedStats = SRenderStats();
+	for (unsigned int item = 0; item < QueuedItems.size(); ++item)
+	{
+		ChangeRenderState( QueuedItems[item], &state, &unsortedStats );
+	}
+	RenderStats.numUnsortedStateChanges = unsortedStats.numStateChanges;
+
+	// Sort the queue - a stable sort, so items with the same states keep the order they were
+	// queued in (e.g. for models sorted by distance)
+	stable_sort( QueuedItems.begin(), QueuedItems.end() );
+
+	// Render each item, setting the states that change. A render method's shader constants are
+	// set when it is selected, the model constants for every item
+	state.mesh = NULL;
+	for (unsigned int item = 0; item < QueuedItems.size(); ++item)
+	{
+		const SRenderItem& queued = QueuedItems[item];
+		const SRenderMethodShaders& shaders = RenderMethodShaders[queued.renderMethod];
+		unsigned int changes = ChangeRenderState( queued, &state, &RenderStats );
+		if (changes & VertexShaderChange)
+		{
+			g_pd3dDevice->SetVertexShader( queued.vertexShader );
+		}
+		if (changes & PixelShaderChange)
+		{
+			g_pd3dDevice->SetPixelShader( queued.pixelShader );
+		}
+		if ((changes & (RenderMethodChange | VertexShaderChange | PixelShaderChange)) &&
+		    shaders.setShaderConstants != NULL)
+		{
+			shaders.setShaderConstants();
+		}
+		if (changes & TextureChange)
+		{
+			g_pd3dDevice->SetTexture( 0, queued.texture );
+		}
+		if (changes & BufferChange)
+		{
+			queued.mesh->SetSubMeshBuffers( queued.subMesh );
+		}
+		if (shaders.setModelConstants != NULL)
+		{
+			shaders.setModelConstants( queued.model, queued.mesh->GetSubMesh( queued.subMesh ) );
+		}
+		RenderStats.numDrawCalls += queued.geometry->DrawSubMesh( queued.subMesh );
+	}
+	QueuedItems.clear();
+}
+
+// Get the counts from the last call to RenderQueue
+void CModel::GetRenderStats( SRenderStats* stats )
+{
+	*stats = RenderStats;
+}
+
+// Release the textures loaded for materials
+void CModel::ReleaseTextures()
+{
+	for (map<string, LPDIRECT3DTEXTURE9>::iterator texture = MaterialTextures.begin();
+	     texture != MaterialTextures.end(); ++texture)
+	{
+		SAFE_RELEASE( texture->second );
+	}
+	MaterialTextures.clear();
+}
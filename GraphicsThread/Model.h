@@ -7,18 +7,52 @@
 #pragma once // Prevent file being included more than once (would cause errors)
 
 #include <string>
+#include <vector>
 using namespace std;
 
 #include <d3d9.h>
 #include <d3dx9.h>
 #include "Input.h"
+#include "Mesh.h"
 
 //-----------------------------------------------------------------------------
 // DirectX Model Class
 //-----------------------------------------------------------------------------
 
+// An instance of a mesh in the scene - the mesh is shared with other models using the same geometry
+// (see CMesh), each model has its own position, orientation and scale, and level of detail. Models
+// can be rendered directly, or queued and rendered together sorted by render method, shaders and
+// texture so each state is changed as few times as possible
 class CModel
 {
+/////////////////////////////
+// Public types
+public:
+
+	// Functions setting shader constants for a render method. The shader constants function is
+	// called when the method's shaders are selected, e.g. to set the camera and lights. The model
+	// constants function is called before each sub-mesh is drawn, e.g. to set the world matrix
+	typedef void (*TSetShaderConstants)();
+	typedef void (*TSetModelConstants)( CModel* model, const CMesh::SSubMeshRange& subMesh );
+
+	// Counts from the last call to RenderQueue. State changes are counted for each vertex shader,
+	// pixel shader, texture and buffer change (a buffer change selects the vertex buffer, index
+	// buffer and vertex format). Also the state changes that would have been needed to render the
+	// queue in the order the models were queued
+	struct SRenderStats
+	{
+		unsigned int numDrawCalls;
+		unsigned int numShaderChanges;
+		unsigned int numTextureChanges;
+		unsigned int numBufferChanges;
+		unsigned int numStateChanges;
+		unsigned int numUnsortedStateChanges;
+	};
+
+	// Render method value meaning each sub-mesh uses the render method of its material
+	static const unsigned int MaterialRenderMethod = 0xffffffff;
+
+
 /////////////////////////////
 // Public member functions
 public:
@@ -32,7 +66,7 @@ public:
 	// Destructor
 	~CModel();
 
-	// Release resources used by model
+	// Release the model's mesh
 	void ReleaseResources();
 
 
@@ -62,14 +96,36 @@ public:
 		m_Scale = scale;
 	}
 
+	// Render all the model's sub-meshes with the given render method (a gen::ERenderMethod) and
+	// texture when queued, instead of those of their materials. Use MaterialRenderMethod / NULL
+	// to use the materials' again
+	void SetRenderMethod( unsigned int renderMethod )
+	{
+		m_RenderMethod = renderMethod;
+	}
+	void SetTexture( LPDIRECT3DTEXTURE9 texture )
+	{
+		m_Texture = texture;
+	}
+
 
 	/////////////////////////////
 	// Model Loading / Creation
 
-	// Load the model geometry from a file
-	bool Load( const string& fileName );
+	// Use the mesh for a file, loading it if not already loaded with the same options, optionally
+	// generating levels of detail, building meshlets (clusters of faces that can be culled, see
+	// CullMeshlets) and building a hierarchy for ray queries (see RayCast). Models loading the
+	// same file share its geometry
+	bool Load( const string& fileName, unsigned int numLODs = 0, bool meshlets = false,
+	           bool rayQueries = false );
+
+	// Use the mesh for a file as Load, but if not already loaded, load it in the background (see
+	// CMesh::LoadAsync). Use IsLoading / IsReady to check progress. Returns false if the load could
+	// not be started
+	bool LoadAsync( const string& fileName, unsigned int numLODs = 0, bool meshlets = false,
+	                bool rayQueries = false );
 
-	// Create the model geometry from arrays of vertices and indices
+	// Create the model geometry from arrays of vertices and indices. The geometry is not shared
 	bool CreateGeometry
 	(
 		void*        vertices,   // Pointer to vertex array (void* because we allow custom types)
@@ -79,14 +135,54 @@ public:
 		unsigned int numIndices  // Number of indices in the model mesh
 	);
 
+	// Set a model to render in place of models that are still loading (NULL for none)
+	static void SetPlaceholder( CModel* placeholder )
+	{
+		m_Placeholder = placeholder;
+	}
+
+	// Is the model's mesh waiting for a background load to complete
+	bool IsLoading()
+	{
+		return m_Mesh != NULL && m_Mesh->IsLoading();
+	}
+
+	// Does the model have geometry to render. A model that is neither loading nor ready has no
+	// geometry or failed to load
+	bool IsReady()
+	{
+		return m_Mesh != NULL && m_Mesh->IsReady();
+	}
+
 
 	/////////////////////////////
 	// Model Usage
 
 	// Calculate the model's world matrix from its current position, orientation and scale
 	void CalculateMatrix();
+
+	// Select the level of detail to render from the model's on-screen size - the lowest detail
+	// level whose error, projected onto the screen, is no more than the given number of pixels
+	void SelectLOD( const D3DXVECTOR3& cameraPosition, const D3DXMATRIXA16& projMatrix,
+	                float maxPixelError = 1.0f );
+
+	// Cull the model's meshlets against the camera - those outside the view frustum or facing
+	// away from the camera are not rendered. Only affects the full detail level and models loaded
+	// with meshlets. Call after CalculateMatrix, the result is used until the next call
+	void CullMeshlets( const D3DXVECTOR3& cameraPosition, const D3DXMATRIXA16& viewProjMatrix );
 	
-	// Render the model
+	// Find where a world space ray first hits the model's full detail geometry, within the given
+	// distance. Distances are in multiples of the direction, which need not be unit length.
+	// Returns false if there is no hit or the model was not loaded with ray queries. Call after
+	// CalculateMatrix
+	bool RayCast( const D3DXVECTOR3& origin, const D3DXVECTOR3& direction, float maxDistance,
+	              float* hitDistance );
+
+	// Return true if a world space ray hits the model within the given distance - e.g. to test
+	// line of sight. Faster than RayCast as it stops at the first hit found
+	bool RayHits( const D3DXVECTOR3& origin, const D3DXVECTOR3& direction, float maxDistance );
+
+	// Render the model (using the selected level of detail) with the current shaders and texture
 	void Render();
 	
 	// Control the model using keys
@@ -96,24 +192,65 @@ public:
 				  EKeyCode moveForward, EKeyCode moveBackward );
 
 
+	/////////////////////////////
+	// Render Queue
+
+	// Set the shaders used to render sub-meshes with a render method (a gen::ERenderMethod) and the
+	// functions to set their constants. Sub-meshes with a render method that has no shaders are not
+	// rendered by the queue
+	static void SetRenderMethodShaders( unsigned int renderMethod,
+	                                    LPDIRECT3DVERTEXSHADER9 vertexShader,
+	                                    LPDIRECT3DPIXELSHADER9 pixelShader,
+	                                    TSetShaderConstants setShaderConstants,
+	                                    TSetModelConstants setModelConstants );
+
+	// Add the model's sub-meshes to the render queue (using the selected level of detail). The
+	// model must not be changed or deleted until the queue is rendered
+	void Queue();
+
+	// Render the queued sub-meshes, sorted by render method, shaders, texture and mesh, then empty
+	// the queue. Call once per frame after queuing the models
+	static void RenderQueue();
+
+	// Get the counts from the last call to RenderQueue
+	static void GetRenderStats( SRenderStats* stats );
+
+	// Release the textures loaded for materials. Call before the DirectX device is released
+	static void ReleaseTextures();
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Draw a sub-mesh of the model's mesh (using the selected level of detail), with the current
+	// shaders, texture and buffers. Returns the number of draw calls made
+	unsigned int DrawSubMesh( unsigned int subMesh );
+
+
 /////////////////////////////
 // Private member variables
 private:
 
-	// Vertex data for the model stored in a vertex buffer and the number / size of
-	// the vertices in the buffer
-	LPDIRECT3DVERTEXBUFFER9 m_VertexBuffer;
-	unsigned int            m_NumVertices;
-	DWORD                   m_VertexFVF;  // DirectX FVF code for vertex format (look up D3DFVF)
-	unsigned int            m_VertexSize;
+	// Mesh used by this model, NULL if none. The model holds a reference to it
+	CMesh*        m_Mesh;
+
+	// Render method and texture used for all sub-meshes when queued, MaterialRenderMethod / NULL
+	// to use those of the sub-meshes' materials
+	unsigned int       m_RenderMethod;
+	LPDIRECT3DTEXTURE9 m_Texture;
+
+	// Level of detail rendered
+	unsigned int  m_CurrentLOD;
 
-	// Index data for the model stored in a index buffer and the number of
-	// indices in the buffer
-	LPDIRECT3DINDEXBUFFER9  m_IndexBuffer;
-	unsigned int            m_NumIndices;
+	// Ranges of indices left visible by the last call to CullMeshlets, whether they are in use and
+	// the version of the mesh they were culled from
+	vector<CMesh::SIndexRange> m_VisibleRanges;
+	bool          m_MeshletsCulled;
+	unsigned int  m_CulledVersion;
 
-	// Does this model have any geometry to render
-	bool          m_HasGeometry;
+	// Model rendered in place of models that are still loading
+	static CModel* m_Placeholder;
 
 	// Positions, rotations and scaling for the model
 	D3DXVECTOR3   m_Position;
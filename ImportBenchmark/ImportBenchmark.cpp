@@ -0,0 +1,759 @@
+/*******************************************
+	ImportBenchmark.cpp
+
+	Measures importer throughput over a
+	corpus of synthetic X-files and OBJ
+	files, reporting MB/s (overall and for
+	the parse of mesh data), faces/s, peak
+	memory and the time
+	to build the global material list and
+	match bones to frames. Also measures
+	the build time and ray query speed of
+	mesh BVHs, checked against brute force,
+	and the parallel tangent calculation
+	against the serial reference.
+	Runs on Windows and, with the Makefile,
+	on other platforms (e.g. Linux)
+********************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#ifdef _MSC_VER
+#include <process.h> // Use standard library to run each import in its own process
+#include <direct.h>
+#include <windows.h>
+#include <psapi.h>   // Process memory information
+#else
+#include <unistd.h>  // Run each import in a child process with fork and exec
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h> // Process memory information
+#endif
+
+#include "CImportXFile.h"
+#include "CImportOBJFile.h"
+#include "MeshBVH.h"
+#include "Parallel.h"
+#include "Profile.h"
+#include "XFileGenerator.h"
+
+
+/////////////////////////
+// Types / Data
+
+// One file in the benchmark corpus
+struct SBenchmarkCase
+{
+	string     name; // Description of the case, also used for the file name
+	SXFileSpec spec;
+	bool       obj;  // Written as an OBJ file rather than an X-file
+};
+
+// Folder to generate the corpus into
+const string CorpusFolder = "Corpus/";
+
+// Number of times each file is imported, the fastest time is reported
+const int NumRuns = 3;
+
+// Target throughput of the parse of an OBJ file. OBJ files parsed slower are marked in the results
+const double TargetOBJParseMBPerSecond = 500.0;
+
+// Scene mesh used for the ray query benchmark. X-files need DirectX, elsewhere use the OBJ copy
+// made for RasterBenchmark
+#ifdef GEN_DIRECTX
+const string RayMeshFile = "../GraphicsThread/Sphere.x";
+#else
+const string RayMeshFile = "../RasterBenchmark/Sphere.obj";
+#endif
+
+// Size of the generated mesh in the ray query benchmark - a torus with two faces per grid square
+const unsigned int TorusSegments = 1000;
+const unsigned int TorusSides = 500;
+
+// Number of random rays cast at each mesh, and the most brute force ray/face tests used to check
+// the results (limits the number of rays checked on large meshes)
+const unsigned int NumRays = 1000000;
+const double MaxCheckTests = 2.0e8;
+
+// Vertices in the OBJ file used by the tangent benchmark, and the largest difference allowed
+// between any component of the parallel and serial tangents (ranges of faces are summed in a
+// different order on several processors)
+const unsigned int TangentVertices = 1000000;
+const float MaxTangentDifference = 1.0e-4f;
+
+
+/////////////////////////
+// Platform
+
+// Create a folder, if it does not already exist
+void MakeFolder( const string& folder )
+{
+#ifdef _MSC_VER
+	_mkdir( folder.c_str() );
+#else
+	mkdir( folder.c_str(), 0755 );
+#endif
+}
+
+// Get the size of a file in MB, returns false if the file cannot be found
+bool GetFileSizeMB( const string& fileName, double* sizeMB )
+{
+#ifdef _MSC_VER
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA( fileName.c_str(), GetFileExInfoStandard, &attributes ))
+	{
+		return false;
+	}
+	*sizeMB = (static_cast<double>(attributes.nFileSizeHigh) * 4294967296.0 +
+	           attributes.nFileSizeLow) / (1024.0 * 1024.0);
+#else
+	struct stat attributes;
+	if (stat( fileName.c_str(), &attributes ) != 0)
+	{
+		return false;
+	}
+	*sizeMB = static_cast<double>(attributes.st_size) / (1024.0 * 1024.0);
+#endif
+	return true;
+}
+
+// Get the peak memory used by this process in MB
+double PeakMemoryMB()
+{
+#ifdef _MSC_VER
+	PROCESS_MEMORY_COUNTERS memory;
+	memory.cb = sizeof(memory);
+	GetProcessMemoryInfo( GetCurrentProcess(), &memory, sizeof(memory) );
+	return memory.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	struct rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+	return usage.ru_maxrss / 1024.0; // Kilobytes
+#endif
+}
+
+// Run this program again with the given arguments and wait for it to finish
+void RunChild( const char* program, const char* argument1, const char* argument2 )
+{
+#ifdef _MSC_VER
+	_spawnl( _P_WAIT, program, program, argument1, argument2, NULL );
+#else
+	pid_t child = fork();
+	if (child == 0)
+	{
+		execl( program, program, argument1, argument2, static_cast<char*>(NULL) );
+		_exit( 1 );
+	}
+	if (child > 0)
+	{
+		waitpid( child, NULL, 0 );
+	}
+#endif
+}
+
+
+/////////////////////////
+// Corpus
+
+// Add a case to the corpus in both text and binary formats
+void AddCase( vector<SBenchmarkCase>& cases, const string& name, const SXFileSpec& spec )
+{
+	SBenchmarkCase benchmarkCase;
+	benchmarkCase.name = name + "_txt";
+	benchmarkCase.spec = spec;
+	benchmarkCase.spec.binary = false;
+	benchmarkCase.obj = false;
+	cases.push_back( benchmarkCase );
+
+	benchmarkCase.name = name + "_bin";
+	benchmarkCase.spec.binary = true;
+	cases.push_back( benchmarkCase );
+}
+
+// Add a case to the corpus as an OBJ file
+void AddOBJCase( vector<SBenchmarkCase>& cases, const string& name, const SXFileSpec& spec )
+{
+	SBenchmarkCase benchmarkCase;
+	benchmarkCase.name = name + "_obj";
+	benchmarkCase.spec = spec;
+	benchmarkCase.obj = true;
+	cases.push_back( benchmarkCase );
+}
+
+// File name of a case in the corpus
+string CaseFileName( const SBenchmarkCase& benchmarkCase )
+{
+	return CorpusFolder + benchmarkCase.name + (benchmarkCase.obj ? ".obj" : ".x");
+}
+
+// Build the list of cases - one factor at a time is varied from a 10K vertex single mesh, so the
+// cost of each factor can be seen on its own
+vector<SBenchmarkCase> BuildCorpus()
+{
+	vector<SBenchmarkCase> cases;
+	SXFileSpec baseSpec;
+
+	// Size
+	unsigned int sizes[] = { 1000, 10000, 100000, 1000000 };
+	const char* sizeNames[] = { "verts_1K", "verts_10K", "verts_100K", "verts_1M" };
+	for (int size = 0; size < 4; ++size)
+	{
+		SXFileSpec spec = baseSpec;
+		spec.verticesPerMesh = sizes[size];
+		AddCase( cases, sizeNames[size], spec );
+	}
+
+	// Size as OBJ files, up to a 200MB file to measure the parse of a large file
+	for (int size = 0; size < 4; ++size)
+	{
+		SXFileSpec spec = baseSpec;
+		spec.verticesPerMesh = sizes[size];
+		AddOBJCase( cases, sizeNames[size], spec );
+	}
+
+	// Same total vertices split over many meshes
+	SXFileSpec spec = baseSpec;
+	spec.verticesPerMesh = baseSpec.verticesPerMesh / 16;
+	spec.numMeshes = 16;
+	AddCase( cases, "meshes_16", spec );
+
+	// Many materials
+	spec = baseSpec;
+	spec.materialsPerMesh = 8;
+	AddCase( cases, "materials_8", spec );
+
+	// Deep frame hierarchy
+	spec = baseSpec;
+	spec.frameDepth = 32;
+	AddCase( cases, "depth_32", spec );
+
+	// Scaling with the number of materials - all distinct, so each is looked up in a global list
+	// of all those before it
+	unsigned int materialCounts[] = { 10, 100, 1000, 10000 };
+	const char* materialNames[] = { "materials_10", "materials_100", "materials_1K",
+	                                "materials_10K" };
+	for (int count = 0; count < 4; ++count)
+	{
+		spec = baseSpec;
+		spec.materialsPerMesh = materialCounts[count];
+		AddCase( cases, materialNames[count], spec );
+	}
+
+	// Scaling with the number of frames - each of a fixed set of bones is matched to its frame
+	// among all the others
+	unsigned int frameCounts[] = { 1000, 5000, 10000, 50000 };
+	const char* frameNames[] = { "frames_1K", "frames_5K", "frames_10K", "frames_50K" };
+	for (int count = 0; count < 4; ++count)
+	{
+		spec = baseSpec;
+		spec.extraFrames = frameCounts[count];
+		spec.bonesPerMesh = 64;
+		AddCase( cases, frameNames[count], spec );
+	}
+
+	// Skinned
+	spec = baseSpec;
+	spec.bonesPerMesh = 16;
+	AddCase( cases, "bones_16", spec );
+
+	// Normals differing from the vertex face list, forcing vertex duplication
+	spec = baseSpec;
+	spec.normalDivergence = 0.25f;
+	AddCase( cases, "divergence_25", spec );
+	spec.normalDivergence = 1.0f;
+	AddCase( cases, "divergence_100", spec );
+
+	return cases;
+}
+
+
+/////////////////////////
+// Measurement
+
+// Import the given file several times and print the size, the fastest time, throughput and peak
+// memory use of this process, with the throughput of the read mesh stage (for OBJ files the parse
+// of the whole text) and the time of the material list and bone stages in the fastest run. Run
+// in a process of its own so the peak memory belongs to this file
+int RunImport( const string& fileName )
+{
+	// File size
+	double fileMB;
+	if (!GetFileSizeMB( fileName, &fileMB ))
+	{
+		printf( "  cannot open %s\n", fileName.c_str() );
+		return 1;
+	}
+
+	double bestSeconds = 1.0e30;
+	double parseMBPerSecond = 0.0, materialSeconds = 0.0, boneSeconds = 0.0;
+	unsigned int numFaces = 0;
+	for (int run = 0; run < NumRuns; ++run)
+	{
+		gen::CImportXFile importFile;
+		gen::TUInt64 startTime = gen::GetTimeStamp();
+		if (importFile.ImportFile( fileName ) != gen::kSuccess)
+		{
+			printf( "  import failed for %s\n", fileName.c_str() );
+			return 1;
+		}
+
+		// Include getting the mesh data, as a model would
+		numFaces = 0;
+		for (gen::TUInt32 subMesh = 0; subMesh < importFile.GetNumSubMeshes(); ++subMesh)
+		{
+			gen::SSubMesh subMeshData;
+			importFile.GetSubMesh( subMesh, &subMeshData );
+			numFaces += subMeshData.numFaces;
+			delete[] subMeshData.vertices;
+			delete[] subMeshData.faces;
+		}
+		double seconds = static_cast<double>(gen::GetTimeStamp() - startTime) /
+		                 gen::GetTimeStampFrequency();
+		if (seconds < bestSeconds)
+		{
+			bestSeconds = seconds;
+			const gen::SImportReport& report = importFile.GetImportReport();
+			const gen::SStageStats& parseStage = report.aStages[gen::kStageReadMesh];
+			parseMBPerSecond = parseStage.fSeconds > 0.0 ?
+			                   parseStage.iBytes / (1024.0 * 1024.0) / parseStage.fSeconds : 0.0;
+			materialSeconds = report.aStages[gen::kStageMaterialList].fSeconds;
+			boneSeconds = report.aStages[gen::kStageProcessBones].fSeconds;
+		}
+	}
+
+	double peakMB = PeakMemoryMB();
+
+	printf( "%9.2f %10u %10.2f %9.2f %10.2f %11.3f %9.1f %9.3f %9.3f", fileMB, numFaces,
+	        bestSeconds * 1000.0, fileMB / bestSeconds, parseMBPerSecond,
+	        numFaces / bestSeconds / 1.0e6, peakMB, materialSeconds * 1000.0,
+	        boneSeconds * 1000.0 );
+	if (gen::CImportOBJFile::IsOBJFile( fileName ) && parseMBPerSecond < TargetOBJParseMBPerSecond)
+	{
+		printf( "  below %.0f MB/s parse target", TargetOBJParseMBPerSecond );
+	}
+	printf( "\n" );
+	return 0;
+}
+
+
+/////////////////////////
+// Ray queries
+
+// A triangle mesh as positions and an index list, for building a BVH
+struct SRayMesh
+{
+	string                name;
+	vector<gen::CVector3> positions;
+	vector<gen::TUInt32>  indices;
+};
+
+// Load all the sub-meshes of a mesh file into a single triangle mesh, returns false on failure
+bool LoadRayMesh( const string& fileName, SRayMesh* mesh )
+{
+	gen::CImportXFile importFile;
+	if (importFile.ImportFile( fileName ) != gen::kSuccess)
+	{
+		printf( "Cannot load %s\n", fileName.c_str() );
+		return false;
+	}
+	mesh->name = fileName.substr( fileName.find_last_of( "/\\" ) + 1 );
+	for (gen::TUInt32 subMesh = 0; subMesh < importFile.GetNumSubMeshes(); ++subMesh)
+	{
+		gen::SSubMesh subMeshData;
+		if (importFile.GetSubMesh( subMesh, &subMeshData ) != gen::kSuccess)
+		{
+			printf( "Cannot get data from %s\n", fileName.c_str() );
+			return false;
+		}
+
+		// Positions are the first component of each vertex, use the full detail faces
+		gen::TUInt32 firstVertex = static_cast<gen::TUInt32>(mesh->positions.size());
+		for (gen::TUInt32 vertex = 0; vertex < subMeshData.numVertices; ++vertex)
+		{
+			mesh->positions.push_back( *reinterpret_cast<gen::CVector3*>(
+				subMeshData.vertices + vertex * subMeshData.vertexSize) );
+		}
+		gen::TUInt32 numIndices = subMeshData.lods[0].numFaces * 3;
+		for (gen::TUInt32 index = 0; index < numIndices; ++index)
+		{
+			gen::TUInt32 vertex = (subMeshData.indexSize == sizeof(gen::TUInt16)) ?
+				reinterpret_cast<gen::TUInt16*>(subMeshData.faces)[index] :
+				reinterpret_cast<gen::TUInt32*>(subMeshData.faces)[index];
+			mesh->indices.push_back( firstVertex + vertex );
+		}
+		delete[] subMeshData.vertices;
+		delete[] subMeshData.faces;
+	}
+	return true;
+}
+
+// Generate a bumpy torus with two faces per grid square of the given size
+void BuildTorus( unsigned int segments, unsigned int sides, SRayMesh* mesh )
+{
+	mesh->name = "Torus (" + to_string( static_cast<unsigned long long>(segments * sides * 2) ) +
+	             " faces)";
+	for (unsigned int segment = 0; segment < segments; ++segment)
+	{
+		float u = 2.0f * gen::kfPi * segment / segments;
+		for (unsigned int side = 0; side < sides; ++side)
+		{
+			float v = 2.0f * gen::kfPi * side / sides;
+			float radius = 0.35f + 0.03f * sinf( 12.0f * u ) * sinf( 9.0f * v );
+			float ring = 1.0f + radius * cosf( v );
+			mesh->positions.push_back( gen::CVector3( ring * cosf( u ), radius * sinf( v ),
+			                                          ring * sinf( u ) ) );
+
+			gen::TUInt32 corner00 = segment * sides + side;
+			gen::TUInt32 corner01 = segment * sides + (side + 1) % sides;
+			gen::TUInt32 corner10 = ((segment + 1) % segments) * sides + side;
+			gen::TUInt32 corner11 = ((segment + 1) % segments) * sides + (side + 1) % sides;
+			gen::TUInt32 faces[6] = { corner00, corner10, corner01, corner01, corner10, corner11 };
+			mesh->indices.insert( mesh->indices.end(), faces, faces + 6 );
+		}
+	}
+}
+
+// Simple repeatable random numbers in the range 0 to 1, the same on all platforms
+float RandomFloat( unsigned int* seed )
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return (*seed >> 8) * (1.0f / 16777216.0f);
+}
+
+// Find the closest face hit by a ray by testing every face of a mesh, in the same way as
+// CMeshBVH::RayCastClosest, returns true and the hit details if a face was hit
+bool BruteForceClosest( const SRayMesh& mesh, const gen::CVector3& origin,
+                        const gen::CVector3& direction, float maxDistance, gen::SRayHit* hit )
+{
+	bool found = false;
+	hit->fDistance = maxDistance;
+	for (gen::TUInt32 face = 0; face < mesh.indices.size() / 3; ++face)
+	{
+		const gen::CVector3& p0 = mesh.positions[mesh.indices[face * 3]];
+		gen::CVector3 edge1 = mesh.positions[mesh.indices[face * 3 + 1]] - p0;
+		gen::CVector3 edge2 = mesh.positions[mesh.indices[face * 3 + 2]] - p0;
+		gen::CVector3 p = gen::Cross( direction, edge2 );
+		float det = gen::Dot( edge1, p );
+		if (det == 0.0f)
+		{
+			continue;
+		}
+		float invDet = 1.0f / det;
+		gen::CVector3 t = origin - p0;
+		float u = gen::Dot( t, p ) * invDet;
+		if (u < 0.0f || u > 1.0f)
+		{
+			continue;
+		}
+		gen::CVector3 q = gen::Cross( t, edge1 );
+		float v = gen::Dot( direction, q ) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			continue;
+		}
+		float distance = gen::Dot( edge2, q ) * invDet;
+		if (distance >= 0.0f && distance <= hit->fDistance)
+		{
+			hit->iFace = face;
+			hit->fDistance = distance;
+			found = true;
+		}
+	}
+	return found;
+}
+
+// Build a BVH over a mesh, then cast random rays at it from outside its bounds towards points
+// inside, with both queries. Prints the build time, rays per second and the number of rays whose
+// results differ from a brute force test of every face (the first rays, as many as the test
+// budget allows). Returns the number of differences
+unsigned int RunRayQueries( const SRayMesh& mesh )
+{
+	gen::TUInt32 numFaces = static_cast<gen::TUInt32>(mesh.indices.size() / 3);
+	gen::TUInt64 startTime = gen::GetTimeStamp();
+	gen::CMeshBVH bvh;
+	bvh.Build( &mesh.indices[0], numFaces, &mesh.positions[0] );
+	double buildSeconds = static_cast<double>(gen::GetTimeStamp() - startTime) /
+	                      gen::GetTimeStampFrequency();
+
+	// Rays start on a sphere twice the size of the bounds and pass through a random point within
+	// the bounding sphere, reaching as far again beyond it
+	gen::CVector3 minBounds = mesh.positions[0], maxBounds = mesh.positions[0];
+	for (gen::TUInt32 vertex = 1; vertex < mesh.positions.size(); ++vertex)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			minBounds[axis] = gen::Min( minBounds[axis], mesh.positions[vertex][axis] );
+			maxBounds[axis] = gen::Max( maxBounds[axis], mesh.positions[vertex][axis] );
+		}
+	}
+	gen::CVector3 centre = (minBounds + maxBounds) * 0.5f;
+	float radius = gen::Length( maxBounds - minBounds ) * 0.5f;
+	vector<gen::CVector3> origins( NumRays ), directions( NumRays );
+	unsigned int seed = 1;
+	for (unsigned int ray = 0; ray < NumRays; ++ray)
+	{
+		const gen::CVector3 one( 1.0f, 1.0f, 1.0f );
+		gen::CVector3 offset, target;
+		do
+		{
+			offset = gen::CVector3( RandomFloat( &seed ), RandomFloat( &seed ),
+			                        RandomFloat( &seed ) ) * 2.0f - one;
+		} while (gen::LengthSquared( offset ) > 1.0f || gen::LengthSquared( offset ) < 0.01f);
+		do
+		{
+			target = gen::CVector3( RandomFloat( &seed ), RandomFloat( &seed ),
+			                        RandomFloat( &seed ) ) * 2.0f - one;
+		} while (gen::LengthSquared( target ) > 1.0f);
+		origins[ray] = centre + gen::Normalise( offset ) * (2.0f * radius);
+		directions[ray] = centre + target * radius - origins[ray];
+	}
+	const float maxDistance = 2.0f;
+
+	vector<gen::SRayHit> hits( NumRays );
+	vector<char> hitFound( NumRays ), anyFound( NumRays );
+	startTime = gen::GetTimeStamp();
+	for (unsigned int ray = 0; ray < NumRays; ++ray)
+	{
+		hitFound[ray] = bvh.RayCastClosest( origins[ray], directions[ray], maxDistance,
+		                                    &hits[ray] );
+	}
+	double closestSeconds = static_cast<double>(gen::GetTimeStamp() - startTime) /
+	                        gen::GetTimeStampFrequency();
+	startTime = gen::GetTimeStamp();
+	for (unsigned int ray = 0; ray < NumRays; ++ray)
+	{
+		anyFound[ray] = bvh.RayCastAny( origins[ray], directions[ray], maxDistance );
+	}
+	double anySeconds = static_cast<double>(gen::GetTimeStamp() - startTime) /
+	                    gen::GetTimeStampFrequency();
+	unsigned int numHits = 0;
+	for (unsigned int ray = 0; ray < NumRays; ++ray)
+	{
+		numHits += hitFound[ray] ? 1 : 0;
+	}
+
+	// Check against brute force. Different faces may be reported where faces share an edge, so
+	// only the distances of hits are compared
+	double checkRays = floor( MaxCheckTests / numFaces );
+	unsigned int numChecked = (checkRays < NumRays) ? static_cast<unsigned int>(checkRays) :
+	                                                  NumRays;
+	numChecked = (numChecked > 0) ? numChecked : 1;
+	unsigned int numDifferences = 0;
+	for (unsigned int ray = 0; ray < numChecked; ++ray)
+	{
+		gen::SRayHit bruteHit;
+		bool bruteFound = BruteForceClosest( mesh, origins[ray], directions[ray], maxDistance,
+		                                     &bruteHit );
+		if (bruteFound != (hitFound[ray] != 0) || bruteFound != (anyFound[ray] != 0) ||
+		    (bruteFound && fabs( bruteHit.fDistance - hits[ray].fDistance ) > 1.0e-6f))
+		{
+			++numDifferences;
+		}
+	}
+
+	printf( "%-22s %9u %10.2f %9u %9.2f %12.3f %12.3f %7.1f %9u %9u\n", mesh.name.c_str(),
+	        numFaces, buildSeconds * 1000.0, bvh.GetNumNodes(),
+	        bvh.GetMemoryUsed() / (1024.0 * 1024.0), NumRays / closestSeconds / 1.0e6,
+	        NumRays / anySeconds / 1.0e6, 100.0 * numHits / NumRays, numChecked,
+	        numDifferences );
+	return numDifferences;
+}
+
+// Run the ray query benchmark on the given mesh files (the scene's sphere if none are given) and
+// a generated torus of a million faces. Returns 0 if all results match brute force
+int RunRayBenchmark( int numFiles, char* fileNames[] )
+{
+	vector<string> files( fileNames, fileNames + numFiles );
+	if (files.empty())
+	{
+		files.push_back( RayMeshFile );
+	}
+
+	printf( "Casting %u rays at each mesh on %u processors\n\n", NumRays, gen::NumProcessors() );
+	printf( "%-22s %9s %10s %9s %9s %12s %12s %7s %9s %9s\n", "Mesh", "Faces", "Build ms",
+	        "Nodes", "Memory MB", "Closest Mr/s", "Any Mr/s", "Hit %", "Checked", "Differ" );
+	unsigned int numDifferences = 0;
+	for (unsigned int file = 0; file < files.size(); ++file)
+	{
+		SRayMesh mesh;
+		if (!LoadRayMesh( files[file], &mesh ))
+		{
+			return 1;
+		}
+		numDifferences += RunRayQueries( mesh );
+	}
+	SRayMesh torus;
+	BuildTorus( TorusSegments, TorusSides, &torus );
+	numDifferences += RunRayQueries( torus );
+
+	if (numDifferences > 0)
+	{
+		printf( "\n%u rays differ from brute force\n", numDifferences );
+		return 1;
+	}
+	return 0;
+}
+
+
+/////////////////////////
+// Tangents
+
+// Get the vertex data of every sub-mesh of an imported file, with or without tangents, and the
+// time taken. The tangents are appended to the given list if it is not NULL. Returns false if
+// tangents were requested but some sub-mesh has none
+bool GetAllSubMeshes( gen::CImportXFile& importFile, bool tangents, double* seconds,
+                      vector<gen::CVector3>* tangentList )
+{
+	gen::TUInt64 startTime = gen::GetTimeStamp();
+	bool allTangents = true;
+	for (gen::TUInt32 subMesh = 0; subMesh < importFile.GetNumSubMeshes(); ++subMesh)
+	{
+		gen::SSubMesh subMeshData;
+		importFile.GetSubMesh( subMesh, &subMeshData, tangents );
+		allTangents = allTangents && (subMeshData.hasTangents || !tangents);
+
+		// Tangents follow the position and normal (the benchmark meshes are not skinned)
+		if (tangentList != NULL && subMeshData.hasTangents)
+		{
+			unsigned int offset = sizeof(gen::CVector3) * 2;
+			for (gen::TUInt32 vertex = 0; vertex < subMeshData.numVertices; ++vertex)
+			{
+				tangentList->push_back( *reinterpret_cast<gen::CVector3*>(
+					subMeshData.vertices + vertex * subMeshData.vertexSize + offset) );
+			}
+		}
+		delete[] subMeshData.vertices;
+		delete[] subMeshData.faces;
+	}
+	*seconds = static_cast<double>(gen::GetTimeStamp() - startTime) /
+	           gen::GetTimeStampFrequency();
+	return allTangents;
+}
+
+// Import a generated OBJ file with a million vertices and calculate its tangents with the
+// parallel code and the serial reference. Prints the best time of each to get the sub-meshes with
+// and without tangents, and the difference (the tangent calculation). Returns 0 if the parallel
+// tangents match the serial ones
+int RunTangentBenchmark()
+{
+	MakeFolder( CorpusFolder );
+	string fileName = CorpusFolder + "tangents_1M.obj";
+	SXFileSpec spec;
+	spec.verticesPerMesh = TangentVertices;
+	if (!GenerateOBJFile( fileName, spec ))
+	{
+		printf( "Cannot write %s\n", fileName.c_str() );
+		return 1;
+	}
+
+	printf( "Calculating tangents for %u vertices on %u processors\n\n", TangentVertices,
+	        gen::NumProcessors() );
+	printf( "%-10s %10s %13s %11s %10s\n", "Path", "Vertices", "No tangent ms", "Tangent ms",
+	        "Mverts/s" );
+	vector<gen::CVector3> tangents[2];
+	const char* pathNames[2] = { "Parallel", "Serial" };
+	for (int path = 0; path < 2; ++path)
+	{
+		gen::SImportOptions options;
+		options.bSerialTangents = (path == 1);
+		gen::CImportXFile importFile;
+		if (importFile.ImportFile( fileName, options ) != gen::kSuccess)
+		{
+			printf( "Cannot load %s\n", fileName.c_str() );
+			return 1;
+		}
+
+		double bestWithout = 1.0e30, bestWith = 1.0e30;
+		for (int run = 0; run < NumRuns; ++run)
+		{
+			double seconds;
+			GetAllSubMeshes( importFile, false, &seconds, NULL );
+			bestWithout = min( bestWithout, seconds );
+			tangents[path].clear();
+			if (!GetAllSubMeshes( importFile, true, &seconds, &tangents[path] ))
+			{
+				printf( "No tangents calculated for %s\n", fileName.c_str() );
+				return 1;
+			}
+			bestWith = min( bestWith, seconds );
+		}
+		double tangentSeconds = max( bestWith - bestWithout, 1.0e-9 );
+		printf( "%-10s %10u %13.2f %11.2f %10.2f\n", pathNames[path],
+		        static_cast<unsigned int>(tangents[path].size()), bestWithout * 1000.0,
+		        tangentSeconds * 1000.0, tangents[path].size() / tangentSeconds / 1.0e6 );
+	}
+
+	// Compare the parallel tangents with the serial ones
+	float maxDifference = 0.0f;
+	unsigned int numDifferences = 0;
+	for (unsigned int vertex = 0; vertex < tangents[0].size(); ++vertex)
+	{
+		float difference = 0.0f;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			difference = max( difference, fabsf( tangents[0][vertex][axis] -
+			                                     tangents[1][vertex][axis] ) );
+		}
+		maxDifference = max( maxDifference, difference );
+		numDifferences += (difference > MaxTangentDifference) ? 1 : 0;
+	}
+	printf( "\nLargest difference from serial %g, %u tangents differ by more than %g\n",
+	        maxDifference, numDifferences, MaxTangentDifference );
+	return (numDifferences > 0 || tangents[0].size() != tangents[1].size()) ? 1 : 0;
+}
+
+
+/////////////////////////
+// Main
+
+// With no arguments, generate the corpus and benchmark each file in a child process. With
+// "-run <file>", benchmark a single file. With "-bvh [files]", run the ray query benchmark. With
+// "-tangents", compare the parallel and serial tangent calculations
+int main( int argc, char* argv[] )
+{
+	if (argc == 3 && string( argv[1] ) == "-run")
+	{
+		return RunImport( argv[2] );
+	}
+	if (argc >= 2 && string( argv[1] ) == "-bvh")
+	{
+		return RunRayBenchmark( argc - 2, argv + 2 );
+	}
+	if (argc == 2 && string( argv[1] ) == "-tangents")
+	{
+		return RunTangentBenchmark();
+	}
+
+	// Generate the corpus
+	MakeFolder( CorpusFolder );
+	vector<SBenchmarkCase> cases = BuildCorpus();
+	printf( "Generating %d files in %s\n", static_cast<int>(cases.size()), CorpusFolder.c_str() );
+	for (unsigned int i = 0; i < cases.size(); ++i)
+	{
+		string fileName = CaseFileName( cases[i] );
+		bool written = cases[i].obj ? GenerateOBJFile( fileName, cases[i].spec ) :
+		                              GenerateXFile( fileName, cases[i].spec );
+		if (!written)
+		{
+			printf( "Cannot write %s\n", fileName.c_str() );
+			return 1;
+		}
+	}
+
+	// Benchmark each file in a fresh process so peak memory is not carried between files
+	printf( "\n%-18s %9s %10s %10s %9s %10s %11s %9s %9s %9s\n", "File", "Size MB", "Faces",
+	        "Best ms", "MB/s", "Parse MB/s", "Mfaces/s", "Peak MB", "Mat ms", "Bones ms" );
+	for (unsigned int i = 0; i < cases.size(); ++i)
+	{
+		string fileName = CaseFileName( cases[i] );
+		printf( "%-18s ", cases[i].name.c_str() );
+		fflush( stdout );
+		RunChild( argv[0], "-run", fileName.c_str() );
+	}
+
+	return 0;
+}
@@ -0,0 +1,613 @@
+/*******************************************
+	XFileGenerator.cpp
+
+	Generation of synthetic X-files (and the
+	same meshes as OBJ files) with
+	controllable size and content, used to
+	benchmark the importer
+********************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "XFileGenerator.h"
+
+
+/////////////////////////
+// X-file writer
+
+// Tokens used in the binary X-file format
+const unsigned short TokenName = 1;
+const unsigned short TokenString = 2;
+const unsigned short TokenIntegerList = 6;
+const unsigned short TokenFloatList = 7;
+const unsigned short TokenOpenBrace = 10;
+const unsigned short TokenCloseBrace = 11;
+const unsigned short TokenSemicolon = 20;
+
+// Writes the objects and members of an X-file in text or binary format. Member functions match
+// the kinds of member used by the standard templates, so the generator does not need to know
+// the format
+class CXFileWriter
+{
+public:
+	// Open the file and write the header. Check IsOpen before use
+	CXFileWriter( const string& fileName, bool binary )
+	{
+		m_Binary = binary;
+		m_Depth = 0;
+		m_File = fopen( fileName.c_str(), binary ? "wb" : "w" );
+		if (m_File)
+		{
+			fputs( binary ? "xof 0303bin 0032" : "xof 0303txt 0032\n", m_File );
+		}
+	}
+
+	~CXFileWriter()
+	{
+		if (m_File)
+		{
+			fclose( m_File );
+		}
+	}
+
+	bool IsOpen()
+	{
+		return m_File != NULL;
+	}
+
+	// Start an object of the given template type with an optional name, then end it
+	void BeginObject( const char* type, const string& name = "" )
+	{
+		if (m_Binary)
+		{
+			WriteName( type );
+			if (!name.empty())
+			{
+				WriteName( name );
+			}
+			WriteToken( TokenOpenBrace );
+		}
+		else
+		{
+			Indent();
+			fprintf( m_File, "%s %s%s{\n", type, name.c_str(), name.empty() ? "" : " " );
+		}
+		++m_Depth;
+	}
+
+	void EndObject()
+	{
+		--m_Depth;
+		if (m_Binary)
+		{
+			WriteToken( TokenCloseBrace );
+		}
+		else
+		{
+			Indent();
+			fputs( "}\n", m_File );
+		}
+	}
+
+	// Single DWORD or WORD member
+	void Integer( unsigned int value )
+	{
+		Integers( &value, 1 );
+	}
+
+	// Array of DWORDs member
+	void Integers( const unsigned int* values, unsigned int count )
+	{
+		if (m_Binary)
+		{
+			WriteToken( TokenIntegerList );
+			WriteData( &count, sizeof(count) );
+			WriteData( values, count * sizeof(unsigned int) );
+			return;
+		}
+		Indent();
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			fprintf( m_File, i + 1 < count ? "%u," : "%u", values[i] );
+		}
+		fputs( ";\n", m_File );
+	}
+
+	// Single FLOAT member
+	void Float( float value )
+	{
+		if (m_Binary)
+		{
+			WriteFloats( &value, 1 );
+			return;
+		}
+		Indent();
+		fprintf( m_File, "%f;\n", value );
+	}
+
+	// Array member whose elements are structures of the given number of FLOATs (e.g. Vector has
+	// 3, Coords2d has 2), or an array of FLOATs if elementSize is 1
+	void Floats( const float* values, unsigned int count, unsigned int elementSize )
+	{
+		if (m_Binary)
+		{
+			WriteFloats( values, count * elementSize );
+			return;
+		}
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			Indent();
+			for (unsigned int j = 0; j < elementSize; ++j)
+			{
+				fprintf( m_File, elementSize > 1 ? "%f;" : "%f", values[i * elementSize + j] );
+			}
+			fputs( i + 1 < count ? ",\n" : ";\n", m_File );
+		}
+		if (count == 0)
+		{
+			Indent();
+			fputs( ";\n", m_File );
+		}
+	}
+
+	// Structure member made of the given number of FLOATs (e.g. ColorRGBA)
+	void FloatStructure( const float* values, unsigned int count )
+	{
+		if (m_Binary)
+		{
+			WriteFloats( values, count );
+			return;
+		}
+		Indent();
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			fprintf( m_File, "%f;", values[i] );
+		}
+		fputs( ";\n", m_File );
+	}
+
+	// Matrix4x4 member
+	void Matrix( const float* values )
+	{
+		if (m_Binary)
+		{
+			WriteFloats( values, 16 );
+			return;
+		}
+		Indent();
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			fprintf( m_File, i < 15 ? "%f," : "%f;;\n", values[i] );
+		}
+	}
+
+	// Array of MeshFace member - triangles given by three indices each
+	void Faces( const unsigned int* indices, unsigned int numFaces )
+	{
+		if (m_Binary)
+		{
+			vector<unsigned int> data( numFaces * 4 );
+			for (unsigned int face = 0; face < numFaces; ++face)
+			{
+				data[face * 4] = 3;
+				data[face * 4 + 1] = indices[face * 3];
+				data[face * 4 + 2] = indices[face * 3 + 1];
+				data[face * 4 + 3] = indices[face * 3 + 2];
+			}
+			WriteToken( TokenIntegerList );
+			unsigned int count = numFaces * 4;
+			WriteData( &count, sizeof(count) );
+			if (count > 0)
+			{
+				WriteData( &data[0], count * sizeof(unsigned int) );
+			}
+			return;
+		}
+		for (unsigned int face = 0; face < numFaces; ++face)
+		{
+			Indent();
+			fprintf( m_File, "3;%u,%u,%u;%s\n", indices[face * 3], indices[face * 3 + 1],
+			         indices[face * 3 + 2], face + 1 < numFaces ? "," : ";" );
+		}
+	}
+
+	// STRING member
+	void String( const string& value )
+	{
+		if (m_Binary)
+		{
+			WriteToken( TokenString );
+			unsigned int count = static_cast<unsigned int>(value.size());
+			WriteData( &count, sizeof(count) );
+			WriteData( value.c_str(), count );
+			unsigned int terminator = TokenSemicolon;
+			WriteData( &terminator, sizeof(terminator) );
+			return;
+		}
+		Indent();
+		fprintf( m_File, "\"%s\";\n", value.c_str() );
+	}
+
+private:
+	void Indent()
+	{
+		for (unsigned int i = 0; i < m_Depth; ++i)
+		{
+			fputc( ' ', m_File );
+		}
+	}
+
+	void WriteData( const void* data, size_t size )
+	{
+		fwrite( data, 1, size, m_File );
+	}
+
+	void WriteToken( unsigned short token )
+	{
+		WriteData( &token, sizeof(token) );
+	}
+
+	void WriteName( const string& name )
+	{
+		WriteToken( TokenName );
+		unsigned int count = static_cast<unsigned int>(name.size());
+		WriteData( &count, sizeof(count) );
+		WriteData( name.c_str(), count );
+	}
+
+	void WriteFloats( const float* values, unsigned int count )
+	{
+		WriteToken( TokenFloatList );
+		WriteData( &count, sizeof(count) );
+		WriteData( values, count * sizeof(float) );
+	}
+
+	FILE*        m_File;
+	bool         m_Binary;
+	unsigned int m_Depth;
+};
+
+
+/////////////////////////
+// Generation
+
+// Identity matrix for frame transforms and bone offsets
+const float IdentityMatrix[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+
+// A grid mesh with normals, texture coordinates and materials, as vertex and face lists
+struct SGridMesh
+{
+	unsigned int         width, height;
+	unsigned int         numVertices, numFaces, numMaterials;
+	vector<float>        positions, normals, uvs;
+	vector<unsigned int> faces, normalFaces, faceMaterials;
+};
+
+// Build one of the grid meshes described by a spec
+void BuildGridMesh( const SXFileSpec& spec, unsigned int mesh, SGridMesh* grid )
+{
+	// Grid dimensions giving about the requested number of vertices
+	unsigned int width = static_cast<unsigned int>(sqrt( (float)spec.verticesPerMesh ));
+	if (width < 2) width = 2;
+	unsigned int height = (spec.verticesPerMesh + width - 1) / width;
+	if (height < 2) height = 2;
+	unsigned int numVertices = width * height;
+	unsigned int numFaces = (width - 1) * (height - 1) * 2;
+	grid->width = width;
+	grid->height = height;
+	grid->numVertices = numVertices;
+	grid->numFaces = numFaces;
+
+	// Vertices on a gently undulating grid, meshes side by side. Normals and texture coordinates
+	// are per-vertex
+	vector<float>& positions = grid->positions;
+	vector<float>& normals = grid->normals;
+	vector<float>& uvs = grid->uvs;
+	positions.resize( numVertices * 3 );
+	normals.resize( numVertices * 3 );
+	uvs.resize( numVertices * 2 );
+	for (unsigned int z = 0; z < height; ++z)
+	{
+		for (unsigned int x = 0; x < width; ++x)
+		{
+			unsigned int vertex = z * width + x;
+			positions[vertex * 3] = static_cast<float>(x + mesh * width);
+			positions[vertex * 3 + 1] = sinf( x * 0.1f ) * cosf( z * 0.1f );
+			positions[vertex * 3 + 2] = static_cast<float>(z);
+			normals[vertex * 3] = 0.0f;
+			normals[vertex * 3 + 1] = 1.0f;
+			normals[vertex * 3 + 2] = 0.0f;
+			uvs[vertex * 2] = static_cast<float>(x) / (width - 1);
+			uvs[vertex * 2 + 1] = static_cast<float>(z) / (height - 1);
+		}
+	}
+
+	// Two faces per grid square
+	vector<unsigned int>& faces = grid->faces;
+	faces.clear();
+	faces.reserve( numFaces * 3 );
+	for (unsigned int z = 0; z < height - 1; ++z)
+	{
+		for (unsigned int x = 0; x < width - 1; ++x)
+		{
+			unsigned int corner = z * width + x;
+			unsigned int faceIndices[6] = { corner, corner + width, corner + 1,
+			                                corner + 1, corner + width, corner + width + 1 };
+			faces.insert( faces.end(), faceIndices, faceIndices + 6 );
+		}
+	}
+
+	// Divergent faces use three normals of their own, tilted so they differ from the shared ones
+	vector<unsigned int>& normalFaces = grid->normalFaces;
+	normalFaces = faces;
+	for (unsigned int face = 0; face < numFaces; ++face)
+	{
+		if (static_cast<unsigned int>((face + 1) * spec.normalDivergence) >
+		    static_cast<unsigned int>(face * spec.normalDivergence))
+		{
+			for (unsigned int corner = 0; corner < 3; ++corner)
+			{
+				normalFaces[face * 3 + corner] = static_cast<unsigned int>(normals.size() / 3);
+				normals.push_back( 0.1f );
+				normals.push_back( 0.995f );
+				normals.push_back( 0.0f );
+			}
+		}
+	}
+
+	// Materials in bands of faces
+	unsigned int numMaterials = spec.materialsPerMesh ? spec.materialsPerMesh : 1;
+	grid->numMaterials = numMaterials;
+	grid->faceMaterials.resize( numFaces );
+	for (unsigned int face = 0; face < numFaces; ++face)
+	{
+		grid->faceMaterials[face] = static_cast<unsigned int>(
+			static_cast<unsigned long long>(face) * numMaterials / numFaces);
+	}
+}
+
+// Write a grid mesh with normals, texture coordinates, materials and optional skinning. Returns
+// the number of faces
+unsigned int WriteMesh( CXFileWriter& writer, const SXFileSpec& spec, unsigned int mesh )
+{
+	SGridMesh grid;
+	BuildGridMesh( spec, mesh, &grid );
+	unsigned int width = grid.width;
+	unsigned int numVertices = grid.numVertices;
+	unsigned int numFaces = grid.numFaces;
+	const vector<float>& positions = grid.positions;
+	const vector<float>& normals = grid.normals;
+	const vector<float>& uvs = grid.uvs;
+	const vector<unsigned int>& faces = grid.faces;
+	const vector<unsigned int>& normalFaces = grid.normalFaces;
+
+	writer.BeginObject( "Mesh", "Mesh_" + to_string( static_cast<unsigned long long>(mesh) ) );
+	writer.Integer( numVertices );
+	writer.Floats( &positions[0], numVertices, 3 );
+	writer.Integer( numFaces );
+	writer.Faces( &faces[0], numFaces );
+
+	writer.BeginObject( "MeshNormals" );
+	writer.Integer( static_cast<unsigned int>(normals.size() / 3) );
+	writer.Floats( &normals[0], static_cast<unsigned int>(normals.size() / 3), 3 );
+	writer.Integer( numFaces );
+	writer.Faces( &normalFaces[0], numFaces );
+	writer.EndObject();
+
+	writer.BeginObject( "MeshTextureCoords" );
+	writer.Integer( numVertices );
+	writer.Floats( &uvs[0], numVertices, 2 );
+	writer.EndObject();
+
+	// Materials in bands of faces
+	unsigned int numMaterials = grid.numMaterials;
+	writer.BeginObject( "MeshMaterialList" );
+	writer.Integer( numMaterials );
+	writer.Integer( numFaces );
+	writer.Integers( &grid.faceMaterials[0], numFaces );
+	for (unsigned int material = 0; material < numMaterials; ++material)
+	{
+		float shade = 0.5f + 0.5f * material / numMaterials;
+		float diffuse[4] = { shade, shade, shade, 1.0f };
+		float black[3] = { 0.0f, 0.0f, 0.0f };
+		writer.BeginObject( "Material" );
+		writer.FloatStructure( diffuse, 4 );
+		writer.Float( 20.0f );
+		writer.FloatStructure( black, 3 );
+		writer.FloatStructure( black, 3 );
+		writer.EndObject();
+	}
+	writer.EndObject();
+
+	// Skinning - each vertex is weighted between the two bones nearest to it across the grid
+	if (spec.bonesPerMesh > 0)
+	{
+		unsigned int numBones = spec.bonesPerMesh;
+		vector< vector<unsigned int> > boneVertices( numBones );
+		vector< vector<float> > boneWeights( numBones );
+		for (unsigned int vertex = 0; vertex < numVertices; ++vertex)
+		{
+			float bonePosition = static_cast<float>(vertex % width) / (width - 1) * (numBones - 1);
+			unsigned int bone = static_cast<unsigned int>(bonePosition);
+			float blend = bonePosition - bone;
+			boneVertices[bone].push_back( vertex );
+			boneWeights[bone].push_back( 1.0f - blend );
+			if (blend > 0.0f && bone + 1 < numBones)
+			{
+				boneVertices[bone + 1].push_back( vertex );
+				boneWeights[bone + 1].push_back( blend );
+			}
+		}
+
+		writer.BeginObject( "XSkinMeshHeader" );
+		writer.Integer( numBones > 1 ? 2 : 1 );
+		writer.Integer( numBones > 3 ? 4 : numBones );
+		writer.Integer( numBones );
+		writer.EndObject();
+		for (unsigned int bone = 0; bone < numBones; ++bone)
+		{
+			unsigned int numWeights = static_cast<unsigned int>(boneVertices[bone].size());
+			writer.BeginObject( "SkinWeights" );
+			writer.String( "Bone_" + to_string( static_cast<unsigned long long>(bone) ) );
+			writer.Integer( numWeights );
+			writer.Integers( numWeights ? &boneVertices[bone][0] : NULL, numWeights );
+			writer.Floats( numWeights ? &boneWeights[bone][0] : NULL, numWeights, 1 );
+			writer.Matrix( IdentityMatrix );
+			writer.EndObject();
+		}
+	}
+
+	writer.EndObject();
+	return numFaces;
+}
+
+// Write a chain of frames down to the given depth, with the meshes in the deepest frame.
+// Returns the number of faces written
+unsigned int WriteFrames( CXFileWriter& writer, const SXFileSpec& spec, unsigned int depth )
+{
+	if (depth == spec.frameDepth)
+	{
+		unsigned int numFaces = 0;
+		for (unsigned int mesh = 0; mesh < spec.numMeshes; ++mesh)
+		{
+			numFaces += WriteMesh( writer, spec, mesh );
+		}
+		return numFaces;
+	}
+
+	writer.BeginObject( "Frame", "Frame_" + to_string( static_cast<unsigned long long>(depth) ) );
+	writer.BeginObject( "FrameTransformMatrix" );
+	writer.Matrix( IdentityMatrix );
+	writer.EndObject();
+	unsigned int numFaces = WriteFrames( writer, spec, depth + 1 );
+	writer.EndObject();
+	return numFaces;
+}
+
+// Write a synthetic X-file to the given file name. Returns false if the file cannot be written.
+// Optionally returns the total number of faces written
+bool GenerateXFile( const string& fileName, const SXFileSpec& spec, unsigned int* numFaces )
+{
+	CXFileWriter writer( fileName, spec.binary );
+	if (!writer.IsOpen())
+	{
+		return false;
+	}
+
+	// Extra frames and the frames for the bones, at the top level
+	for (unsigned int frame = 0; frame < spec.extraFrames; ++frame)
+	{
+		string name = "Node_" + to_string( static_cast<unsigned long long>(frame) );
+		writer.BeginObject( "Frame", name );
+		writer.BeginObject( "FrameTransformMatrix" );
+		writer.Matrix( IdentityMatrix );
+		writer.EndObject();
+		writer.EndObject();
+	}
+	for (unsigned int bone = 0; bone < spec.bonesPerMesh; ++bone)
+	{
+		writer.BeginObject( "Frame", "Bone_" + to_string( static_cast<unsigned long long>(bone) ) );
+		writer.BeginObject( "FrameTransformMatrix" );
+		writer.Matrix( IdentityMatrix );
+		writer.EndObject();
+		writer.EndObject();
+	}
+
+	// Frame hierarchy holding the meshes
+	unsigned int facesWritten = WriteFrames( writer, spec, 0 );
+	if (numFaces)
+	{
+		*numFaces = facesWritten;
+	}
+	return true;
+}
+
+
+/////////////////////////
+// OBJ generation
+
+// Write the meshes described by a spec as a Wavefront OBJ file, with a material library of the
+// same name (.mtl). OBJ files have no frames or skinning, so those parts of the spec and the
+// binary flag are ignored. Each mesh is an object, texture V is flipped to the OBJ convention
+// so the imported data matches the X-file. Returns false if the files cannot be written.
+// Optionally returns the total number of faces written
+bool GenerateOBJFile( const string& fileName, const SXFileSpec& spec, unsigned int* numFaces )
+{
+	string baseName = fileName.substr( 0, fileName.find_last_of( '.' ) );
+	string libraryName = baseName + ".mtl";
+	FILE* file = fopen( fileName.c_str(), "w" );
+	FILE* library = fopen( libraryName.c_str(), "w" );
+	if (!file || !library)
+	{
+		if (file) fclose( file );
+		if (library) fclose( library );
+		return false;
+	}
+
+	// Materials as in the X-file, the library is named relative to the OBJ file
+	unsigned int numMaterials = spec.materialsPerMesh ? spec.materialsPerMesh : 1;
+	for (unsigned int material = 0; material < numMaterials; ++material)
+	{
+		float shade = 0.5f + 0.5f * material / numMaterials;
+		fprintf( library, "newmtl Material_%u\nKd %f %f %f\nNs %f\n\n", material, shade, shade,
+		         shade, 20.0f );
+	}
+	fclose( library );
+	string libraryFile = libraryName.substr( libraryName.find_last_of( "/\\" ) + 1 );
+	fprintf( file, "mtllib %s\n", libraryFile.c_str() );
+
+	// Indices are 1-based and count from the start of the file
+	unsigned int facesWritten = 0;
+	unsigned int firstVertex = 1, firstNormal = 1;
+	for (unsigned int mesh = 0; mesh < spec.numMeshes; ++mesh)
+	{
+		SGridMesh grid;
+		BuildGridMesh( spec, mesh, &grid );
+		unsigned int numNormals = static_cast<unsigned int>(grid.normals.size() / 3);
+
+		fprintf( file, "o Mesh_%u\n", mesh );
+		for (unsigned int vertex = 0; vertex < grid.numVertices; ++vertex)
+		{
+			fprintf( file, "v %f %f %f\n", grid.positions[vertex * 3],
+			         grid.positions[vertex * 3 + 1], grid.positions[vertex * 3 + 2] );
+		}
+		for (unsigned int vertex = 0; vertex < grid.numVertices; ++vertex)
+		{
+			fprintf( file, "vt %f %f\n", grid.uvs[vertex * 2], 1.0f - grid.uvs[vertex * 2 + 1] );
+		}
+		for (unsigned int normal = 0; normal < numNormals; ++normal)
+		{
+			fprintf( file, "vn %f %f %f\n", grid.normals[normal * 3], grid.normals[normal * 3 + 1],
+			         grid.normals[normal * 3 + 2] );
+		}
+		for (unsigned int face = 0; face < grid.numFaces; ++face)
+		{
+			if (face == 0 || grid.faceMaterials[face] != grid.faceMaterials[face - 1])
+			{
+				fprintf( file, "usemtl Material_%u\n", grid.faceMaterials[face] );
+			}
+			fputc( 'f', file );
+			for (unsigned int corner = 0; corner < 3; ++corner)
+			{
+				unsigned int vertex = firstVertex + grid.faces[face * 3 + corner];
+				fprintf( file, " %u/%u/%u", vertex, vertex,
+				         firstNormal + grid.normalFaces[face * 3 + corner] );
+			}
+			fputc( '\n', file );
+		}
+		firstVertex += grid.numVertices;
+		firstNormal += numNormals;
+		facesWritten += grid.numFaces;
+	}
+	fclose( file );
+
+	if (numFaces)
+	{
+		*numFaces = facesWritten;
+	}
+	return true;
+}
@@ -0,0 +1,62 @@
+/*******************************************
+	XFileGenerator.h
+
+	Generation of synthetic X-files (and the
+	same meshes as OBJ files) with
+	controllable size and content, used to
+	benchmark the importer
+********************************************/
+
+#pragma once // Prevent file being included more than once (would cause errors)
+
+#include <string>
+using namespace std;
+
+
+/////////////////////////
+// Types
+
+// Description of a synthetic X-file. Each mesh is a grid with two faces per grid square
+struct SXFileSpec
+{
+	unsigned int verticesPerMesh;  // Approximate vertices in each mesh (at least 4)
+	unsigned int numMeshes;        // Number of meshes in the file
+	unsigned int materialsPerMesh; // Faces in each mesh are split into bands of this many materials
+	unsigned int frameDepth;       // Meshes are held by the deepest of a chain of frames this long
+	                               // (0 to place meshes at the top level)
+	unsigned int extraFrames;      // Empty frames added at the top level, as in scenes with many
+	                               // nodes. Written before the bone frames, so every bone is
+	                               // matched against all of them
+	unsigned int bonesPerMesh;     // Bones skinning each mesh, 0 for no skinning. Each vertex is
+	                               // weighted to (up to) two bones
+	float        normalDivergence; // Fraction of faces with their own normals rather than sharing
+	                               // those of their vertices - the importer must duplicate vertices
+	bool         binary;           // Write binary rather than text format
+
+	// Constructor sets a small single mesh in text format
+	SXFileSpec()
+	{
+		verticesPerMesh = 10000;
+		numMeshes = 1;
+		materialsPerMesh = 1;
+		frameDepth = 1;
+		extraFrames = 0;
+		bonesPerMesh = 0;
+		normalDivergence = 0.0f;
+		binary = false;
+	}
+};
+
+
+/////////////////////////
+// Functions
+
+// Write a synthetic X-file to the given file name. Returns false if the file cannot be written.
+// Optionally returns the total number of faces written
+bool GenerateXFile( const string& fileName, const SXFileSpec& spec, unsigned int* numFaces = 0 );
+
+// Write the meshes described by a spec as a Wavefront OBJ file with a material library of the
+// same name (.mtl). Frames, skinning and the binary flag do not apply to OBJ files and are
+// ignored. Returns false if the files cannot be written. Optionally returns the total number of
+// faces written
+bool GenerateOBJFile( const string& fileName, const SXFileSpec& spec, unsigned int* numFaces = 0 );
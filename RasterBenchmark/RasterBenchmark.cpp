@@ -0,0 +1,639 @@
+/*******************************************
+	RasterBenchmark.cpp
+
+	Renders the GraphicsThread scene with the
+	software rasteriser, without a graphics
+	device, reporting frames per second and
+	saving the last frame as a bitmap. Also
+	renders 1,000 spheres with and without
+	levels of detail selected by size on-
+	screen, to measure the saving, and
+	spheres hidden behind walls, to measure
+	the hierarchical depth buffer. Uses no
+	Windows or DirectX functions, so runs
+	headless on other platforms (see Makefile)
+********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "CImportXFile.h"
+#include "SoftwareRaster.h"
+#include "Parallel.h"
+#include "Profile.h"
+#include "Fractal.h"
+
+
+/////////////////////////
+// Types / Data
+
+// Sub-meshes of one mesh file, with their vertex and face data
+struct SBenchmarkMesh
+{
+	vector<gen::SSubMesh> subMeshes;
+};
+
+// Size of the frames rendered
+const gen::TUInt32 FrameWidth = 1280;
+const gen::TUInt32 FrameHeight = 960;
+
+// Number of frames rendered if not given on the command line
+const int DefaultNumFrames = 300;
+
+// Scene settings, matching SceneSetup and UpdateScene in GraphicsThread
+const float LightOrbit = 15.0f;
+const float LightOrbitSpeed = 0.01f;
+
+// Sphere scene settings - a grid of spheres on the ground receding from the camera, with levels
+// of detail chosen as CModel::SelectLOD does. Fewer frames by default as the scene is heavier
+const int SphereColumns = 40;
+const int SphereRows = 25;
+const float SphereSpacing = 3.0f; // In sphere radii
+const unsigned int SphereLODs = 4;
+const float MaxPixelError = 1.0f;
+const int DefaultSphereFrames = 20;
+
+// Occluder scene settings - a grid of spheres on the ground behind a row of walls, which hide
+// most of them. The walls are cubes scaled by the given size. Also fewer frames by default
+const int OccluderWalls = 3;
+const float OccluderWallSpacing = 60.0f;
+const gen::CVector3 OccluderWallSize( 4.0f, 6.0f, 0.5f );
+const int OccludedSphereColumns = 20;
+const int OccludedSphereRows = 10;
+const float OccludedSphereDistance = 100.0f;
+const int DefaultOccluderFrames = 20;
+
+
+/////////////////////////
+// Bitmap files
+
+// Read a 32-bit value from 4 bytes, least significant first
+gen::TUInt32 ReadLittleEndian( const gen::TUInt8* bytes )
+{
+	gen::TUInt32 value = 0;
+	for (int byte = 3; byte >= 0; --byte)
+	{
+		value = (value << 8) | bytes[byte];
+	}
+	return value;
+}
+
+// Write a 32-bit value into 4 bytes, least significant first
+void WriteLittleEndian( gen::TUInt8* bytes, gen::TUInt32 value )
+{
+	for (int byte = 0; byte < 4; ++byte)
+	{
+		bytes[byte] = static_cast<gen::TUInt8>(value >> (byte * 8));
+	}
+}
+
+// Load an uncompressed 24 or 32-bit bitmap file into X8R8G8B8 pixels, row by row from the top.
+// Returns false on failure or if the bitmap is compressed or has another format
+bool LoadBitmap( const string& fileName, gen::TUInt32* width, gen::TUInt32* height,
+                 vector<gen::TUInt32>* pixels )
+{
+	FILE* file = fopen( fileName.c_str(), "rb" );
+	if (!file)
+	{
+		return false;
+	}
+
+	// File header (14 bytes) and the start of the info header. Negative height for rows from the
+	// top, otherwise rows are from the bottom
+	gen::TUInt8 header[54];
+	if (fread( header, sizeof(header), 1, file ) != 1 || header[0] != 'B' || header[1] != 'M' ||
+	    header[26] != 1 || (header[28] != 24 && header[28] != 32) || // Planes, bits per pixel
+	    ReadLittleEndian( header + 30 ) != 0)                         // Uncompressed
+	{
+		fclose( file );
+		return false;
+	}
+	int signedHeight = static_cast<int>(ReadLittleEndian( header + 22 ));
+	*width = ReadLittleEndian( header + 18 );
+	*height = (signedHeight < 0) ? -signedHeight : signedHeight;
+	if (*width == 0 || *height == 0 || *width > 0x4000 || *height > 0x4000 ||
+	    fseek( file, ReadLittleEndian( header + 10 ), SEEK_SET ) != 0)
+	{
+		fclose( file );
+		return false;
+	}
+
+	// Rows of blue, green, red (and unused) bytes, padded to a multiple of 4 bytes
+	gen::TUInt32 pixelBytes = header[28] / 8;
+	vector<gen::TUInt8> row( (*width * pixelBytes + 3) & ~3 );
+	pixels->resize( *width * *height );
+	bool success = true;
+	for (gen::TUInt32 y = 0; success && y < *height; ++y)
+	{
+		success = fread( &row[0], row.size(), 1, file ) == 1;
+		gen::TUInt32* pixel = &(*pixels)[(signedHeight < 0 ? y : *height - 1 - y) * *width];
+		for (gen::TUInt32 x = 0; x < *width; ++x)
+		{
+			const gen::TUInt8* bytes = &row[x * pixelBytes];
+			pixel[x] = 0xff000000 | (bytes[2] << 16) | (bytes[1] << 8) | bytes[0];
+		}
+	}
+	fclose( file );
+	return success;
+}
+
+// Save X8R8G8B8 pixels, row by row from the top, as a 32-bit bitmap file. Returns false on failure
+bool SaveBitmap( const string& fileName, const gen::TUInt32* pixels, int width, int height )
+{
+	FILE* file = fopen( fileName.c_str(), "wb" );
+	if (!file)
+	{
+		return false;
+	}
+
+	// File header (14 bytes) and info header (40 bytes), written a byte at a time as they are
+	// little-endian and unaligned. Negative height for rows from the top
+	gen::TUInt32 pixelBytes = width * height * sizeof(gen::TUInt32);
+	gen::TUInt8 header[54];
+	memset( header, 0, sizeof(header) );
+	header[0] = 'B';
+	header[1] = 'M';
+	WriteLittleEndian( header + 2, sizeof(header) + pixelBytes ); // File size
+	WriteLittleEndian( header + 10, sizeof(header) );             // Offset to pixels
+	WriteLittleEndian( header + 14, 40 );                         // Info header size
+	WriteLittleEndian( header + 18, width );
+	WriteLittleEndian( header + 22, -height );
+	header[26] = 1;                                               // Planes
+	header[28] = 32;                                              // Bits per pixel
+	WriteLittleEndian( header + 34, pixelBytes );                 // Image size
+
+	bool success = fwrite( header, sizeof(header), 1, file ) == 1 &&
+	               fwrite( pixels, pixelBytes, 1, file ) == 1;
+	fclose( file );
+	return success;
+}
+
+
+/////////////////////////
+// Scene loading
+
+// The scene's meshes and texture are loaded from this folder - the meshes are OBJ copies of the
+// scene's X-files, as the X-file API is only available with DirectX, and the texture is an
+// uncompressed bitmap copy of wood.jpg, so no image decoder is needed
+
+// Load the sub-meshes of a mesh file, optionally with levels of detail, returns false on failure
+bool LoadMesh( const string& fileName, SBenchmarkMesh* mesh, unsigned int numLODs = 0 )
+{
+	gen::CImportXFile importFile;
+	gen::SImportOptions options;
+	options.iNumLODs = numLODs;
+	if (importFile.ImportFile( fileName, options ) != gen::kSuccess)
+	{
+		printf( "Cannot load %s\n", fileName.c_str() );
+		return false;
+	}
+	mesh->subMeshes.resize( importFile.GetNumSubMeshes() );
+	for (gen::TUInt32 subMesh = 0; subMesh < importFile.GetNumSubMeshes(); ++subMesh)
+	{
+		if (importFile.GetSubMesh( subMesh, &mesh->subMeshes[subMesh] ) != gen::kSuccess)
+		{
+			mesh->subMeshes.resize( subMesh );
+			printf( "Cannot get data from %s\n", fileName.c_str() );
+			return false;
+		}
+	}
+	return true;
+}
+
+// Release the vertex and face data of a mesh
+void ReleaseMesh( SBenchmarkMesh* mesh )
+{
+	for (unsigned int subMesh = 0; subMesh < mesh->subMeshes.size(); ++subMesh)
+	{
+		delete[] mesh->subMeshes[subMesh].vertices;
+		delete[] mesh->subMeshes[subMesh].faces;
+	}
+	mesh->subMeshes.clear();
+}
+
+// Load a bitmap file into a software rendering texture with mip-maps, returns false on failure.
+// The image must have a power of two width and height
+bool LoadTexture( const string& fileName, gen::SRasterTexture* texture )
+{
+	gen::TUInt32 width, height;
+	vector<gen::TUInt32> pixels;
+	if (!LoadBitmap( fileName, &width, &height, &pixels ))
+	{
+		printf( "Cannot load %s\n", fileName.c_str() );
+		return false;
+	}
+	if ((width & (width - 1)) != 0 || (height & (height - 1)) != 0)
+	{
+		printf( "Texture %s is not a power of two size\n", fileName.c_str() );
+		return false;
+	}
+	gen::CreateRasterTexture( &pixels[0], width, height, true, texture );
+	return true;
+}
+
+
+/////////////////////////
+// Camera
+
+// Projection matrix as CCamera builds it, matching D3DXMatrixPerspectiveFovLH
+gen::CMatrix4x4 ProjectionMatrix()
+{
+	const float nearClip = 0.1f, farClip = 10000.0f, aspect = 1.33f;
+	float yScale = 1.0f / tanf( gen::kfPi / 8.0f );
+	float xScale = yScale / aspect;
+	float zScale = farClip / (farClip - nearClip);
+	return gen::CMatrix4x4( xScale, 0.0f,   0.0f,               0.0f,
+	                        0.0f,   yScale, 0.0f,               0.0f,
+	                        0.0f,   0.0f,   zScale,             1.0f,
+	                        0.0f,   0.0f,   -nearClip * zScale, 0.0f );
+}
+
+// Select the level of detail of a sub-mesh at the given distance from the camera, as
+// CModel::SelectLOD does - the coarsest level whose error covers at most MaxPixelError pixels
+gen::TUInt32 SelectLOD( const gen::SSubMesh& subMesh, const gen::CMatrix4x4& projMatrix,
+                        float distance )
+{
+	gen::TUInt32 lod = 0;
+	if (distance <= 0.0f)
+	{
+		return lod;
+	}
+	float pixelsPerUnit = projMatrix.e11 * FrameHeight * 0.5f / distance;
+	while (lod + 1 < subMesh.numLODs &&
+	       subMesh.lods[lod + 1].error * pixelsPerUnit <= MaxPixelError)
+	{
+		++lod;
+	}
+	return lod;
+}
+
+
+/////////////////////////
+// Sphere scene
+
+// Render a grid of 1,000 spheres for the given number of frames, first always at full detail, then
+// with levels of detail selected by size on-screen. Reports the time, vertices and triangles
+// processed each way and saves the last frame with levels of detail. Returns 0 on success
+int RenderSpheres( int numFrames, const string& bitmapName )
+{
+	SBenchmarkMesh sphereMesh;
+	if (!LoadMesh( "Sphere.obj", &sphereMesh, SphereLODs ))
+	{
+		ReleaseMesh( &sphereMesh );
+		return 1;
+	}
+
+	// Place the spheres on the ground in rows receding from a camera looking down over them
+	float radius = 0.0f;
+	for (unsigned int subMesh = 0; subMesh < sphereMesh.subMeshes.size(); ++subMesh)
+	{
+		radius = max( radius, sphereMesh.subMeshes[subMesh].bounds.radius );
+	}
+	float spacing = SphereSpacing * radius;
+	vector<gen::CMatrix4x4> sphereMatrices;
+	for (int row = 0; row < SphereRows; ++row)
+	{
+		for (int column = 0; column < SphereColumns; ++column)
+		{
+			gen::CVector3 position( (column - (SphereColumns - 1) * 0.5f) * spacing, radius,
+			                        row * spacing );
+			sphereMatrices.push_back( gen::MatrixTranslation( position ) );
+		}
+	}
+	gen::CVector3 cameraPosition( 0.0f, 10.0f * spacing, -12.0f * spacing );
+	gen::CMatrix4x4 viewMatrix = gen::MatrixTranslation( -cameraPosition ) *
+	                             gen::MatrixRotationX( -gen::ToRadians( 25.0f ) );
+	gen::CMatrix4x4 projMatrix = ProjectionMatrix();
+	gen::CMatrix4x4 viewProjMatrix = viewMatrix * projMatrix;
+
+	gen::SRasterLighting lighting;
+	lighting.ambientColour = gen::SColourRGBA( 0.3f, 0.3f, 0.3f );
+	lighting.iNumLights = 1;
+	lighting.aLightPositions[0] = cameraPosition + gen::CVector3( 0.0f, 20.0f * spacing, 0.0f );
+	lighting.aLightColours[0] = gen::SColourRGBA( 1.0f, 1.0f, 1.0f );
+	lighting.afLightBrightness[0] = 30.0f * spacing;
+	lighting.fSpecularPower = 64.0f;
+	gen::SColourRGBA clearColour( 128.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f );
+	gen::SRasterMaterial sphereMaterial;
+	sphereMaterial.renderMethod = gen::PixelLit;
+	sphereMaterial.colour = gen::SColourRGBA( 0.8f, 0.6f, 0.3f );
+	sphereMaterial.pTexture = 0;
+
+	// Select the levels of detail, the scene is static so once is enough
+	vector<gen::TUInt32> sphereLODs( sphereMatrices.size() );
+	unsigned int lodCounts[gen::kiMaxLODs] = { 0 };
+	for (unsigned int sphere = 0; sphere < sphereMatrices.size(); ++sphere)
+	{
+		float distance = gen::Length( sphereMatrices[sphere].Position() - cameraPosition );
+		sphereLODs[sphere] = SelectLOD( sphereMesh.subMeshes[0], projMatrix, distance );
+		++lodCounts[sphereLODs[sphere]];
+	}
+
+	printf( "Rendering %u spheres for %d frames at %ux%u on %u processors\n",
+	        static_cast<unsigned int>(sphereMatrices.size()), numFrames, FrameWidth, FrameHeight,
+	        gen::NumProcessors() );
+	printf( "Spheres at each level of detail:" );
+	for (gen::TUInt32 lod = 0; lod < sphereMesh.subMeshes[0].numLODs; ++lod)
+	{
+		printf( " %u (%u faces, %u vertices)", lodCounts[lod],
+		        sphereMesh.subMeshes[0].lods[lod].numFaces,
+		        sphereMesh.subMeshes[0].lods[lod].numVertices );
+	}
+	printf( "\n%-12s %10s %12s %12s\n", "", "ms/frame", "Vertices", "Triangles" );
+
+	gen::CSoftwareRaster raster;
+	raster.SetSize( FrameWidth, FrameHeight );
+	double fullSeconds = 0.0;
+	gen::TUInt32 fullVertices = 0;
+	for (int useLODs = 0; useLODs < 2; ++useLODs)
+	{
+		gen::TUInt64 startTime = gen::GetTimeStamp();
+		for (int frame = 0; frame < numFrames; ++frame)
+		{
+			raster.BeginFrame( viewProjMatrix, cameraPosition, lighting, clearColour );
+			for (unsigned int sphere = 0; sphere < sphereMatrices.size(); ++sphere)
+			{
+				for (unsigned int subMesh = 0; subMesh < sphereMesh.subMeshes.size(); ++subMesh)
+				{
+					raster.DrawSubMesh( sphereMesh.subMeshes[subMesh], sphereMatrices[sphere],
+					                    sphereMaterial, useLODs ? sphereLODs[sphere] : 0 );
+				}
+			}
+			raster.EndFrame();
+		}
+		double seconds = static_cast<double>(gen::GetTimeStamp() - startTime) /
+		                 gen::GetTimeStampFrequency();
+
+		const gen::SRasterStats& stats = raster.GetStats();
+		printf( "%-12s %10.2f %12u %12u", useLODs ? "Selected LOD" : "Full detail",
+		        seconds * 1000.0 / numFrames, stats.iNumVertices, stats.iNumTriangles );
+		if (useLODs)
+		{
+			printf( "   (%.1fx faster, %.1f%% of the vertices)", fullSeconds / seconds,
+			        100.0 * stats.iNumVertices / fullVertices );
+		}
+		printf( "\n" );
+		fullSeconds = seconds;
+		fullVertices = stats.iNumVertices;
+	}
+	if (!SaveBitmap( bitmapName, raster.GetPixels(), FrameWidth, FrameHeight ))
+	{
+		printf( "Cannot write %s\n", bitmapName.c_str() );
+	}
+
+	ReleaseMesh( &sphereMesh );
+	return 0;
+}
+
+
+/////////////////////////
+// Occluder scene
+
+// Render a grid of spheres behind a row of walls for the given number of frames, first drawing
+// the walls before the spheres, then after them. With the walls first the hierarchical depth
+// buffer rejects the blocks of the spheres hidden behind them. Reports the time, blocks rejected
+// and pixels shaded each way and saves the last frame. Returns 0 on success
+int RenderOccluders( int numFrames, const string& bitmapName )
+{
+	SBenchmarkMesh wallMesh, sphereMesh;
+	if (!LoadMesh( "Cube.obj", &wallMesh ) || !LoadMesh( "Sphere.obj", &sphereMesh ))
+	{
+		ReleaseMesh( &wallMesh );
+		ReleaseMesh( &sphereMesh );
+		return 1;
+	}
+
+	// Walls are scaled cubes standing on the ground with gaps between them, in front of the
+	// spheres. The spheres are drawn nearest first, as a renderer sorting by depth would
+	vector<gen::CMatrix4x4> wallMatrices;
+	for (int wall = 0; wall < OccluderWalls; ++wall)
+	{
+		gen::CVector3 position( (wall - (OccluderWalls - 1) * 0.5f) * OccluderWallSpacing,
+		                        OccluderWallSize.y * 5.0f, 0.0f );
+		wallMatrices.push_back( gen::MatrixScaling( OccluderWallSize ) *
+		                        gen::MatrixTranslation( position ) );
+	}
+	float radius = 0.0f;
+	for (unsigned int subMesh = 0; subMesh < sphereMesh.subMeshes.size(); ++subMesh)
+	{
+		radius = max( radius, sphereMesh.subMeshes[subMesh].bounds.radius );
+	}
+	float spacing = SphereSpacing * radius;
+	vector<gen::CMatrix4x4> sphereMatrices;
+	for (int row = 0; row < OccludedSphereRows; ++row)
+	{
+		for (int column = 0; column < OccludedSphereColumns; ++column)
+		{
+			gen::CVector3 position( (column - (OccludedSphereColumns - 1) * 0.5f) * spacing,
+			                        radius, OccludedSphereDistance + row * spacing );
+			sphereMatrices.push_back( gen::MatrixTranslation( position ) );
+		}
+	}
+	gen::CVector3 cameraPosition( 0.0f, 50.0f, -100.0f );
+	gen::CMatrix4x4 viewMatrix = gen::MatrixTranslation( -cameraPosition ) *
+	                             gen::MatrixRotationX( -gen::ToRadians( 15.0f ) );
+	gen::CMatrix4x4 viewProjMatrix = viewMatrix * ProjectionMatrix();
+
+	gen::SRasterLighting lighting;
+	lighting.ambientColour = gen::SColourRGBA( 0.3f, 0.3f, 0.3f );
+	lighting.iNumLights = 1;
+	lighting.aLightPositions[0] = gen::CVector3( 0.0f, 200.0f, -100.0f );
+	lighting.aLightColours[0] = gen::SColourRGBA( 1.0f, 1.0f, 1.0f );
+	lighting.afLightBrightness[0] = 300.0f;
+	lighting.fSpecularPower = 64.0f;
+	gen::SColourRGBA clearColour( 128.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f );
+	gen::SRasterMaterial wallMaterial, sphereMaterial;
+	wallMaterial.renderMethod = gen::PixelLit;
+	wallMaterial.colour = gen::SColourRGBA( 0.5f, 0.6f, 0.7f );
+	wallMaterial.pTexture = 0;
+	sphereMaterial = wallMaterial;
+	sphereMaterial.colour = gen::SColourRGBA( 0.8f, 0.6f, 0.3f );
+
+	printf( "Rendering %u spheres behind %d walls for %d frames at %ux%u on %u processors\n",
+	        static_cast<unsigned int>(sphereMatrices.size()), OccluderWalls, numFrames,
+	        FrameWidth, FrameHeight, gen::NumProcessors() );
+	printf( "%-15s %10s %12s %16s %14s\n", "", "ms/frame", "Triangles", "Blocks rejected",
+	        "Pixels shaded" );
+
+	gen::CSoftwareRaster raster;
+	raster.SetSize( FrameWidth, FrameHeight );
+	for (int wallsFirst = 1; wallsFirst >= 0; --wallsFirst)
+	{
+		gen::TUInt64 startTime = gen::GetTimeStamp();
+		for (int frame = 0; frame < numFrames; ++frame)
+		{
+			raster.BeginFrame( viewProjMatrix, cameraPosition, lighting, clearColour );
+			for (int pass = 0; pass < 2; ++pass)
+			{
+				bool walls = (pass == 0) == (wallsFirst != 0);
+				const SBenchmarkMesh& mesh = walls ? wallMesh : sphereMesh;
+				const vector<gen::CMatrix4x4>& matrices = walls ? wallMatrices : sphereMatrices;
+				for (unsigned int model = 0; model < matrices.size(); ++model)
+				{
+					for (unsigned int subMesh = 0; subMesh < mesh.subMeshes.size(); ++subMesh)
+					{
+						raster.DrawSubMesh( mesh.subMeshes[subMesh], matrices[model],
+						                    walls ? wallMaterial : sphereMaterial );
+					}
+				}
+			}
+			raster.EndFrame();
+		}
+		double seconds = static_cast<double>(gen::GetTimeStamp() - startTime) /
+		                 gen::GetTimeStampFrequency();
+
+		const gen::SRasterStats& stats = raster.GetStats();
+		printf( "%-15s %10.2f %12u %16u %14u\n", wallsFirst ? "Walls first" : "Walls last",
+		        seconds * 1000.0 / numFrames, stats.iNumTriangles, stats.iNumBlocksRejected,
+		        stats.iNumPixelsShaded );
+	}
+	if (!SaveBitmap( bitmapName, raster.GetPixels(), FrameWidth, FrameHeight ))
+	{
+		printf( "Cannot write %s\n", bitmapName.c_str() );
+	}
+
+	ReleaseMesh( &wallMesh );
+	ReleaseMesh( &sphereMesh );
+	return 0;
+}
+
+
+/////////////////////////
+// Main
+
+// Usage: RasterBenchmark [spheres | occluders] [frames] [bitmap file]. Renders the scene for the
+// given number of frames with the orbiting light moving each frame, as the GraphicsThread
+// application does, then saves the last frame. With "spheres" or "occluders", renders the sphere
+// or occluder scene instead (see RenderSpheres, RenderOccluders)
+int main( int argc, char* argv[] )
+{
+	bool spheres = (argc > 1 && strcmp( argv[1], "spheres" ) == 0);
+	bool occluders = (argc > 1 && strcmp( argv[1], "occluders" ) == 0);
+	if (spheres || occluders)
+	{
+		--argc;
+		++argv;
+	}
+	int numFrames = (argc > 1) ? atoi( argv[1] ) :
+	                spheres ? DefaultSphereFrames : occluders ? DefaultOccluderFrames :
+	                DefaultNumFrames;
+	string bitmapName = (argc > 2) ? argv[2] : "RasterBenchmark.bmp";
+	if (numFrames < 1)
+	{
+		printf( "Usage: RasterBenchmark [spheres | occluders] [frames] [bitmap file]\n" );
+		return 1;
+	}
+	if (spheres)
+	{
+		return RenderSpheres( numFrames, bitmapName );
+	}
+	if (occluders)
+	{
+		return RenderOccluders( numFrames, bitmapName );
+	}
+
+	// Scene data - meshes, the wood texture and the fractal texture as it is first shown
+	SBenchmarkMesh floorMesh, cubeMesh, sphereMesh;
+	gen::SRasterTexture floorTexture, cubeTexture;
+	if (!LoadMesh( "Floor.obj", &floorMesh ) || !LoadMesh( "Cube.obj", &cubeMesh ) ||
+	    !LoadMesh( "Sphere.obj", &sphereMesh ) || !LoadTexture( "wood.bmp", &floorTexture ))
+	{
+		ReleaseMesh( &floorMesh );
+		ReleaseMesh( &cubeMesh );
+		ReleaseMesh( &sphereMesh );
+		return 1;
+	}
+	DrawMandelbrot();
+	gen::CreateRasterTexture( FractalPixels, FractalTexWidth, FractalTexHeight, false,
+	                          &cubeTexture );
+
+	// Camera, as CCamera builds its matrices - the view matrix is the inverse of the camera's
+	// world matrix
+	gen::CVector3 cameraPosition( -16.0f, 25.0f, -50.0f );
+	gen::CMatrix4x4 viewMatrix = gen::MatrixTranslation( -cameraPosition ) *
+	                             gen::MatrixRotationX( -gen::ToRadians( 13.0f ) );
+	gen::CMatrix4x4 viewProjMatrix = viewMatrix * ProjectionMatrix();
+
+	// Lights, materials as in SceneSetup
+	gen::SRasterLighting lighting;
+	lighting.ambientColour = gen::SColourRGBA( 0.5f, 0.5f, 0.5f );
+	lighting.iNumLights = 2;
+	lighting.aLightColours[0] = gen::SColourRGBA( 1.0f, 1.0f, 1.0f );
+	lighting.afLightBrightness[0] = 10.0f;
+	lighting.aLightPositions[1] = gen::CVector3( -60.0f, 30.0f, 60.0f );
+	lighting.aLightColours[1] = gen::SColourRGBA( 1.0f, 0.9f, 0.2f );
+	lighting.afLightBrightness[1] = 100.0f;
+	lighting.fSpecularPower = 256.0f;
+	gen::SColourRGBA clearColour( 128.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f );
+
+	gen::SRasterMaterial floorMaterial, cubeMaterial, lightMaterial;
+	floorMaterial.renderMethod = gen::PixelLitTex;
+	floorMaterial.colour = gen::SColourRGBA( 1.0f, 1.0f, 1.0f );
+	floorMaterial.pTexture = &floorTexture;
+	cubeMaterial = floorMaterial;
+	cubeMaterial.pTexture = &cubeTexture;
+	lightMaterial.renderMethod = gen::PlainColour;
+	lightMaterial.pTexture = 0;
+
+	gen::CMatrix4x4 floorMatrix = gen::MatrixIdentity();
+	gen::CMatrix4x4 cubeMatrix = gen::MatrixTranslation( gen::CVector3( 0.0f, 15.0f, 0.0f ) );
+
+	// Render the frames
+	gen::CSoftwareRaster raster;
+	raster.SetSize( FrameWidth, FrameHeight );
+	printf( "Rendering %d frames at %ux%u on %u processors\n", numFrames, FrameWidth, FrameHeight,
+	        gen::NumProcessors() );
+	float rotate = 0.0f;
+	gen::TUInt64 startTime = gen::GetTimeStamp();
+	for (int frame = 0; frame < numFrames; ++frame)
+	{
+		lighting.aLightPositions[0] =
+			gen::CVector3( cosf( rotate ) * LightOrbit, 15.0f, sinf( rotate ) * LightOrbit );
+		rotate -= LightOrbitSpeed;
+
+		raster.BeginFrame( viewProjMatrix, cameraPosition, lighting, clearColour );
+		for (unsigned int subMesh = 0; subMesh < floorMesh.subMeshes.size(); ++subMesh)
+		{
+			raster.DrawSubMesh( floorMesh.subMeshes[subMesh], floorMatrix, floorMaterial );
+		}
+		for (unsigned int subMesh = 0; subMesh < cubeMesh.subMeshes.size(); ++subMesh)
+		{
+			raster.DrawSubMesh( cubeMesh.subMeshes[subMesh], cubeMatrix, cubeMaterial );
+		}
+		for (gen::TUInt32 light = 0; light < lighting.iNumLights; ++light)
+		{
+			gen::CMatrix4x4 lightMatrix = gen::MatrixScaling( 0.3f ) *
+			                              gen::MatrixTranslation( lighting.aLightPositions[light] );
+			lightMaterial.colour = lighting.aLightColours[light];
+			for (unsigned int subMesh = 0; subMesh < sphereMesh.subMeshes.size(); ++subMesh)
+			{
+				raster.DrawSubMesh( sphereMesh.subMeshes[subMesh], lightMatrix, lightMaterial );
+			}
+		}
+		raster.EndFrame();
+	}
+	double seconds = static_cast<double>(gen::GetTimeStamp() - startTime) /
+	                 gen::GetTimeStampFrequency();
+
+	// Report, with statistics of the last frame
+	const gen::SRasterStats& stats = raster.GetStats();
+	printf( "%10.2f ms/frame %10.1f frames/s\n", seconds * 1000.0 / numFrames,
+	        numFrames / seconds );
+	printf( "Triangles %u, binned %u, bin entries %u, blocks rejected %u, pixels shaded %u\n",
+	        stats.iNumTriangles, stats.iNumBinned, stats.iNumBinEntries,
+	        stats.iNumBlocksRejected, stats.iNumPixelsShaded );
+	if (!SaveBitmap( bitmapName, raster.GetPixels(), FrameWidth, FrameHeight ))
+	{
+		printf( "Cannot write %s\n", bitmapName.c_str() );
+	}
+
+	ReleaseMesh( &floorMesh );
+	ReleaseMesh( &cubeMesh );
+	ReleaseMesh( &sphereMesh );
+	return 0;
+}